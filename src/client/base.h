@@ -24,6 +24,8 @@
 
 #include "pch.h"
 #include "log/log.h"
+#include "shadow_map.h"
+#include "slab_allocator.h"
 
 #include <unknwn.h>
 #include <sstream>
@@ -31,10 +33,6 @@
 #include <atomic>
 #include <functional>
 
-using ShadowMap = std::unordered_map<uintptr_t, IUnknown*>;
-extern ShadowMap gShadowMap;
-
-extern std::mutex gShadowMapMutex;
 
 enum class D3D9ObjectType: char {
   Module,
@@ -374,9 +372,7 @@ protected:
   }
 
   ~D3DBase() override {
-    gShadowMapMutex.lock();
     gShadowMap.erase(m_id);
-    gShadowMapMutex.unlock();
 #ifdef _DEBUG
     Logger::debug(format_string("%s object [%p/%p] destroyed",
                                 toD3D9ObjectTypeName<T>(), this, m_id));
@@ -384,6 +380,14 @@ protected:
   }
 
 public:
+  // Wrapper objects are allocated from the client slabs rather than the game's heap
+  static void* operator new(size_t size) {
+    return SlabAllocator::allocate(size);
+  }
+
+  static void operator delete(void* ptr, size_t size) {
+    SlabAllocator::deallocate(ptr, size);
+  }
 
   D3D9ObjectType getType() {
     return m_type;
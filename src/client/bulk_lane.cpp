@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2022-2023, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#include "pch.h"
+#include "bulk_lane.h"
+
+#include "config/global_options.h"
+#include "util_bulkcommand.h"
+#include "util_devicecommand.h"
+
+bool BulkLane::isEnabled() {
+  return GlobalOptions::getUseBulkLane();
+}
+
+bool BulkLane::canUpload(const size_t size) {
+  // Blobs are never split across the end of the data queue, so leave room for that
+  return size <= BulkBridge::getWriterChannel().m_dataMemSize / 2;
+}
+
+void BulkLane::beginUpload() {
+  // Device commands sent before the upload may still read the previous contents.
+  // The UID only advances under the device writer lock, so read it under that too.
+  uint32_t token = 0;
+  {
+    std::scoped_lock deviceLock(DeviceBridge::getWriterChannel().m_mutex);
+    token = (uint32_t) ClientMessage::get_uid();
+  }
+  std::scoped_lock lock(s_mutex);
+  if (token > s_deviceTokenSent) {
+    BulkClientCommand { Commands::Bridge_LaneDependency, token };
+    s_deviceTokenSent = token;
+  }
+}
+
+void BulkLane::endUpload(const size_t resourceId, const uint32_t token) {
+  std::scoped_lock lock(s_mutex);
+  uint32_t& pendingToken = s_pending[resourceId];
+  pendingToken = std::max(pendingToken, token);
+  s_numPending.store(s_pending.size(), std::memory_order_relaxed);
+}
+
+void BulkLane::forget(const size_t resourceId) {
+  std::scoped_lock lock(s_mutex);
+  s_pending.erase(resourceId);
+  s_numPending.store(s_pending.size(), std::memory_order_relaxed);
+}
+
+uint32_t BulkLane::getPendingToken(const size_t resourceId) {
+  if (resourceId == 0) {
+    return 0;
+  }
+  std::scoped_lock lock(s_mutex);
+  const auto it = s_pending.find(resourceId);
+  return (it != s_pending.end()) ? it->second : 0;
+}
+
+void BulkLane::dependOnToken(const uint32_t token) {
+  std::scoped_lock lock(s_mutex);
+  if (token <= s_bulkTokenSent) {
+    return;
+  }
+  ClientMessage { Commands::Bridge_LaneDependency, token };
+  s_bulkTokenSent = token;
+  // Every upload up to the token is waited for now, no matter what resource it went to
+  for (auto it = s_pending.begin(); it != s_pending.end();) {
+    if (it->second <= token) {
+      it = s_pending.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  s_numPending.store(s_pending.size(), std::memory_order_relaxed);
+}
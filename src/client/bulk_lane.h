@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) 2022-2023, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <stdint.h>
+#include <unordered_map>
+
+// Client side bookkeeping for the bulk lane, a second channel to the server that
+// texture uploads are sent through so that they do not hold up the device commands
+// queued behind them. The server processes both lanes concurrently, so the order
+// between them is only restored where it matters: an upload waits for the device
+// commands sent before it, and a device command that accesses a texture waits for
+// the uploads to it that are still in flight. Uploads are identified by a token,
+// the UID of their bulk lane command plus one. See useBulkLane.
+class BulkLane {
+public:
+  static bool isEnabled();
+
+  // Whether an upload of the given size fits into the data queue of the bulk lane,
+  // larger uploads must stay on the device lane where they can use the shared heap
+  static bool canUpload(const size_t size);
+
+  // Must be called before an upload is sent through the bulk lane
+  static void beginUpload();
+  // Must be called once the upload was sent, with the token of its command
+  static void endUpload(const size_t resourceId, const uint32_t token);
+
+  static bool hasPendingUploads() {
+    return s_numPending.load(std::memory_order_relaxed) != 0;
+  }
+
+  // Token of the last upload to the resource that device commands have not waited for yet, 0 if none
+  static uint32_t getPendingToken(const size_t resourceId);
+
+  // Makes the next device command wait for the bulk lane up to the token,
+  // must be called before that command is constructed
+  static void dependOnToken(const uint32_t token);
+
+  static void dependOn(const size_t resourceId) {
+    if (hasPendingUploads()) {
+      dependOnToken(getPendingToken(resourceId));
+    }
+  }
+
+  // Must be called when a texture is destroyed. Device commands no longer need to
+  // wait for its uploads, the server skips those that are still in flight.
+  static void onDestroy(const size_t resourceId) {
+    if (hasPendingUploads()) {
+      forget(resourceId);
+    }
+  }
+
+private:
+  BulkLane() = delete;
+
+  static void forget(const size_t resourceId);
+
+  static inline std::mutex s_mutex;
+  // Last upload token per texture, for uploads still to be waited for
+  static inline std::unordered_map<size_t, uint32_t> s_pending;
+  static inline std::atomic<size_t> s_numPending = 0;
+  // Highest token each lane was last told to wait for
+  static inline uint32_t s_deviceTokenSent = 0;
+  static inline uint32_t s_bulkTokenSent = 0;
+};
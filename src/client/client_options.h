@@ -62,6 +62,81 @@ namespace ClientOptions {
     return bridge_util::Config::getOption<bool>("client.enableDpiAwareness", true);
   }
 
+  // Adapts the frames the client may run ahead of the server within the bounds
+  // below, instead of always blocking on the server's Present
+  inline bool getAdaptivePresentLatency() {
+    return bridge_util::Config::getOption<bool>("client.adaptivePresentLatency", false);
+  }
+
+  inline uint8_t getPresentLatencyMinFrames() {
+    return bridge_util::Config::getOption<uint8_t>("client.presentLatencyMinFrames", 0);
+  }
+
+  inline uint8_t getPresentLatencyMaxFrames() {
+    return bridge_util::Config::getOption<uint8_t>("client.presentLatencyMaxFrames", 3);
+  }
+
+  // Return GetRenderTargetData()/GetFrontBufferData() results through the shared
+  // heap without blocking, requires useSharedHeap
+  // Read once on first use, since these are queried on every surface lock
+  inline bool getAsyncReadback() {
+    static const bool asyncReadback = bridge_util::Config::getOption<bool>("client.asyncReadback", false);
+    return asyncReadback;
+  }
+
+  // Serve the previous readback instead of waiting when the latest one is not done yet
+  inline bool getAsyncReadbackAllowPreviousFrame() {
+    static const bool allowPreviousFrame = bridge_util::Config::getOption<bool>("client.asyncReadbackAllowPreviousFrame", false);
+    return allowPreviousFrame;
+  }
+
+  // Promote write-only dynamic buffers that are appended to with D3DLOCK_NOOVERWRITE
+  // to persistent shared heap mirrors, requires useSharedHeap
+  inline bool getStreamingBufferMirrors() {
+    static const bool streamingBufferMirrors = bridge_util::Config::getOption<bool>("client.streamingBufferMirrors", false);
+    return streamingBufferMirrors;
+  }
+
+  // Have the server keep UP draw payloads that are redrawn unchanged every frame
+  // in resident buffers, and only send their hash from then on
+  inline bool getCacheRepeatedUPDraws() {
+    static const bool cacheRepeatedUPDraws = bridge_util::Config::getOption<bool>("client.cacheRepeatedUPDraws", false);
+    return cacheRepeatedUPDraws;
+  }
+
+  // Size in MB of the virtual region reserved for large buffer and surface shadows,
+  // 0 leaves them on the heap
+  inline uint32_t getShadowArenaSize() {
+    static const uint32_t shadowArenaSize = bridge_util::Config::getOption<uint32_t>("client.shadowArenaSize", 0);
+    return shadowArenaSize;
+  }
+
+  // Have the server share one object between all shaders and vertex declarations
+  // created with identical contents
+  inline bool getInternShaders() {
+    static const bool internShaders = bridge_util::Config::getOption<bool>("client.internShaders", false);
+    return internShaders;
+  }
+
+  // Launch the server as soon as the client DLL is loaded instead of when the
+  // application creates its first D3D9 object
+  inline bool getLaunchServerEarly() {
+    static const bool launchServerEarly = bridge_util::Config::getOption<bool>("client.launchServerEarly", false);
+    return launchServerEarly;
+  }
+
+  // Allocate buffer and surface shadows with a write watch and only send the pages
+  // the application wrote to on unlock
+  inline bool getTrackShadowWrites() {
+    static const bool trackShadowWrites = bridge_util::Config::getOption<bool>("client.trackShadowWrites", false);
+    return trackShadowWrites;
+  }
+
+  // Path of the command trace file, tracing is disabled when empty
+  inline std::string getCommandTraceFile() {
+    return bridge_util::Config::getOption<std::string>("client.commandTraceFile", "");
+  }
+
   // If set, the space for data for dynamic buffer updates will be preallocated on data channel
   // and redundant copy will be avioded. However, because D3D applications are not obliged
   // to write the entire locked region this optimization is NOT considered safe and may
@@ -24,6 +24,7 @@
 #include "util_common.h"
 #include "util_scopedlock.h"
 
+#include "bulk_lane.h"
 #include "d3d9_resource.h"
 #include "d3d9_surface.h"
 #include "util_devicecommand.h"
@@ -157,6 +158,7 @@ public:
     LogFunctionCall();
 
     if (m_desc.Usage & D3DUSAGE_AUTOGENMIPMAP) {
+      BulkLane::dependOn(getId());
       ClientMessage c(Commands::IDirect3DBaseTexture9_GenerateMipSubLevels, getId());
     }
   }
@@ -51,6 +51,7 @@ API_HOOK_DECL(D3DPERF_GetStatus);
 #endif
 
 extern bool RemixAttach(HMODULE);
+extern void LaunchServerEarly();
 extern void RemixDetach();
 extern std::chrono::steady_clock::time_point gTimeStart;
 
@@ -147,6 +148,7 @@ BOOL WINAPI DllMain(HINSTANCE hinst, DWORD dwReason, LPVOID reserved) {
     } else if (RemixAttach(hinst)) {
       gTimeStart = std::chrono::high_resolution_clock::now();
       gRemixAttached = true;
+      LaunchServerEarly();
       return TRUE;
     }
     return FALSE;
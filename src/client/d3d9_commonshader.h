@@ -22,6 +22,7 @@
 #pragma once
 
 #include "util_common.h"
+#include "util_hash.h"
 #include "base.h"
 
 #include <d3d9.h>
@@ -142,6 +143,7 @@ class CommonShader {
   }
 
   std::vector<uint8_t> m_code;
+  uint64_t m_hash = 0;
 
   uint32_t m_majorVersion = -1;
   uint32_t m_minorVersion = -1;
@@ -152,6 +154,7 @@ public:
 
     m_code.resize(size);
     memcpy(m_code.data(), pFunction, m_code.size());
+    m_hash = bridge_util::hash64(m_code.data(), m_code.size());
   }
 
   const DWORD* getCode() const {
@@ -162,6 +165,11 @@ public:
     return m_code.size();
   }
 
+  // Hash of the token stream
+  const uint64_t getHash() const {
+    return m_hash;
+  }
+
   const uint32_t getMajorVersion() const {
     return m_majorVersion;
   }
@@ -65,6 +65,7 @@ ULONG Direct3DCubeTexture9_LSS::Release() {
 }
 
 void Direct3DCubeTexture9_LSS::onDestroy() {
+   BulkLane::onDestroy(getId());
    ClientMessage { Commands::IDirect3DCubeTexture9_Destroy, getId() };
 }
 
@@ -35,12 +35,21 @@
 #include "d3d9_vertexdeclaration.h"
 #include "d3d9_vertexshader.h"
 #include "d3d9_volumetexture.h"
+#include "bulk_lane.h"
+#include "present_latency_controller.h"
+#include "shadow_arena.h"
 #include "shadow_map.h"
+#include "slab_allocator.h"
+#include "object_interner.h"
+#include "up_geometry_cache.h"
 #include "client_options.h"
 
 #include "config/global_options.h"
 
 #include "util_bridge_assert.h"
+#include "util_deferrederrors.h"
+#include "util_geometryring.h"
+#include "util_hash.h"
 #include "util_semaphore.h"
 
 #include <wingdi.h>
@@ -414,6 +423,10 @@ HRESULT Direct3DDevice9Ex_LSS<EnableSync>::Reset(D3DPRESENT_PARAMETERS* pPresent
     BRIDGE_DEVICE_LOCKGUARD();
     // Clear all device state and release implicit/internal objects
     releaseInternalObjects();
+    // The server has to let go of its resident UP geometry before resetting
+    if (UpGeometryCache::isEnabled()) {
+      UpGeometryCache::releaseAll();
+    }
     // Reset all device state to default values and init implicit/internal objects
     ResetState();
     const auto presParam = Direct3DSwapChain9_LSS::sanitizePresentationParameters(*pPresentationParameters, getCreateParams());
@@ -443,18 +456,96 @@ HRESULT Direct3DDevice9Ex_LSS<EnableSync>::Reset(D3DPRESENT_PARAMETERS* pPresent
   return res;
 }
 
+// Interned objects are shared per device and per kind of object, so mix both into the content hash
+template<bool EnableSync>
+uint64_t Direct3DDevice9Ex_LSS<EnableSync>::getInternHash(const Commands::D3D9Command command, const uint64_t contentHash) const {
+  const uint64_t scope = ((uint64_t) getId() << 32) | command;
+  return bridge_util::hash64(&scope, sizeof(scope), contentHash);
+}
+
+template<bool EnableSync>
+uint64_t Direct3DDevice9Ex_LSS<EnableSync>::getInternHash(const Commands::D3D9Command command, const void* pData, const size_t size) const {
+  return getInternHash(command, bridge_util::hash64(pData, size));
+}
+
+// Command flags telling the server where the geometry of an UP draw is
+static Commands::Flags getUPDrawFlags(const bool bUseRing, const UpGeometryCache::Action cacheAction) {
+  Commands::Flags flags = 0;
+  if (bUseRing) {
+    flags |= Commands::FlagBits::DataInGeometryRing;
+  }
+  if (cacheAction == UpGeometryCache::Action::Promote) {
+    flags |= Commands::FlagBits::GeometryPromote;
+  } else if (cacheAction == UpGeometryCache::Action::Cached) {
+    flags |= Commands::FlagBits::GeometryCached;
+  }
+  return flags;
+}
+
+// Waits for the response the server always sends to the create of newly interned
+// contents, regardless of the response options
+static HRESULT waitForInternResponse(const char* const func, const UID uid) {
+  if (Result::Success != DeviceBridge::waitForCommand(Commands::Bridge_Response, GlobalOptions::getAckTimeout(), nullptr, true, uid)) {
+    Logger::err(format_string("%s failed with: no response from server.", func));
+    return D3DERR_INVALIDCALL;
+  }
+  const HRESULT hresult = (HRESULT) DeviceBridge::get_data();
+  DeviceBridge::pop_front();
+  return hresult;
+}
+
+HRESULT checkDeferredErrors() {
+  if (!GlobalOptions::getAsyncCreateFunctions()) {
+    return S_OK;
+  }
+  HRESULT surfaced = S_OK;
+  DeferredErrors::drain([&surfaced](const DeferredErrors::Entry& entry) {
+    Logger::err(format_string("Deferred failure of %s (UID %u) reported by the server: 0x%08x",
+                              Commands::toString(entry.command).c_str(), entry.uid, entry.hresult));
+    if (entry.hresult == D3DERR_DEVICELOST || entry.hresult == D3DERR_DEVICEREMOVED) {
+      surfaced = D3DERR_DEVICELOST;
+    } else if ((entry.hresult == D3DERR_OUTOFVIDEOMEMORY || entry.hresult == E_OUTOFMEMORY) && surfaced == S_OK) {
+      surfaced = D3DERR_OUTOFVIDEOMEMORY;
+    }
+  });
+  static uint32_t numDroppedReported = 0;
+  const uint32_t numDropped = DeferredErrors::getNumDropped();
+  if (numDropped != numDroppedReported) {
+    Logger::err(format_string("%u deferred create failures were dropped, the error ring was full.", numDropped - numDroppedReported));
+    numDroppedReported = numDropped;
+  }
+  return surfaced;
+}
+
 HRESULT syncOnPresent() {
 #ifdef ENABLE_PRESENT_SEMAPHORE_TRACE
   Logger::trace("Client side Present call received, acquiring semaphore...");
 #endif
 
+  Direct3DQuery9_LSS::onPresentSubmitted();
+  if (UpGeometryCache::isEnabled()) {
+    UpGeometryCache::onPresent();
+  }
+  if (GeometryRing::isEnabled()) {
+    GeometryRing::onPresentSubmitted();
+  }
+#ifdef TRACY_ENABLE
+  TracyPlot("Slab Allocator In Use (bytes)", (int64_t) SlabAllocator::getBytesInUse());
+  TracyPlot("Slab Allocator Reserved (bytes)", (int64_t) SlabAllocator::getBytesReserved());
+  TracyPlot("Shadow Arena Committed (bytes)", (int64_t) ShadowArena::getBytesCommitted());
+#endif
+
   // If we're syncing with the server on Present() then wait for the semaphore to be released
   if (GlobalOptions::getPresentSemaphoreEnabled()) {
     const auto maxRetries = GlobalOptions::getCommandRetries();
     size_t numRetries = 0;
+    LARGE_INTEGER stallStart, stallEnd;
+    QueryPerformanceCounter(&stallStart);
     while (gbBridgeRunning && RESULT_FAILURE(gpPresent->wait()) && numRetries++ < maxRetries) {
       Logger::warn("Still waiting on the Present semaphore to be released...");
     }
+    QueryPerformanceCounter(&stallEnd);
+    PresentLatencyController::onPresent(stallEnd.QuadPart - stallStart.QuadPart);
     if (numRetries >= maxRetries) {
       Logger::err("Max retries reached waiting on the Present semaphore!");
       return ERROR_SEM_TIMEOUT;
@@ -519,6 +610,11 @@ HRESULT Direct3DDevice9Ex_LSS<EnableSync>::Present(CONST RECT* pSourceRect, CONS
     if (syncResult == ERROR_SEM_TIMEOUT) {
       return ERROR_SEM_TIMEOUT;
     }
+
+    const auto deferredResult = checkDeferredErrors();
+    if (FAILED(deferredResult)) {
+      return deferredResult;
+    }
   }
 
   FrameMark;
@@ -799,6 +895,8 @@ HRESULT Direct3DDevice9Ex_LSS<EnableSync>::UpdateSurface(IDirect3DSurface9* pSou
 
   const auto pLssSrcSurface = bridge_cast<Direct3DSurface9_LSS*>(pSourceSurface);
   const auto pLssDestSurface = bridge_cast<Direct3DSurface9_LSS*>(pDestinationSurface);
+  BulkLane::dependOn(pLssSrcSurface->getBulkResourceId());
+  BulkLane::dependOn(pLssDestSurface->getBulkResourceId());
   UID currentUID = 0;
   {
     ClientMessage c(Commands::IDirect3DDevice9Ex_UpdateSurface, getId());
@@ -823,6 +921,8 @@ HRESULT Direct3DDevice9Ex_LSS<EnableSync>::UpdateTextureImpl(IDirect3DBaseTextur
   auto pLssDestinationTexture = bridge_cast<T*>(pDestinationTexture);
   assert(pLssSourceTexture && "UpdateTexture: unable to cast source texture!");
   assert(pLssDestinationTexture && "UpdateTexture: unable to cast destination texture!");
+  BulkLane::dependOn(pLssSourceTexture->getId());
+  BulkLane::dependOn(pLssDestinationTexture->getId());
   UID currentUID = 0;
   {
     ClientMessage c(Commands::IDirect3DDevice9Ex_UpdateTexture, getId());
@@ -861,6 +961,19 @@ HRESULT Direct3DDevice9Ex_LSS<EnableSync>::GetRenderTargetData(IDirect3DSurface9
 
   const auto pLssSourceSurface = bridge_cast<Direct3DSurface9_LSS*>(pRenderTarget);
   const auto pLssDestinationSurface = bridge_cast<Direct3DSurface9_LSS*>(pDestSurface);
+  BulkLane::dependOn(pLssDestinationSurface->getBulkResourceId());
+
+  if (Direct3DSurface9_LSS::useAsyncReadback()) {
+    const auto [bufId, fence] = pLssDestinationSurface->beginAsyncReadback();
+    if (bufId != SharedHeap::kInvalidId) {
+      // The data is picked up by the surface once it gets locked
+      ClientMessage c(Commands::IDirect3DDevice9Ex_GetRenderTargetData, getId(), Commands::FlagBits::DataInSharedHeap);
+      c.send_data(pLssSourceSurface->getId());
+      c.send_data(pLssDestinationSurface->getId());
+      c.send_many(bufId, fence);
+      return D3D_OK;
+    }
+  }
 
   UID currentUID = 0;
   {
@@ -884,6 +997,16 @@ HRESULT Direct3DDevice9Ex_LSS<EnableSync>::GetFrontBufferData(UINT iSwapChain, I
   }
 
   const auto pLssDestinationSurface = bridge_cast<Direct3DSurface9_LSS*>(pDestSurface);
+  BulkLane::dependOn(pLssDestinationSurface->getBulkResourceId());
+
+  if (Direct3DSurface9_LSS::useAsyncReadback()) {
+    const auto [bufId, fence] = pLssDestinationSurface->beginAsyncReadback();
+    if (bufId != SharedHeap::kInvalidId) {
+      ClientMessage c(Commands::IDirect3DDevice9Ex_GetFrontBufferData, getId(), Commands::FlagBits::DataInSharedHeap);
+      c.send_many(iSwapChain, pLssDestinationSurface->getId(), bufId, fence);
+      return D3D_OK;
+    }
+  }
 
   UID currentUID = 0;
   {
@@ -912,6 +1035,8 @@ HRESULT Direct3DDevice9Ex_LSS<EnableSync>::StretchRect(IDirect3DSurface9* pSourc
 
   const auto pLssSrcSurface = bridge_cast<Direct3DSurface9_LSS*>(pSourceSurface);
   const auto pLssDstSurface = bridge_cast<Direct3DSurface9_LSS*>(pDestSurface);
+  BulkLane::dependOn(pLssSrcSurface->getBulkResourceId());
+  BulkLane::dependOn(pLssDstSurface->getBulkResourceId());
   UID currentUID = 0;
   {
     ClientMessage c(Commands::IDirect3DDevice9Ex_StretchRect, getId());
@@ -935,6 +1060,7 @@ HRESULT Direct3DDevice9Ex_LSS<EnableSync>::ColorFill(IDirect3DSurface9* pSurface
   }
 
   const auto pLssSurface = bridge_cast<Direct3DSurface9_LSS*>(pSurface);
+  BulkLane::dependOn(pLssSurface->getBulkResourceId());
   UID currentUID = 0;
   {
     ClientMessage c(Commands::IDirect3DDevice9Ex_ColorFill, getId());
@@ -1370,11 +1496,18 @@ HRESULT Direct3DDevice9Ex_LSS<EnableSync>::SetLight(DWORD Index, CONST D3DLIGHT9
   {
     {
       BRIDGE_DEVICE_LOCKGUARD();
-      if (m_stateRecording) {
-        m_stateRecording->m_captureState.lights[Index] = *pLight;
-        m_stateRecording->m_dirtyFlags.lights[Index] = true;
+      auto& state = m_stateRecording ? m_stateRecording->m_captureState : m_state;
+      if (Index < kMaxLights) {
+        state.lights[Index] = *pLight;
+        state.lightDefined[Index] = true;
+        if (m_stateRecording) {
+          m_stateRecording->m_dirtyFlags.lights[Index] = true;
+        }
       } else {
-        m_state.lights[Index] = *pLight;
+        state.extraLights[Index] = *pLight;
+        if (m_stateRecording) {
+          m_stateRecording->m_dirtyFlags.extraLights.insert(Index);
+        }
       }
     }
     {
@@ -1398,6 +1531,17 @@ HRESULT Direct3DDevice9Ex_LSS<EnableSync>::GetLight(DWORD Index, D3DLIGHT9* pLig
 
   {
     BRIDGE_DEVICE_LOCKGUARD();
+    if (Index >= kMaxLights) {
+      const auto it = m_state.extraLights.find(Index);
+      if (it == m_state.extraLights.end()) {
+        return D3DERR_INVALIDCALL;
+      }
+      *pLight = it->second;
+      return S_OK;
+    }
+    if (!m_state.lightDefined[Index]) {
+      return D3DERR_INVALIDCALL;
+    }
     *pLight = m_state.lights[Index];
   }
   return S_OK;
@@ -1412,10 +1556,17 @@ HRESULT Direct3DDevice9Ex_LSS<EnableSync>::LightEnable(DWORD LightIndex, BOOL bE
   {
     {
       BRIDGE_DEVICE_LOCKGUARD();
-      if (m_stateRecording) {
-        m_stateRecording->m_captureState.bLightEnables[LightIndex] = bEnable;
+      auto& state = m_stateRecording ? m_stateRecording->m_captureState : m_state;
+      if (LightIndex < kMaxLights) {
+        state.bLightEnables[LightIndex] = bEnable;
+        if (m_stateRecording) {
+          m_stateRecording->m_dirtyFlags.bLightEnables[LightIndex] = true;
+        }
       } else {
-        m_state.bLightEnables[LightIndex] = bEnable;
+        state.extraLightEnables[LightIndex] = bEnable;
+        if (m_stateRecording) {
+          m_stateRecording->m_dirtyFlags.extraLightEnables.insert(LightIndex);
+        }
       }
     }
     {
@@ -1438,6 +1589,11 @@ HRESULT Direct3DDevice9Ex_LSS<EnableSync>::GetLightEnable(DWORD Index, BOOL* pEn
 
   {
     BRIDGE_DEVICE_LOCKGUARD();
+    if (Index >= kMaxLights) {
+      const auto it = m_state.extraLightEnables.find(Index);
+      *pEnable = (it != m_state.extraLightEnables.end()) ? it->second : FALSE;
+      return S_OK;
+    }
     *pEnable = m_state.bLightEnables[Index];
   }
   return S_OK;
@@ -1615,17 +1771,11 @@ void Direct3DDevice9Ex_LSS<EnableSync>::StateBlockSetPixelCaptureFlags(BaseDirec
     flags.samplerStates[i][D3DSAMP_SRGBTEXTURE] = true;
     flags.samplerStates[i][D3DSAMP_ELEMENTINDEX] = true;
   }
-  for (auto& fConst : flags.pixelConstants.fConsts) {
-    fConst = true;
-  }
-  for (auto& iConst : flags.pixelConstants.iConsts) {
-    iConst = true;
-  }
-  for (auto& bConst : flags.pixelConstants.bConsts) {
-    bConst = true;
-  }
+  flags.pixelConstants.fConsts.setAll();
+  flags.pixelConstants.iConsts.setAll();
+  flags.pixelConstants.bConsts.setAll();
   for (auto& stage : flags.textureStageStates) {
-    std::fill(std::begin(stage), std::end(stage), true);
+    stage.setAll();
   }
 }
 
@@ -1678,27 +1828,17 @@ void Direct3DDevice9Ex_LSS<EnableSync>::StateBlockSetVertexCaptureFlags(BaseDire
   flags.renderStates[D3DRS_SHADEMODE] = true;
 
   flags.vertexDecl = true;
-  std::fill(std::begin(flags.streamFreqs), std::end(flags.streamFreqs), true);
-  // Lights in the map are always transferred if they exist 
-  // LightEnables in the map are always transferred if they exist 
+  flags.streamFreqs.setAll();
+  flags.lights.setAll();
+  flags.bLightEnables.setAll();
+  flags.allExtraLights = true;
   for (uint32_t i = caps::MaxTexturesPS + 1; i < BaseDirect3DDevice9Ex_LSS::kMaxStageSamplerStateTypes; i++) {
     flags.samplerStates[i][D3DSAMP_DMAPOFFSET] = true;
   }
 
-  for (auto& fConst : flags.vertexConstants.fConsts) {
-    fConst = true;
-  }
-  for (auto& iConst : flags.vertexConstants.iConsts) {
-    iConst = true;
-  }
-  for (auto& bConst : flags.vertexConstants.bConsts) {
-    bConst = true;
-  }
-
-  for (uint32_t i = 0; i < flags.streamFreqs.size(); i++) {
-    flags.streamFreqs[i] = true;
-  }
-
+  flags.vertexConstants.fConsts.setAll();
+  flags.vertexConstants.iConsts.setAll();
+  flags.vertexConstants.bConsts.setAll();
 }
 
 template<bool EnableSync>
@@ -1710,16 +1850,16 @@ void Direct3DDevice9Ex_LSS<EnableSync>::StateBlockSetCaptureFlags(D3DSTATEBLOCKT
     StateBlockSetVertexCaptureFlags(flags);
   }
   if (Type == D3DSBT_ALL) {
-    std::fill(std::begin(flags.textures), std::end(flags.textures), true);
-    std::fill(std::begin(flags.streams), std::end(flags.streams), true);
+    flags.textures.setAll();
+    flags.streams.setAll();
 
     flags.indices = true;
     flags.viewport = true;
     flags.scissorRect = true;
 
-    std::fill(std::begin(flags.clipPlanes), std::end(flags.clipPlanes), true);
+    flags.clipPlanes.setAll();
 
-    std::fill(std::begin(flags.transforms), std::end(flags.transforms), true);
+    flags.transforms.setAll();
 
     flags.material = true;
   }
@@ -2282,10 +2422,40 @@ float Direct3DDevice9Ex_LSS<EnableSync>::GetNPatchMode() {
   return result;
 }
 
+template<bool EnableSync>
+void Direct3DDevice9Ex_LSS<EnableSync>::dependOnBoundTextureUploads() {
+  if (!BulkLane::hasPendingUploads()) {
+    return;
+  }
+  uint32_t token = 0;
+  {
+    BRIDGE_DEVICE_LOCKGUARD();
+    for (size_t idx = 0; idx < kNumStageSamplers; ++idx) {
+      D3DRefCounted* const pTexture = *m_state.textures[idx];
+      if (pTexture == nullptr) {
+        continue;
+      }
+      // Volume textures never use the bulk lane
+      switch (m_state.textureTypes[idx]) {
+      case D3DRTYPE_TEXTURE:
+        token = std::max(token, BulkLane::getPendingToken(bridge_cast<Direct3DTexture9_LSS*>(pTexture)->getId()));
+        break;
+      case D3DRTYPE_CUBETEXTURE:
+        token = std::max(token, BulkLane::getPendingToken(bridge_cast<Direct3DCubeTexture9_LSS*>(pTexture)->getId()));
+        break;
+      default:
+        break;
+      }
+    }
+  }
+  BulkLane::dependOnToken(token);
+}
+
 template<bool EnableSync>
 HRESULT Direct3DDevice9Ex_LSS<EnableSync>::DrawPrimitive(D3DPRIMITIVETYPE PrimitiveType, UINT StartVertex, UINT PrimitiveCount) {
   ZoneScoped;
   LogFunctionCall();
+  dependOnBoundTextureUploads();
   UID currentUID = 0;
   {
     ClientMessage c(Commands::IDirect3DDevice9Ex_DrawPrimitive, getId());
@@ -2299,6 +2469,7 @@ template<bool EnableSync>
 HRESULT Direct3DDevice9Ex_LSS<EnableSync>::DrawIndexedPrimitive(D3DPRIMITIVETYPE Type, INT BaseVertexIndex, UINT MinVertexIndex, UINT NumVertices, UINT startIndex, UINT primCount) {
   ZoneScoped;
   LogFunctionCall();
+  dependOnBoundTextureUploads();
   UID currentUID = 0;
   {
     ClientMessage c(Commands::IDirect3DDevice9Ex_DrawIndexedPrimitive, getId());
@@ -2312,17 +2483,44 @@ template<bool EnableSync>
 HRESULT Direct3DDevice9Ex_LSS<EnableSync>::DrawPrimitiveUP(D3DPRIMITIVETYPE PrimitiveType, UINT PrimitiveCount, CONST void* pVertexStreamZeroData, UINT VertexStreamZeroStride) {
   ZoneScoped;
   LogFunctionCall();
+  dependOnBoundTextureUploads();
   UID currentUID = 0;
   {
-    ClientMessage c(Commands::IDirect3DDevice9Ex_DrawPrimitiveUP, getId());
-    currentUID = c.get_uid();
-    c.send_many(PrimitiveType, PrimitiveCount);
-
     uint32_t numIndices = GetIndexCount(PrimitiveType, PrimitiveCount);
     uint32_t vertexDataSize = numIndices * VertexStreamZeroStride;
 
-    c.send_data(vertexDataSize, (void*) pVertexStreamZeroData);
+    // Payloads that are redrawn unchanged every frame are kept by the server and only referenced by hash
+    uint64_t hash = 0;
+    auto cacheAction = UpGeometryCache::Action::Send;
+    if (UpGeometryCache::isEnabled()) {
+      hash = bridge_util::hash64(pVertexStreamZeroData, vertexDataSize, ((uint64_t) getId() << 32) | VertexStreamZeroStride);
+      cacheAction = UpGeometryCache::onDraw(hash);
+    }
+    const bool bCached = cacheAction == UpGeometryCache::Action::Cached;
+
+    // Pass the geometry through the transient ring when there is room, or the data queue otherwise
+    const uint32_t vertexRingOffset = (GeometryRing::isEnabled() && !bCached) ?
+      GeometryRing::allocate(vertexDataSize) : GeometryRing::kInvalidOffset;
+    const bool bUseRing = vertexRingOffset != GeometryRing::kInvalidOffset;
+    if (bUseRing) {
+      memcpy(GeometryRing::getData(vertexRingOffset), pVertexStreamZeroData, vertexDataSize);
+    }
+
+    ClientMessage c(Commands::IDirect3DDevice9Ex_DrawPrimitiveUP, getId(), getUPDrawFlags(bUseRing, cacheAction));
+    currentUID = c.get_uid();
+    c.send_many(PrimitiveType, PrimitiveCount);
+
+    if (bCached) {
+      c.send_many((uint32_t) hash, (uint32_t) (hash >> 32));
+    } else if (bUseRing) {
+      c.send_data(vertexRingOffset);
+    } else {
+      c.send_data(vertexDataSize, (void*) pVertexStreamZeroData);
+    }
     c.send_data(VertexStreamZeroStride);
+    if (cacheAction == UpGeometryCache::Action::Promote) {
+      c.send_many((uint32_t) hash, (uint32_t) (hash >> 32), vertexDataSize);
+    }
   }
   WAIT_FOR_OPTIONAL_SERVER_RESPONSE("DrawPrimitiveUP()", D3DERR_INVALIDCALL, currentUID);
 }
@@ -2331,19 +2529,49 @@ template<bool EnableSync>
 HRESULT Direct3DDevice9Ex_LSS<EnableSync>::DrawIndexedPrimitiveUP(D3DPRIMITIVETYPE PrimitiveType, UINT MinIndex, UINT NumVertices, UINT PrimitiveCount, CONST void* pIndexData, D3DFORMAT IndexDataFormat, CONST void* pVertexStreamZeroData, UINT VertexStreamZeroStride) {
   ZoneScoped;
   LogFunctionCall();
+  dependOnBoundTextureUploads();
   UID currentUID = 0;
   {
-    ClientMessage c(Commands::IDirect3DDevice9Ex_DrawIndexedPrimitiveUP, getId());
-    currentUID = c.get_uid();
-    c.send_many(PrimitiveType, MinIndex, NumVertices, PrimitiveCount, IndexDataFormat, VertexStreamZeroStride);
-
     uint32_t numIndices = GetIndexCount(PrimitiveType, PrimitiveCount);
     uint32_t indexStride = IndexDataFormat == D3DFMT_INDEX16 ? 2 : 4;
     uint32_t indexDataSize = numIndices * indexStride;
     uint32_t vertexDataSize = NumVertices * VertexStreamZeroStride;
 
-    c.send_data(indexDataSize, (void*) pIndexData);
-    c.send_data(vertexDataSize, (void*) pVertexStreamZeroData);
+    // Payloads that are redrawn unchanged every frame are kept by the server and only referenced by hash
+    uint64_t hash = 0;
+    auto cacheAction = UpGeometryCache::Action::Send;
+    if (UpGeometryCache::isEnabled()) {
+      hash = bridge_util::hash64(pVertexStreamZeroData, vertexDataSize, ((uint64_t) getId() << 32) | VertexStreamZeroStride);
+      hash = bridge_util::hash64(pIndexData, indexDataSize, hash ^ indexStride);
+      cacheAction = UpGeometryCache::onDraw(hash);
+    }
+    const bool bCached = cacheAction == UpGeometryCache::Action::Cached;
+
+    // Indices and vertices share one ring allocation, vertices start at the next aligned offset
+    const uint32_t vertexDataOffset = align<uint32_t>(indexDataSize, GeometryRing::kAlignment);
+    const uint32_t ringOffset = (GeometryRing::isEnabled() && !bCached) ?
+      GeometryRing::allocate(vertexDataOffset + vertexDataSize) : GeometryRing::kInvalidOffset;
+    const bool bUseRing = ringOffset != GeometryRing::kInvalidOffset;
+    if (bUseRing) {
+      memcpy(GeometryRing::getData(ringOffset), pIndexData, indexDataSize);
+      memcpy(GeometryRing::getData(ringOffset + vertexDataOffset), pVertexStreamZeroData, vertexDataSize);
+    }
+
+    ClientMessage c(Commands::IDirect3DDevice9Ex_DrawIndexedPrimitiveUP, getId(), getUPDrawFlags(bUseRing, cacheAction));
+    currentUID = c.get_uid();
+    c.send_many(PrimitiveType, MinIndex, NumVertices, PrimitiveCount, IndexDataFormat, VertexStreamZeroStride);
+
+    if (bCached) {
+      c.send_many((uint32_t) hash, (uint32_t) (hash >> 32));
+    } else if (bUseRing) {
+      c.send_many(ringOffset, ringOffset + vertexDataOffset);
+    } else {
+      c.send_data(indexDataSize, (void*) pIndexData);
+      c.send_data(vertexDataSize, (void*) pVertexStreamZeroData);
+    }
+    if (cacheAction == UpGeometryCache::Action::Promote) {
+      c.send_many((uint32_t) hash, (uint32_t) (hash >> 32), indexDataSize, vertexDataSize);
+    }
   }
   WAIT_FOR_OPTIONAL_SERVER_RESPONSE("DrawIndexedPrimitiveUP()", D3DERR_INVALIDCALL, currentUID);
 }
@@ -2396,12 +2624,38 @@ HRESULT Direct3DDevice9Ex_LSS<EnableSync>::CreateVertexDeclaration(CONST D3DVERT
       pVtxElemItr++;
     }
 
-    {
-      ClientMessage c(Commands::IDirect3DDevice9Ex_CreateVertexDeclaration, getId());
+    const auto sendCreate = [&](const Commands::Flags flags, const uint64_t hash) {
+      ClientMessage c(Commands::IDirect3DDevice9Ex_CreateVertexDeclaration, getId(), flags);
       currentUID = c.get_uid();
-      c.send_data(numElem);
-      c.send_data(sizeof(D3DVERTEXELEMENT9) * numElem, (void*) pStart);
+      if (flags != 0) {
+        c.send_many((uint32_t) hash, (uint32_t) (hash >> 32));
+      }
+      if (!Commands::IsObjectInterned(flags)) {
+        c.send_data(numElem);
+        c.send_data(sizeof(D3DVERTEXELEMENT9) * numElem, (void*) pStart);
+      }
       c.send_data((uint32_t) pLssVtxDecl->getId());
+    };
+
+    if (ObjectInterner::isEnabled()) {
+      const uint64_t hash = getInternHash(Commands::IDirect3DDevice9Ex_CreateVertexDeclaration,
+                                          pStart, sizeof(D3DVERTEXELEMENT9) * numElem);
+      pLssVtxDecl->setInternHash(hash);
+      bool bResponded = false;
+      const HRESULT hresult = ObjectInterner::create(hash, [&](const bool bInterned) {
+        sendCreate(bInterned ? Commands::FlagBits::ObjectInterned : Commands::FlagBits::InternObject, hash);
+      }, [&]() {
+        bResponded = true;
+        return waitForInternResponse("CreateVertexDeclaration()", currentUID);
+      });
+      if (bResponded) {
+        if (FAILED(hresult)) {
+          pLssVtxDecl->setInternHash(0);
+        }
+        return hresult;
+      }
+    } else {
+      sendCreate(0, 0);
     }
   }
   WAIT_FOR_OPTIONAL_CREATE_FUNCTION_SERVER_RESPONSE("CreateVertexDeclaration()", D3DERR_INVALIDCALL, currentUID);
@@ -2511,13 +2765,37 @@ HRESULT Direct3DDevice9Ex_LSS<EnableSync>::CreateVertexShader(CONST DWORD* pFunc
   pLssVertexShader->GetFunction(nullptr, &dataSize);
 
   UID currentUID = 0;
-  {
-    ClientMessage c(Commands::IDirect3DDevice9Ex_CreateVertexShader, getId());
+  const auto sendCreate = [&](const Commands::Flags flags, const uint64_t hash) {
+    ClientMessage c(Commands::IDirect3DDevice9Ex_CreateVertexShader, getId(), flags);
     currentUID = c.get_uid();
+    if (flags != 0) {
+      c.send_many((uint32_t) hash, (uint32_t) (hash >> 32));
+    }
     c.send_data((uint32_t) pLssVertexShader->getId());
-    c.send_data(dataSize);
-    c.send_data(dataSize, (void*) pFunction);
-    
+    if (!Commands::IsObjectInterned(flags)) {
+      c.send_data(dataSize);
+      c.send_data(dataSize, (void*) pFunction);
+    }
+  };
+
+  if (ObjectInterner::isEnabled()) {
+    const uint64_t hash = getInternHash(Commands::IDirect3DDevice9Ex_CreateVertexShader, shader.getHash());
+    pLssVertexShader->setInternHash(hash);
+    bool bResponded = false;
+    const HRESULT hresult = ObjectInterner::create(hash, [&](const bool bInterned) {
+      sendCreate(bInterned ? Commands::FlagBits::ObjectInterned : Commands::FlagBits::InternObject, hash);
+    }, [&]() {
+      bResponded = true;
+      return waitForInternResponse("CreateVertexShader()", currentUID);
+    });
+    if (bResponded) {
+      if (FAILED(hresult)) {
+        pLssVertexShader->setInternHash(0);
+      }
+      return hresult;
+    }
+  } else {
+    sendCreate(0, 0);
   }
   WAIT_FOR_OPTIONAL_CREATE_FUNCTION_SERVER_RESPONSE("CreateVertexShader()", D3DERR_INVALIDCALL, currentUID);
 }
@@ -2899,12 +3177,37 @@ HRESULT Direct3DDevice9Ex_LSS<EnableSync>::CreatePixelShader(CONST DWORD* pFunct
   pLssPixelShader->GetFunction(nullptr, &dataSize);
 
   UID currentUID = 0;
-  {
-    ClientMessage c(Commands::IDirect3DDevice9Ex_CreatePixelShader, getId());
+  const auto sendCreate = [&](const Commands::Flags flags, const uint64_t hash) {
+    ClientMessage c(Commands::IDirect3DDevice9Ex_CreatePixelShader, getId(), flags);
     currentUID = c.get_uid();
+    if (flags != 0) {
+      c.send_many((uint32_t) hash, (uint32_t) (hash >> 32));
+    }
     c.send_data((uint32_t) pLssPixelShader->getId());
-    c.send_data(dataSize);
-    c.send_data(dataSize, (void*) pFunction);
+    if (!Commands::IsObjectInterned(flags)) {
+      c.send_data(dataSize);
+      c.send_data(dataSize, (void*) pFunction);
+    }
+  };
+
+  if (ObjectInterner::isEnabled()) {
+    const uint64_t hash = getInternHash(Commands::IDirect3DDevice9Ex_CreatePixelShader, shader.getHash());
+    pLssPixelShader->setInternHash(hash);
+    bool bResponded = false;
+    const HRESULT hresult = ObjectInterner::create(hash, [&](const bool bInterned) {
+      sendCreate(bInterned ? Commands::FlagBits::ObjectInterned : Commands::FlagBits::InternObject, hash);
+    }, [&]() {
+      bResponded = true;
+      return waitForInternResponse("CreatePixelShader()", currentUID);
+    });
+    if (bResponded) {
+      if (FAILED(hresult)) {
+        pLssPixelShader->setInternHash(0);
+      }
+      return hresult;
+    }
+  } else {
+    sendCreate(0, 0);
   }
   WAIT_FOR_OPTIONAL_CREATE_FUNCTION_SERVER_RESPONSE("CreatePixelShader()", D3DERR_INVALIDCALL, currentUID);
 }
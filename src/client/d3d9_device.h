@@ -23,11 +23,16 @@
 
 #include "d3d9_device_base.h"
 
+#include "util_commands.h"
 #include "util_common.h"
 #include "util_scopedlock.h"
 
 #include <type_traits>
 
+// Logs the create call failures the server reported since the last Present when
+// asyncCreateFunctions is enabled, and returns the one the application should see
+HRESULT checkDeferredErrors();
+
 template<bool EnableSync>
 class Direct3DDevice9Ex_LSS: public BaseDirect3DDevice9Ex_LSS {
 
@@ -240,5 +245,10 @@ private:
   template<typename T>
   HRESULT UpdateTextureImpl(IDirect3DBaseTexture9* pSourceTexture, IDirect3DBaseTexture9* pDestinationTexture);
   void setupFPU();
+  // Makes the next draw wait for bulk lane uploads to the bound textures still in flight
+  void dependOnBoundTextureUploads();
+  // Hash under which an object with the given contents is interned on the server
+  uint64_t getInternHash(const Commands::D3D9Command command, const uint64_t contentHash) const;
+  uint64_t getInternHash(const Commands::D3D9Command command, const void* pData, const size_t size) const;
 };
 
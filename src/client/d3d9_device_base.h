@@ -21,6 +21,7 @@
  */
 #pragma once
 
+#include "util_bitset.h"
 #include "util_common.h"
 #include "util_scopedlock.h"
 
@@ -29,6 +30,8 @@
 #include "shadow_map.h"
 
 #include <array>
+#include <unordered_map>
+#include <unordered_set>
 
 class Direct3D9Ex_LSS;
 class Direct3DSwapChain9_LSS;
@@ -46,6 +49,8 @@ public:
   static constexpr size_t kNumStageSamplers = caps::MaxTexturesPS + caps::MaxTexturesVS + 1;
   static constexpr size_t kMaxTexStageStateTypes = 18;
   static constexpr size_t kMaxStageSamplerStateTypes = D3DSAMP_DMAPOFFSET + 1;
+  // Lights below this index are tracked in fixed arrays, higher ones in overflow maps
+  static constexpr size_t kMaxLights = 64;
 
   const D3DDEVICE_CREATION_PARAMETERS& getCreateParams() const {
     return m_createParams;
@@ -170,50 +175,57 @@ protected:
   UINT m_maxFrameLatency;
   HWND m_hWnd = NULL;
 
+  // Packed bitsets, so that transferring state only visits what a state block touches
   struct StateCaptureDirtyFlags {
+    template<size_t N>
+    using Bitset = bridge_util::Bitset<N>;
     // Vertex Decl
-    bool vertexDecl;
+    bool vertexDecl = false;
     // Indices
-    bool indices;
+    bool indices = false;
     // Render State
-    std::array<bool, kNumRenderStates> renderStates = { false };
+    Bitset<kNumRenderStates> renderStates;
     // Sampler States
-    std::array<std::array<bool, kMaxStageSamplerStateTypes>, kNumStageSamplers> samplerStates;
+    std::array<Bitset<kMaxStageSamplerStateTypes>, kNumStageSamplers> samplerStates;
     // Streams
-    std::array<bool, caps::MaxStreams> streams;
-    std::array<bool, caps::MaxStreams> streamFreqs;
+    Bitset<caps::MaxStreams> streams;
+    Bitset<caps::MaxStreams> streamFreqs;
     // Textures
-    std::array<bool, kNumStageSamplers> textures;
+    Bitset<kNumStageSamplers> textures;
     // Vertex Shader
-    bool vertexShader;
+    bool vertexShader = false;
     // Pixel Shader
-    bool pixelShader;
+    bool pixelShader = false;
     // Material
-    bool material;
+    bool material = false;
     // Lights
-    std::unordered_map<DWORD, bool> lights;
+    Bitset<kMaxLights> lights;
     // Light Enables
-    std::unordered_map<DWORD, bool> bLightEnables;
+    Bitset<kMaxLights> bLightEnables;
+    // Lights and light enables from kMaxLights on, all of them if allExtraLights is set
+    std::unordered_set<DWORD> extraLights;
+    std::unordered_set<DWORD> extraLightEnables;
+    bool allExtraLights = false;
     // Transforms
-    std::array<bool, caps::MaxTransforms> transforms;
+    Bitset<caps::MaxTransforms> transforms;
     // Texture Stage State
-    using TextureStateArray = std::array<bool, kMaxTexStageStateTypes>;
+    using TextureStateArray = Bitset<kMaxTexStageStateTypes>;
     std::array<TextureStateArray, kNumStageSamplers> textureStageStates;
     // Viewport
-    bool viewport;
+    bool viewport = false;
     // Scissor Rect
-    bool scissorRect;
-    std::array<bool, caps::MaxClipPlanes> clipPlanes;
+    bool scissorRect = false;
+    Bitset<caps::MaxClipPlanes> clipPlanes;
     // Pixel Shader Constants
     struct VertexConstants {
-      std::array<bool, caps::MaxFloatConstantsSoftware> fConsts;
-      std::array<bool, caps::MaxOtherConstantsSoftware> iConsts;
-      std::array<bool, caps::MaxOtherConstantsSoftware> bConsts;
+      Bitset<caps::MaxFloatConstantsSoftware> fConsts;
+      Bitset<caps::MaxOtherConstantsSoftware> iConsts;
+      Bitset<caps::MaxOtherConstantsSoftware> bConsts;
     } vertexConstants;
     struct PixelConstants {
-      std::array<bool, caps::MaxFloatConstantsPS> fConsts;
-      std::array<bool, caps::MaxOtherConstants> iConsts;
-      std::array<bool, caps::MaxOtherConstants> bConsts;
+      Bitset<caps::MaxFloatConstantsPS> fConsts;
+      Bitset<caps::MaxOtherConstants> iConsts;
+      Bitset<caps::MaxOtherConstants> bConsts;
     } pixelConstants;
   };
 
@@ -228,10 +240,14 @@ protected:
     D3DVIEWPORT9 viewport;
     // Material
     D3DMATERIAL9 material;
-    // Lights
-    std::unordered_map<DWORD, D3DLIGHT9> lights;
+    // Lights, only the first kMaxLights indices
+    std::array<D3DLIGHT9, kMaxLights> lights;
+    bridge_util::Bitset<kMaxLights> lightDefined;
     // Light Enables
-    std::unordered_map<DWORD, bool> bLightEnables;
+    std::array<bool, kMaxLights> bLightEnables = {};
+    // Lights and light enables from kMaxLights on
+    std::unordered_map<DWORD, D3DLIGHT9> extraLights;
+    std::unordered_map<DWORD, bool> extraLightEnables;
     // Clip Plane
     std::array<float[4], caps::MaxClipPlanes> clipPlanes;
     // Render State
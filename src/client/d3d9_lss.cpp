@@ -33,19 +33,32 @@
 #include "config/global_options.h"
 #include "di_hook.h"
 #include "log/log.h"
+#include "present_latency_controller.h"
 #include "remix_state.h"
+#include "shadow_arena.h"
+#include "slab_allocator.h"
+#include "trace_driver.h"
 #include "util_bridge_assert.h"
 #include "util_bridge_state.h"
+#include "util_bulkcommand.h"
+#include "util_commandlog.h"
+#include "util_commandtrace.h"
 #include "util_common.h"
+#include "util_deferrederrors.h"
+#include "util_geometryring.h"
 #include "util_devicecommand.h"
 #include "util_modulecommand.h"
+#include "util_process.h"
+#include "util_queryresults.h"
 #include "util_filesys.h"
 #include "util_hack_d3d_debug.h"
 #include "util_messagechannel.h"
 #include "util_seh.h"
 #include "util_semaphore.h"
 
+#include <algorithm>
 #include <assert.h>
+#include <atomic>
 #include <sstream>
 #include <stdio.h>
 #include <string>
@@ -110,12 +123,14 @@ Guid gUniqueIdentifier;
 Process* gpServer = nullptr;
 NamedSemaphore* gpPresent = nullptr;
 ShadowMap gShadowMap;
-std::mutex gShadowMapMutex;
 std::unordered_map<HWND, std::deque<WNDPROC>> ogWndProcList;
 std::mutex gWndProcListMapMutex;
 std::unique_ptr<MessageChannelClient> gpRemixMessageChannel;  // Message channel with the Remix renderer
 std::unique_ptr<MessageChannelClient> gpServerMessageChannel; // Message channel with the Bridge server
 std::mutex serverStartMutex;
+std::mutex serverLaunchMutex;
+// Set when a server that was launched early exited before the handshake started
+std::atomic<bool> gbServerExitedBeforeSyn = false;
 SceneState gSceneState = WaitBeginScene;
 std::chrono::steady_clock::time_point gTimeStart;
 bool gbBridgeRunning = true;
@@ -142,6 +157,14 @@ void SetupExceptionHandler() {
 }
 
 void OnServerExited(Process const* process) {
+  // A server that was launched early has nothing to render yet, it is simply
+  // launched again once the application creates its D3D9 object
+  if (BridgeState::getClientState() < BridgeState::ProcessState::Handshaking) {
+    Logger::warn("The bridge server process exited before the handshake, it will be launched again.");
+    gbServerExitedBeforeSyn = true;
+    return;
+  }
+
   BridgeState::setServerState(BridgeState::ProcessState::Exited);
 
   // Disable the bridge to terminate any ongoing processing
@@ -163,9 +186,18 @@ void OnServerExited(Process const* process) {
   Logger::info(uptimeSS.str());
 }
 
-void InitServer() {
-  std::lock_guard<std::mutex> guard(serverStartMutex);
+// Spawns the server process, which starts loading its D3D9 runtime right away
+void LaunchServer(const bool bTraceReplay = false, const bool bEarly = false) {
+  std::lock_guard<std::mutex> guard(serverLaunchMutex);
+  if (gpServer != nullptr && gbServerExitedBeforeSyn) {
+    delete gpServer;
+    gpServer = nullptr;
+    gbServerExitedBeforeSyn = false;
+  }
   if (gpServer != nullptr) {
+    if (bTraceReplay) {
+      Logger::warn("The server was launched early without the null device, the command trace will be replayed on D3D9.");
+    }
     return;
   }
   Logger::info("Launching server with GUID " + gUniqueIdentifier.toString());
@@ -174,9 +206,45 @@ void InitServer() {
   cmdSS << ".trex/NvRemixBridge.exe";
   cmdSS << " " << gUniqueIdentifier.toString();
   cmdSS << " " << BRIDGE_VERSION;
+  if (bTraceReplay) {
+    // Window handles in a trace are stale, so nothing can actually be rendered
+    cmdSS << " --null-device";
+  } else if (bEarly) {
+    // The application may take arbitrarily long before it creates its D3D9 object,
+    // so the server waits for the handshake for as long as this process is alive
+    cmdSS << " --wait-for-client " << GetCurrentProcessId();
+  }
   cmdSS << " " << std::string(GetCommandLineA());
   const std::string command = cmdSS.str();
   gpServer = new Process(command.c_str(), OnServerExited);
+  logStartupPhase("Server launched");
+}
+
+// Launches the server from a new thread when the client DLL gets loaded, so that it
+// is already initializing by the time the application creates its D3D9 object
+void LaunchServerEarly() {
+  if (!ClientOptions::getLaunchServerEarly()) {
+    return;
+  }
+  // Called from DllMain, the thread only starts running once the loader lock was
+  // released, which process creation requires
+  const HANDLE hThread = CreateThread(nullptr, 0, [](LPVOID) -> DWORD {
+    LaunchServer(false, true);
+    return 0;
+  }, nullptr, 0, nullptr);
+  if (hThread != nullptr) {
+    CloseHandle(hThread);
+  }
+}
+
+void InitServer(const bool bTraceReplay = false) {
+  std::lock_guard<std::mutex> guard(serverStartMutex);
+  static bool bIsInit = false;
+  if (bIsInit) {
+    return;
+  }
+  bIsInit = true;
+  LaunchServer(bTraceReplay);
 
   if (ClientOptions::getEnableDpiAwareness()) {
     Logger::info("Process set as DPI aware");
@@ -222,6 +290,7 @@ void InitServer() {
   }
   // Remove Ack from queue and get thread id for thread proc message handler from server
   const auto ackResponse = DeviceBridge::pop_front();
+  logStartupPhase("Server acknowledged");
   gpServerMessageChannel = std::make_unique<MessageChannelClient>(static_cast<uint32_t>(ackResponse.pHandle));
   {
     // Special handling for certain window messages to disable semaphore timeouts
@@ -269,10 +338,34 @@ void InitServer() {
 #endif
   BridgeState::setClientState(BridgeState::ProcessState::Running);
   BridgeState::setServerState(BridgeState::ProcessState::Running);
+  logStartupPhase("Handshake completed");
   
   if (GlobalOptions::getUseSharedHeap()) {
     SharedHeap::init();
   }
+
+  if (GlobalOptions::getEmulateQueries()) {
+    QueryResults::init();
+  }
+
+  if (GlobalOptions::getAsyncCreateFunctions()) {
+    DeferredErrors::init();
+  }
+
+  if (GlobalOptions::getGeometryRingSize() > 0) {
+    GeometryRing::init(GlobalOptions::getGeometryRingSize());
+  }
+
+  // The shared heap, optimized dynamic locks and the geometry ring move data outside
+  // of the command stream, which a trace would then be unable to reproduce.
+  const std::string commandTraceFile = ClientOptions::getCommandTraceFile();
+  if (!commandTraceFile.empty() && !bTraceReplay) {
+    if (GlobalOptions::getUseSharedHeap() || ClientOptions::getOptimizedDynamicLock() || GlobalOptions::getGeometryRingSize() > 0) {
+      Logger::warn("Command trace capture is not supported with useSharedHeap, client.optimizedDynamicLock or geometryRingSize enabled, no trace will be written.");
+    } else {
+      CommandTrace::beginCapture(commandTraceFile);
+    }
+  }
 }
 
 bool InitRemixFolder(HMODULE hinst) {
@@ -570,6 +663,8 @@ bool RemixAttach(HMODULE hModule) {
     Config::init(Config::App::Client, hModule);
     GlobalOptions::init();
     Logger::set_loglevel(GlobalOptions::getLogLevel());
+    Logger::set_max_file_size(GlobalOptions::getLogMaxFileSize());
+    CommandLog::init(CommandLog::Side::Client, hModule);
 
     SetupExceptionHandler();
 
@@ -586,8 +681,12 @@ bool RemixAttach(HMODULE hModule) {
 
     initModuleBridge();
     initDeviceBridge();
+    if (GlobalOptions::getUseBulkLane()) {
+      initBulkBridge();
+    }
 
     gpPresent = new NamedSemaphore("Present", 0, GlobalOptions::getPresentSemaphoreMaxFrames());
+    PresentLatencyController::init(gpPresent);
 
     BridgeState::setClientState(BridgeState::ProcessState::Init);
 
@@ -634,11 +733,15 @@ void RemixDetach() {
       } else {
         Logger::err("Timeout waiting for clean server termination. Moving ahead anyway.");
       }
+      CommandTrace::endCapture();
 
       delete gpServer;
     }
 
     PrintRecentCommandHistory();
+    Logger::debug(format_string("Shadow memory at shutdown: slabs %zd of %zd bytes in use, arena %zd of %zd bytes committed",
+                                SlabAllocator::getBytesInUse(), SlabAllocator::getBytesReserved(),
+                                ShadowArena::getBytesCommitted(), ShadowArena::getBytesReserved()));
 
     // Clean up resources
     delete gpPresent;
@@ -683,3 +786,40 @@ IDirect3D9* LssDirect3DCreate9(UINT SDKVersion) {
   InitServer();
   return retval;
 }
+
+/*
+ * Command trace replay entry point, see TraceDriver. Meant to be invoked as:
+ *   rundll32 d3d9.dll,RemixReplayCommandTrace <trace file> [--asap]
+ */
+extern "C" void CALLBACK RemixReplayCommandTrace(HWND hwnd, HINSTANCE hinst, LPSTR lpszCmdLine, int nCmdShow) {
+  if (!RemixAttach(NULL)) {
+    return;
+  }
+
+  std::string args(lpszCmdLine != nullptr ? lpszCmdLine : "");
+  std::string tracePath;
+  size_t pathEnd;
+  if (!args.empty() && args[0] == '"') {
+    pathEnd = args.find('"', 1);
+    tracePath = args.substr(1, pathEnd == std::string::npos ? std::string::npos : pathEnd - 1);
+    pathEnd = pathEnd == std::string::npos ? args.size() : pathEnd + 1;
+  } else {
+    pathEnd = std::min(args.find(' '), args.size());
+    tracePath = args.substr(0, pathEnd);
+  }
+  const bool bAsap = args.find("--asap", pathEnd) != std::string::npos;
+  if (tracePath.empty()) {
+    Logger::err("No command trace file given to replay.");
+    return;
+  }
+
+  TraceDriver driver(tracePath, bAsap ? TraceDriver::Pacing::AsFastAsPossible : TraceDriver::Pacing::Original);
+  if (!driver.isValid()) {
+    return;
+  }
+  InitServer(true);
+  if (gbBridgeRunning) {
+    driver.run();
+  }
+  RemixDetach();
+}
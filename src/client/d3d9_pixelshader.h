@@ -29,6 +29,8 @@
 class Direct3DPixelShader9_LSS: public D3DBase<IDirect3DPixelShader9> {
   void onDestroy() override;
   CommonShader m_shader;
+  // Content hash the object was interned under on the server, 0 if it was not
+  uint64_t m_internHash = 0;
 protected:
   BaseDirect3DDevice9Ex_LSS* const m_pDevice = nullptr;
 public:
@@ -46,4 +48,8 @@ public:
   /*** IDirect3DPixelShader9 methods ***/
   STDMETHOD(GetDevice)(THIS_ IDirect3DDevice9** ppDevice);
   STDMETHOD(GetFunction)(THIS_ void*, UINT* pSizeOfData);
+
+  void setInternHash(const uint64_t hash) {
+    m_internHash = hash;
+  }
 };
\ No newline at end of file
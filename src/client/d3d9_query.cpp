@@ -22,6 +22,50 @@
 #include "pch.h"
 #include "d3d9_query.h"
 #include "util_devicecommand.h"
+#include "config/global_options.h"
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+namespace {
+  // Presents sent to the server so far, compared against QueryResults::Table::completedFrames
+  std::atomic<uint32_t> gSubmittedFrames = 0;
+  // Unique per occlusion query end, so that a result in a recycled slot is never mistaken
+  std::atomic<uint32_t> gQuerySequence = 0;
+
+  std::mutex gSlotLock;
+  std::vector<uint32_t> gFreeSlots;
+  uint32_t gNextSlot = 0;
+
+  uint32_t allocateSlot() {
+    std::scoped_lock lock(gSlotLock);
+    if (!gFreeSlots.empty()) {
+      const uint32_t slot = gFreeSlots.back();
+      gFreeSlots.pop_back();
+      return slot;
+    }
+    if (gNextSlot < QueryResults::kMaxSlots) {
+      return gNextSlot++;
+    }
+    ONCE(Logger::warn("Out of emulated query slots, further occlusion queries will wait on the server."));
+    return QueryResults::kInvalidSlot;
+  }
+
+  void freeSlot(const uint32_t slot) {
+    std::scoped_lock lock(gSlotLock);
+    gFreeSlots.push_back(slot);
+  }
+}
+
+void Direct3DQuery9_LSS::onPresentSubmitted() {
+  ++gSubmittedFrames;
+}
+
+bool Direct3DQuery9_LSS::isEmulated() const {
+  return GlobalOptions::getEmulateQueries() &&
+    (m_type == D3DQUERYTYPE_EVENT || m_type == D3DQUERYTYPE_OCCLUSION);
+}
 
 HRESULT Direct3DQuery9_LSS::QueryInterface(REFIID riid, LPVOID* ppvObj) {
   LogFunctionCall();
@@ -54,6 +98,11 @@ ULONG Direct3DQuery9_LSS::Release() {
 void Direct3DQuery9_LSS::onDestroy() {
   LogFunctionCall();
   ClientMessage { Commands::IDirect3DQuery9_Destroy, getId() };
+  // Server drops any pending result for this query on destroy, so the slot
+  // is free for reuse as soon as the destroy command is queued
+  if (m_slot != QueryResults::kInvalidSlot) {
+    freeSlot(m_slot);
+  }
 }
 
 HRESULT Direct3DQuery9_LSS::GetDevice(IDirect3DDevice9** ppDevice) {
@@ -98,15 +147,76 @@ HRESULT Direct3DQuery9_LSS::Issue(DWORD dwIssueFlags) {
     ClientMessage c(Commands::IDirect3DQuery9_Issue, getId());
     currentUID = c.get_uid();
     c.send_data(dwIssueFlags);
+    if (isEmulated() && (dwIssueFlags & D3DISSUE_END)) {
+      m_issueFrame = gSubmittedFrames.load();
+      if (m_type == D3DQUERYTYPE_OCCLUSION) {
+        if (m_slot == QueryResults::kInvalidSlot) {
+          m_slot = allocateSlot();
+        }
+        m_sequence = ++gQuerySequence;
+        c.send_data(m_slot);
+        c.send_data(m_sequence);
+      }
+    }
   }
   WAIT_FOR_OPTIONAL_SERVER_RESPONSE("Direct3DQuery9_LSS::Issue()", D3DERR_INVALIDCALL, currentUID);
 
   return S_OK;
 }
 
+HRESULT Direct3DQuery9_LSS::getEmulatedData(void* pData, DWORD dwSize, bool& bAnswered) const {
+  bAnswered = false;
+  // Results are only published on Present, so a query issued in the current frame
+  // is left to the server, which also honors D3DGETDATA_FLUSH for it.
+  if (m_issueFrame == kNotIssued || m_issueFrame == gSubmittedFrames.load()) {
+    return S_FALSE;
+  }
+  if (m_type == D3DQUERYTYPE_OCCLUSION && m_slot == QueryResults::kInvalidSlot) {
+    return S_FALSE;
+  }
+
+  bAnswered = true;
+  const auto& table = QueryResults::get();
+  if (m_type == D3DQUERYTYPE_EVENT) {
+    // All GPU work submitted before a Present is done once the server has presented it
+    const uint32_t completed = table.completedFrames.load(std::memory_order_acquire);
+    if ((int32_t) (completed - m_issueFrame) <= 0) {
+      return S_FALSE;
+    }
+    if (pData != nullptr && dwSize >= sizeof(BOOL)) {
+      *static_cast<BOOL*>(pData) = TRUE;
+    }
+    return S_OK;
+  }
+
+  const auto& slot = table.slots[m_slot];
+  if (slot.sequence.load(std::memory_order_acquire) != m_sequence) {
+    // The server only publishes results that were ready at a Present, ask it
+    // directly so that a query polled before the next Present still completes
+    bAnswered = false;
+    return S_FALSE;
+  }
+  if (pData != nullptr && dwSize >= sizeof(DWORD)) {
+    *static_cast<DWORD*>(pData) = slot.result;
+  }
+  return S_OK;
+}
+
 HRESULT Direct3DQuery9_LSS::GetData(void* pData, DWORD dwSize, DWORD dwGetDataFlags) {
   LogFunctionCall();
 
+  if (isEmulated()) {
+    bool bAnswered;
+    const HRESULT hresult = getEmulatedData(pData, dwSize, bAnswered);
+    if (bAnswered) {
+      return hresult;
+    }
+  }
+
+  return getServerData(pData, dwSize, dwGetDataFlags);
+}
+
+HRESULT Direct3DQuery9_LSS::getServerData(void* pData, DWORD dwSize, DWORD dwGetDataFlags) {
   UID currentUID = 0;
   {
     ClientMessage c(Commands::IDirect3DQuery9_GetData, getId());
@@ -24,11 +24,22 @@
 #include "d3d9_util.h"
 #include "base.h"
 #include "d3d9_device_base.h"
+#include "util_queryresults.h"
 
 class Direct3DQuery9_LSS: public D3DBase<IDirect3DQuery9> {
   void onDestroy() override;
   D3DQUERYTYPE m_type;
 
+  // Query emulation state, see GlobalOptions::getEmulateQueries()
+  static constexpr uint32_t kNotIssued = (uint32_t) -1;
+  uint32_t m_slot = bridge_util::QueryResults::kInvalidSlot;
+  uint32_t m_sequence = 0;
+  uint32_t m_issueFrame = kNotIssued;
+
+  bool isEmulated() const;
+  HRESULT getEmulatedData(void* pData, DWORD dwSize, bool& bAnswered) const;
+  HRESULT getServerData(void* pData, DWORD dwSize, DWORD dwGetDataFlags);
+
 protected:
   BaseDirect3DDevice9Ex_LSS* const m_pDevice = nullptr;
 public:
@@ -49,4 +60,7 @@ public:
   STDMETHOD_(DWORD, GetDataSize)(THIS);
   STDMETHOD(Issue)(THIS_ DWORD dwIssueFlags);
   STDMETHOD(GetData)(THIS_ void* pData, DWORD dwSize, DWORD dwGetDataFlags);
+
+  // Counts Presents sent to the server, must be called for every Present
+  static void onPresentSubmitted();
 };
@@ -69,42 +69,44 @@ HRESULT Direct3DStateBlock9_LSS::GetDevice(IDirect3DDevice9** ppDevice) {
   return S_OK;
 }
 
-void Direct3DStateBlock9_LSS::StateTransfer(const BaseDirect3DDevice9Ex_LSS::StateCaptureDirtyFlags& flags, BaseDirect3DDevice9Ex_LSS::State& src, BaseDirect3DDevice9Ex_LSS::State& dst) {
-  for (size_t i = 0; i < dst.renderStates.size(); i++) {
-    if (flags.renderStates[i]) {
-      dst.renderStates[i] = src.renderStates[i];
-    }
+namespace {
+  // Copies one bit per set flag between bool constant words
+  template<typename FlagsT>
+  void transferBoolConstants(const FlagsT& flags, const uint32_t* src, uint32_t* dst) {
+    flags.forEachSet([&](const size_t i) {
+      const size_t dwordIndex = i / 32;
+      const uint32_t bitMask = 1 << (i % 32);
+      dst[dwordIndex] = (src[dwordIndex] & bitMask) ? dst[dwordIndex] | bitMask : dst[dwordIndex] & ~bitMask;
+    });
   }
+}
+
+void Direct3DStateBlock9_LSS::StateTransfer(const BaseDirect3DDevice9Ex_LSS::StateCaptureDirtyFlags& flags, BaseDirect3DDevice9Ex_LSS::State& src, BaseDirect3DDevice9Ex_LSS::State& dst) {
+  flags.renderStates.forEachSet([&](const size_t i) {
+    dst.renderStates[i] = src.renderStates[i];
+  });
   if (flags.vertexDecl) {
     dst.vertexDecl = src.vertexDecl;
   }
   if (flags.indices) {
     dst.indices = src.indices;
   }
-  for (int i = 0; i < flags.samplerStates.size(); i++) {
-    for (int j = 0; j < flags.samplerStates[i].size(); j++) {
-      if (flags.samplerStates[i][j]) {
-        dst.samplerStates[i][j] = src.samplerStates[i][j];
-      }
-    }
-  }
-  for (int i = 0; i < flags.streams.size(); i++) {
-    if (flags.streams[i]) {
-      dst.streams[i] = src.streams[i];
-      dst.streamOffsets[i] = src.streamOffsets[i];
-      dst.streamStrides[i] = src.streamStrides[i];
-    }
-  }
-  for (int i = 0; i < flags.streamFreqs.size(); i++) {
-    if (flags.streamFreqs[i]) {
-      dst.streamFreqs[i] = src.streamFreqs[i];
-    }
-  }
-  for (int i = 0; i < flags.textures.size(); i++) {
-    if (flags.textures[i]) {
-      dst.textures[i] = src.textures[i];
-    }
-  }
+  for (size_t i = 0; i < flags.samplerStates.size(); i++) {
+    flags.samplerStates[i].forEachSet([&](const size_t j) {
+      dst.samplerStates[i][j] = src.samplerStates[i][j];
+    });
+  }
+  flags.streams.forEachSet([&](const size_t i) {
+    dst.streams[i] = src.streams[i];
+    dst.streamOffsets[i] = src.streamOffsets[i];
+    dst.streamStrides[i] = src.streamStrides[i];
+  });
+  flags.streamFreqs.forEachSet([&](const size_t i) {
+    dst.streamFreqs[i] = src.streamFreqs[i];
+  });
+  flags.textures.forEachSet([&](const size_t i) {
+    dst.textures[i] = src.textures[i];
+  });
   if (flags.vertexShader) {
     dst.vertexShader = src.vertexShader;
   }
@@ -114,75 +116,69 @@ void Direct3DStateBlock9_LSS::StateTransfer(const BaseDirect3DDevice9Ex_LSS::Sta
   if (flags.material) {
     dst.material = src.material;
   }
-  for (const auto& [key, value] : flags.lights) {
-    dst.lights[key] = src.lights[key];
-  }
-  for (const auto& [key, value] : flags.bLightEnables) {
-    dst.bLightEnables[key] = src.bLightEnables[key];
-  }
-  for (int i = 0; i < flags.transforms.size(); i++) {
-    if (flags.transforms[i]) {
-      dst.transforms[i] = src.transforms[i];
+  flags.lights.forEachSet([&](const size_t i) {
+    if (src.lightDefined[i]) {
+      dst.lights[i] = src.lights[i];
+      dst.lightDefined[i] = true;
     }
-  }
-  for (int i = 0; i < flags.textureStageStates.size(); i++) {
-    for (int j = 0; j < flags.textureStageStates[i].size(); j++) {
-      if (flags.textureStageStates[i][j]) {
-        dst.textureStageStates[i][j] = src.textureStageStates[i][j];
+  });
+  flags.bLightEnables.forEachSet([&](const size_t i) {
+    dst.bLightEnables[i] = src.bLightEnables[i];
+  });
+  if (flags.allExtraLights) {
+    for (const auto& [index, light] : src.extraLights) {
+      dst.extraLights[index] = light;
+    }
+    for (const auto& [index, bEnable] : src.extraLightEnables) {
+      dst.extraLightEnables[index] = bEnable;
+    }
+  } else {
+    for (const DWORD index : flags.extraLights) {
+      const auto it = src.extraLights.find(index);
+      if (it != src.extraLights.end()) {
+        dst.extraLights[index] = it->second;
+      }
+    }
+    for (const DWORD index : flags.extraLightEnables) {
+      const auto it = src.extraLightEnables.find(index);
+      if (it != src.extraLightEnables.end()) {
+        dst.extraLightEnables[index] = it->second;
       }
     }
   }
+  flags.transforms.forEachSet([&](const size_t i) {
+    dst.transforms[i] = src.transforms[i];
+  });
+  for (size_t i = 0; i < flags.textureStageStates.size(); i++) {
+    flags.textureStageStates[i].forEachSet([&](const size_t j) {
+      dst.textureStageStates[i][j] = src.textureStageStates[i][j];
+    });
+  }
   if (flags.viewport) {
     dst.viewport = src.viewport;
   }
   if (flags.scissorRect) {
     dst.scissorRect = src.scissorRect;
   }
-  for (int i = 0; i < flags.clipPlanes.size(); i++) {
-    if (flags.clipPlanes[i]) {
-      for (int j = 0; j < 4; j++) {
-        dst.clipPlanes[i][j] = src.clipPlanes[i][j];
-      }
-    }
-  }
-  for (int i = 0; i < flags.vertexConstants.fConsts.size(); i++) {
-    if (flags.vertexConstants.fConsts[i]) {
-      dst.vertexConstants.fConsts[i] = src.vertexConstants.fConsts[i];
-    }
-  }
-  for (int i = 0; i < flags.vertexConstants.iConsts.size(); i++) {
-    if (flags.vertexConstants.iConsts[i]) {
-      dst.vertexConstants.iConsts[i] = src.vertexConstants.iConsts[i];
+  flags.clipPlanes.forEachSet([&](const size_t i) {
+    for (int j = 0; j < 4; j++) {
+      dst.clipPlanes[i][j] = src.clipPlanes[i][j];
     }
-  }
-  for (int i = 0; i < flags.vertexConstants.bConsts.size(); i++) {
-    if (flags.vertexConstants.bConsts[i]) {
-      size_t dwordIndex = i / 32;
-      size_t dwordOffset = i % 32;
-      uint32_t bitMask = 1 << dwordOffset;
-      dst.vertexConstants.bConsts[dwordIndex]
-        = (src.vertexConstants.bConsts[dwordIndex] & bitMask) ? dst.vertexConstants.bConsts[dwordIndex] | bitMask : dst.vertexConstants.bConsts[dwordIndex] & ~bitMask;
-    }
-  }
-  for (int i = 0; i < flags.pixelConstants.fConsts.size(); i++) {
-    if (flags.pixelConstants.fConsts[i]) {
-      dst.pixelConstants.fConsts[i] = src.pixelConstants.fConsts[i];
-    }
-  }
-  for (int i = 0; i < flags.pixelConstants.iConsts.size(); i++) {
-    if (flags.pixelConstants.iConsts[i]) {
-      dst.pixelConstants.iConsts[i] = src.pixelConstants.iConsts[i];
-    }
-  }
-  for (int i = 0; i < flags.pixelConstants.bConsts.size(); i++) {
-    if (flags.pixelConstants.bConsts[i]) {
-      size_t dwordIndex = i / 32;
-      size_t dwordOffset = i % 32;
-      uint32_t bitMask = 1 << dwordOffset;
-      dst.pixelConstants.bConsts[dwordIndex]
-        = (src.pixelConstants.bConsts[dwordIndex] & bitMask) ? dst.pixelConstants.bConsts[dwordIndex] | bitMask : dst.pixelConstants.bConsts[dwordIndex] & ~bitMask;
-    }
-  }
+  });
+  flags.vertexConstants.fConsts.forEachSet([&](const size_t i) {
+    dst.vertexConstants.fConsts[i] = src.vertexConstants.fConsts[i];
+  });
+  flags.vertexConstants.iConsts.forEachSet([&](const size_t i) {
+    dst.vertexConstants.iConsts[i] = src.vertexConstants.iConsts[i];
+  });
+  transferBoolConstants(flags.vertexConstants.bConsts, src.vertexConstants.bConsts, dst.vertexConstants.bConsts);
+  flags.pixelConstants.fConsts.forEachSet([&](const size_t i) {
+    dst.pixelConstants.fConsts[i] = src.pixelConstants.fConsts[i];
+  });
+  flags.pixelConstants.iConsts.forEachSet([&](const size_t i) {
+    dst.pixelConstants.iConsts[i] = src.pixelConstants.iConsts[i];
+  });
+  transferBoolConstants(flags.pixelConstants.bConsts, src.pixelConstants.bConsts, dst.pixelConstants.bConsts);
 }
 
 void Direct3DStateBlock9_LSS::LocalCapture() {
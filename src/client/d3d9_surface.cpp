@@ -22,14 +22,18 @@
 #include "pch.h"
 
 #include "d3d9_lss.h"
+#include "bulk_lane.h"
 #include "d3d9_util.h"
 #include "d3d9_surface.h"
 #include "d3d9_texture.h"
 #include "d3d9_cubetexture.h"
 
 #include "util_bridge_assert.h"
+#include "util_bulkcommand.h"
 #include "util_gdi.h"
 
+#include <thread>
+
 Direct3DSurface9_LSS::Direct3DSurface9_LSS(BaseDirect3DDevice9Ex_LSS* const pDevice,
                                            const D3DSURFACE_DESC& desc)
   : Direct3DResource9_LSS((IDirect3DSurface9*)nullptr, pDevice)
@@ -38,11 +42,18 @@ Direct3DSurface9_LSS::Direct3DSurface9_LSS(BaseDirect3DDevice9Ex_LSS* const pDev
 }
 
 Direct3DSurface9_LSS::~Direct3DSurface9_LSS() {
+  // The server handles deallocations in order, so any readback still in flight
+  // completes before the memory can be handed out again.
+  for (const auto& readback : m_readbacks) {
+    if (readback.bufId != SharedHeap::kInvalidId) {
+      SharedHeap::deallocate(readback.bufId);
+    }
+  }
   if (m_bUseSharedHeap) {
     if (m_bufferId != SharedHeap::kInvalidId) {
       SharedHeap::deallocate(m_bufferId);
     }
-  } else if (m_shadow) {
+  } else if (m_shadow || m_pTrackedShadow) {
     const auto surfaceSize =
       bridge_util::calcTotalSizeOfRect(m_desc.Width, m_desc.Height, m_desc.Format);
 
@@ -189,6 +200,7 @@ HRESULT Direct3DSurface9_LSS::ReleaseDC(HDC hdc) {
 }
 
 bool Direct3DSurface9_LSS::lock(D3DLOCKED_RECT& lockedRect, const RECT* pRect, const DWORD& flags) {
+  resolveAsyncReadback();
   const RECT rect = resolveLockInfoRect(pRect, m_desc);
   lockedRect.Pitch = bridge_util::calcRowSize(m_desc.Width, m_desc.Format);
   const auto surfaceSize =
@@ -206,17 +218,9 @@ bool Direct3DSurface9_LSS::lock(D3DLOCKED_RECT& lockedRect, const RECT* pRect, c
     lockedRect.pBits = getBufPtr(lockedRect.Pitch, rect);
     m_lockInfoQueue.push({ lockedRect, rect, flags, m_bufferId, discardBufId });
   } else {
-    if (!m_shadow) {
-      m_shadow.reset(new uint8_t[surfaceSize]);
-      g_totalSurfaceShadow += surfaceSize;
-      Logger::debug(format_string("Allocated a shadow for surface [%p] "
-                                  "(size: %zd, total surface shadow size: %zd)",
-                                  this, surfaceSize, g_totalSurfaceShadow));
-    }
-
     const size_t byteOffset = bridge_util::calcImageByteOffset(lockedRect.Pitch, rect, m_desc.Format);
 
-    lockedRect.pBits = m_shadow.get() + byteOffset;
+    lockedRect.pBits = getShadow() + byteOffset;
     m_lockInfoQueue.push({ lockedRect, rect, flags });
   }
   return true;
@@ -231,7 +235,11 @@ void Direct3DSurface9_LSS::unlock() {
   m_lockInfoQueue.pop();
   // If this is a read only access then don't bother sending anything to the server
   if ((lockInfo.flags & D3DLOCK_READONLY) == 0) {
-    sendDataToServer(lockInfo);
+    if (m_pTrackedShadow) {
+      sendWrittenRowsToServer(lockInfo);
+    } else {
+      sendDataToServer(lockInfo);
+    }
   }
 }
 
@@ -247,29 +255,69 @@ void* Direct3DSurface9_LSS::getBufPtr(const int pitch, const RECT& rect) {
   return ptr;
 }
 
+void Direct3DSurface9_LSS::sendWrittenRowsToServer(const LockInfo& lockInfo) const {
+  static thread_local std::vector<WriteTrackedShadow::Range> ranges;
+  const uint32_t blockSize = bridge_util::getBlockSize(m_desc.Format);
+  const size_t pitch = lockInfo.lockedRect.Pitch;
+  const size_t firstRow = bridge_util::calcStride(lockInfo.rect.top, m_desc.Format);
+  const size_t endRow = bridge_util::calcStride(lockInfo.rect.bottom, m_desc.Format);
+
+  ranges.clear();
+  m_pTrackedShadow->consumeWrittenRanges(firstRow * pitch, (endRow - firstRow) * pitch, ranges);
+
+  // Turn the written byte ranges into bands of whole (block) rows of the locked rect
+  size_t bandBegin = 0;
+  size_t bandEnd = 0;
+  auto sendBand = [&]() {
+    LockInfo bandInfo = lockInfo;
+    bandInfo.rect.top = std::max<LONG>(lockInfo.rect.top, (LONG) (bandBegin * blockSize));
+    bandInfo.rect.bottom = std::min<LONG>(lockInfo.rect.bottom, (LONG) (bandEnd * blockSize));
+    bandInfo.lockedRect.pBits = (uint8_t*) lockInfo.lockedRect.pBits + (bandBegin - firstRow) * pitch;
+    // The server copy keeps everything that was not written, so nothing may be discarded
+    bandInfo.flags &= ~D3DLOCK_DISCARD;
+    sendDataToServer(bandInfo);
+  };
+  for (const auto& range : ranges) {
+    const size_t rowBegin = range.offset / pitch;
+    const size_t rowEnd = (range.offset + range.size + pitch - 1) / pitch;
+    if (bandEnd != bandBegin && rowBegin <= bandEnd) {
+      bandEnd = std::max(bandEnd, rowEnd);
+      continue;
+    }
+    if (bandEnd != bandBegin) {
+      sendBand();
+    }
+    bandBegin = rowBegin;
+    bandEnd = rowEnd;
+  }
+  if (bandEnd != bandBegin) {
+    sendBand();
+  }
+}
+
+bool Direct3DSurface9_LSS::canUseBulkLane(const LockInfo& lockInfo) const {
+  const auto [width, height] = getRectDimensions(lockInfo.rect);
+  return BulkLane::canUpload(bridge_util::calcTotalSizeOfRect(width, height, m_desc.Format));
+}
+
 void Direct3DSurface9_LSS::sendDataToServer(const LockInfo& lockInfo) const {
+  // Texture uploads that are not placed in the shared heap may bypass the device commands
+  if (m_bulkResourceId != 0 && !m_bUseSharedHeap && BulkLane::isEnabled() && canUseBulkLane(lockInfo)) {
+    BulkLane::beginUpload();
+    uint32_t token = 0;
+    {
+      BulkClientCommand c(Commands::IDirect3DSurface9_UnlockRect, getId());
+      token = (uint32_t) c.get_uid() + 1;
+      sendUnlockRect(c, lockInfo);
+    }
+    BulkLane::endUpload(m_bulkResourceId, token);
+    return;
+  }
+
   const auto dataFlag = m_bUseSharedHeap ? Commands::FlagBits::DataInSharedHeap : 0;
   {
     ClientMessage c(Commands::IDirect3DSurface9_UnlockRect, getId(), dataFlag);
-    c.send_data(sizeof(RECT), &lockInfo.rect);
-    c.send_data(lockInfo.flags);
-    c.send_data(m_desc.Format);
-    if (m_bUseSharedHeap) {
-      c.send_data(lockInfo.lockedRect.Pitch);
-      c.send_data(lockInfo.bufId);
-    } else {
-      const auto [width, height] = getRectDimensions(lockInfo.rect);
-      const size_t totalSize = bridge_util::calcTotalSizeOfRect(width, height, m_desc.Format);
-      const size_t rowSize = bridge_util::calcRowSize(width, m_desc.Format);
-      c.send_data(rowSize);
-      if (auto* blobPacketPtr = c.begin_data_blob(totalSize)) {
-        FOR_EACH_RECT_ROW(lockInfo.lockedRect, height, m_desc.Format, {
-          memcpy(blobPacketPtr, ptr, rowSize);
-          blobPacketPtr += rowSize;
-        });
-        c.end_data_blob();
-      }
-    }
+    sendUnlockRect(c, lockInfo);
   }
 
   if (m_bUseSharedHeap) {
@@ -279,6 +327,143 @@ void Direct3DSurface9_LSS::sendDataToServer(const LockInfo& lockInfo) const {
   }
 }
 
+template<typename CommandT>
+void Direct3DSurface9_LSS::sendUnlockRect(CommandT& c, const LockInfo& lockInfo) const {
+  c.send_data(sizeof(RECT), &lockInfo.rect);
+  c.send_data(lockInfo.flags);
+  c.send_data(m_desc.Format);
+  if (m_bUseSharedHeap) {
+    c.send_data(lockInfo.lockedRect.Pitch);
+    c.send_data(lockInfo.bufId);
+  } else {
+    const auto [width, height] = getRectDimensions(lockInfo.rect);
+    const size_t totalSize = bridge_util::calcTotalSizeOfRect(width, height, m_desc.Format);
+    const size_t rowSize = bridge_util::calcRowSize(width, m_desc.Format);
+    c.send_data(rowSize);
+    if (auto* blobPacketPtr = c.begin_data_blob(totalSize)) {
+      FOR_EACH_RECT_ROW(lockInfo.lockedRect, height, m_desc.Format, {
+        memcpy(blobPacketPtr, ptr, rowSize);
+        blobPacketPtr += rowSize;
+      });
+      c.end_data_blob();
+    }
+  }
+}
+
+uint8_t* Direct3DSurface9_LSS::getShadow() {
+  if (!m_shadow && !m_pTrackedShadow) {
+    const auto surfaceSize =
+      bridge_util::calcTotalSizeOfRect(m_desc.Width, m_desc.Height, m_desc.Format);
+    if (WriteTrackedShadow::isEnabled(surfaceSize)) {
+      m_pTrackedShadow = std::make_unique<WriteTrackedShadow>(surfaceSize);
+    } else {
+      m_shadow = ShadowArena::makeShadow(surfaceSize);
+    }
+    g_totalSurfaceShadow += surfaceSize;
+    Logger::debug(format_string("Allocated a shadow for surface [%p] "
+                                "(size: %zd, total surface shadow size: %zd)",
+                                this, surfaceSize, g_totalSurfaceShadow));
+  }
+  return m_pTrackedShadow ? m_pTrackedShadow->data() : m_shadow.get();
+}
+
+std::tuple<SharedHeap::AllocId, uint32_t> Direct3DSurface9_LSS::beginAsyncReadback() {
+  const uint32_t slot = m_latestReadback ^ 1;
+  Readback& readback = m_readbacks[slot];
+  if (readback.bufId == SharedHeap::kInvalidId) {
+    const auto surfaceSize =
+      bridge_util::calcTotalSizeOfRect(m_desc.Width, m_desc.Height, m_desc.Format);
+    readback.bufId = SharedHeap::allocate(kReadbackDataOffset + surfaceSize);
+    if (readback.bufId == SharedHeap::kInvalidId) {
+      return { SharedHeap::kInvalidId, 0 };
+    }
+    // SharedHeap memory is not cleared, a stale fence could match the one handed out below
+    reinterpret_cast<ReadbackHeader*>(SharedHeap::getBuf(readback.bufId))->fence.store(0);
+  }
+  readback.fence = ++m_readbackFenceCounter;
+  readback.bPending = true;
+  m_latestReadback = slot;
+  return { readback.bufId, readback.fence };
+}
+
+bool Direct3DSurface9_LSS::isReadbackDone(const Readback& readback) const {
+  const auto* const pHeader = reinterpret_cast<const ReadbackHeader*>(SharedHeap::getBuf(readback.bufId));
+  return pHeader->fence.load(std::memory_order_acquire) == readback.fence;
+}
+
+bool Direct3DSurface9_LSS::waitForReadback(const Readback& readback) const {
+  if (isReadbackDone(readback)) {
+    return true;
+  }
+  ZoneScoped;
+  const uint64_t timeoutMs = (uint64_t) GlobalOptions::getCommandTimeout() * GlobalOptions::getCommandRetries();
+  const uint64_t start = GetTickCount64();
+  while (!isReadbackDone(readback)) {
+    if (!gbBridgeRunning || GetTickCount64() - start > timeoutMs) {
+      Logger::err("Timed out waiting for the server to complete a surface readback.");
+      return false;
+    }
+    std::this_thread::yield();
+  }
+  return true;
+}
+
+void Direct3DSurface9_LSS::copyReadbackToSurface(const Readback& readback) {
+  const BYTE* const pBuf = SharedHeap::getBuf(readback.bufId);
+  const HRESULT result = reinterpret_cast<const ReadbackHeader*>(pBuf)->result;
+  if (FAILED(result)) {
+    Logger::warn(format_string("Asynchronous surface readback failed on the server: 0x%x", result));
+    return;
+  }
+  const auto surfaceSize =
+    bridge_util::calcTotalSizeOfRect(m_desc.Width, m_desc.Height, m_desc.Format);
+  uint8_t* pDst = nullptr;
+  if (m_bUseSharedHeap) {
+    if (m_bufferId == SharedHeap::kInvalidId) {
+      m_bufferId = SharedHeap::allocate(surfaceSize);
+      if (m_bufferId == SharedHeap::kInvalidId) {
+        return;
+      }
+    }
+    pDst = SharedHeap::getBuf(m_bufferId);
+  } else {
+    pDst = getShadow();
+  }
+  // Both sides store the surface rows tightly packed
+  memcpy(pDst, pBuf + kReadbackDataOffset, surfaceSize);
+  if (m_pTrackedShadow) {
+    // The server already holds this data
+    m_pTrackedShadow->resetTracking();
+  }
+}
+
+void Direct3DSurface9_LSS::resolveAsyncReadback() {
+  Readback& latest = m_readbacks[m_latestReadback];
+  if (!latest.bPending) {
+    return;
+  }
+  if (ClientOptions::getAsyncReadbackAllowPreviousFrame() && !isReadbackDone(latest)) {
+    // Rather than waiting, serve the readback before the latest one if it has
+    // landed already, or keep what the surface holds from it.
+    Readback& previous = m_readbacks[m_latestReadback ^ 1];
+    if (!previous.bPending) {
+      return;
+    }
+    if (isReadbackDone(previous)) {
+      copyReadbackToSurface(previous);
+      previous.bPending = false;
+      return;
+    }
+  }
+  if (waitForReadback(latest)) {
+    copyReadbackToSurface(latest);
+  }
+  // Anything older than the latest readback is superseded now
+  for (auto& readback : m_readbacks) {
+    readback.bPending = false;
+  }
+}
+
 std::tuple<size_t, size_t> Direct3DSurface9_LSS::getRectDimensions(const RECT& rect) {
   return { rect.right  - rect.left,
            rect.bottom - rect.top  };
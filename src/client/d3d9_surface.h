@@ -25,9 +25,14 @@
 
 #include <unknwn.h>
 #include <d3d9.h>
+#include "client_options.h"
 #include "util_gdi.h"
+#include "util_readback.h"
+#include "shadow_arena.h"
+#include "write_tracked_shadow.h"
 
 #include <queue>
+#include <tuple>
 
 /*
  * IDirect3DSurface9 LSS Interceptor Class
@@ -39,6 +44,8 @@ class Direct3DSurface9_LSS: public Direct3DResource9_LSS<IDirect3DSurface9> {
   const bool m_bUseSharedHeap = false;
   gdi::D3DKMT_DESTROYDCFROMMEMORY m_dcDesc;
   SharedHeap::AllocId m_bufferId = SharedHeap::kInvalidId;
+  // Texture that uploads to this surface are tracked under on the bulk lane, 0 if none
+  size_t m_bulkResourceId = 0;
   struct LockInfo {
     D3DLOCKED_RECT lockedRect;
     RECT rect;
@@ -48,9 +55,21 @@ class Direct3DSurface9_LSS: public Direct3DResource9_LSS<IDirect3DSurface9> {
   };
   std::queue<LockInfo> m_lockInfoQueue;
 
-  std::unique_ptr<uint8_t[]> m_shadow;
+  ShadowArena::Shadow m_shadow;
+  std::unique_ptr<WriteTrackedShadow> m_pTrackedShadow;
   inline static size_t g_totalSurfaceShadow = 0;
 
+  // Asynchronous GetRenderTargetData()/GetFrontBufferData() results, double
+  // buffered so the server can fill one while the client reads the other
+  struct Readback {
+    SharedHeap::AllocId bufId = SharedHeap::kInvalidId;
+    uint32_t fence = 0;
+    bool bPending = false; // Not yet copied into the surface
+  };
+  Readback m_readbacks[2];
+  uint32_t m_latestReadback = 0;
+  uint32_t m_readbackFenceCounter = 0;
+
 public:
   Direct3DSurface9_LSS(BaseDirect3DDevice9Ex_LSS* const pDevice,
                        const D3DSURFACE_DESC& desc);
@@ -62,6 +81,9 @@ public:
     : Direct3DResource9_LSS((IDirect3DSurface9*)nullptr, pDevice, pContainer)
     , m_bUseSharedHeap(GlobalOptions::getUseSharedHeapForTextures())
     , m_desc(desc) {
+    if constexpr (std::is_base_of_v<IDirect3DBaseTexture9, ContainerType>) {
+      m_bulkResourceId = pContainer->getId();
+    }
   }
 
   ~Direct3DSurface9_LSS();
@@ -87,12 +109,34 @@ public:
     return m_desc;
   }
 
+  size_t getBulkResourceId() const {
+    return m_bulkResourceId;
+  }
+
+  static bool useAsyncReadback() {
+    return GlobalOptions::getUseSharedHeap() && ClientOptions::getAsyncReadback();
+  }
+
+  // Reserves the readback slot for the next asynchronous readback into this
+  // surface, returns the SharedHeap allocation and fence value to send along
+  // with the command.
+  std::tuple<SharedHeap::AllocId, uint32_t> beginAsyncReadback();
+
 private:
   /*** Lock/Unlock Functionality ***/
   bool lock(D3DLOCKED_RECT& lockedRect, const RECT* pRect, const DWORD& flags);
   void unlock();
   static RECT resolveLockInfoRect(const RECT* const pRect, const D3DSURFACE_DESC& desc);
   void* getBufPtr(const int pitch, const RECT& rect);
+  bool canUseBulkLane(const LockInfo& lockInfo) const;
   void sendDataToServer(const LockInfo& lockInfo) const;
+  template<typename CommandT>
+  void sendUnlockRect(CommandT& c, const LockInfo& lockInfo) const;
+  void sendWrittenRowsToServer(const LockInfo& lockInfo) const;
+  uint8_t* getShadow();
+  void resolveAsyncReadback();
+  bool waitForReadback(const Readback& readback) const;
+  bool isReadbackDone(const Readback& readback) const;
+  void copyReadbackToSurface(const Readback& readback);
   static std::tuple<size_t, size_t> getRectDimensions(const RECT& box);
 };
\ No newline at end of file
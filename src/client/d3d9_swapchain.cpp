@@ -21,6 +21,7 @@
  */
 #include "pch.h"
 #include "d3d9_lss.h"
+#include "d3d9_device.h"
 #include "d3d9_swapchain.h"
 #include "d3d9_surface.h"
 #include "d3d9_surfacebuffer_helper.h"
@@ -103,6 +104,11 @@ HRESULT Direct3DSwapChain9_LSS::Present(CONST RECT* pSourceRect, CONST RECT* pDe
     return ERROR_SEM_TIMEOUT;
   }
 
+  const auto deferredResult = checkDeferredErrors();
+  if (FAILED(deferredResult)) {
+    return deferredResult;
+  }
+
   FrameMark;
 
   return D3D_OK;
@@ -114,6 +120,15 @@ HRESULT Direct3DSwapChain9_LSS::GetFrontBufferData(IDirect3DSurface9* pDestSurfa
   const auto pLssDestinationSurface = bridge_cast<Direct3DSurface9_LSS*>(pDestSurface);
   const auto pIDestinationSurface = pLssDestinationSurface->D3D<IDirect3DSurface9>();
 
+  if (Direct3DSurface9_LSS::useAsyncReadback()) {
+    const auto [bufId, fence] = pLssDestinationSurface->beginAsyncReadback();
+    if (bufId != SharedHeap::kInvalidId) {
+      ClientMessage c(Commands::IDirect3DSwapChain9_GetFrontBufferData, getId(), Commands::FlagBits::DataInSharedHeap);
+      c.send_many((uint32_t) pIDestinationSurface, bufId, fence);
+      return D3D_OK;
+    }
+  }
+
   UID currentUID = 0;
   {
     ClientMessage c(Commands::IDirect3DSwapChain9_GetFrontBufferData, getId());
@@ -66,6 +66,7 @@ ULONG Direct3DTexture9_LSS::Release() {
 }
 
 void Direct3DTexture9_LSS::onDestroy() {
+  BulkLane::onDestroy(getId());
   ClientMessage { Commands::IDirect3DTexture9_Destroy, getId() };
 }
 
@@ -23,6 +23,7 @@
 
 #include "pch.h"
 
+#include "object_interner.h"
 #include "util_devicecommand.h"
 
 HRESULT Direct3DVertexDeclaration9_LSS::QueryInterface(REFIID riid, LPVOID* ppvObj) {
@@ -55,6 +56,12 @@ ULONG Direct3DVertexDeclaration9_LSS::Release() {
 }
 
 void Direct3DVertexDeclaration9_LSS::onDestroy() {
+  if (m_internHash != 0) {
+    ObjectInterner::destroy(m_internHash, [this]() {
+      ClientMessage { Commands::IDirect3DVertexDeclaration9_Destroy, getId() };
+    });
+    return;
+  }
   ClientMessage { Commands::IDirect3DVertexDeclaration9_Destroy, getId() };
 }
 
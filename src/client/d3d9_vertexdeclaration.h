@@ -30,6 +30,8 @@
 class Direct3DVertexDeclaration9_LSS: public D3DBase<IDirect3DVertexDeclaration9> {
   void onDestroy() override;
   std::vector<D3DVERTEXELEMENT9> m_elements;
+  // Content hash the object was interned under on the server, 0 if it was not
+  uint64_t m_internHash = 0;
 
 protected:
   BaseDirect3DDevice9Ex_LSS* const m_pDevice = nullptr;
@@ -54,4 +56,8 @@ public:
   /*** IDirect3DVertexDeclaration9 methods ***/
   STDMETHOD(GetDevice)(THIS_ IDirect3DDevice9** ppDevice);
   STDMETHOD(GetDeclaration)(THIS_ D3DVERTEXELEMENT9* pElement, UINT* pNumElements);
+
+  void setInternHash(const uint64_t hash) {
+    m_internHash = hash;
+  }
 };
\ No newline at end of file
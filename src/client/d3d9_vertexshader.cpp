@@ -22,6 +22,7 @@
 #include "pch.h"
 #include "d3d9_vertexshader.h"
 
+#include "object_interner.h"
 #include "util_devicecommand.h"
 
 HRESULT Direct3DVertexShader9_LSS::QueryInterface(REFIID riid, LPVOID* ppvObj) {
@@ -54,6 +55,12 @@ ULONG Direct3DVertexShader9_LSS::Release() {
 }
 
 void Direct3DVertexShader9_LSS::onDestroy() {
+  if (m_internHash != 0) {
+    ObjectInterner::destroy(m_internHash, [this]() {
+      ClientMessage { Commands::IDirect3DVertexShader9_Destroy, getId() };
+    });
+    return;
+  }
   ClientMessage { Commands::IDirect3DVertexShader9_Destroy, getId() };
 }
 
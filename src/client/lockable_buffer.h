@@ -23,11 +23,15 @@
 
 #include "util_bridgecommand.h"
 #include "util_sharedheap.h"
+#include "util_streammirror.h"
 
 #include "d3d9_util.h"
+#include "shadow_arena.h"
+#include "write_tracked_shadow.h"
 
 #include <d3d9.h>
 #include <queue>
+#include <thread>
 
 template <typename T>
 class LockableBuffer: public Direct3DResource9_LSS<T> {
@@ -48,11 +52,33 @@ class LockableBuffer: public Direct3DResource9_LSS<T> {
     uint32_t* checkPtr;
     SharedHeap::AllocId bufferId = SharedHeap::kInvalidId;
     SharedHeap::AllocId discardedBufferId = SharedHeap::kInvalidId;
+    int32_t streamMirror = -1;
   };
   std::queue<LockInfo> m_lockInfos;
 
+  // Dynamic buffers that are streamed into by appending with D3DLOCK_NOOVERWRITE get
+  // promoted to persistent shared heap mirrors, see client.streamingBufferMirrors.
+  // Mirrors rotate on D3DLOCK_DISCARD and when a D3DLOCK_NOOVERWRITE lock wraps back
+  // over earlier ranges, and a mirror is only reused from the start once the server
+  // consumed every range sent from it. A lock without either flag demotes the buffer
+  // back to regular locks.
+  static constexpr uint32_t kAppendLocksBeforePromotion = 8;
+  static constexpr uint32_t kNumStreamMirrors = 3;
+  struct StreamMirror {
+    SharedHeap::AllocId bufId = SharedHeap::kInvalidId;
+    uint32_t submittedSerial = 0;
+  };
+  bool m_bCanStream = false;
+  bool m_bStreaming = false;
+  uint32_t m_numAppendLocks = 0;
+  size_t m_appendEnd = 0;
+  StreamMirror m_streamMirrors[kNumStreamMirrors];
+  uint32_t m_activeMirror = 0;
+
   const bool m_bUseSharedHeap = false;
-  std::unique_ptr<uint8_t[]> m_shadow;
+  const bool m_bTrackWrites = false;
+  ShadowArena::Shadow m_shadow;
+  std::unique_ptr<WriteTrackedShadow> m_pTrackedShadow;
   inline static size_t g_totalBufferShadow = 0;
 
 public:
@@ -72,7 +98,11 @@ private:
   }
 
   void initShadowMem() {
-    m_shadow = std::make_unique<uint8_t[]>(m_desc.Size);
+    if (m_bTrackWrites) {
+      m_pTrackedShadow = std::make_unique<WriteTrackedShadow>(m_desc.Size);
+    } else {
+      m_shadow = ShadowArena::makeShadow(m_desc.Size);
+    }
     g_totalBufferShadow += m_desc.Size;
     Logger::debug(format_string("Allocated a shadow for dynamic %s buffer [%p] "
                                 "(size: %zd, total shadow size: %zd)",
@@ -80,6 +110,145 @@ private:
                                 this, m_desc.Size, g_totalBufferShadow));
   }
 
+  static bool getCanStream(const DescType& desc) {
+    return GlobalOptions::getUseSharedHeap() && ClientOptions::getStreamingBufferMirrors() &&
+      (desc.Usage & D3DUSAGE_DYNAMIC) != 0 && (desc.Usage & D3DUSAGE_WRITEONLY) != 0;
+  }
+
+  void trackAppendPattern(const UINT offset, const UINT size, const DWORD flags) {
+    const size_t end = (size == 0) ? m_desc.Size : (size_t) offset + size;
+    if ((flags & D3DLOCK_DISCARD) != 0) {
+      // Wrapping around is part of the pattern
+      m_appendEnd = end;
+    } else if ((flags & D3DLOCK_NOOVERWRITE) != 0 && offset >= m_appendEnd) {
+      ++m_numAppendLocks;
+      m_appendEnd = end;
+    } else {
+      m_numAppendLocks = 0;
+      m_appendEnd = end;
+    }
+  }
+
+  bool allocateStreamMirror(StreamMirror& mirror) {
+    mirror.bufId = SharedHeap::allocate(m_desc.Size + kStreamMirrorDataOffset);
+    if (mirror.bufId == SharedHeap::kInvalidId) {
+      return false;
+    }
+    mirror.submittedSerial = 0;
+    reinterpret_cast<StreamMirrorHeader*>(SharedHeap::getBuf(mirror.bufId))->consumedSerial.store(0);
+    return true;
+  }
+
+  bool isStreamMirrorConsumed(const StreamMirror& mirror) const {
+    const auto* const pHeader = reinterpret_cast<const StreamMirrorHeader*>(SharedHeap::getBuf(mirror.bufId));
+    return pHeader->consumedSerial.load(std::memory_order_acquire) == mirror.submittedSerial;
+  }
+
+  void waitForStreamMirror(const StreamMirror& mirror) const {
+    ZoneScoped;
+    const ULONGLONG start = GetTickCount64();
+    while (!isStreamMirrorConsumed(mirror)) {
+      if (GetTickCount64() - start > GlobalOptions::getAckTimeout() || !gbBridgeRunning) {
+        Logger::warn("Timed out waiting on the server to consume a streaming buffer mirror.");
+        return;
+      }
+      std::this_thread::yield();
+    }
+  }
+
+  void promoteToStreaming() {
+    if (!allocateStreamMirror(m_streamMirrors[0])) {
+      ONCE(Logger::warn("Unable to allocate a streaming buffer mirror on the SharedHeap, "
+                        "streaming buffers will keep using regular locks."));
+      m_bCanStream = false;
+      return;
+    }
+    m_activeMirror = 0;
+    m_bStreaming = true;
+    Logger::debug(format_string("Promoted dynamic %s buffer [%p] (size: %zd) to a streaming mirror",
+                                bIsVertexBuffer ? "vertex" : "index", this, m_desc.Size));
+  }
+
+  void rotateStreamMirror() {
+    // Prefer a mirror the server is done with, then a new one, and only wait as a last resort
+    for (uint32_t i = 1; i <= kNumStreamMirrors; ++i) {
+      const uint32_t index = (m_activeMirror + i) % kNumStreamMirrors;
+      const auto& mirror = m_streamMirrors[index];
+      if (mirror.bufId != SharedHeap::kInvalidId && isStreamMirrorConsumed(mirror)) {
+        m_activeMirror = index;
+        return;
+      }
+    }
+    for (uint32_t i = 1; i < kNumStreamMirrors; ++i) {
+      const uint32_t index = (m_activeMirror + i) % kNumStreamMirrors;
+      auto& mirror = m_streamMirrors[index];
+      if (mirror.bufId == SharedHeap::kInvalidId && allocateStreamMirror(mirror)) {
+        m_activeMirror = index;
+        return;
+      }
+    }
+    m_activeMirror = (m_activeMirror + 1) % kNumStreamMirrors;
+    if (m_streamMirrors[m_activeMirror].bufId == SharedHeap::kInvalidId) {
+      // Allocation failed above, keep streaming through the current mirror
+      m_activeMirror = (m_activeMirror + kNumStreamMirrors - 1) % kNumStreamMirrors;
+    }
+    waitForStreamMirror(m_streamMirrors[m_activeMirror]);
+  }
+
+  void demoteFromStreaming() {
+    // The server handles deallocations in order, after any unlock still reading a mirror
+    for (auto& mirror : m_streamMirrors) {
+      if (mirror.bufId != SharedHeap::kInvalidId) {
+        SharedHeap::deallocate(mirror.bufId);
+        mirror.bufId = SharedHeap::kInvalidId;
+      }
+    }
+    m_bStreaming = false;
+    m_numAppendLocks = 0;
+    m_appendEnd = 0;
+    Logger::debug(format_string("Demoted dynamic %s buffer [%p] from its streaming mirror",
+                                bIsVertexBuffer ? "vertex" : "index", this));
+  }
+
+  void lockStreaming(const UINT offset, const UINT size, void** ppbData, const DWORD flags) {
+    if ((flags & D3DLOCK_DISCARD) != 0) {
+      rotateStreamMirror();
+    } else if ((flags & D3DLOCK_NOOVERWRITE) != 0) {
+      if (offset < m_appendEnd) {
+        // Wrapped around without a discard, e.g. behind a fence. The server may not
+        // have copied the earlier ranges of this mirror yet, so move on to another one.
+        rotateStreamMirror();
+      }
+    } else if ((flags & D3DLOCK_READONLY) == 0) {
+      // Without NOOVERWRITE the application may write over ranges still in flight
+      waitForStreamMirror(m_streamMirrors[m_activeMirror]);
+    }
+    m_appendEnd = (size == 0) ? m_desc.Size : (size_t) offset + size;
+    const auto& mirror = m_streamMirrors[m_activeMirror];
+    *ppbData = SharedHeap::getBuf(mirror.bufId) + kStreamMirrorDataOffset + offset;
+    LockInfo lockInfo { offset, size, *ppbData, flags, nullptr };
+    lockInfo.streamMirror = (int32_t) m_activeMirror;
+    m_lockInfos.push(lockInfo);
+  }
+
+  uint8_t* getShadow() const {
+    return m_bTrackWrites ? m_pTrackedShadow->data() : m_shadow.get();
+  }
+
+  // Sends only the pages of the range the application wrote to, one unlock per run
+  void sendWrittenRanges(const uint32_t offset, const size_t size, const DWORD flags) {
+    static thread_local std::vector<WriteTrackedShadow::Range> ranges;
+    ranges.clear();
+    m_pTrackedShadow->consumeWrittenRanges(offset, size, ranges);
+    // The server copy keeps everything that was not written, so nothing may be discarded
+    const DWORD writeFlags = flags & ~D3DLOCK_DISCARD;
+    for (const auto& range : ranges) {
+      ClientMessage c(UnlockCmd, getId());
+      c.send_many((uint32_t) range.offset, (uint32_t) range.size, writeFlags);
+      c.send_data((uint32_t) range.size, getShadow() + range.offset);
+    }
+  }
+
 protected:
   const DescType m_desc;
   SharedHeap::AllocId m_bufferId = SharedHeap::kInvalidId;
@@ -90,19 +259,27 @@ protected:
     : Direct3DResource9_LSS<T>(pD3dBuf, pDevice)
     , m_desc(desc)
     , m_bUseSharedHeap(getSharedHeapPolicy(m_desc))
+    , m_bTrackWrites(!m_bUseSharedHeap && (desc.Usage & D3DUSAGE_DYNAMIC) == 0 && WriteTrackedShadow::isEnabled(desc.Size))
     , m_sendWhole((desc.Usage& D3DUSAGE_DYNAMIC) == 0 && GlobalOptions::getAlwaysCopyEntireStaticBuffer())
     , m_optimizedLock((desc.Usage& D3DUSAGE_DYNAMIC) != 0 && ClientOptions::getOptimizedDynamicLock()) {
+    m_bCanStream = getCanStream(desc);
     if (!m_bUseSharedHeap) {
       initShadowMem();
     }
   }
 
   ~LockableBuffer() {
+    // The server handles deallocations in order, after any unlock still reading a mirror
+    for (const auto& mirror : m_streamMirrors) {
+      if (mirror.bufId != SharedHeap::kInvalidId) {
+        SharedHeap::deallocate(mirror.bufId);
+      }
+    }
     if (m_bUseSharedHeap) {
       if (m_bufferId != SharedHeap::kInvalidId) {
         SharedHeap::deallocate(m_bufferId);
       }
-    } else if (m_shadow) {
+    } else if (getShadow() != nullptr) {
       g_totalBufferShadow -= m_desc.Size;
       Logger::debug(format_string("Released shadow of dynamic %s buffer [%p] "
                                   "(size: %zd, total shadow size: %zd)",
@@ -118,7 +295,20 @@ protected:
 
     uint32_t* checkPtr = nullptr;
 
-    if (m_bUseSharedHeap) {
+    if (m_bStreaming && (flags & (D3DLOCK_DISCARD | D3DLOCK_NOOVERWRITE)) == 0 && m_lockInfos.empty()) {
+      // The application stopped streaming into the buffer
+      demoteFromStreaming();
+    }
+    if (m_bCanStream && !m_bStreaming) {
+      trackAppendPattern(offset, size, flags);
+      if (m_numAppendLocks >= kAppendLocksBeforePromotion) {
+        promoteToStreaming();
+      }
+    }
+
+    if (m_bStreaming) {
+      lockStreaming(offset, size, ppbData, flags);
+    } else if (m_bUseSharedHeap) {
       SharedHeap::AllocId discardedBufferId = SharedHeap::kInvalidId;
       const bool bDiscard = (flags & D3DLOCK_DISCARD) != 0;
       if (bDiscard && (m_bufferId != SharedHeap::kInvalidId)) {
@@ -143,7 +333,7 @@ protected:
       *ppbData = SharedHeap::getBuf(m_bufferId) + offset;
       m_lockInfos.push({ offset, size, nullptr, flags, checkPtr, m_bufferId, discardedBufferId });
     } else {
-      *ppbData = m_shadow.get() + offset;
+      *ppbData = getShadow() + offset;
 
       if (m_optimizedLock) {
         const size_t dataSize = (size == 0) ? m_desc.Size : size;
@@ -185,12 +375,19 @@ protected:
     if (m_sendWhole) {
       size = m_desc.Size;
       offset = 0;
-      ptr = m_shadow.get();
+      ptr = getShadow();
     }
 
     // If this is a read only access then don't bother sending
     if ((lockInfo.flags & D3DLOCK_READONLY) == 0) {
-      {
+      if (lockInfo.streamMirror >= 0) {
+        auto& mirror = m_streamMirrors[lockInfo.streamMirror];
+        ClientMessage c(UnlockCmd, getId(), Commands::FlagBits::DataInStreamMirror);
+        c.send_many(offset, size, lockInfo.flags);
+        c.send_many(mirror.bufId, ++mirror.submittedSerial);
+      } else if (m_bTrackWrites) {
+        sendWrittenRanges(offset, size, lockInfo.flags);
+      } else {
         Commands::Flags cmdFlags = 0;
 
         if (m_bUseSharedHeap) {
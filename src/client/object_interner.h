@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) 2022-2023, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#pragma once
+
+#include "client_options.h"
+
+#include <mutex>
+#include <stdint.h>
+#include <unordered_map>
+
+// Reference counts of the shaders and vertex declarations the server holds as
+// interned objects, keyed by a hash of their contents. The first create of some
+// contents has the server intern the new object, every further create with the
+// same contents only sends the hash and the server hands out the existing object.
+// Creates and destroys are sent while the lock is held, so they reach the server
+// in the same order the counts change here. The first create of some contents
+// waits for the server, contents it failed to create are not counted so the next
+// create sends them again. See client.internShaders.
+class ObjectInterner {
+public:
+  static bool isEnabled() {
+    return ClientOptions::getInternShaders();
+  }
+
+  // Calls send(bInterned) for the create command, bInterned tells whether the
+  // server already holds an object with these contents. When it does not, wait()
+  // returns the result of the create on the server, which is returned here too.
+  template<typename SendFn, typename WaitFn>
+  static HRESULT create(const uint64_t hash, const SendFn& send, const WaitFn& wait) {
+    std::scoped_lock lock(s_mutex);
+    const bool bInterned = s_refCounts[hash]++ > 0;
+    send(bInterned);
+    if (bInterned) {
+      return S_OK;
+    }
+    const HRESULT hresult = wait();
+    if (FAILED(hresult)) {
+      s_refCounts.erase(hash);
+    }
+    return hresult;
+  }
+
+  // Calls send() for the destroy command of an object created with create()
+  template<typename SendFn>
+  static void destroy(const uint64_t hash, const SendFn& send) {
+    std::scoped_lock lock(s_mutex);
+    auto it = s_refCounts.find(hash);
+    if (it != s_refCounts.end() && --it->second == 0) {
+      s_refCounts.erase(it);
+    }
+    send();
+  }
+
+private:
+  ObjectInterner() = delete;
+
+  static inline std::mutex s_mutex;
+  static inline std::unordered_map<uint64_t, uint32_t> s_refCounts;
+};
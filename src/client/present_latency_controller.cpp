@@ -0,0 +1,100 @@
+/*
+ * Copyright (c) 2022-2023, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#include "present_latency_controller.h"
+
+#include "client_options.h"
+#include "config/global_options.h"
+#include "log/log.h"
+
+#include "../tracy/tracy.hpp"
+
+#include <algorithm>
+
+using namespace bridge_util;
+
+void PresentLatencyController::init(NamedSemaphore* pPresentSemaphore) {
+  if (!ClientOptions::getAdaptivePresentLatency() || !GlobalOptions::getPresentSemaphoreEnabled()) {
+    return;
+  }
+  s_pSemaphore = pPresentSemaphore;
+  // Handing out more frames than the semaphore can count would silently be dropped
+  s_maxFrames = std::min<uint32_t>(ClientOptions::getPresentLatencyMaxFrames(),
+                                   GlobalOptions::getPresentSemaphoreMaxFrames());
+  s_minFrames = std::min<uint32_t>(ClientOptions::getPresentLatencyMinFrames(), s_maxFrames);
+
+  LARGE_INTEGER frequency;
+  QueryPerformanceFrequency(&frequency);
+  s_frequency = frequency.QuadPart;
+
+  s_framesInFlight = s_minFrames;
+  if (s_framesInFlight > 0) {
+    s_pSemaphore->release(s_framesInFlight);
+  }
+  s_bEnabled = true;
+  Logger::info(format_string("Adaptive Present latency enabled, between %u and %u frames in flight.", s_minFrames, s_maxFrames));
+}
+
+void PresentLatencyController::onPresent(const int64_t stallTicks) {
+  if (!s_bEnabled) {
+    return;
+  }
+  LARGE_INTEGER now;
+  QueryPerformanceCounter(&now);
+  s_lastStallMs = 1000.0 * (double) stallTicks / (double) s_frequency;
+  TracyPlot("Present Stall (ms)", s_lastStallMs);
+
+  if (s_lastPresentTicks != 0) {
+    s_windowFrameTicks += now.QuadPart - s_lastPresentTicks;
+    s_windowStallTicks += stallTicks;
+    ++s_windowFrames;
+  }
+  s_lastPresentTicks = now.QuadPart;
+
+  if (s_windowFrames < kWindowFrames) {
+    return;
+  }
+  const double stallRatio = (double) s_windowStallTicks / (double) std::max<int64_t>(s_windowFrameTicks, 1);
+  if (stallRatio > kRaiseStallRatio && s_framesInFlight < s_maxFrames) {
+    raise();
+  } else if (stallRatio < kLowerStallRatio && s_framesInFlight > s_minFrames) {
+    lower();
+  }
+  s_windowFrameTicks = 0;
+  s_windowStallTicks = 0;
+  s_windowFrames = 0;
+  TracyPlot("Present Frames In Flight", (int64_t) s_framesInFlight);
+}
+
+void PresentLatencyController::raise() {
+  s_pSemaphore->release(1);
+  ++s_framesInFlight;
+  Logger::debug(format_string("Client stalled on Present, allowing %u frames in flight.", s_framesInFlight));
+}
+
+void PresentLatencyController::lower() {
+  // Take back one of the counts handed out earlier. The client did not stall in
+  // the last window so one is normally available, if not try again next window.
+  if (RESULT_SUCCESS(s_pSemaphore->wait(0))) {
+    --s_framesInFlight;
+    Logger::debug(format_string("Client ran ahead of the server, reducing to %u frames in flight.", s_framesInFlight));
+  }
+}
@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 2022-2023, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#pragma once
+
+#include "util_semaphore.h"
+
+#include <cstdint>
+
+// Adapts the number of frames the client may run ahead of the server on the
+// Present semaphore to the workload. Each frame the time the client spent
+// stalled in syncOnPresent() is compared with the time it took to submit the
+// frame: a client that keeps stalling gets another frame in flight to recover
+// throughput, and a client that never stalls gives one back to cut latency.
+//
+// Frames in flight are handed out as extra semaphore counts on top of the one
+// the server releases per Present, so the server side needs no changes.
+class PresentLatencyController {
+public:
+  static void init(bridge_util::NamedSemaphore* pPresentSemaphore);
+
+  // Called once per Present() with the time spent waiting on the semaphore
+  static void onPresent(const int64_t stallTicks);
+
+  static bool isEnabled() {
+    return s_bEnabled;
+  }
+  static uint32_t getFramesInFlight() {
+    return s_framesInFlight;
+  }
+  static double getLastStallMs() {
+    return s_lastStallMs;
+  }
+
+private:
+  static void raise();
+  static void lower();
+
+  // Number of frames over which stall and frame times are averaged before adjusting
+  static constexpr uint32_t kWindowFrames = 32;
+  // Stalling for more than this fraction of the frame time adds a frame in flight
+  static constexpr double kRaiseStallRatio = 0.05;
+  // Stalling for less than this fraction of the frame time removes one
+  static constexpr double kLowerStallRatio = 0.005;
+
+  static inline bridge_util::NamedSemaphore* s_pSemaphore = nullptr;
+  static inline bool s_bEnabled = false;
+  static inline uint32_t s_minFrames = 0;
+  static inline uint32_t s_maxFrames = 0;
+  static inline uint32_t s_framesInFlight = 0;
+  static inline double s_lastStallMs = 0.0;
+
+  static inline int64_t s_frequency = 1;
+  static inline int64_t s_lastPresentTicks = 0;
+  static inline int64_t s_windowFrameTicks = 0;
+  static inline int64_t s_windowStallTicks = 0;
+  static inline uint32_t s_windowFrames = 0;
+};
@@ -0,0 +1,162 @@
+/*
+ * Copyright (c) 2022-2023, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#include "pch.h"
+#include "shadow_arena.h"
+
+#include "client_options.h"
+#include "slab_allocator.h"
+#include "log/log.h"
+#include "util_common.h"
+
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <new>
+
+namespace {
+  constexpr size_t kPageSize = 4096;
+
+  std::mutex gMutex;
+  uint8_t* gpRegion = nullptr;
+  size_t gRegionSize = 0;
+  size_t gBytesCommitted = 0;
+  bool gbRegionInitialized = false;
+  bool gbExhaustedReported = false;
+  // Free page ranges of the region, offset to size, never adjacent to each other
+  std::map<size_t, size_t> gFreeRanges;
+
+  // Reserves the region on first use, since the options are not known at static init
+  bool initRegion() {
+    if (gbRegionInitialized) {
+      return gpRegion != nullptr;
+    }
+    gbRegionInitialized = true;
+    const size_t size = (size_t) ClientOptions::getShadowArenaSize() << 20;
+    if (size == 0) {
+      return false;
+    }
+    gpRegion = static_cast<uint8_t*>(VirtualAlloc(nullptr, size, MEM_RESERVE, PAGE_READWRITE));
+    if (gpRegion == nullptr) {
+      Logger::err(format_string("Unable to reserve a shadow arena of %zd bytes, error: %d", size, GetLastError()));
+      return false;
+    }
+    gRegionSize = size;
+    gFreeRanges[0] = size;
+    Logger::info(format_string("Reserved a shadow arena of %zd bytes at %p", size, gpRegion));
+    return true;
+  }
+
+  bool isInRegion(const uint8_t* ptr) {
+    return gpRegion != nullptr && ptr >= gpRegion && ptr < gpRegion + gRegionSize;
+  }
+
+  uint8_t* allocateFromRegion(const size_t size) {
+    std::scoped_lock lock(gMutex);
+    if (!initRegion()) {
+      return nullptr;
+    }
+    // First fit, which keeps the long lived shadows packed at the start of the region
+    for (auto it = gFreeRanges.begin(); it != gFreeRanges.end(); ++it) {
+      if (it->second < size) {
+        continue;
+      }
+      const size_t offset = it->first;
+      const size_t remaining = it->second - size;
+      uint8_t* const ptr = gpRegion + offset;
+      // Commit before taking the range, so that it stays free when the commit fails
+      if (VirtualAlloc(ptr, size, MEM_COMMIT, PAGE_READWRITE) == nullptr) {
+        Logger::err(format_string("Unable to commit %zd bytes of the shadow arena, error: %d", size, GetLastError()));
+        return nullptr;
+      }
+      gFreeRanges.erase(it);
+      if (remaining > 0) {
+        gFreeRanges[offset + size] = remaining;
+      }
+      gBytesCommitted += size;
+      return ptr;
+    }
+    if (!gbExhaustedReported) {
+      gbExhaustedReported = true;
+      Logger::warn("Shadow arena exhausted, further shadows are allocated on the heap. Consider raising client.shadowArenaSize.");
+    }
+    return nullptr;
+  }
+
+  void deallocateFromRegion(uint8_t* ptr, const size_t size) {
+    std::scoped_lock lock(gMutex);
+    VirtualFree(ptr, size, MEM_DECOMMIT);
+    gBytesCommitted -= size;
+    size_t offset = ptr - gpRegion;
+    size_t rangeSize = size;
+    // Merge with the free neighbours
+    auto next = gFreeRanges.lower_bound(offset);
+    if (next != gFreeRanges.end() && next->first == offset + rangeSize) {
+      rangeSize += next->second;
+      next = gFreeRanges.erase(next);
+    }
+    if (next != gFreeRanges.begin()) {
+      auto prev = std::prev(next);
+      if (prev->first + prev->second == offset) {
+        offset = prev->first;
+        rangeSize += prev->second;
+        gFreeRanges.erase(prev);
+      }
+    }
+    gFreeRanges[offset] = rangeSize;
+  }
+}
+
+uint8_t* ShadowArena::allocate(const size_t size) {
+  if (size <= SlabAllocator::kMaxBlockSize) {
+    auto* const ptr = static_cast<uint8_t*>(SlabAllocator::allocate(size));
+    memset(ptr, 0, size);
+    return ptr;
+  }
+  // Committed pages are zeroed by the OS
+  if (auto* const ptr = allocateFromRegion(align<size_t>(size, kPageSize))) {
+    return ptr;
+  }
+  return new uint8_t[size]();
+}
+
+void ShadowArena::deallocate(uint8_t* ptr, const size_t size) {
+  if (ptr == nullptr) {
+    return;
+  }
+  if (size <= SlabAllocator::kMaxBlockSize) {
+    SlabAllocator::deallocate(ptr, size);
+  } else if (isInRegion(ptr)) {
+    deallocateFromRegion(ptr, align<size_t>(size, kPageSize));
+  } else {
+    delete[] ptr;
+  }
+}
+
+size_t ShadowArena::getBytesCommitted() {
+  std::scoped_lock lock(gMutex);
+  return gBytesCommitted;
+}
+
+size_t ShadowArena::getBytesReserved() {
+  std::scoped_lock lock(gMutex);
+  return gRegionSize;
+}
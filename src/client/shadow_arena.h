@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) 2022-2023, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#pragma once
+
+#include <memory>
+#include <stddef.h>
+#include <stdint.h>
+
+// Allocator for the client side shadow memory of buffers and surfaces. Large shadows
+// are served from one virtual region reserved up front, see client.shadowArenaSize,
+// with pages committed on allocation and decommitted on release. Small shadows come
+// from the slab allocator. Shadows that do not fit, or all large shadows when the
+// arena is disabled, fall back to the heap. Shadow memory is always zero initialized.
+class ShadowArena {
+public:
+  struct Deleter {
+    size_t size = 0;
+    void operator()(uint8_t* ptr) const {
+      ShadowArena::deallocate(ptr, size);
+    }
+  };
+  typedef std::unique_ptr<uint8_t[], Deleter> Shadow;
+
+  static Shadow makeShadow(const size_t size) {
+    return Shadow(allocate(size), Deleter { size });
+  }
+
+  static uint8_t* allocate(const size_t size);
+  static void deallocate(uint8_t* ptr, const size_t size);
+
+  // Bytes currently committed in the arena, and the size of the reserved region
+  static size_t getBytesCommitted();
+  static size_t getBytesReserved();
+
+private:
+  ShadowArena() = delete;
+};
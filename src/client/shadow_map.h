@@ -22,23 +22,112 @@
 #pragma once
 
 #include <unknwn.h>
-#include <unordered_map>
+#include <atomic>
+#include <stdint.h>
 
-using ShadowMap = std::unordered_map<uintptr_t, IUnknown*>;
-extern ShadowMap gShadowMap;
-extern std::mutex gShadowMapMutex;
+// Wrapper objects indexed by their id. Ids are dense counters handed out by
+// D3dBaseIdFactory, so the table is a two level directory of fixed size pages
+// indexed by the id bits, with every slot an atomic pointer. Only the small top
+// level is part of the map, the directories below it are allocated once their
+// first id is registered and stay around. Registration, lookup and removal never
+// lock: a missing directory or page is allocated and published with a single CAS,
+// and a page is released once every id in it was removed, which happens after the
+// last object with an id in that range has been destroyed. Looking up the id of a
+// destroyed object is a bug and may race with such a release.
+class ShadowMap {
+public:
+  static constexpr uint32_t kPageBits = 12;
+  static constexpr uint32_t kPageSize = 1 << kPageBits;
+  static constexpr uint32_t kDirBits = 10;
+  static constexpr uint32_t kDirSize = 1 << kDirBits;
+  static constexpr uint32_t kNumDirs = 1 << (32 - kPageBits - kDirBits);
+
+  void set(const uintptr_t id, IUnknown* const pObject) {
+    getPage(id)->slots[id & (kPageSize - 1)].store(pObject, std::memory_order_release);
+  }
 
-#define SHADOW_MAP_LOCKGUARD \
-   std::scoped_lock lockObj(gShadowMapMutex); \
+  IUnknown* get(const uintptr_t id) const {
+    const Dir* const pDir = m_dirs[dirIndex(id)].load(std::memory_order_acquire);
+    if (!pDir) {
+      return nullptr;
+    }
+    const Page* const pPage = pDir->pages[pageIndex(id)].load(std::memory_order_acquire);
+    return pPage ? pPage->slots[id & (kPageSize - 1)].load(std::memory_order_acquire) : nullptr;
+  }
+
+  // Must be called exactly once for every id handed out, tracked or not
+  void erase(const uintptr_t id) {
+    Page* const pPage = getPage(id);
+    pPage->slots[id & (kPageSize - 1)].store(nullptr, std::memory_order_release);
+    if (pPage->numRemoved.fetch_add(1, std::memory_order_acq_rel) + 1 == kPageSize) {
+      getDir(id)->pages[pageIndex(id)].store(nullptr, std::memory_order_release);
+      delete pPage;
+    }
+  }
+
+private:
+  struct Page {
+    std::atomic<IUnknown*> slots[kPageSize] = {};
+    std::atomic<uint32_t> numRemoved = 0;
+  };
+
+  struct Dir {
+    std::atomic<Page*> pages[kDirSize] = {};
+  };
+
+  static uint32_t dirIndex(const uintptr_t id) {
+    return (uint32_t) (id >> (kPageBits + kDirBits)) & (kNumDirs - 1);
+  }
+
+  static uint32_t pageIndex(const uintptr_t id) {
+    return (uint32_t) (id >> kPageBits) & (kDirSize - 1);
+  }
+
+  // Returns the directory of the id, allocating and publishing it if there is none yet
+  Dir* getDir(const uintptr_t id) {
+    auto& dirSlot = m_dirs[dirIndex(id)];
+    Dir* pDir = dirSlot.load(std::memory_order_acquire);
+    if (pDir) {
+      return pDir;
+    }
+    Dir* const pNewDir = new Dir();
+    if (dirSlot.compare_exchange_strong(pDir, pNewDir, std::memory_order_acq_rel)) {
+      return pNewDir;
+    }
+    // Another thread published the directory first
+    delete pNewDir;
+    return pDir;
+  }
+
+  // Returns the page of the id, allocating and publishing it if there is none yet
+  Page* getPage(const uintptr_t id) {
+    auto& pageSlot = getDir(id)->pages[pageIndex(id)];
+    Page* pPage = pageSlot.load(std::memory_order_acquire);
+    if (pPage) {
+      return pPage;
+    }
+    Page* const pNewPage = new Page();
+    if ((id >> kPageBits) == 0) {
+      // Id 0 is never handed out, so it would never be removed from the first page
+      pNewPage->numRemoved.store(1, std::memory_order_relaxed);
+    }
+    if (pageSlot.compare_exchange_strong(pPage, pNewPage, std::memory_order_acq_rel)) {
+      return pNewPage;
+    }
+    // Another thread published the page first
+    delete pNewPage;
+    return pPage;
+  }
+
+  std::atomic<Dir*> m_dirs[kNumDirs] = {};
+};
+
+extern ShadowMap gShadowMap;
 
 class BaseDirect3DDevice9Ex_LSS;
 
 template<class WrapperType>
 static WrapperType* trackWrapper(WrapperType* const pLss) {
-  {
-    SHADOW_MAP_LOCKGUARD;
-    gShadowMap[pLss->getId()] = pLss;
-  }
-
+  gShadowMap.set(pLss->getId(), pLss);
   return pLss;
-}
\ No newline at end of file
+}
@@ -0,0 +1,117 @@
+/*
+ * Copyright (c) 2022-2023, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#include "pch.h"
+#include "slab_allocator.h"
+
+#include "log/log.h"
+#include "util_common.h"
+
+#include <atomic>
+#include <mutex>
+#include <new>
+
+namespace {
+  constexpr size_t kChunkSize = 64 * 1024;
+  // Size classes are the powers of two from kMinBlockSize to kMaxBlockSize
+  constexpr size_t kNumSizeClasses = 7;
+  static_assert((SlabAllocator::kMinBlockSize << (kNumSizeClasses - 1)) == SlabAllocator::kMaxBlockSize);
+
+  struct FreeBlock {
+    FreeBlock* pNext;
+  };
+
+  struct SizeClass {
+    std::mutex mutex;
+    FreeBlock* pFreeList = nullptr;
+  };
+
+  SizeClass gSizeClasses[kNumSizeClasses];
+  std::atomic<size_t> gBytesInUse = 0;
+  std::atomic<size_t> gBytesReserved = 0;
+
+  size_t getSizeClass(const size_t size) {
+    size_t index = 0;
+    while ((SlabAllocator::kMinBlockSize << index) < size) {
+      ++index;
+    }
+    return index;
+  }
+
+  // Splits a fresh chunk into blocks of the size class and puts them on its free list
+  bool refill(SizeClass& sizeClass, const size_t blockSize) {
+    auto* const pChunk = static_cast<uint8_t*>(
+      VirtualAlloc(nullptr, kChunkSize, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE));
+    if (pChunk == nullptr) {
+      return false;
+    }
+    gBytesReserved += kChunkSize;
+    for (size_t offset = kChunkSize; offset >= blockSize; offset -= blockSize) {
+      auto* const pBlock = reinterpret_cast<FreeBlock*>(pChunk + offset - blockSize);
+      pBlock->pNext = sizeClass.pFreeList;
+      sizeClass.pFreeList = pBlock;
+    }
+    return true;
+  }
+}
+
+void* SlabAllocator::allocate(const size_t size) {
+  if (size > kMaxBlockSize) {
+    return ::operator new(size);
+  }
+  const size_t index = getSizeClass(size);
+  const size_t blockSize = kMinBlockSize << index;
+  auto& sizeClass = gSizeClasses[index];
+  std::scoped_lock lock(sizeClass.mutex);
+  if (sizeClass.pFreeList == nullptr && !refill(sizeClass, blockSize)) {
+    Logger::err(format_string("Unable to reserve a slab chunk, error: %d", GetLastError()));
+    throw std::bad_alloc();
+  }
+  FreeBlock* const pBlock = sizeClass.pFreeList;
+  sizeClass.pFreeList = pBlock->pNext;
+  gBytesInUse += blockSize;
+  return pBlock;
+}
+
+void SlabAllocator::deallocate(void* ptr, const size_t size) {
+  if (ptr == nullptr) {
+    return;
+  }
+  if (size > kMaxBlockSize) {
+    ::operator delete(ptr);
+    return;
+  }
+  const size_t index = getSizeClass(size);
+  auto& sizeClass = gSizeClasses[index];
+  std::scoped_lock lock(sizeClass.mutex);
+  auto* const pBlock = static_cast<FreeBlock*>(ptr);
+  pBlock->pNext = sizeClass.pFreeList;
+  sizeClass.pFreeList = pBlock;
+  gBytesInUse -= kMinBlockSize << index;
+}
+
+size_t SlabAllocator::getBytesInUse() {
+  return gBytesInUse;
+}
+
+size_t SlabAllocator::getBytesReserved() {
+  return gBytesReserved;
+}
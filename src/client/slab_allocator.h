@@ -0,0 +1,46 @@
+/*
+ * Copyright (c) 2022-2023, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#pragma once
+
+#include <stddef.h>
+
+// Size classed slab allocator for the client wrapper objects. Slabs are carved out of
+// 64KB chunks taken straight from the OS, which keeps the bridge objects packed
+// together instead of interleaving them with the allocations of the game on its heap
+// in the 2GB address space of a 32-bit process. Chunks are never returned, freed
+// blocks go back on the free list of their size class. Allocations larger than the
+// largest size class are passed on to the global operator new.
+class SlabAllocator {
+public:
+  static constexpr size_t kMinBlockSize = 32;
+  static constexpr size_t kMaxBlockSize = 2048;
+
+  static void* allocate(const size_t size);
+  static void deallocate(void* ptr, const size_t size);
+
+  // Bytes handed out from the slabs, and bytes taken from the OS for them
+  static size_t getBytesInUse();
+  static size_t getBytesReserved();
+
+private:
+  SlabAllocator() = delete;
+};
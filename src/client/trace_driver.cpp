@@ -0,0 +1,221 @@
+/*
+ * Copyright (c) 2022-2023, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#include "trace_driver.h"
+
+#include "config/global_options.h"
+#include "log/log.h"
+#include "present_latency_controller.h"
+#include "util_devicecommand.h"
+#include "util_modulecommand.h"
+
+#include <algorithm>
+#include <thread>
+
+using namespace Commands;
+using namespace bridge_util;
+
+extern HRESULT syncOnPresent();
+
+namespace {
+  using Channel = CommandTrace::Channel;
+  using Item = CommandTrace::Reader::Item;
+
+  int64_t queryTimestamp() {
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+    return counter.QuadPart;
+  }
+
+  int64_t queryFrequency() {
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+    return frequency.QuadPart;
+  }
+
+  double ticksToMs(const int64_t ticks) {
+    return 1000.0 * (double) ticks / (double) queryFrequency();
+  }
+
+  bool isPresentCommand(const D3D9Command command) {
+    return command == IDirect3DDevice9Ex_Present || command == IDirect3DSwapChain9_Present;
+  }
+}
+
+TraceDriver::TraceDriver(const std::string& tracePath, const Pacing pacing)
+  : m_reader(tracePath)
+  , m_pacing(pacing) {
+  if (!isValid()) {
+    return;
+  }
+  const CommandTrace::FileHeader& fileHeader = m_reader.getFileHeader();
+  if (fileHeader.flags != CommandTrace::getCurrentFileFlags()) {
+    Logger::warn(format_string("Command trace was captured with server response flags 0x%x, but 0x%x are configured. "
+                               "Use the same bridge.conf for capture and replay.",
+                               fileHeader.flags, CommandTrace::getCurrentFileFlags()));
+  }
+  if (fileHeader.timerFrequency > 0) {
+    m_tickScale = (double) queryFrequency() / (double) fileHeader.timerFrequency;
+  }
+  Logger::info(format_string("Loaded command trace %s (%zu bytes).", tracePath.c_str(), m_reader.getFileSize()));
+}
+
+void TraceDriver::run() {
+  Logger::info(format_string("Starting command trace replay through the client transport (%s pacing)...",
+                             m_pacing == Pacing::Original ? "original" : "as fast as possible"));
+  m_startTicks = queryTimestamp();
+
+  Record record;
+  while (gbBridgeRunning && m_reader.next(record)) {
+    if (record.header.channel >= Channel::Count) {
+      Logger::err("Command trace contains a record for an unknown channel, stopping replay.");
+      break;
+    }
+    const bool bModule = record.header.channel == Channel::Module;
+    const auto command = (D3D9Command) record.header.command;
+    // The client sends Terminate on its own once the replay is detached
+    if (command == Bridge_Terminate) {
+      break;
+    }
+    // Bulk lane uploads are replayed in order on the device lane, which needs no dependencies
+    if (command == Bridge_LaneDependency) {
+      continue;
+    }
+
+    if (record.header.type == CommandTrace::RecordType::Response) {
+      if (bModule) {
+        waitForResponse<ModuleBridge>(command);
+      } else {
+        waitForResponse<DeviceBridge>(command);
+      }
+      continue;
+    }
+
+    if (m_pacing == Pacing::Original) {
+      waitUntil(record.header.timestamp);
+    }
+    if (bModule) {
+      issueCommand<ModuleBridge>(record);
+    } else {
+      issueCommand<DeviceBridge>(record);
+    }
+
+    if (isPresentCommand(command)) {
+      // Same frame throttling as the Present() interceptors
+      const int64_t waitStart = queryTimestamp();
+      syncOnPresent();
+      const int64_t waitTicks = queryTimestamp() - waitStart;
+      m_presentWaitTicks += waitTicks;
+      m_maxPresentWaitTicks = std::max(m_maxPresentWaitTicks, waitTicks);
+      ++m_numPresents;
+    }
+  }
+
+  m_endTicks = queryTimestamp();
+  logReport();
+}
+
+template<typename BridgeT>
+void TraceDriver::issueCommand(const Record& record) {
+  typename BridgeT::Command c((D3D9Command) record.header.command, (uintptr_t) record.header.handle, record.header.flags);
+  record.forEachItem([&](const Item& item) {
+    if (item.isScalar) {
+      c.send_data(item.value);
+    } else {
+      c.send_data(item.value, item.pData);
+    }
+  });
+  ++m_numCommandsSent;
+  // Payload plus the UID that the Command prepends
+  m_numBytesSent += record.header.payloadSize + sizeof(uint32_t);
+}
+
+template<typename BridgeT>
+void TraceDriver::waitForResponse(const D3D9Command command) {
+  // Only the fact that the application had to wait for the server matters here,
+  // the content of the response is discarded.
+  const int64_t waitStart = queryTimestamp();
+  const auto result = BridgeT::waitForCommandAndDiscard(command, GlobalOptions::getAckTimeout());
+  m_responseWaitTicks += queryTimestamp() - waitStart;
+  if (RESULT_SUCCESS(result)) {
+    ++m_numResponses;
+  } else {
+    Logger::warn(format_string("No %s response received from server during trace replay.", toString(command).c_str()));
+  }
+}
+
+void TraceDriver::waitUntil(const int64_t traceTimestamp) {
+  if (m_localStart == 0) {
+    m_traceStart = traceTimestamp;
+    m_localStart = queryTimestamp();
+    return;
+  }
+  const int64_t due = m_localStart + (int64_t) ((double) (traceTimestamp - m_traceStart) * m_tickScale);
+  int64_t now = queryTimestamp();
+  if (now > due) {
+    m_scheduleLagTicks = std::max(m_scheduleLagTicks, now - due);
+    return;
+  }
+  // Sleep through the bulk of the gap, then yield for the remainder since
+  // Sleep() granularity is far too coarse for individual commands.
+  const int64_t sleepThreshold = queryFrequency() / 500;
+  while (now < due && gbBridgeRunning) {
+    if (due - now > sleepThreshold) {
+      Sleep(1);
+    } else {
+      std::this_thread::yield();
+    }
+    now = queryTimestamp();
+  }
+}
+
+void TraceDriver::logReport() const {
+  const double totalMs = ticksToMs(m_endTicks - m_startTicks);
+  const double totalSec = std::max(totalMs / 1000.0, 1e-9);
+  const auto& deviceStats = DeviceBridge::getTransportStats();
+  const auto& moduleStats = ModuleBridge::getTransportStats();
+
+  Logger::info("==================\nCommand trace transport report\n==================");
+  Logger::info(format_string("Channel configuration: clientChannelMemSize=%u clientCmdQueueSize=%u clientDataQueueSize=%u",
+                             GlobalOptions::getClientChannelMemSize(), GlobalOptions::getClientCmdQueueSize(),
+                             GlobalOptions::getClientDataQueueSize()));
+  Logger::info(format_string("Replayed %llu commands and %.2f MB of data in %.2f ms (%.0f commands/s, %.2f MB/s).",
+                             m_numCommandsSent, m_numBytesSent / (1024.0 * 1024.0), totalMs,
+                             m_numCommandsSent / totalSec, m_numBytesSent / (1024.0 * 1024.0) / totalSec));
+  Logger::info(format_string("syncDataQueue stalls: device %llu (%.3f ms), module %llu (%.3f ms)",
+                             deviceStats.dataQueueStalls.load(), ticksToMs(deviceStats.dataQueueStallTicks.load()),
+                             moduleStats.dataQueueStalls.load(), ticksToMs(moduleStats.dataQueueStallTicks.load())));
+  Logger::info(format_string("Command queue full retries: device %llu, module %llu",
+                             deviceStats.commandPushRetries.load(), moduleStats.commandPushRetries.load()));
+  Logger::info(format_string("Present semaphore wait: %llu frames, %.3f ms total, %.3f ms avg, %.3f ms max",
+                             m_numPresents, ticksToMs(m_presentWaitTicks),
+                             m_numPresents > 0 ? ticksToMs(m_presentWaitTicks) / m_numPresents : 0.0,
+                             ticksToMs(m_maxPresentWaitTicks)));
+  if (PresentLatencyController::isEnabled()) {
+    Logger::info(format_string("Adaptive Present latency settled at %u frames in flight.",
+                               PresentLatencyController::getFramesInFlight()));
+  }
+  Logger::info(format_string("Server response wait: %llu responses, %.3f ms total",
+                             m_numResponses, ticksToMs(m_responseWaitTicks)));
+  if (m_pacing == Pacing::Original) {
+    Logger::info(format_string("Maximum lag behind the captured schedule: %.3f ms", ticksToMs(m_scheduleLagTicks)));
+  }
+}
@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) 2022-2023, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#pragma once
+
+#include "util_commands.h"
+#include "util_commandtrace.h"
+
+#include <string>
+
+// Re-issues a captured command trace through the regular client transport, i.e.
+// the same ClientMessage/ModuleClientCommand objects and send_data() calls that
+// the d3d9 interceptors use, against a server running the null D3D9 backend in
+// its own process. Since neither side does any actual rendering work this
+// measures the cost of the IPC path itself under the traffic of a real title,
+// which is what the channel and queue sizes in bridge.conf need to be tuned for.
+class TraceDriver {
+public:
+  enum class Pacing {
+    // Commands are issued at the same relative time they were captured at
+    Original,
+    // Commands are issued back to back, limited only by the transport
+    AsFastAsPossible
+  };
+
+  TraceDriver(const std::string& tracePath, const Pacing pacing);
+
+  bool isValid() const {
+    return m_reader.isValid();
+  }
+
+  // Submits the whole trace, returns once the last command has been sent or
+  // the bridge was shut down.
+  void run();
+
+private:
+  using Record = bridge_util::CommandTrace::Reader::Record;
+
+  template<typename BridgeT>
+  void issueCommand(const Record& record);
+  template<typename BridgeT>
+  void waitForResponse(const Commands::D3D9Command command);
+  void waitUntil(const int64_t traceTimestamp);
+  void logReport() const;
+
+  bridge_util::CommandTrace::Reader m_reader;
+  const Pacing m_pacing;
+
+  // Maps trace timestamps onto the local performance counter
+  int64_t m_traceStart = 0;
+  int64_t m_localStart = 0;
+  double m_tickScale = 1.0;
+
+  int64_t m_startTicks = 0;
+  int64_t m_endTicks = 0;
+  uint64_t m_numCommandsSent = 0;
+  uint64_t m_numBytesSent = 0;
+  uint64_t m_numResponses = 0;
+  uint64_t m_numPresents = 0;
+  int64_t m_responseWaitTicks = 0;
+  int64_t m_presentWaitTicks = 0;
+  int64_t m_maxPresentWaitTicks = 0;
+  int64_t m_scheduleLagTicks = 0;
+};
@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) 2022-2023, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#include "pch.h"
+#include "up_geometry_cache.h"
+
+#include "client_options.h"
+#include "util_devicecommand.h"
+
+namespace {
+  // Draws of a payload in consecutive frames before the server is asked to keep it
+  constexpr uint32_t kRepeatsBeforePromotion = 3;
+  // Frames a resident payload may go unused before it is released on the server
+  constexpr uint32_t kFramesBeforeEviction = 120;
+  constexpr uint32_t kMaxResident = 1024;
+}
+
+bool UpGeometryCache::isEnabled() {
+  return ClientOptions::getCacheRepeatedUPDraws();
+}
+
+UpGeometryCache::Action UpGeometryCache::onDraw(const uint64_t hash) {
+  std::scoped_lock lock(s_mutex);
+  Entry& entry = s_entries[hash];
+  if (entry.bResident) {
+    entry.lastUsedFrame = s_frame;
+    return Action::Cached;
+  }
+  // Only count the first draw per frame, a payload drawn several times in one
+  // frame does not make it any more likely to come back in the next frame
+  if (entry.repeats == 0 || entry.lastUsedFrame != s_frame) {
+    ++entry.repeats;
+  }
+  entry.lastUsedFrame = s_frame;
+  if (entry.repeats >= kRepeatsBeforePromotion && s_numResident < kMaxResident) {
+    entry.bResident = true;
+    ++s_numResident;
+    return Action::Promote;
+  }
+  return Action::Send;
+}
+
+void UpGeometryCache::onPresent() {
+  std::vector<uint64_t> evicted;
+  {
+    std::scoped_lock lock(s_mutex);
+    for (auto it = s_entries.begin(); it != s_entries.end();) {
+      const uint32_t unusedFrames = s_frame - it->second.lastUsedFrame;
+      if (it->second.bResident && unusedFrames >= kFramesBeforeEviction) {
+        evicted.push_back(it->first);
+        --s_numResident;
+        it = s_entries.erase(it);
+      } else if (!it->second.bResident && unusedFrames >= 1) {
+        // Candidates have to show up every frame
+        it = s_entries.erase(it);
+      } else {
+        ++it;
+      }
+    }
+    ++s_frame;
+  }
+  sendRelease(evicted);
+}
+
+void UpGeometryCache::releaseAll() {
+  std::vector<uint64_t> released;
+  {
+    std::scoped_lock lock(s_mutex);
+    for (const auto& [hash, entry] : s_entries) {
+      if (entry.bResident) {
+        released.push_back(hash);
+      }
+    }
+    s_entries.clear();
+    s_numResident = 0;
+  }
+  sendRelease(released);
+}
+
+void UpGeometryCache::sendRelease(const std::vector<uint64_t>& hashes) {
+  if (hashes.empty()) {
+    return;
+  }
+  ClientMessage c(Commands::Bridge_ReleaseCachedGeometry);
+  c.send_data((uint32_t) hashes.size());
+  c.send_data((uint32_t) (hashes.size() * sizeof(uint64_t)), hashes.data());
+}
@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2022-2023, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#pragma once
+
+#include <mutex>
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+// Client side bookkeeping for DrawPrimitiveUP()/DrawIndexedPrimitiveUP() payloads
+// that are redrawn with byte-identical data every frame. Once a payload has been
+// seen often enough the server is asked to keep it in resident buffers, and from
+// then on only its hash is sent. The client decides what is resident on the server,
+// including evictions, so both sides always agree. See client.cacheRepeatedUPDraws.
+class UpGeometryCache {
+public:
+  enum class Action {
+    Send,    // Send the payload as usual
+    Promote, // Send the payload along with its hash for the server to keep
+    Cached   // The server has it, only send the hash
+  };
+
+  static bool isEnabled();
+
+  // Must be called for every UP draw payload
+  static Action onDraw(const uint64_t hash);
+
+  // Evicts payloads that went unused and drops stale candidates, must be called for every Present
+  static void onPresent();
+
+  // Releases everything the server holds, e.g. before a device reset
+  static void releaseAll();
+
+private:
+  UpGeometryCache() = delete;
+
+  static void sendRelease(const std::vector<uint64_t>& hashes);
+
+  struct Entry {
+    uint32_t repeats = 0;
+    uint32_t lastUsedFrame = 0;
+    bool bResident = false;
+  };
+
+  static inline std::mutex s_mutex;
+  static inline std::unordered_map<uint64_t, Entry> s_entries;
+  static inline uint32_t s_numResident = 0;
+  static inline uint32_t s_frame = 0;
+};
@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) 2022-2023, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#include "pch.h"
+#include "write_tracked_shadow.h"
+
+#include "client_options.h"
+#include "log/log.h"
+#include "util_common.h"
+#include "util_once.h"
+
+#include <algorithm>
+
+namespace {
+  size_t getPageSize() {
+    static const size_t pageSize = [] {
+      SYSTEM_INFO info;
+      GetSystemInfo(&info);
+      return (size_t) info.dwPageSize;
+    }();
+    return pageSize;
+  }
+
+  size_t getAllocationGranularity() {
+    static const size_t granularity = [] {
+      SYSTEM_INFO info;
+      GetSystemInfo(&info);
+      return (size_t) info.dwAllocationGranularity;
+    }();
+    return granularity;
+  }
+}
+
+WriteTrackedShadow::WriteTrackedShadow(const size_t size)
+  : m_size(size) {
+  m_pData = static_cast<uint8_t*>(
+    VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT | MEM_WRITE_WATCH, PAGE_READWRITE));
+  if (m_pData == nullptr) {
+    Logger::err(format_string("Unable to allocate a write tracked shadow of size %zd, error: %d", size, GetLastError()));
+    throw std::bad_alloc();
+  }
+  m_writtenPages.resize((size + getPageSize() - 1) / getPageSize());
+}
+
+WriteTrackedShadow::~WriteTrackedShadow() {
+  if (m_pData) {
+    VirtualFree(m_pData, 0, MEM_RELEASE);
+  }
+}
+
+void WriteTrackedShadow::consumeWrittenRanges(const size_t offset, const size_t size, std::vector<Range>& ranges) {
+  if (size == 0) {
+    return;
+  }
+  const size_t pageSize = getPageSize();
+  const size_t firstPage = offset / pageSize;
+  const size_t endPage = (offset + size + pageSize - 1) / pageSize;
+
+  ULONG_PTR numWritten = endPage - firstPage;
+  DWORD granularity = 0;
+  if (GetWriteWatch(WRITE_WATCH_FLAG_RESET, m_pData + firstPage * pageSize, (endPage - firstPage) * pageSize,
+                    m_writtenPages.data(), &numWritten, &granularity) != 0) {
+    ONCE(Logger::warn("Querying the shadow memory write watch failed, sending whole locked ranges instead."));
+    ranges.push_back({ offset, size });
+    return;
+  }
+
+  // Written pages come back in ascending order, merge adjacent ones into runs
+  const size_t firstNewRange = ranges.size();
+  for (ULONG_PTR i = 0; i < numWritten; ++i) {
+    const size_t pageBegin = static_cast<uint8_t*>(m_writtenPages[i]) - m_pData;
+    if (ranges.size() > firstNewRange && ranges.back().offset + ranges.back().size == pageBegin) {
+      ranges.back().size += pageSize;
+    } else {
+      ranges.push_back({ pageBegin, pageSize });
+    }
+  }
+
+  // Clamp the runs to the requested range, the outer pages may extend past it
+  for (size_t i = firstNewRange; i < ranges.size(); ++i) {
+    const size_t begin = std::max(ranges[i].offset, offset);
+    const size_t end = std::min(ranges[i].offset + ranges[i].size, offset + size);
+    ranges[i] = { begin, end - begin };
+  }
+}
+
+void WriteTrackedShadow::resetTracking() {
+  ResetWriteWatch(m_pData, m_size);
+}
+
+bool WriteTrackedShadow::isEnabled(const size_t size) {
+  // Every shadow takes up at least a whole allocation of address space, which
+  // is scarce in the 32-bit client, so smaller ones stay in the shadow arena
+  return ClientOptions::getTrackShadowWrites() && size >= getAllocationGranularity();
+}
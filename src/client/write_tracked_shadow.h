@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) 2022-2023, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+// Page aligned shadow memory that records which pages were written to since the
+// last time they were consumed, using the OS write watch. Lets unlocks send only
+// the pages the application touched instead of the whole locked range.
+class WriteTrackedShadow {
+public:
+  struct Range {
+    size_t offset;
+    size_t size;
+  };
+
+  explicit WriteTrackedShadow(const size_t size);
+  ~WriteTrackedShadow();
+
+  WriteTrackedShadow(const WriteTrackedShadow&) = delete;
+  WriteTrackedShadow& operator=(const WriteTrackedShadow&) = delete;
+
+  uint8_t* data() const {
+    return m_pData;
+  }
+
+  // Appends the written parts of [offset, offset + size) to ranges, with adjacent
+  // pages merged, and resets tracking for them. Falls back to the whole range if
+  // the write watch cannot be queried.
+  void consumeWrittenRanges(const size_t offset, const size_t size, std::vector<Range>& ranges);
+
+  // Forgets writes made by the bridge itself, e.g. when filling in readback data
+  void resetTracking();
+
+  // Whether a shadow of the given size should be write tracked, see client.trackShadowWrites
+  static bool isEnabled(const size_t size);
+
+private:
+  uint8_t* m_pData = nullptr;
+  size_t m_size = 0;
+  std::vector<void*> m_writtenPages;
+};
@@ -0,0 +1,188 @@
+/*
+ * Copyright (c) 2022-2023, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#include <windows.h>
+
+#include "bulk_processing.h"
+
+#include "util_bridge_assert.h"
+#include "util_bulkcommand.h"
+#include "util_commandlog.h"
+#include "util_texture_and_volume.h"
+
+#include "config/global_options.h"
+#include "log/log.h"
+
+#include <condition_variable>
+#include <d3d9.h>
+#include <unordered_map>
+
+using namespace Commands;
+using namespace bridge_util;
+
+// Mapping between client and server pointer addresses
+extern std::unordered_map<uint32_t, IDirect3DResource9*> gpD3DResources; // For Textures, Buffers, and Surfaces
+
+extern std::mutex gLock;
+
+#define PULL(type, name) const auto& name = (type)BulkBridge::get_data()
+#define PULL_U(name) PULL(UINT, name)
+#define PULL_D(name) PULL(DWORD, name)
+#define PULL_DATA(size, name) \
+            uint32_t name##_len = BulkBridge::get_data((void**)&name); \
+            assert(name##_len == 0 || size == name##_len)
+#define PULL_OBJ(type, name) \
+            type* name = nullptr; \
+            PULL_DATA(sizeof(type), name)
+// Commands with a chunked payload have their header sent ahead of the data
+#define CHECK_DATA_OFFSET (Commands::IsDataChunked(rpcHeader.flags) || \
+                           BulkBridge::get_data_pos() == rpcHeader.dataOffset)
+#define GET_HND(name) \
+            const auto& name = rpcHeader.pHandle; \
+            assert(name != NULL)
+#define GET_HDR_VAL(name) \
+            const DWORD& name = rpcHeader.pHandle;
+
+namespace {
+  // How far each lane got, as the UID of the last command processed plus one,
+  // which is what the client hands out as Bridge_LaneDependency tokens.
+  // Only accessed with gLock held.
+  std::condition_variable gLaneProgress;
+  uint32_t gDeviceProgress = 0;
+  uint32_t gBulkProgress = 0;
+  bool gbBulkLaneRunning = false;
+  bool gbBulkLaneWaiting = false;
+
+  // Waits for the other lane until it reached the token or shut down. Continuing
+  // early would apply the commands of both lanes out of order, so a wait that takes
+  // longer than a command would be waited for is only reported.
+  template<typename Predicate>
+  void waitForLane(std::unique_lock<std::mutex>& lock, const char* const laneName, const uint32_t token,
+                   const Predicate& predicate) {
+    ZoneScoped;
+    const auto timeout = std::chrono::milliseconds(GlobalOptions::getCommandTimeout());
+    uint32_t numRetries = 0;
+    while (!predicate() && gbBridgeRunning) {
+      if (numRetries++ == GlobalOptions::getCommandRetries()) {
+        Logger::warn(format_string("Still waiting for the %s lane to reach token %u.", laneName, token));
+      }
+      gLaneProgress.wait_for(lock, timeout);
+    }
+  }
+
+  void unlockRect(const Header& rpcHeader) {
+    GET_HND(pHandle);
+    PULL_OBJ(RECT, pRect);
+    PULL_D(Flags);
+    PULL_D(dFormat);
+    PULL_D(IncomingPitch);
+    void* pData = nullptr;
+    BulkBridge::get_data(&pData);
+    // The texture may have been released while the upload was in flight
+    const auto it = gpD3DResources.find(pHandle);
+    if (it == gpD3DResources.end()) {
+      return;
+    }
+    const auto pSurface = (IDirect3DSurface9*) it->second;
+    D3DLOCKED_RECT lockedRect;
+    auto hresult = pSurface->LockRect(OUT & lockedRect, IN pRect, IN Flags);
+    assert(S_OK == hresult);
+    const uint32_t width = pRect->right - pRect->left;
+    const uint32_t height = pRect->bottom - pRect->top;
+    const D3DFORMAT format = (D3DFORMAT) dFormat;
+    const size_t rowSize = bridge_util::calcRowSize(width, format);
+    FOR_EACH_RECT_ROW(lockedRect, height, format,
+      memcpy(ptr, (PBYTE) pData + y * IncomingPitch, rowSize);
+    )
+    hresult = pSurface->UnlockRect();
+    assert(SUCCEEDED(hresult));
+  }
+}
+
+void onDeviceCommandProcessed(const uint32_t uid) {
+  gDeviceProgress = uid + 1;
+  if (gbBulkLaneWaiting) {
+    gLaneProgress.notify_all();
+  }
+}
+
+void waitForBulkLane(std::unique_lock<std::mutex>& lock, const uint32_t token) {
+  waitForLane(lock, "bulk", token, [token]() {
+    return gBulkProgress >= token || !gbBulkLaneRunning;
+  });
+}
+
+void processBulkCommandQueue(std::atomic<bool>* const pbSignalEnd) {
+  {
+    std::scoped_lock lock(gLock);
+    gbBulkLaneRunning = true;
+  }
+  // Unlike the other lanes the bulk lane may well be idle for longer than a command timeout
+  while (!pbSignalEnd->load() && gbBridgeRunning) {
+    const Result result = BulkBridge::waitForCommand(Commands::Bridge_Any, 0, pbSignalEnd);
+    if (result == Result::Timeout) {
+      continue;
+    }
+    if (RESULT_FAILURE(result)) {
+      break;
+    }
+    const Header rpcHeader = BulkBridge::pop_front();
+    ZoneScopedN("Process Bulk Command");
+    ZoneCommandName(rpcHeader.command);
+    PULL_U(currentUID);
+    CommandLog::record(CommandLog::Event::Process, (uint8_t) CommandTrace::Channel::Bulk, (uint16_t) rpcHeader.command,
+                       currentUID, rpcHeader.dataOffset, 0);
+    ZoneCommandUID(currentUID);
+#ifdef TRACY_ENABLE
+    TracyPlot("Bulk Command Queue Residency (us)", getQueueResidencyUs(rpcHeader));
+#endif
+    std::unique_lock<std::mutex> lock(gLock);
+    switch (rpcHeader.command) {
+    case Bridge_LaneDependency:
+    {
+      // The upload after this must not overtake the device commands before it
+      GET_HDR_VAL(token);
+      gbBulkLaneWaiting = true;
+      waitForLane(lock, "device", token, [token, pbSignalEnd]() {
+        return gDeviceProgress >= token || pbSignalEnd->load();
+      });
+      gbBulkLaneWaiting = false;
+      break;
+    }
+    case IDirect3DSurface9_UnlockRect:
+      unlockRect(rpcHeader);
+      break;
+    default:
+      Logger::err(format_string("Unexpected command %s on the bulk lane.", toString(rpcHeader.command).c_str()));
+      break;
+    }
+    assert(CHECK_DATA_OFFSET);
+    // Hand the data queue space used by the command back to the client
+    BulkBridge::release_data_credits();
+    gBulkProgress = currentUID + 1;
+    gLaneProgress.notify_all();
+  }
+  {
+    std::scoped_lock lock(gLock);
+    gbBulkLaneRunning = false;
+  }
+  gLaneProgress.notify_all();
+}
@@ -0,0 +1,37 @@
+/*
+ * Copyright (c) 2022-2023, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <stdint.h>
+
+// Processes the bulk lane, the texture uploads that the client sends past the device
+// commands, on its own thread. Commands of both lanes are executed with gLock held.
+void processBulkCommandQueue(std::atomic<bool>* const pbSignalEnd);
+
+// Must be called by the device command loop for every command, with gLock held
+void onDeviceCommandProcessed(const uint32_t uid);
+
+// Blocks the device command loop until the bulk lane processed every upload before the
+// token, releasing gLock while waiting. Must be called with gLock held by the lock.
+void waitForBulkLane(std::unique_lock<std::mutex>& lock, const uint32_t token);
@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2022-2023, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#include "frame_arena.h"
+
+#include "util_common.h"
+
+#include "log/log.h"
+
+#include "../tracy/tracy.hpp"
+
+#include <assert.h>
+
+using namespace bridge_util;
+
+void* FrameArena::allocate(const size_t size, const size_t alignment) {
+  // Neither the block nor the overflow allocations are aligned any further than new[] does
+  assert(alignment <= alignof(std::max_align_t) && "Unsupported frame arena alignment!");
+  if (!s_pBlock) {
+    s_pBlock.reset(new uint8_t[kInitialCapacity]);
+    s_capacity = kInitialCapacity;
+  }
+  const size_t offset = align<size_t>(s_offset, alignment);
+  if (offset + size <= s_capacity) {
+    s_offset = offset + size;
+    return s_pBlock.get() + offset;
+  }
+  s_overflow.emplace_back(new uint8_t[size]);
+  s_overflowSize += align<size_t>(size, alignof(std::max_align_t));
+  return s_overflow.back().get();
+}
+
+void FrameArena::reset() {
+  if (!s_overflow.empty()) {
+    ZoneScoped;
+    // Make room for everything this frame needed, with some headroom for the next one
+    const size_t required = std::max(s_offset, s_peakOffset) + s_overflowSize;
+    size_t capacity = s_capacity;
+    while (capacity < required + required / 2) {
+      capacity *= 2;
+    }
+    s_pBlock.reset(new uint8_t[capacity]);
+    s_capacity = capacity;
+    s_overflow.clear();
+    s_overflowSize = 0;
+    Logger::debug(format_string("Frame arena grown to %zu bytes.", capacity));
+  }
+  s_offset = 0;
+  s_peakOffset = 0;
+}
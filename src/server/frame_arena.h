@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2022-2023, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <stdint.h>
+#include <type_traits>
+#include <vector>
+
+// Scratch memory for the server command handlers that lives until the end of the
+// frame. Allocations are bumped off a single block that is reset on every Present.
+// Whatever does not fit is served from the heap for the rest of the frame, and the
+// block is regrown at the next reset to hold everything that frame needed, so a
+// steady-state frame does not allocate at all. Only to be used with gLock held.
+class FrameArena {
+public:
+  // Returns memory that stays valid until the next Present
+  static void* allocate(const size_t size, const size_t alignment = alignof(std::max_align_t));
+
+  template<typename T>
+  static T* allocate(const size_t count) {
+    static_assert(std::is_trivially_destructible_v<T>, "Frame arena memory is released without destruction.");
+    return static_cast<T*>(allocate(sizeof(T) * count, alignof(T)));
+  }
+
+  // Must be called on every Present, releases everything allocated during the frame
+  static void reset();
+
+  // Releases the block memory allocated while it is alive, for scratch memory that
+  // is only needed by a single command
+  class Scope {
+  public:
+    Scope()
+      : m_offset(s_offset) {
+    }
+
+    ~Scope() {
+      s_peakOffset = std::max(s_peakOffset, s_offset);
+      s_offset = m_offset;
+    }
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+  private:
+    const size_t m_offset;
+  };
+
+  static size_t getCapacity() {
+    return s_capacity;
+  }
+
+private:
+  FrameArena() = delete;
+
+  static constexpr size_t kInitialCapacity = 64 << 10; // 64kB
+
+  static inline std::unique_ptr<uint8_t[]> s_pBlock;
+  static inline size_t s_capacity = 0;
+  static inline size_t s_offset = 0;
+  // Highest offset reached this frame before a scope released it
+  static inline size_t s_peakOffset = 0;
+  // Allocations that did not fit into the block this frame
+  static inline std::vector<std::unique_ptr<uint8_t[]>> s_overflow;
+  static inline size_t s_overflowSize = 0;
+};
@@ -22,11 +22,19 @@
 #include <windows.h>
 
 #include "version.h"
+#include "bulk_processing.h"
+#include "frame_arena.h"
 #include "module_processing.h"
+#include "null_d3d9.h"
+#include "trace_replay.h"
 
 #include "util_bridge_assert.h"
+#include "util_bulkcommand.h"
 #include "util_circularbuffer.h"
+#include "util_commandlog.h"
 #include "util_commands.h"
+#include "util_deferrederrors.h"
+#include "util_geometryring.h"
 #include "util_common.h"
 #include "util_devicecommand.h"
 #include "util_filesys.h"
@@ -34,10 +42,14 @@
 #include "util_hack_d3d_debug.h"
 #include "util_messagechannel.h"
 #include "util_modulecommand.h"
+#include "util_process.h"
+#include "util_queryresults.h"
+#include "util_readback.h"
 #include "util_seh.h"
 #include "util_semaphore.h"
 #include "util_sharedheap.h"
 #include "util_sharedmemory.h"
+#include "util_streammirror.h"
 #include "util_texture_and_volume.h"
 
 #include "log/log.h"
@@ -50,7 +62,11 @@
 #include <d3d9.h>
 #include <assert.h>
 #include <map>
+#include <algorithm>
+#include <type_traits>
 #include <atomic>
+#include <future>
+#include <vector>
 
 using namespace Commands;
 using namespace bridge_util;
@@ -66,12 +82,27 @@ using namespace bridge_util;
   } 
 
 #define SEND_OPTIONAL_CREATE_FUNCTION_SERVER_RESPONSE(hresult, uid) { \
-    if (GlobalOptions::getSendCreateFunctionServerResponses() || GlobalOptions::getSendAllServerResponses()) { \
+    if (GlobalOptions::getAsyncCreateFunctions()) { \
+      if (FAILED(hresult)) { \
+        DeferredErrors::post(rpcHeader.command, (uint32_t) uid, hresult); \
+      } \
+    } else if (GlobalOptions::getSendCreateFunctionServerResponses() || GlobalOptions::getSendAllServerResponses()) { \
       ServerMessage c(Commands::Bridge_Response, uid); \
       c.send_data(hresult); \
     } \
   } 
 
+// The client waits on the first create of interned contents to learn whether the
+// server holds them now, so that one is answered regardless of the response options
+#define SEND_CREATE_FUNCTION_SERVER_RESPONSE_FOR_INTERNING(hresult, uid) { \
+    if (Commands::IsInternObject(rpcHeader.flags)) { \
+      ServerMessage c(Commands::Bridge_Response, uid); \
+      c.send_data(hresult); \
+    } else { \
+      SEND_OPTIONAL_CREATE_FUNCTION_SERVER_RESPONSE(hresult, uid); \
+    } \
+  }
+
 #define PULL(type, name) const auto& name = (type)DeviceBridge::get_data()
 #define PULL_I(name) PULL(INT, name)
 #define PULL_U(name) PULL(UINT, name)
@@ -86,7 +117,9 @@ using namespace bridge_util;
 #define PULL_OBJ(type, name) \
             type* name = nullptr; \
             PULL_DATA(sizeof(type), name)
-#define CHECK_DATA_OFFSET (DeviceBridge::get_data_pos() == rpcHeader.dataOffset)
+// Commands with a chunked payload have their header sent ahead of the data
+#define CHECK_DATA_OFFSET (Commands::IsDataChunked(rpcHeader.flags) || \
+                           DeviceBridge::get_data_pos() == rpcHeader.dataOffset)
 #define GET_HND(name) \
             const auto& name = rpcHeader.pHandle; \
             assert(name != NULL)
@@ -108,14 +141,14 @@ std::chrono::steady_clock::time_point gTimeStart;
 Guid gUniqueIdentifier;
 NamedSemaphore* gpPresent = nullptr;
 std::unique_ptr<MessageChannelServer> gpClientMessageChannel;
+// Only set when replaying a command trace instead of serving a client
+std::unique_ptr<TraceReplay> gpTraceReplay;
 // D3D Library handle
 typedef IDirect3D9* (WINAPI* D3DC9)(UINT);
 typedef HRESULT(WINAPI* D3DC9Ex)(UINT, IDirect3D9Ex**);
 HMODULE ghModule;
 LPDIRECT3D9 gpD3D;
 
-bool gOverwriteConditionAlreadyActive = false;
-
 // Mapping between client and server pointer addresses
 std::unordered_map<uint32_t, IDirect3DDevice9*> gpD3DDevices;
 std::unordered_map<uint32_t, IDirect3DResource9*> gpD3DResources; // For Textures, Buffers, and Surfaces
@@ -127,6 +160,34 @@ std::unordered_map<uint32_t, IDirect3DPixelShader9*> gpD3DPixelShaders;
 std::unordered_map<uint32_t, IDirect3DSwapChain9*> gpD3DSwapChains;
 std::unordered_map<uint32_t, IDirect3DQuery9*> gpD3DQuery;
 
+// Occlusion queries the client expects to find published in the QueryResults table
+struct PendingQuery {
+  IDirect3DQuery9* pQuery;
+  uint32_t slot;
+  uint32_t sequence;
+};
+std::vector<PendingQuery> gPendingQueries;
+
+// UP draw payloads the client promoted to resident buffers, keyed by payload hash.
+// The client is not told when the buffers cannot be created and keeps referencing
+// the payload by hash, so it is then kept in system memory and drawn as an UP draw.
+struct CachedGeometry {
+  IDirect3DVertexBuffer9* pVB;
+  IDirect3DIndexBuffer9* pIB;
+  std::vector<uint8_t> vertexData;
+  std::vector<uint8_t> indexData;
+};
+std::unordered_map<uint64_t, CachedGeometry> gCachedGeometry;
+
+// Shaders and vertex declarations shared between all handles the client created with
+// identical contents, keyed by the content hash the client computed
+struct InternedObject {
+  IUnknown* pObject;
+  uint32_t numHandles;
+};
+std::unordered_map<uint64_t, InternedObject> gInternedObjects;
+std::unordered_map<uint32_t, uint64_t> gInternedHandles;
+
 std::mutex gLock;
 
 // Global state
@@ -223,6 +284,139 @@ HRESULT ReturnSurfaceDataToClient(IDirect3DSurface9* pReturnSurfaceData, HRESULT
   return hresult;
 }
 
+// Asynchronous flavor of ReturnSurfaceDataToClient(): the data goes into a SharedHeap
+// allocation provided by the client and instead of a response the readback fence in
+// that allocation is signaled, see util_readback.h.
+void WriteSurfaceDataToSharedHeap(IDirect3DSurface9* pReturnSurfaceData, HRESULT hresult,
+                                  const SharedHeap::AllocId allocId, const uint32_t fence) {
+  BYTE* const pBuf = SharedHeap::getBuf(allocId);
+  if (SUCCEEDED(hresult)) {
+    D3DSURFACE_DESC desc;
+    hresult = pReturnSurfaceData->GetDesc(OUT &desc);
+    D3DLOCKED_RECT lockedRect;
+    if (SUCCEEDED(hresult)) {
+      hresult = pReturnSurfaceData->LockRect(OUT &lockedRect, NULL, IN D3DLOCK_READONLY);
+    }
+    if (SUCCEEDED(hresult)) {
+      const uint32_t rowSize = bridge_util::calcRowSize(desc.Width, desc.Format);
+      BYTE* pDst = pBuf + kReadbackDataOffset;
+      FOR_EACH_RECT_ROW(lockedRect, desc.Height, desc.Format, {
+        memcpy(pDst, ptr, rowSize);
+        pDst += rowSize;
+      });
+      hresult = pReturnSurfaceData->UnlockRect();
+    }
+  }
+  auto* const pHeader = reinterpret_cast<ReadbackHeader*>(pBuf);
+  pHeader->result = hresult;
+  pHeader->fence.store(fence, std::memory_order_release);
+}
+
+// Called once per Present: publishes every pending occlusion query result that is
+// available by now, then advances the completed frame counter which the client
+// uses to retire event queries issued before that Present.
+static void PublishQueryResults() {
+  ZoneScoped;
+  auto& table = QueryResults::get();
+  auto it = gPendingQueries.begin();
+  while (it != gPendingQueries.end()) {
+    DWORD result = 0;
+    if (it->pQuery->GetData(&result, sizeof(result), 0) == S_OK) {
+      auto& slot = table.slots[it->slot];
+      slot.result = result;
+      slot.sequence.store(it->sequence, std::memory_order_release);
+      it = gPendingQueries.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  table.completedFrames.fetch_add(1, std::memory_order_release);
+}
+
+// Copies an UP draw payload into a new write-only default pool buffer. The client
+// promotes a payload once it was drawn unchanged over several frames and from then
+// on only references it by hash.
+template<typename BufferT>
+static BufferT* createCachedBuffer(IDirect3DDevice9* pDevice, const void* pData, const uint32_t size, const D3DFORMAT indexFormat) {
+  BufferT* pBuffer = nullptr;
+  HRESULT hresult;
+  if constexpr (std::is_same_v<BufferT, IDirect3DIndexBuffer9>) {
+    hresult = pDevice->CreateIndexBuffer(size, D3DUSAGE_WRITEONLY, indexFormat, D3DPOOL_DEFAULT, &pBuffer, nullptr);
+  } else {
+    hresult = pDevice->CreateVertexBuffer(size, D3DUSAGE_WRITEONLY, 0, D3DPOOL_DEFAULT, &pBuffer, nullptr);
+  }
+  if (FAILED(hresult)) {
+    Logger::warn(format_string("Unable to create cached UP geometry buffer of %u bytes: 0x%08x", size, hresult));
+    return nullptr;
+  }
+  void* pDst = nullptr;
+  hresult = pBuffer->Lock(0, size, &pDst, 0);
+  if (FAILED(hresult)) {
+    Logger::warn(format_string("Unable to fill cached UP geometry buffer of %u bytes: 0x%08x", size, hresult));
+    pBuffer->Release();
+    return nullptr;
+  }
+  memcpy(pDst, pData, size);
+  pBuffer->Unlock();
+  return pBuffer;
+}
+
+static void releaseCachedGeometry(const uint64_t hash) {
+  auto it = gCachedGeometry.find(hash);
+  if (it == gCachedGeometry.end()) {
+    return;
+  }
+  if (it->second.pVB) {
+    it->second.pVB->Release();
+  }
+  if (it->second.pIB) {
+    it->second.pIB->Release();
+  }
+  gCachedGeometry.erase(it);
+}
+
+static inline uint64_t makeHash(const uint32_t lo, const uint32_t hi) {
+  return ((uint64_t) hi << 32) | lo;
+}
+
+// Looks up the interned object for a create that only carried the content hash and
+// adds the handle to its users, returns nullptr if nothing was interned under the hash
+template<typename T>
+static T* acquireInternedObject(const uint64_t hash, const uint32_t handle) {
+  auto it = gInternedObjects.find(hash);
+  if (it == gInternedObjects.end()) {
+    Logger::err(format_string("No interned object found for handle %x", handle));
+    return nullptr;
+  }
+  ++it->second.numHandles;
+  gInternedHandles[handle] = hash;
+  return static_cast<T*>(it->second.pObject);
+}
+
+static void internObject(const uint64_t hash, const uint32_t handle, IUnknown* pObject) {
+  gInternedObjects[hash] = { pObject, 1 };
+  gInternedHandles[handle] = hash;
+}
+
+// Drops the handle from the users of its interned object, returns false while other
+// handles still use the object, i.e. when it must not be destroyed yet
+static bool releaseInternedHandle(const uint32_t handle) {
+  auto handleIt = gInternedHandles.find(handle);
+  if (handleIt == gInternedHandles.end()) {
+    return true;
+  }
+  auto it = gInternedObjects.find(handleIt->second);
+  gInternedHandles.erase(handleIt);
+  if (it == gInternedObjects.end()) {
+    return true;
+  }
+  if (--it->second.numHandles > 0) {
+    return false;
+  }
+  gInternedObjects.erase(it);
+  return true;
+}
+
 template<typename T>
 static bool dumpLeakedObjects(const char* name, const T& map) {
   if (!map.empty()) {
@@ -264,6 +458,12 @@ void ProcessDeviceCommandQueue() {
 
     const Header rpcHeader = DeviceBridge::pop_front();
 
+    LARGE_INTEGER replayStart {};
+    const size_t replayDataStart = DeviceBridge::get_data_pos();
+    if (gpTraceReplay) {
+      QueryPerformanceCounter(&replayStart);
+    }
+
 #ifdef _DEBUG
     // If data batching is enabled and the data offset on the comamnd is different from
     // our current offset we know there must be data to read, so we start a data batch
@@ -276,15 +476,13 @@ void ProcessDeviceCommandQueue() {
 
     {
       ZoneScoped;
-      if (ZoneIsActive) {
-        const std::string commandStr = toString(rpcHeader.command);
-        ZoneName(commandStr.c_str(), commandStr.size());
-      }
+      ZoneCommandName(rpcHeader.command);
       PULL_U(currentUID);
-#if defined(_DEBUG) || defined(DEBUGOPT)
-      if (GlobalOptions::getLogServerCommands()) {
-        Logger::info("Device Processing: " + toString(rpcHeader.command) + " UID: " + std::to_string(currentUID));
-      }
+      CommandLog::record(CommandLog::Event::Process, (uint8_t) CommandTrace::Channel::Device, (uint16_t) rpcHeader.command,
+                         currentUID, rpcHeader.dataOffset, 0);
+      ZoneCommandUID(currentUID);
+#ifdef TRACY_ENABLE
+      TracyPlot("Command Queue Residency (us)", getQueueResidencyUs(rpcHeader));
 #endif
       std::unique_lock<std::mutex> lock(gLock);
       // The mother of all switch statements - every call in the D3D9 interface is mapped here...
@@ -601,6 +799,15 @@ void ProcessDeviceCommandQueue() {
           Logger::err(ss.str());
         }
 
+        if (GlobalOptions::getEmulateQueries()) {
+          PublishQueryResults();
+        }
+        if (GeometryRing::isEnabled()) {
+          // Everything drawn from the ring this frame has been submitted by now
+          GeometryRing::onPresentCompleted();
+        }
+        FrameArena::reset();
+
         // If we're syncing with the client on Present() then trigger the semaphore now
         if (GlobalOptions::getPresentSemaphoreEnabled()) {
           gpPresent->release();
@@ -827,6 +1034,12 @@ void ProcessDeviceCommandQueue() {
         const auto& pRenderTarget = (IDirect3DSurface9*) gpD3DResources[pRenderTargetHandle];
         const auto& pDestSurface = (IDirect3DSurface9*) gpD3DResources[pDestSurfaceHandle];
         auto hresult = pD3DDevice->GetRenderTargetData(IN pRenderTarget, IN pDestSurface);
+        if (Commands::IsDataInSharedHeap(rpcHeader.flags)) {
+          PULL_U(allocId);
+          PULL_U(fence);
+          WriteSurfaceDataToSharedHeap(pDestSurface, hresult, allocId, fence);
+          break;
+        }
         hresult = ReturnSurfaceDataToClient(pDestSurface, hresult, currentUID);
         assert(SUCCEEDED(hresult));
         break;
@@ -839,6 +1052,12 @@ void ProcessDeviceCommandQueue() {
         const auto& pDestSurface = (IDirect3DSurface9*) gpD3DResources[pDestSurfaceHandle];
         IDirect3DSurface9* pBackbuffer = nullptr;
         auto hresult = pD3DDevice->GetFrontBufferData(IN iSwapChain, IN pDestSurface);
+        if (Commands::IsDataInSharedHeap(rpcHeader.flags)) {
+          PULL_U(allocId);
+          PULL_U(fence);
+          WriteSurfaceDataToSharedHeap(pDestSurface, hresult, allocId, fence);
+          break;
+        }
         hresult = ReturnSurfaceDataToClient(pDestSurface, hresult, currentUID);
         assert(SUCCEEDED(hresult));
         break;
@@ -1217,11 +1436,49 @@ void ProcessDeviceCommandQueue() {
         GET_RES(pD3DDevice, gpD3DDevices);
         PULL(D3DPRIMITIVETYPE, PrimitiveType);
         PULL_U(PrimitiveCount);
+        if (Commands::IsGeometryCached(rpcHeader.flags)) {
+          PULL_U(hashLo);
+          PULL_U(hashHi);
+          PULL_U(VertexStreamZeroStride);
+          HRESULT hresult = D3DERR_INVALIDCALL;
+          auto it = gCachedGeometry.find(makeHash(hashLo, hashHi));
+          if (it != gCachedGeometry.end() && it->second.pVB) {
+            // Leave stream 0 unset afterwards, just like DrawPrimitiveUP does
+            pD3DDevice->SetStreamSource(0, it->second.pVB, 0, VertexStreamZeroStride);
+            hresult = pD3DDevice->DrawPrimitive(PrimitiveType, 0, PrimitiveCount);
+            pD3DDevice->SetStreamSource(0, nullptr, 0, 0);
+          } else if (it != gCachedGeometry.end() && !it->second.vertexData.empty()) {
+            hresult = pD3DDevice->DrawPrimitiveUP(PrimitiveType, PrimitiveCount, it->second.vertexData.data(), VertexStreamZeroStride);
+          } else {
+            Logger::err("DrawPrimitiveUP() referenced UP geometry that is not cached");
+          }
+          SEND_OPTIONAL_SERVER_RESPONSE(hresult, currentUID);
+          break;
+        }
         void* pVertexStreamZeroData = nullptr;
-        DeviceBridge::get_data(&pVertexStreamZeroData);
+        if (Commands::IsDataInGeometryRing(rpcHeader.flags)) {
+          PULL_U(vertexRingOffset);
+          pVertexStreamZeroData = GeometryRing::getData(vertexRingOffset);
+        } else {
+          DeviceBridge::get_data(&pVertexStreamZeroData);
+        }
         PULL_U(VertexStreamZeroStride);
         const auto hresult = pD3DDevice->DrawPrimitiveUP(IN PrimitiveType, IN PrimitiveCount, IN pVertexStreamZeroData, IN VertexStreamZeroStride);
         assert(SUCCEEDED(hresult));
+        if (Commands::IsGeometryPromote(rpcHeader.flags)) {
+          PULL_U(hashLo);
+          PULL_U(hashHi);
+          PULL_U(vertexDataSize);
+          const uint64_t hash = makeHash(hashLo, hashHi);
+          releaseCachedGeometry(hash);
+          auto* const pVB = createCachedBuffer<IDirect3DVertexBuffer9>(pD3DDevice, pVertexStreamZeroData, vertexDataSize, D3DFMT_UNKNOWN);
+          if (pVB) {
+            gCachedGeometry[hash] = { pVB, nullptr };
+          } else {
+            const auto* const pVertexData = static_cast<const uint8_t*>(pVertexStreamZeroData);
+            gCachedGeometry[hash] = { nullptr, nullptr, { pVertexData, pVertexData + vertexDataSize } };
+          }
+        }
         SEND_OPTIONAL_SERVER_RESPONSE(hresult, currentUID);
         break;
       }
@@ -1235,13 +1492,68 @@ void ProcessDeviceCommandQueue() {
         PULL(D3DFORMAT, IndexDataFormat);
         PULL_U(VertexStreamZeroStride);
 
+        if (Commands::IsGeometryCached(rpcHeader.flags)) {
+          PULL_U(hashLo);
+          PULL_U(hashHi);
+          HRESULT hresult = D3DERR_INVALIDCALL;
+          auto it = gCachedGeometry.find(makeHash(hashLo, hashHi));
+          if (it != gCachedGeometry.end() && it->second.pVB && it->second.pIB) {
+            // Leave stream 0 and the indices unset afterwards, just like DrawIndexedPrimitiveUP does
+            pD3DDevice->SetStreamSource(0, it->second.pVB, 0, VertexStreamZeroStride);
+            pD3DDevice->SetIndices(it->second.pIB);
+            hresult = pD3DDevice->DrawIndexedPrimitive(PrimitiveType, 0, MinVertexIndex, NumVertices, 0, PrimitiveCount);
+            pD3DDevice->SetStreamSource(0, nullptr, 0, 0);
+            pD3DDevice->SetIndices(nullptr);
+          } else if (it != gCachedGeometry.end() && !it->second.vertexData.empty()) {
+            hresult = pD3DDevice->DrawIndexedPrimitiveUP(PrimitiveType, MinVertexIndex, NumVertices, PrimitiveCount,
+                                                         it->second.indexData.data(), IndexDataFormat,
+                                                         it->second.vertexData.data(), VertexStreamZeroStride);
+          } else {
+            Logger::err("DrawIndexedPrimitiveUP() referenced UP geometry that is not cached");
+          }
+          SEND_OPTIONAL_SERVER_RESPONSE(hresult, currentUID);
+          break;
+        }
+
         void* pIndexData = nullptr;
-        DeviceBridge::get_data(&pIndexData);
         void* pVertexStreamZeroData = nullptr;
-        DeviceBridge::get_data(&pVertexStreamZeroData);
+        if (Commands::IsDataInGeometryRing(rpcHeader.flags)) {
+          PULL_U(indexRingOffset);
+          PULL_U(vertexRingOffset);
+          pIndexData = GeometryRing::getData(indexRingOffset);
+          pVertexStreamZeroData = GeometryRing::getData(vertexRingOffset);
+        } else {
+          DeviceBridge::get_data(&pIndexData);
+          DeviceBridge::get_data(&pVertexStreamZeroData);
+        }
 
         const auto hresult = pD3DDevice->DrawIndexedPrimitiveUP(IN PrimitiveType, IN MinVertexIndex, IN NumVertices, IN PrimitiveCount, IN pIndexData, IN IndexDataFormat, IN pVertexStreamZeroData, IN VertexStreamZeroStride);
         assert(SUCCEEDED(hresult));
+        if (Commands::IsGeometryPromote(rpcHeader.flags)) {
+          PULL_U(hashLo);
+          PULL_U(hashHi);
+          PULL_U(indexDataSize);
+          PULL_U(vertexDataSize);
+          const uint64_t hash = makeHash(hashLo, hashHi);
+          releaseCachedGeometry(hash);
+          auto* const pIB = createCachedBuffer<IDirect3DIndexBuffer9>(pD3DDevice, pIndexData, indexDataSize, IndexDataFormat);
+          auto* const pVB = createCachedBuffer<IDirect3DVertexBuffer9>(pD3DDevice, pVertexStreamZeroData, vertexDataSize, D3DFMT_UNKNOWN);
+          if (pIB && pVB) {
+            gCachedGeometry[hash] = { pVB, pIB };
+          } else {
+            if (pIB) {
+              pIB->Release();
+            }
+            if (pVB) {
+              pVB->Release();
+            }
+            const auto* const pIndices = static_cast<const uint8_t*>(pIndexData);
+            const auto* const pVertexData = static_cast<const uint8_t*>(pVertexStreamZeroData);
+            gCachedGeometry[hash] = { nullptr, nullptr,
+                                      { pVertexData, pVertexData + vertexDataSize },
+                                      { pIndices, pIndices + indexDataSize } };
+          }
+        }
         SEND_OPTIONAL_SERVER_RESPONSE(hresult, currentUID);
         break;
       }
@@ -1266,17 +1578,36 @@ void ProcessDeviceCommandQueue() {
       case IDirect3DDevice9Ex_CreateVertexDeclaration:
       {
         GET_RES(pD3DDevice, gpD3DDevices);
-        PULL_U(numOfElements);
-        D3DVERTEXELEMENT9* pVertexElements = nullptr;
-        PULL_DATA(sizeof(D3DVERTEXELEMENT9) * numOfElements, pVertexElements);
-        PULL_HND(pHandle);
-        LPDIRECT3DVERTEXDECLARATION9 pDecl;
-        const auto hresult = pD3DDevice->CreateVertexDeclaration(IN pVertexElements, OUT & pDecl);
-        if (SUCCEEDED(hresult)) {
-          gpD3DVertexDeclarations[pHandle] = pDecl;
+        uint64_t internHash = 0;
+        if (Commands::IsInternObject(rpcHeader.flags) || Commands::IsObjectInterned(rpcHeader.flags)) {
+          PULL_U(hashLo);
+          PULL_U(hashHi);
+          internHash = makeHash(hashLo, hashHi);
+        }
+        HRESULT hresult;
+        if (Commands::IsObjectInterned(rpcHeader.flags)) {
+          PULL_HND(pHandle);
+          auto* const pDecl = acquireInternedObject<IDirect3DVertexDeclaration9>(internHash, pHandle);
+          hresult = pDecl ? S_OK : D3DERR_INVALIDCALL;
+          if (pDecl) {
+            gpD3DVertexDeclarations[pHandle] = pDecl;
+          }
+        } else {
+          PULL_U(numOfElements);
+          D3DVERTEXELEMENT9* pVertexElements = nullptr;
+          PULL_DATA(sizeof(D3DVERTEXELEMENT9) * numOfElements, pVertexElements);
+          PULL_HND(pHandle);
+          LPDIRECT3DVERTEXDECLARATION9 pDecl;
+          hresult = pD3DDevice->CreateVertexDeclaration(IN pVertexElements, OUT & pDecl);
+          if (SUCCEEDED(hresult)) {
+            gpD3DVertexDeclarations[pHandle] = pDecl;
+            if (Commands::IsInternObject(rpcHeader.flags)) {
+              internObject(internHash, pHandle, pDecl);
+            }
+          }
         }
         assert(SUCCEEDED(hresult));
-        SEND_OPTIONAL_CREATE_FUNCTION_SERVER_RESPONSE(hresult, currentUID);
+        SEND_CREATE_FUNCTION_SERVER_RESPONSE_FOR_INTERNING(hresult, currentUID);
         break;
       }
       case IDirect3DDevice9Ex_SetVertexDeclaration:
@@ -1308,17 +1639,35 @@ void ProcessDeviceCommandQueue() {
       case IDirect3DDevice9Ex_CreateVertexShader:
       {
         GET_RES(pD3DDevice, gpD3DDevices);
+        uint64_t internHash = 0;
+        if (Commands::IsInternObject(rpcHeader.flags) || Commands::IsObjectInterned(rpcHeader.flags)) {
+          PULL_U(hashLo);
+          PULL_U(hashHi);
+          internHash = makeHash(hashLo, hashHi);
+        }
         PULL_HND(pHandle);
-        PULL_U(dataSize);
-        DWORD* pFunction = nullptr;
-        PULL_DATA(dataSize, pFunction);
-        IDirect3DVertexShader9* pShader = nullptr;
-        const auto hresult = pD3DDevice->CreateVertexShader(IN pFunction, OUT & pShader);
-        if (SUCCEEDED(hresult)) {
-          gpD3DVertexShaders[pHandle] = pShader;
+        HRESULT hresult;
+        if (Commands::IsObjectInterned(rpcHeader.flags)) {
+          auto* const pShader = acquireInternedObject<IDirect3DVertexShader9>(internHash, pHandle);
+          hresult = pShader ? S_OK : D3DERR_INVALIDCALL;
+          if (pShader) {
+            gpD3DVertexShaders[pHandle] = pShader;
+          }
+        } else {
+          PULL_U(dataSize);
+          DWORD* pFunction = nullptr;
+          PULL_DATA(dataSize, pFunction);
+          IDirect3DVertexShader9* pShader = nullptr;
+          hresult = pD3DDevice->CreateVertexShader(IN pFunction, OUT & pShader);
+          if (SUCCEEDED(hresult)) {
+            gpD3DVertexShaders[pHandle] = pShader;
+            if (Commands::IsInternObject(rpcHeader.flags)) {
+              internObject(internHash, pHandle, pShader);
+            }
+          }
         }
         assert(SUCCEEDED(hresult));
-        SEND_OPTIONAL_CREATE_FUNCTION_SERVER_RESPONSE(hresult, currentUID);
+        SEND_CREATE_FUNCTION_SERVER_RESPONSE_FOR_INTERNING(hresult, currentUID);
         break;
       }
       case IDirect3DDevice9Ex_SetVertexShader:
@@ -1426,17 +1775,35 @@ void ProcessDeviceCommandQueue() {
       case IDirect3DDevice9Ex_CreatePixelShader:
       {
         GET_RES(pD3DDevice, gpD3DDevices);
+        uint64_t internHash = 0;
+        if (Commands::IsInternObject(rpcHeader.flags) || Commands::IsObjectInterned(rpcHeader.flags)) {
+          PULL_U(hashLo);
+          PULL_U(hashHi);
+          internHash = makeHash(hashLo, hashHi);
+        }
         PULL_HND(pHandle);
-        PULL_U(dataSize);
-        DWORD* pFunction = nullptr;
-        PULL_DATA(dataSize, pFunction);
-        IDirect3DPixelShader9* pShader = nullptr;
-        const auto hresult = pD3DDevice->CreatePixelShader(IN pFunction, OUT & pShader);
-        if (SUCCEEDED(hresult)) {
-          gpD3DPixelShaders[pHandle] = pShader;
+        HRESULT hresult;
+        if (Commands::IsObjectInterned(rpcHeader.flags)) {
+          auto* const pShader = acquireInternedObject<IDirect3DPixelShader9>(internHash, pHandle);
+          hresult = pShader ? S_OK : D3DERR_INVALIDCALL;
+          if (pShader) {
+            gpD3DPixelShaders[pHandle] = pShader;
+          }
+        } else {
+          PULL_U(dataSize);
+          DWORD* pFunction = nullptr;
+          PULL_DATA(dataSize, pFunction);
+          IDirect3DPixelShader9* pShader = nullptr;
+          hresult = pD3DDevice->CreatePixelShader(IN pFunction, OUT & pShader);
+          if (SUCCEEDED(hresult)) {
+            gpD3DPixelShaders[pHandle] = pShader;
+            if (Commands::IsInternObject(rpcHeader.flags)) {
+              internObject(internHash, pHandle, pShader);
+            }
+          }
         }
         assert(SUCCEEDED(hresult));
-        SEND_OPTIONAL_CREATE_FUNCTION_SERVER_RESPONSE(hresult, currentUID);
+        SEND_CREATE_FUNCTION_SERVER_RESPONSE_FOR_INTERNING(hresult, currentUID);
         break;
       }
       case IDirect3DDevice9Ex_SetPixelShader:
@@ -1643,6 +2010,15 @@ void ProcessDeviceCommandQueue() {
           ss << "Present() failed! Check all logs for reported errors.";
         }
 
+        if (GlobalOptions::getEmulateQueries()) {
+          PublishQueryResults();
+        }
+        if (GeometryRing::isEnabled()) {
+          // Everything drawn from the ring this frame has been submitted by now
+          GeometryRing::onPresentCompleted();
+        }
+        FrameArena::reset();
+
         // If we're syncing with the client on Present() then trigger the semaphore now
         if (GlobalOptions::getPresentSemaphoreEnabled()) {
           gpPresent->release();
@@ -1661,6 +2037,12 @@ void ProcessDeviceCommandQueue() {
         if (SUCCEEDED(hresult)) {
           gpD3DResources[pDestSurfaceHandle] = pDestSurface;
         }
+        if (Commands::IsDataInSharedHeap(rpcHeader.flags)) {
+          PULL_U(allocId);
+          PULL_U(fence);
+          WriteSurfaceDataToSharedHeap(pDestSurface, hresult, allocId, fence);
+          break;
+        }
         hresult = ReturnSurfaceDataToClient(pDestSurface, hresult, currentUID);
         assert(SUCCEEDED(hresult));
         break;
@@ -1743,7 +2125,9 @@ void ProcessDeviceCommandQueue() {
       {
         GET_HND(pHandle);
         const auto& pVertexDeclaration = gpD3DVertexDeclarations[pHandle];
-        safeDestroy(pVertexDeclaration, pHandle);
+        if (releaseInternedHandle(pHandle)) {
+          safeDestroy(pVertexDeclaration, pHandle);
+        }
         gpD3DVertexDeclarations.erase(pHandle);
         break;
       }
@@ -1768,7 +2152,9 @@ void ProcessDeviceCommandQueue() {
       {
         GET_HND(pHandle);
         const auto& pVertexShader = gpD3DVertexShaders[pHandle];
-        safeDestroy(pVertexShader, pHandle);
+        if (releaseInternedHandle(pHandle)) {
+          safeDestroy(pVertexShader, pHandle);
+        }
         gpD3DVertexShaders.erase(pHandle);
         break;
       }
@@ -1793,7 +2179,9 @@ void ProcessDeviceCommandQueue() {
       {
         GET_HND(pHandle);
         const auto& pPixelShader = gpD3DPixelShaders[pHandle];
-        safeDestroy(pPixelShader, pHandle);
+        if (releaseInternedHandle(pHandle)) {
+          safeDestroy(pPixelShader, pHandle);
+        }
         gpD3DPixelShaders.erase(pHandle);
         break;
       }
@@ -2264,9 +2652,18 @@ void ProcessDeviceCommandQueue() {
 
         // Copy the data over
         void* data = nullptr;
+        StreamMirrorHeader* pMirrorHeader = nullptr;
+        uint32_t mirrorSerial = 0;
         if (Commands::IsDataReserved(rpcHeader.flags)) {
           PULL_D(DataOffset);
           data = DeviceBridge::Bridge::getReaderChannel().get_data_ptr() + DataOffset;
+        } else if (Commands::IsDataInStreamMirror(rpcHeader.flags)) {
+          PULL_U(allocId);
+          PULL_U(serial);
+          BYTE* const pMirror = SharedHeap::getBuf(allocId);
+          data = pMirror + kStreamMirrorDataOffset + OffsetToLock;
+          pMirrorHeader = reinterpret_cast<StreamMirrorHeader*>(pMirror);
+          mirrorSerial = serial;
         } else if (Commands::IsDataInSharedHeap(rpcHeader.flags)) {
           PULL_U(allocId);
           data = SharedHeap::getBuf(allocId) + OffsetToLock;
@@ -2275,6 +2672,10 @@ void ProcessDeviceCommandQueue() {
           assert(SizeToLock == size);
         }
         memcpy(pbData, data, SizeToLock);
+        if (pMirrorHeader) {
+          // Let the client know this part of the mirror may be reused
+          pMirrorHeader->consumedSerial.store(mirrorSerial, std::memory_order_release);
+        }
         hresult = pVertexBuffer->Unlock();
         assert(SUCCEEDED(hresult));
 
@@ -2352,9 +2753,18 @@ void ProcessDeviceCommandQueue() {
 
         // Copy the data over
         void* data = nullptr;
+        StreamMirrorHeader* pMirrorHeader = nullptr;
+        uint32_t mirrorSerial = 0;
         if (Commands::IsDataReserved(rpcHeader.flags)) {
           PULL_D(DataOffset);
           data = DeviceBridge::Bridge::getReaderChannel().get_data_ptr() + DataOffset;
+        } else if (Commands::IsDataInStreamMirror(rpcHeader.flags)) {
+          PULL_U(allocId);
+          PULL_U(serial);
+          BYTE* const pMirror = SharedHeap::getBuf(allocId);
+          data = pMirror + kStreamMirrorDataOffset + OffsetToLock;
+          pMirrorHeader = reinterpret_cast<StreamMirrorHeader*>(pMirror);
+          mirrorSerial = serial;
         } else if (Commands::IsDataInSharedHeap(rpcHeader.flags)) {
           PULL_U(allocId);
           data = SharedHeap::getBuf(allocId) + OffsetToLock;
@@ -2363,6 +2773,10 @@ void ProcessDeviceCommandQueue() {
           assert(SizeToLock == size);
         }
         memcpy(pbData, data, SizeToLock);
+        if (pMirrorHeader) {
+          // Let the client know this part of the mirror may be reused
+          pMirrorHeader->consumedSerial.store(mirrorSerial, std::memory_order_release);
+        }
         hresult = pIndexBuffer->Unlock();
         assert(SUCCEEDED(hresult));
         break;
@@ -2580,6 +2994,11 @@ void ProcessDeviceCommandQueue() {
       {
         GET_HND(pHandle);
         const auto& pQuery = (IDirect3DQuery9*) gpD3DQuery[pHandle];
+        gPendingQueries.erase(std::remove_if(gPendingQueries.begin(), gPendingQueries.end(),
+                                             [pQuery](const PendingQuery& pending) {
+                                               return pending.pQuery == pQuery;
+                                             }),
+                              gPendingQueries.end());
         safeDestroy(pQuery, pHandle);
         gpD3DQuery.erase(pHandle);
         break;
@@ -2596,6 +3015,25 @@ void ProcessDeviceCommandQueue() {
         PULL(DWORD, dwIssueFlags);
         const auto &pQuery = gpD3DQuery[pHandle];
         const auto hresult = pQuery->Issue(dwIssueFlags);
+        // With query emulation the client tags each occlusion query end with the
+        // slot and sequence number under which it expects the result to be published
+        if (GlobalOptions::getEmulateQueries() && (dwIssueFlags & D3DISSUE_END) &&
+            pQuery->GetType() == D3DQUERYTYPE_OCCLUSION) {
+          PULL_U(slot);
+          PULL_U(sequence);
+          if (SUCCEEDED(hresult) && slot != QueryResults::kInvalidSlot) {
+            // Re-issuing a query supersedes its previous pending result
+            auto it = std::find_if(gPendingQueries.begin(), gPendingQueries.end(),
+                                   [pQuery](const PendingQuery& pending) {
+                                     return pending.pQuery == pQuery;
+                                   });
+            if (it != gPendingQueries.end()) {
+              *it = { pQuery, slot, sequence };
+            } else {
+              gPendingQueries.push_back({ pQuery, slot, sequence });
+            }
+          }
+        }
         SEND_OPTIONAL_SERVER_RESPONSE(hresult, currentUID);
         break;
       }
@@ -2605,11 +3043,26 @@ void ProcessDeviceCommandQueue() {
         PULL(DWORD, dwSize);
         PULL(DWORD, dwGetDataFlags);
         const auto& pQuery = gpD3DQuery[pHandle];
+        // Queries are polled many times per frame, do not hold on to their data until Present
+        FrameArena::Scope scratchScope;
         void* pData = NULL;
         if (dwSize > 0) {
-          pData = new char[dwSize];
+          pData = FrameArena::allocate(dwSize);
         }
         const auto hresult = pQuery->GetData(pData, dwSize, dwGetDataFlags);
+        if (hresult == S_OK && dwSize >= sizeof(DWORD) && !gPendingQueries.empty()) {
+          // Publish the result right away, later polls of the query are then answered locally
+          auto it = std::find_if(gPendingQueries.begin(), gPendingQueries.end(),
+                                 [pQuery](const PendingQuery& pending) {
+                                   return pending.pQuery == pQuery;
+                                 });
+          if (it != gPendingQueries.end()) {
+            auto& slot = QueryResults::get().slots[it->slot];
+            slot.result = *static_cast<const DWORD*>(pData);
+            slot.sequence.store(it->sequence, std::memory_order_release);
+            gPendingQueries.erase(it);
+          }
+        }
 
         ServerMessage c(Commands::Bridge_Response, currentUID);
         c.send_data(hresult);
@@ -2619,10 +3072,6 @@ void ProcessDeviceCommandQueue() {
             c.end_data_blob();
           }
         }
-      
-        if (dwSize > 0) {
-          delete[]pData;
-        }
         break;
       }
 
@@ -2673,9 +3122,27 @@ void ProcessDeviceCommandQueue() {
         gpD3DResources.erase(pHandle);
         break;
       }
+      case Bridge_ReleaseCachedGeometry:
+      {
+        PULL_U(count);
+        uint64_t* pHashes = nullptr;
+        DeviceBridge::get_data((void**) &pHashes);
+        for (uint32_t i = 0; i < count; ++i) {
+          releaseCachedGeometry(pHashes[i]);
+        }
+        break;
+      }
+      case Bridge_LaneDependency:
+      {
+        // The command after this accesses a texture with uploads still in flight on the bulk lane
+        GET_HDR_VAL(token);
+        waitForBulkLane(lock, token);
+        break;
+      }
       default:
         break;
       }
+      onDeviceCommandProcessed(currentUID);
     }
 
     // Ensure the data position between client and server is in sync after processing the command
@@ -2683,24 +3150,19 @@ void ProcessDeviceCommandQueue() {
       Logger::warn("Data not in sync");
     }
     assert(CHECK_DATA_OFFSET);
-    *DeviceBridge::getReaderChannel().serverDataPos = DeviceBridge::get_data_pos();
-    // Check if overwrite condition was met
-    if (*DeviceBridge::getReaderChannel().clientDataExpectedPos != -1) {
-      if (!gOverwriteConditionAlreadyActive) {
-        gOverwriteConditionAlreadyActive = true;
-        Logger::warn("Data Queue overwrite condition triggered");
-      }
-      // Check if server needs to complete a loop and the position was read
-      if (*DeviceBridge::getReaderChannel().serverDataPos > *DeviceBridge::getReaderChannel().clientDataExpectedPos && !(*DeviceBridge::getReaderChannel().serverResetPosRequired)) {
-        DeviceBridge::getReaderChannel().dataSemaphore->release(1);
-        *DeviceBridge::getReaderChannel().clientDataExpectedPos = -1;
-        gOverwriteConditionAlreadyActive = false;
-        Logger::info("DataQueue overwrite condition resolved");
-      }
-    }
+    // Hand the data queue space used by the command back to the client
+    DeviceBridge::release_data_credits();
 
     const auto count = DeviceBridge::end_read_data();
 
+    if (gpTraceReplay) {
+      LARGE_INTEGER replayEnd;
+      QueryPerformanceCounter(&replayEnd);
+      const size_t totalSize = DeviceBridge::getReaderChannel().data->get_total_size();
+      const size_t dataSize = (DeviceBridge::get_data_pos() + totalSize - replayDataStart) % totalSize;
+      gpTraceReplay->recordCommand(rpcHeader.command, replayEnd.QuadPart - replayStart.QuadPart, dataSize * sizeof(uint32_t));
+    }
+
 #ifdef ENABLE_DATA_BATCHING_TRACE
     Logger::trace(format_string("Finished batch data read with %d data items.", count));
 #endif
@@ -2709,8 +3171,7 @@ void ProcessDeviceCommandQueue() {
     // See how long processing this command took
     const auto diff = GetTickCount64() - start;
     if (diff > SERVER_COMMAND_THRESHOLD_MS) {
-      std::string command = Commands::toString(rpcHeader.command);
-      Logger::trace(format_string("Command %s took %d milliseconds to process!", command.c_str(), diff));
+      Logger::trace(format_string("Command %s took %d milliseconds to process!", Commands::toName(rpcHeader.command), diff));
     }
 #endif
   }
@@ -2867,6 +3328,51 @@ static bool RegisterMessageChannel() {
   return true;
 }
 
+// Replays a command trace captured by the client against the null D3D9 backend,
+// so that no client process, GPU or D3D9 runtime is needed.
+static int RunTraceReplay(const std::string& tracePath) {
+  gpTraceReplay = std::make_unique<TraceReplay>(tracePath);
+  if (!gpTraceReplay->isValid()) {
+    return 1;
+  }
+
+  initModuleBridge();
+  initDeviceBridge();
+
+  if (GlobalOptions::getEmulateQueries()) {
+    QueryResults::init();
+  }
+
+  if (GlobalOptions::getAsyncCreateFunctions()) {
+    DeferredErrors::init();
+  }
+
+  if (GlobalOptions::getGeometryRingSize() > 0) {
+    GeometryRing::init(GlobalOptions::getGeometryRingSize());
+  }
+
+  gpPresent = new NamedSemaphore("Present", GlobalOptions::getPresentSemaphoreMaxFrames(), GlobalOptions::getPresentSemaphoreMaxFrames());
+
+  Logger::info("Initializing null D3D9 backend for command trace replay...");
+  gpD3D = NullD3D9::create();
+  // Unlike system D3D9 the null backend has no trouble with fullscreen swapchains
+  bDxvkModuleLoaded = true;
+
+  gpTraceReplay->start(gpPresent);
+
+  std::atomic<bool> bSignalDone(false);
+  auto moduleCmdProcessingThread = std::thread([&]() {
+    processModuleCommandQueue(&bSignalDone);
+  });
+  ProcessDeviceCommandQueue();
+  bSignalDone.store(true);
+  moduleCmdProcessingThread.join();
+
+  gpTraceReplay->finish();
+  NullD3D9::logCallCounts();
+  return 0;
+}
+
 int WINAPI wWinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance, _In_ PWSTR pCmdLine, _In_ int nCmdShow) {
   gTimeStart = std::chrono::high_resolution_clock::now();
 
@@ -2874,6 +3380,7 @@ int WINAPI wWinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance,
   Config::init(Config::App::Server);
   GlobalOptions::init();
   Logger::set_loglevel(GlobalOptions::getLogLevel());
+  Logger::set_max_file_size(GlobalOptions::getLogMaxFileSize());
 
   // Always setup exception handler on server
   ExceptionHandler::get().init();
@@ -2889,6 +3396,27 @@ int WINAPI wWinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance,
 
   int argCount;
   LPWSTR* argList = CommandLineToArgvW(pCmdLine, &argCount);
+  if (argCount >= 3 && wcscmp(argList[0], L"--decode-command-log") == 0) {
+    std::vector<std::string> paths;
+    for (int i = 1; i < argCount; ++i) {
+      char path[MAX_PATH] = {};
+      WideCharToMultiByte(CP_ACP, 0, argList[i], -1, path, sizeof(path), nullptr, nullptr);
+      paths.push_back(path);
+    }
+    LocalFree(argList);
+    // The first path is the output, the rest are the command logs to merge
+    const std::string outputPath = paths.front();
+    paths.erase(paths.begin());
+    return CommandLog::decode(paths, outputPath) ? 0 : 1;
+  }
+  // Only after the decode mode above, mapping the log truncates the server log it may read
+  CommandLog::init(CommandLog::Side::Server);
+  if (argCount >= 2 && wcscmp(argList[0], L"--replay") == 0) {
+    char tracePath[MAX_PATH] = {};
+    WideCharToMultiByte(CP_ACP, 0, argList[1], -1, tracePath, sizeof(tracePath), nullptr, nullptr);
+    LocalFree(argList);
+    return RunTraceReplay(tracePath);
+  }
   BRIDGE_ASSERT_LOG((argCount >= 2), "Command line argument count received to launch server is not as expected");
   if (gUniqueIdentifier.setGuid(&argList[0])) {
     Logger::info("Launched server with GUID " + gUniqueIdentifier.toString());
@@ -2900,21 +3428,64 @@ int WINAPI wWinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance,
     Logger::err(format_string("Client (%s) and server (%s) version numbers do not match. Mixed version runtime execution is currently not supported! Exiting...", argList[1], BRIDGE_VERSION));
     return 1;
   }
+  // Requested by the client when it replays a command trace
+  const bool bUseNullDevice = argCount >= 3 && wcscmp(argList[2], L"--null-device") == 0;
+  // Requested by the client when it launches the server before the application created its D3D9 object
+  HANDLE hEarlyClient = nullptr;
+  if (argCount >= 4 && wcscmp(argList[2], L"--wait-for-client") == 0) {
+    hEarlyClient = OpenProcess(SYNCHRONIZE, FALSE, (DWORD) _wtoi(argList[3]));
+  }
   LocalFree(argList);
+  logStartupPhase("Server started");
+
+  // Loading the D3D9 runtime is by far the most expensive part of startup, so it
+  // happens concurrently with the handshake instead of after the client connected
+  std::future<bool> d3dInitialized;
+  if (!bUseNullDevice) {
+    Logger::info("Initializing D3D9...");
+    d3dInitialized = std::async(std::launch::async, []() {
+      const bool bSuccess = InitializeD3D();
+      logStartupPhase("D3D9 initialized");
+      return bSuccess;
+    });
+  }
 
   initModuleBridge();
   initDeviceBridge();
+  if (GlobalOptions::getUseBulkLane()) {
+    initBulkBridge();
+  }
 
   if (GlobalOptions::getUseSharedHeap()) {
     SharedHeap::init();
   }
 
+  if (GlobalOptions::getEmulateQueries()) {
+    QueryResults::init();
+  }
+
+  if (GlobalOptions::getAsyncCreateFunctions()) {
+    DeferredErrors::init();
+  }
+
+  if (GlobalOptions::getGeometryRingSize() > 0) {
+    GeometryRing::init(GlobalOptions::getGeometryRingSize());
+  }
+
   gpPresent = new NamedSemaphore("Present", GlobalOptions::getPresentSemaphoreMaxFrames(), GlobalOptions::getPresentSemaphoreMaxFrames());
 
   // Initialize our shared client command queue as a Reader.
   // (1) Wait for connection for client.
   Logger::info("Server started up, waiting for connection from client...");
-  const auto waitForSynResult = DeviceBridge::waitForCommand(Bridge_Syn, GlobalOptions::getStartupTimeout());
+  auto waitForSynResult = DeviceBridge::waitForCommand(Bridge_Syn, GlobalOptions::getStartupTimeout());
+  // A server launched early keeps waiting for as long as the client process is around
+  while (waitForSynResult == Result::Timeout && hEarlyClient != nullptr &&
+         WaitForSingleObject(hEarlyClient, 0) == WAIT_TIMEOUT) {
+    waitForSynResult = DeviceBridge::waitForCommand(Bridge_Syn, GlobalOptions::getStartupTimeout());
+  }
+  if (hEarlyClient != nullptr) {
+    CloseHandle(hEarlyClient);
+  }
   switch (waitForSynResult) {
   case Result::Timeout:
   {
@@ -2929,6 +3500,7 @@ int WINAPI wWinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance,
   }
   }
   const auto synResponse = DeviceBridge::pop_front(); // Get process handle from Syn response
+  logStartupPhase("Client connected");
   // Pulling default data sent from client to have the data queue in sync
   {
     PULL_U(uid);
@@ -2938,10 +3510,16 @@ int WINAPI wWinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance,
 
   RegisterMessageChannel();
 
-  // (2) Load d3d9.dll, which could be original system, dxvk-remix, or something else...
-  Logger::info("Initializing D3D9...");
-  if (!InitializeD3D()) {
-    return 1;
+  // (2) Finish loading d3d9.dll, which could be original system, dxvk-remix, or something else...
+  if (bUseNullDevice) {
+    Logger::info("Initializing null D3D9 backend for command trace replay...");
+    gpD3D = NullD3D9::create();
+    bDxvkModuleLoaded = true;
+  } else {
+    Logger::info("Waiting for D3D9 initialization to finish...");
+    if (!d3dInitialized.get()) {
+      return 1;
+    }
   }
 
   // (3) Send ACK to Client. Connection has been established
@@ -2969,19 +3547,32 @@ int WINAPI wWinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance,
   }
   // (5) Ready to listen for incoming commands
   Logger::info("Handshake completed! Now waiting for incoming commands...");
+  logStartupPhase("Handshake completed");
 
   std::atomic<bool> bSignalDone(false);
   auto moduleCmdProcessingThread = std::thread([&]() {
     processModuleCommandQueue(&bSignalDone);
   });
+  std::thread bulkCmdProcessingThread;
+  if (GlobalOptions::getUseBulkLane()) {
+    bulkCmdProcessingThread = std::thread([&]() {
+      processBulkCommandQueue(&bSignalDone);
+    });
+  }
   // Process device commands
   ProcessDeviceCommandQueue();
   bSignalDone.store(true);
   moduleCmdProcessingThread.join();
+  if (bulkCmdProcessingThread.joinable()) {
+    bulkCmdProcessingThread.join();
+  }
 
   if (!dumpLeakedObjects()) {
     bridge_util::Logger::debug("No leaked objects dicovered at Direct3D module eviction.");
   }
+  if (bUseNullDevice) {
+    NullD3D9::logCallCounts();
+  }
 
   // Command processing finished, clean up and exit
   Logger::info("Command processing loop finished, cleaning up and exiting...");
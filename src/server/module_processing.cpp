@@ -40,7 +40,9 @@ extern std::mutex gLock;
 #define PULL_OBJ(type, name) \
             type* name = nullptr; \
             PULL_DATA(sizeof(type), name)
-#define CHECK_DATA_OFFSET (ModuleBridge::get_data_pos() == rpcHeader.dataOffset)
+// Commands with a chunked payload have their header sent ahead of the data
+#define CHECK_DATA_OFFSET (Commands::IsDataChunked(rpcHeader.flags) || \
+                           ModuleBridge::get_data_pos() == rpcHeader.dataOffset)
 #define GET_HND(name) \
             const auto& name = rpcHeader.pHandle; \
             assert(name != NULL)
@@ -86,11 +88,14 @@ void processModuleCommandQueue(std::atomic<bool>* const pbSignalEnd) {
   while (RESULT_SUCCESS(ModuleBridge::waitForCommand(
     Commands::Bridge_Any, 0, pbSignalEnd))) {
     const Header rpcHeader = ModuleBridge::pop_front();
+    ZoneScopedN("Process Module Command");
+    ZoneCommandName(rpcHeader.command);
     PULL_U(currentUID);
-#if defined(_DEBUG) || defined(DEBUGOPT)
-    if (GlobalOptions::getLogServerCommands()) {
-      Logger::info("Module Processing: " + toString(rpcHeader.command) + " UID: " + std::to_string(currentUID));
-    }
+    CommandLog::record(CommandLog::Event::Process, (uint8_t) CommandTrace::Channel::Module, (uint16_t) rpcHeader.command,
+                       currentUID, rpcHeader.dataOffset, 0);
+    ZoneCommandUID(currentUID);
+#ifdef TRACY_ENABLE
+    TracyPlot("Module Command Queue Residency (us)", getQueueResidencyUs(rpcHeader));
 #endif
     std::unique_lock<std::mutex> lock(gLock);
     // The mother of all switch statements - every call in the D3D9 interface is mapped here...
@@ -408,6 +413,8 @@ void processModuleCommandQueue(std::atomic<bool>* const pbSignalEnd) {
       break;
     }
     }
+    // Hand the data queue space used by the command back to the client
+    ModuleBridge::release_data_credits();
   }
   // Check if we exited the command processing loop unexpectedly while the bridge is still enabled
   if (!destroyReceived && gbBridgeRunning) {
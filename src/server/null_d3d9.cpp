@@ -0,0 +1,2011 @@
+/*
+ * Copyright (c) 2022-2023, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#include "null_d3d9.h"
+
+#include "util_texture_and_volume.h"
+
+#include "log/log.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace bridge_util;
+
+namespace NullD3D9 {
+namespace {
+  // The one and only display mode reported by the null adapter
+  constexpr UINT kAdapterWidth = 1920;
+  constexpr UINT kAdapterHeight = 1080;
+  constexpr UINT kAdapterRefreshRate = 60;
+  constexpr D3DFORMAT kAdapterFormat = D3DFMT_X8R8G8B8;
+
+  constexpr DWORD kMaxRenderTargets = 4;
+  constexpr DWORD kShaderEndToken = 0x0000FFFF;
+  constexpr DWORD kShaderCommentMask = 0x0000FFFF;
+  constexpr DWORD kShaderCommentToken = 0x0000FFFE;
+
+  struct CallCounter {
+    const char* const name;
+    std::atomic<uint64_t> count { 0 };
+    explicit CallCounter(const char* name_): name(name_) { }
+  };
+
+  std::mutex gCounterMutex;
+  std::vector<std::unique_ptr<CallCounter>> gCounters;
+
+  CallCounter* registerCounter(const char* name) {
+    std::lock_guard<std::mutex> lock(gCounterMutex);
+    gCounters.emplace_back(std::make_unique<CallCounter>(name));
+    return gCounters.back().get();
+  }
+}
+}
+
+// Each method gets its own lazily registered counter, so counting a call costs
+// one relaxed atomic increment after the first invocation.
+#define NULL_D3D9_CALL() \
+  static CallCounter* const s_pCallCounter = registerCounter(__FUNCTION__); \
+  s_pCallCounter->count.fetch_add(1, std::memory_order_relaxed)
+
+namespace NullD3D9 {
+namespace {
+  static inline UINT calcMipLevelCount(UINT width, UINT height, UINT depth = 1) {
+    UINT levels = 1;
+    while (width > 1 || height > 1 || depth > 1) {
+      width = std::max(1u, width >> 1);
+      height = std::max(1u, height >> 1);
+      depth = std::max(1u, depth >> 1);
+      ++levels;
+    }
+    return levels;
+  }
+
+  static inline UINT calcLevelCount(const UINT levels, const DWORD usage,
+                                    const UINT width, const UINT height, const UINT depth = 1) {
+    if (usage & D3DUSAGE_AUTOGENMIPMAP) {
+      // Auto-generated sublevels are not exposed to the application
+      return 1;
+    }
+    const UINT maxLevels = calcMipLevelCount(width, height, depth);
+    return (levels == 0) ? maxLevels : std::min(levels, maxLevels);
+  }
+
+  static inline UINT calcLevelDimension(const UINT dimension, const UINT level) {
+    return std::max(1u, dimension >> level);
+  }
+
+  static void fillDisplayMode(D3DDISPLAYMODE* pMode) {
+    pMode->Width = kAdapterWidth;
+    pMode->Height = kAdapterHeight;
+    pMode->RefreshRate = kAdapterRefreshRate;
+    pMode->Format = kAdapterFormat;
+  }
+
+  static void fillDisplayModeEx(D3DDISPLAYMODEEX* pMode) {
+    pMode->Size = sizeof(D3DDISPLAYMODEEX);
+    pMode->Width = kAdapterWidth;
+    pMode->Height = kAdapterHeight;
+    pMode->RefreshRate = kAdapterRefreshRate;
+    pMode->Format = kAdapterFormat;
+    pMode->ScanLineOrdering = D3DSCANLINEORDERING_PROGRESSIVE;
+  }
+
+  static void fillDeviceCaps(const UINT adapter, const D3DDEVTYPE deviceType, D3DCAPS9* pCaps) {
+    memset(pCaps, 0, sizeof(D3DCAPS9));
+    pCaps->DeviceType = deviceType;
+    pCaps->AdapterOrdinal = adapter;
+    pCaps->Caps2 = D3DCAPS2_CANAUTOGENMIPMAP | D3DCAPS2_DYNAMICTEXTURES;
+    pCaps->PresentationIntervals = D3DPRESENT_INTERVAL_IMMEDIATE | D3DPRESENT_INTERVAL_ONE;
+    pCaps->DevCaps = D3DDEVCAPS_HWTRANSFORMANDLIGHT | D3DDEVCAPS_PUREDEVICE;
+    pCaps->MaxTextureWidth = 8192;
+    pCaps->MaxTextureHeight = 8192;
+    pCaps->MaxVolumeExtent = 2048;
+    pCaps->MaxTextureAspectRatio = 8192;
+    pCaps->MaxAnisotropy = 16;
+    pCaps->MaxActiveLights = 8;
+    pCaps->MaxUserClipPlanes = 6;
+    pCaps->MaxVertexBlendMatrices = 4;
+    pCaps->MaxTextureBlendStages = 8;
+    pCaps->MaxSimultaneousTextures = 8;
+    pCaps->MaxPointSize = 256.f;
+    pCaps->MaxPrimitiveCount = 0x00FFFFFF;
+    pCaps->MaxVertexIndex = 0x00FFFFFF;
+    pCaps->MaxStreams = 16;
+    pCaps->MaxStreamStride = 508;
+    pCaps->VertexShaderVersion = D3DVS_VERSION(3, 0);
+    pCaps->MaxVertexShaderConst = 256;
+    pCaps->PixelShaderVersion = D3DPS_VERSION(3, 0);
+    pCaps->PixelShader1xMaxValue = 65504.f;
+    pCaps->NumSimultaneousRTs = kMaxRenderTargets;
+    pCaps->MaxVShaderInstructionsExecuted = 0xFFFF;
+    pCaps->MaxPShaderInstructionsExecuted = 0xFFFF;
+    pCaps->MaxVertexShader30InstructionSlots = 32768;
+    pCaps->MaxPixelShader30InstructionSlots = 32768;
+  }
+
+  // Lockable memory backing a resource, allocated on first lock
+  class NullStorage {
+  public:
+    uint8_t* get(const size_t size) {
+      if (m_data.size() < size) {
+        m_data.resize(size);
+      }
+      return m_data.data();
+    }
+
+  private:
+    std::vector<uint8_t> m_data;
+  };
+
+  // Reference counting follows the DXVK model rather than system D3D9: every object
+  // keeps its own count, which never goes below zero. Standalone objects delete
+  // themselves on final release, while objects owned by a container (texture levels,
+  // swapchain backbuffers, implicit device surfaces) are only destroyed together
+  // with their container. The server relies on this when it releases objects in
+  // a loop until their count reaches zero, see safeDestroy().
+  template<typename T>
+  class NullUnknown : public T {
+  public:
+    virtual ~NullUnknown() = default;
+
+    STDMETHOD(QueryInterface)(THIS_ REFIID riid, void** ppvObj) override {
+      NULL_D3D9_CALL();
+      if (ppvObj == nullptr) {
+        return E_POINTER;
+      }
+      if (!isSupportedInterface(riid)) {
+        *ppvObj = nullptr;
+        return E_NOINTERFACE;
+      }
+      AddRef();
+      *ppvObj = this;
+      return S_OK;
+    }
+
+    STDMETHOD_(ULONG, AddRef)(THIS) override {
+      NULL_D3D9_CALL();
+      return ++m_refCount;
+    }
+
+    STDMETHOD_(ULONG, Release)(THIS) override {
+      NULL_D3D9_CALL();
+      ULONG refCount = m_refCount.load();
+      do {
+        if (refCount == 0) {
+          return 0;
+        }
+      } while (!m_refCount.compare_exchange_weak(refCount, refCount - 1));
+
+      if (refCount == 1 && !m_bOwned) {
+        onFinalRelease();
+      }
+      return refCount - 1;
+    }
+
+  protected:
+    explicit NullUnknown(const bool bOwned): m_bOwned(bOwned) { }
+
+    virtual bool isSupportedInterface(REFIID riid) const {
+      return riid == __uuidof(IUnknown) || riid == __uuidof(T);
+    }
+
+    virtual void onFinalRelease() {
+      delete this;
+    }
+
+  private:
+    const bool m_bOwned;
+    std::atomic<ULONG> m_refCount { 1 };
+  };
+
+  template<typename T>
+  class NullDeviceChild : public NullUnknown<T> {
+  public:
+    STDMETHOD(GetDevice)(THIS_ IDirect3DDevice9** ppDevice) override {
+      NULL_D3D9_CALL();
+      if (ppDevice == nullptr) {
+        return D3DERR_INVALIDCALL;
+      }
+      m_pDevice->AddRef();
+      *ppDevice = m_pDevice;
+      return D3D_OK;
+    }
+
+  protected:
+    NullDeviceChild(IDirect3DDevice9Ex* pDevice, const bool bOwned)
+      : NullUnknown<T>(bOwned)
+      , m_pDevice(pDevice) { }
+
+    IDirect3DDevice9Ex* const m_pDevice;
+  };
+
+  template<typename T>
+  class NullResource : public NullDeviceChild<T> {
+  public:
+    STDMETHOD(SetPrivateData)(THIS_ REFGUID refguid, CONST void* pData, DWORD SizeOfData, DWORD Flags) override {
+      NULL_D3D9_CALL();
+      return D3D_OK;
+    }
+
+    STDMETHOD(GetPrivateData)(THIS_ REFGUID refguid, void* pData, DWORD* pSizeOfData) override {
+      NULL_D3D9_CALL();
+      return D3DERR_NOTFOUND;
+    }
+
+    STDMETHOD(FreePrivateData)(THIS_ REFGUID refguid) override {
+      NULL_D3D9_CALL();
+      return D3DERR_NOTFOUND;
+    }
+
+    STDMETHOD_(DWORD, SetPriority)(THIS_ DWORD PriorityNew) override {
+      NULL_D3D9_CALL();
+      return m_priority.exchange(PriorityNew);
+    }
+
+    STDMETHOD_(DWORD, GetPriority)(THIS) override {
+      NULL_D3D9_CALL();
+      return m_priority;
+    }
+
+    STDMETHOD_(void, PreLoad)(THIS) override {
+      NULL_D3D9_CALL();
+    }
+
+    STDMETHOD_(D3DRESOURCETYPE, GetType)(THIS) override {
+      NULL_D3D9_CALL();
+      return m_type;
+    }
+
+  protected:
+    NullResource(IDirect3DDevice9Ex* pDevice, const D3DRESOURCETYPE type, const bool bOwned)
+      : NullDeviceChild<T>(pDevice, bOwned)
+      , m_type(type) { }
+
+    bool isSupportedInterface(REFIID riid) const override {
+      return riid == __uuidof(IDirect3DResource9) || NullDeviceChild<T>::isSupportedInterface(riid);
+    }
+
+  private:
+    const D3DRESOURCETYPE m_type;
+    std::atomic<DWORD> m_priority { 0 };
+  };
+
+  template<typename T>
+  class NullBaseTexture : public NullResource<T> {
+  public:
+    STDMETHOD_(DWORD, SetLOD)(THIS_ DWORD LODNew) override {
+      NULL_D3D9_CALL();
+      return m_lod.exchange(std::min<DWORD>(LODNew, m_levelCount - 1));
+    }
+
+    STDMETHOD_(DWORD, GetLOD)(THIS) override {
+      NULL_D3D9_CALL();
+      return m_lod;
+    }
+
+    STDMETHOD_(DWORD, GetLevelCount)(THIS) override {
+      NULL_D3D9_CALL();
+      return m_levelCount;
+    }
+
+    STDMETHOD(SetAutoGenFilterType)(THIS_ D3DTEXTUREFILTERTYPE FilterType) override {
+      NULL_D3D9_CALL();
+      m_autoGenFilter = FilterType;
+      return D3D_OK;
+    }
+
+    STDMETHOD_(D3DTEXTUREFILTERTYPE, GetAutoGenFilterType)(THIS) override {
+      NULL_D3D9_CALL();
+      return m_autoGenFilter;
+    }
+
+    STDMETHOD_(void, GenerateMipSubLevels)(THIS) override {
+      NULL_D3D9_CALL();
+    }
+
+  protected:
+    NullBaseTexture(IDirect3DDevice9Ex* pDevice, const D3DRESOURCETYPE type, const UINT levelCount)
+      : NullResource<T>(pDevice, type, false)
+      , m_levelCount(levelCount) { }
+
+    bool isSupportedInterface(REFIID riid) const override {
+      return riid == __uuidof(IDirect3DBaseTexture9) || NullResource<T>::isSupportedInterface(riid);
+    }
+
+    const UINT m_levelCount;
+
+  private:
+    std::atomic<DWORD> m_lod { 0 };
+    std::atomic<D3DTEXTUREFILTERTYPE> m_autoGenFilter { D3DTEXF_LINEAR };
+  };
+
+  class NullSurface : public NullResource<IDirect3DSurface9> {
+  public:
+    NullSurface(IDirect3DDevice9Ex* pDevice, const D3DSURFACE_DESC& desc, IUnknown* pContainer)
+      : NullResource<IDirect3DSurface9>(pDevice, D3DRTYPE_SURFACE, pContainer != nullptr)
+      , m_desc(desc)
+      , m_pContainer(pContainer) { }
+
+    ~NullSurface() override;
+
+    STDMETHOD(GetContainer)(THIS_ REFIID riid, void** ppContainer) override {
+      NULL_D3D9_CALL();
+      IUnknown* const pContainer = m_pContainer ? m_pContainer : m_pDevice;
+      return pContainer->QueryInterface(riid, ppContainer);
+    }
+
+    STDMETHOD(GetDesc)(THIS_ D3DSURFACE_DESC* pDesc) override {
+      NULL_D3D9_CALL();
+      if (pDesc == nullptr) {
+        return D3DERR_INVALIDCALL;
+      }
+      *pDesc = m_desc;
+      return D3D_OK;
+    }
+
+    STDMETHOD(LockRect)(THIS_ D3DLOCKED_RECT* pLockedRect, CONST RECT* pRect, DWORD Flags) override {
+      NULL_D3D9_CALL();
+      if (pLockedRect == nullptr) {
+        return D3DERR_INVALIDCALL;
+      }
+      const uint32_t pitch = calcRowSize(m_desc.Width, m_desc.Format);
+      uint8_t* const pBits = m_storage.get(pitch * calcStride(m_desc.Height, m_desc.Format));
+      pLockedRect->Pitch = pitch;
+      pLockedRect->pBits = pBits + (pRect ? calcImageByteOffset(pitch, *pRect, m_desc.Format) : 0);
+      return D3D_OK;
+    }
+
+    STDMETHOD(UnlockRect)(THIS) override {
+      NULL_D3D9_CALL();
+      return D3D_OK;
+    }
+
+    STDMETHOD(GetDC)(THIS_ HDC* phdc) override {
+      NULL_D3D9_CALL();
+      return D3DERR_INVALIDCALL;
+    }
+
+    STDMETHOD(ReleaseDC)(THIS_ HDC hdc) override {
+      NULL_D3D9_CALL();
+      return D3DERR_INVALIDCALL;
+    }
+
+  private:
+    const D3DSURFACE_DESC m_desc;
+    IUnknown* const m_pContainer;
+    NullStorage m_storage;
+  };
+
+  static D3DSURFACE_DESC makeSurfaceDesc(const UINT width, const UINT height, const D3DFORMAT format,
+                                         const DWORD usage, const D3DPOOL pool,
+                                         const D3DMULTISAMPLE_TYPE multiSample = D3DMULTISAMPLE_NONE,
+                                         const DWORD multiSampleQuality = 0) {
+    D3DSURFACE_DESC desc;
+    desc.Format = format;
+    desc.Type = D3DRTYPE_SURFACE;
+    desc.Usage = usage;
+    desc.Pool = pool;
+    desc.MultiSampleType = multiSample;
+    desc.MultiSampleQuality = multiSampleQuality;
+    desc.Width = width;
+    desc.Height = height;
+    return desc;
+  }
+
+  class NullTexture : public NullBaseTexture<IDirect3DTexture9> {
+  public:
+    NullTexture(IDirect3DDevice9Ex* pDevice, const UINT width, const UINT height, const UINT levels,
+                const DWORD usage, const D3DFORMAT format, const D3DPOOL pool)
+      : NullBaseTexture<IDirect3DTexture9>(pDevice, D3DRTYPE_TEXTURE, calcLevelCount(levels, usage, width, height)) {
+      m_levels.reserve(m_levelCount);
+      for (UINT level = 0; level < m_levelCount; ++level) {
+        const auto desc = makeSurfaceDesc(calcLevelDimension(width, level), calcLevelDimension(height, level),
+                                          format, usage, pool);
+        m_levels.emplace_back(std::make_unique<NullSurface>(pDevice, desc, this));
+      }
+    }
+
+    STDMETHOD(GetLevelDesc)(THIS_ UINT Level, D3DSURFACE_DESC* pDesc) override {
+      NULL_D3D9_CALL();
+      if (Level >= m_levelCount) {
+        return D3DERR_INVALIDCALL;
+      }
+      return m_levels[Level]->GetDesc(pDesc);
+    }
+
+    STDMETHOD(GetSurfaceLevel)(THIS_ UINT Level, IDirect3DSurface9** ppSurfaceLevel) override {
+      NULL_D3D9_CALL();
+      if (Level >= m_levelCount || ppSurfaceLevel == nullptr) {
+        return D3DERR_INVALIDCALL;
+      }
+      m_levels[Level]->AddRef();
+      *ppSurfaceLevel = m_levels[Level].get();
+      return D3D_OK;
+    }
+
+    STDMETHOD(LockRect)(THIS_ UINT Level, D3DLOCKED_RECT* pLockedRect, CONST RECT* pRect, DWORD Flags) override {
+      NULL_D3D9_CALL();
+      if (Level >= m_levelCount) {
+        return D3DERR_INVALIDCALL;
+      }
+      return m_levels[Level]->LockRect(pLockedRect, pRect, Flags);
+    }
+
+    STDMETHOD(UnlockRect)(THIS_ UINT Level) override {
+      NULL_D3D9_CALL();
+      if (Level >= m_levelCount) {
+        return D3DERR_INVALIDCALL;
+      }
+      return m_levels[Level]->UnlockRect();
+    }
+
+    STDMETHOD(AddDirtyRect)(THIS_ CONST RECT* pDirtyRect) override {
+      NULL_D3D9_CALL();
+      return D3D_OK;
+    }
+
+  private:
+    std::vector<std::unique_ptr<NullSurface>> m_levels;
+  };
+
+  class NullCubeTexture : public NullBaseTexture<IDirect3DCubeTexture9> {
+  public:
+    static constexpr UINT kNumFaces = 6;
+
+    NullCubeTexture(IDirect3DDevice9Ex* pDevice, const UINT edgeLength, const UINT levels,
+                    const DWORD usage, const D3DFORMAT format, const D3DPOOL pool)
+      : NullBaseTexture<IDirect3DCubeTexture9>(pDevice, D3DRTYPE_CUBETEXTURE, calcLevelCount(levels, usage, edgeLength, edgeLength)) {
+      m_surfaces.reserve(kNumFaces * m_levelCount);
+      for (UINT face = 0; face < kNumFaces; ++face) {
+        for (UINT level = 0; level < m_levelCount; ++level) {
+          const UINT edge = calcLevelDimension(edgeLength, level);
+          const auto desc = makeSurfaceDesc(edge, edge, format, usage, pool);
+          m_surfaces.emplace_back(std::make_unique<NullSurface>(pDevice, desc, this));
+        }
+      }
+    }
+
+    STDMETHOD(GetLevelDesc)(THIS_ UINT Level, D3DSURFACE_DESC* pDesc) override {
+      NULL_D3D9_CALL();
+      if (Level >= m_levelCount) {
+        return D3DERR_INVALIDCALL;
+      }
+      return m_surfaces[Level]->GetDesc(pDesc);
+    }
+
+    STDMETHOD(GetCubeMapSurface)(THIS_ D3DCUBEMAP_FACES FaceType, UINT Level, IDirect3DSurface9** ppCubeMapSurface) override {
+      NULL_D3D9_CALL();
+      NullSurface* const pSurface = getSurface(FaceType, Level);
+      if (pSurface == nullptr || ppCubeMapSurface == nullptr) {
+        return D3DERR_INVALIDCALL;
+      }
+      pSurface->AddRef();
+      *ppCubeMapSurface = pSurface;
+      return D3D_OK;
+    }
+
+    STDMETHOD(LockRect)(THIS_ D3DCUBEMAP_FACES FaceType, UINT Level, D3DLOCKED_RECT* pLockedRect, CONST RECT* pRect, DWORD Flags) override {
+      NULL_D3D9_CALL();
+      NullSurface* const pSurface = getSurface(FaceType, Level);
+      if (pSurface == nullptr) {
+        return D3DERR_INVALIDCALL;
+      }
+      return pSurface->LockRect(pLockedRect, pRect, Flags);
+    }
+
+    STDMETHOD(UnlockRect)(THIS_ D3DCUBEMAP_FACES FaceType, UINT Level) override {
+      NULL_D3D9_CALL();
+      NullSurface* const pSurface = getSurface(FaceType, Level);
+      if (pSurface == nullptr) {
+        return D3DERR_INVALIDCALL;
+      }
+      return pSurface->UnlockRect();
+    }
+
+    STDMETHOD(AddDirtyRect)(THIS_ D3DCUBEMAP_FACES FaceType, CONST RECT* pDirtyRect) override {
+      NULL_D3D9_CALL();
+      return D3D_OK;
+    }
+
+  private:
+    NullSurface* getSurface(const D3DCUBEMAP_FACES face, const UINT level) const {
+      if ((UINT) face >= kNumFaces || level >= m_levelCount) {
+        return nullptr;
+      }
+      return m_surfaces[face * m_levelCount + level].get();
+    }
+
+    std::vector<std::unique_ptr<NullSurface>> m_surfaces;
+  };
+
+  class NullVolume : public NullDeviceChild<IDirect3DVolume9> {
+  public:
+    NullVolume(IDirect3DDevice9Ex* pDevice, const D3DVOLUME_DESC& desc, IUnknown* pContainer)
+      : NullDeviceChild<IDirect3DVolume9>(pDevice, true)
+      , m_desc(desc)
+      , m_pContainer(pContainer) { }
+
+    STDMETHOD(SetPrivateData)(THIS_ REFGUID refguid, CONST void* pData, DWORD SizeOfData, DWORD Flags) override {
+      NULL_D3D9_CALL();
+      return D3D_OK;
+    }
+
+    STDMETHOD(GetPrivateData)(THIS_ REFGUID refguid, void* pData, DWORD* pSizeOfData) override {
+      NULL_D3D9_CALL();
+      return D3DERR_NOTFOUND;
+    }
+
+    STDMETHOD(FreePrivateData)(THIS_ REFGUID refguid) override {
+      NULL_D3D9_CALL();
+      return D3DERR_NOTFOUND;
+    }
+
+    STDMETHOD(GetContainer)(THIS_ REFIID riid, void** ppContainer) override {
+      NULL_D3D9_CALL();
+      return m_pContainer->QueryInterface(riid, ppContainer);
+    }
+
+    STDMETHOD(GetDesc)(THIS_ D3DVOLUME_DESC* pDesc) override {
+      NULL_D3D9_CALL();
+      if (pDesc == nullptr) {
+        return D3DERR_INVALIDCALL;
+      }
+      *pDesc = m_desc;
+      return D3D_OK;
+    }
+
+    STDMETHOD(LockBox)(THIS_ D3DLOCKED_BOX* pLockedVolume, CONST D3DBOX* pBox, DWORD Flags) override {
+      NULL_D3D9_CALL();
+      if (pLockedVolume == nullptr) {
+        return D3DERR_INVALIDCALL;
+      }
+      const uint32_t rowPitch = calcRowSize(m_desc.Width, m_desc.Format);
+      const uint32_t slicePitch = rowPitch * calcStride(m_desc.Height, m_desc.Format);
+      uint8_t* const pBits = m_storage.get(slicePitch * m_desc.Depth);
+      size_t offset = 0;
+      if (pBox) {
+        const RECT rect { (LONG) pBox->Left, (LONG) pBox->Top, (LONG) pBox->Right, (LONG) pBox->Bottom };
+        offset = pBox->Front * slicePitch + calcImageByteOffset(rowPitch, rect, m_desc.Format);
+      }
+      pLockedVolume->RowPitch = rowPitch;
+      pLockedVolume->SlicePitch = slicePitch;
+      pLockedVolume->pBits = pBits + offset;
+      return D3D_OK;
+    }
+
+    STDMETHOD(UnlockBox)(THIS) override {
+      NULL_D3D9_CALL();
+      return D3D_OK;
+    }
+
+  private:
+    const D3DVOLUME_DESC m_desc;
+    IUnknown* const m_pContainer;
+    NullStorage m_storage;
+  };
+
+  class NullVolumeTexture : public NullBaseTexture<IDirect3DVolumeTexture9> {
+  public:
+    NullVolumeTexture(IDirect3DDevice9Ex* pDevice, const UINT width, const UINT height, const UINT depth,
+                      const UINT levels, const DWORD usage, const D3DFORMAT format, const D3DPOOL pool)
+      : NullBaseTexture<IDirect3DVolumeTexture9>(pDevice, D3DRTYPE_VOLUMETEXTURE, calcLevelCount(levels, usage, width, height, depth)) {
+      m_volumes.reserve(m_levelCount);
+      for (UINT level = 0; level < m_levelCount; ++level) {
+        D3DVOLUME_DESC desc;
+        desc.Format = format;
+        desc.Type = D3DRTYPE_VOLUME;
+        desc.Usage = usage;
+        desc.Pool = pool;
+        desc.Width = calcLevelDimension(width, level);
+        desc.Height = calcLevelDimension(height, level);
+        desc.Depth = calcLevelDimension(depth, level);
+        m_volumes.emplace_back(std::make_unique<NullVolume>(pDevice, desc, this));
+      }
+    }
+
+    STDMETHOD(GetLevelDesc)(THIS_ UINT Level, D3DVOLUME_DESC* pDesc) override {
+      NULL_D3D9_CALL();
+      if (Level >= m_levelCount) {
+        return D3DERR_INVALIDCALL;
+      }
+      return m_volumes[Level]->GetDesc(pDesc);
+    }
+
+    STDMETHOD(GetVolumeLevel)(THIS_ UINT Level, IDirect3DVolume9** ppVolumeLevel) override {
+      NULL_D3D9_CALL();
+      if (Level >= m_levelCount || ppVolumeLevel == nullptr) {
+        return D3DERR_INVALIDCALL;
+      }
+      m_volumes[Level]->AddRef();
+      *ppVolumeLevel = m_volumes[Level].get();
+      return D3D_OK;
+    }
+
+    STDMETHOD(LockBox)(THIS_ UINT Level, D3DLOCKED_BOX* pLockedVolume, CONST D3DBOX* pBox, DWORD Flags) override {
+      NULL_D3D9_CALL();
+      if (Level >= m_levelCount) {
+        return D3DERR_INVALIDCALL;
+      }
+      return m_volumes[Level]->LockBox(pLockedVolume, pBox, Flags);
+    }
+
+    STDMETHOD(UnlockBox)(THIS_ UINT Level) override {
+      NULL_D3D9_CALL();
+      if (Level >= m_levelCount) {
+        return D3DERR_INVALIDCALL;
+      }
+      return m_volumes[Level]->UnlockBox();
+    }
+
+    STDMETHOD(AddDirtyBox)(THIS_ CONST D3DBOX* pDirtyBox) override {
+      NULL_D3D9_CALL();
+      return D3D_OK;
+    }
+
+  private:
+    std::vector<std::unique_ptr<NullVolume>> m_volumes;
+  };
+
+  // Vertex and index buffers only differ in their descriptor type
+  template<typename T, typename DescT, D3DRESOURCETYPE Type>
+  class NullBuffer : public NullResource<T> {
+  public:
+    NullBuffer(IDirect3DDevice9Ex* pDevice, const DescT& desc)
+      : NullResource<T>(pDevice, Type, false)
+      , m_desc(desc) { }
+
+    STDMETHOD(Lock)(THIS_ UINT OffsetToLock, UINT SizeToLock, void** ppbData, DWORD Flags) override {
+      NULL_D3D9_CALL();
+      if (ppbData == nullptr || OffsetToLock > m_desc.Size) {
+        return D3DERR_INVALIDCALL;
+      }
+      *ppbData = m_storage.get(m_desc.Size) + OffsetToLock;
+      return D3D_OK;
+    }
+
+    STDMETHOD(Unlock)(THIS) override {
+      NULL_D3D9_CALL();
+      return D3D_OK;
+    }
+
+    STDMETHOD(GetDesc)(THIS_ DescT* pDesc) override {
+      NULL_D3D9_CALL();
+      if (pDesc == nullptr) {
+        return D3DERR_INVALIDCALL;
+      }
+      *pDesc = m_desc;
+      return D3D_OK;
+    }
+
+  private:
+    const DescT m_desc;
+    NullStorage m_storage;
+  };
+
+  using NullVertexBuffer = NullBuffer<IDirect3DVertexBuffer9, D3DVERTEXBUFFER_DESC, D3DRTYPE_VERTEXBUFFER>;
+  using NullIndexBuffer = NullBuffer<IDirect3DIndexBuffer9, D3DINDEXBUFFER_DESC, D3DRTYPE_INDEXBUFFER>;
+
+  // Shader bytecode is not length-prefixed, so walk the token stream up to the end
+  // token, skipping over comment blocks which may contain arbitrary data.
+  static size_t calcShaderTokenCount(const DWORD* pFunction) {
+    size_t i = 1; // Version token
+    while (pFunction[i] != kShaderEndToken) {
+      if ((pFunction[i] & kShaderCommentMask) == kShaderCommentToken) {
+        i += (pFunction[i] >> 16) & 0x7FFF;
+      }
+      ++i;
+    }
+    return i + 1;
+  }
+
+  template<typename T>
+  class NullShader : public NullDeviceChild<T> {
+  public:
+    NullShader(IDirect3DDevice9Ex* pDevice, const DWORD* pFunction)
+      : NullDeviceChild<T>(pDevice, false)
+      , m_function(pFunction, pFunction + calcShaderTokenCount(pFunction)) { }
+
+    STDMETHOD(GetFunction)(THIS_ void* pData, UINT* pSizeOfData) override {
+      NULL_D3D9_CALL();
+      if (pSizeOfData == nullptr) {
+        return D3DERR_INVALIDCALL;
+      }
+      const UINT size = (UINT) (m_function.size() * sizeof(DWORD));
+      if (pData == nullptr) {
+        *pSizeOfData = size;
+        return D3D_OK;
+      }
+      if (*pSizeOfData < size) {
+        return D3DERR_INVALIDCALL;
+      }
+      memcpy(pData, m_function.data(), size);
+      return D3D_OK;
+    }
+
+  private:
+    const std::vector<DWORD> m_function;
+  };
+
+  using NullVertexShader = NullShader<IDirect3DVertexShader9>;
+  using NullPixelShader = NullShader<IDirect3DPixelShader9>;
+
+  class NullVertexDeclaration : public NullDeviceChild<IDirect3DVertexDeclaration9> {
+  public:
+    NullVertexDeclaration(IDirect3DDevice9Ex* pDevice, const D3DVERTEXELEMENT9* pVertexElements)
+      : NullDeviceChild<IDirect3DVertexDeclaration9>(pDevice, false) {
+      const D3DVERTEXELEMENT9* pElement = pVertexElements;
+      while (pElement->Stream != 0xFF) {
+        ++pElement;
+      }
+      // Keep the D3DDECL_END() terminator
+      m_elements.assign(pVertexElements, pElement + 1);
+    }
+
+    STDMETHOD(GetDeclaration)(THIS_ D3DVERTEXELEMENT9* pElement, UINT* pNumElements) override {
+      NULL_D3D9_CALL();
+      if (pNumElements == nullptr) {
+        return D3DERR_INVALIDCALL;
+      }
+      *pNumElements = (UINT) m_elements.size();
+      if (pElement != nullptr) {
+        std::copy(m_elements.begin(), m_elements.end(), pElement);
+      }
+      return D3D_OK;
+    }
+
+  private:
+    std::vector<D3DVERTEXELEMENT9> m_elements;
+  };
+
+  class NullStateBlock : public NullDeviceChild<IDirect3DStateBlock9> {
+  public:
+    explicit NullStateBlock(IDirect3DDevice9Ex* pDevice)
+      : NullDeviceChild<IDirect3DStateBlock9>(pDevice, false) { }
+
+    STDMETHOD(Capture)(THIS) override {
+      NULL_D3D9_CALL();
+      return D3D_OK;
+    }
+
+    STDMETHOD(Apply)(THIS) override {
+      NULL_D3D9_CALL();
+      return D3D_OK;
+    }
+  };
+
+  class NullQuery : public NullDeviceChild<IDirect3DQuery9> {
+  public:
+    NullQuery(IDirect3DDevice9Ex* pDevice, const D3DQUERYTYPE type)
+      : NullDeviceChild<IDirect3DQuery9>(pDevice, false)
+      , m_type(type) { }
+
+    STDMETHOD_(D3DQUERYTYPE, GetType)(THIS) override {
+      NULL_D3D9_CALL();
+      return m_type;
+    }
+
+    STDMETHOD_(DWORD, GetDataSize)(THIS) override {
+      NULL_D3D9_CALL();
+      return getDataSize(m_type);
+    }
+
+    STDMETHOD(Issue)(THIS_ DWORD dwIssueFlags) override {
+      NULL_D3D9_CALL();
+      return D3D_OK;
+    }
+
+    STDMETHOD(GetData)(THIS_ void* pData, DWORD dwSize, DWORD dwGetDataFlags) override {
+      NULL_D3D9_CALL();
+      if (pData != nullptr) {
+        memset(pData, 0, dwSize);
+      }
+      return S_OK;
+    }
+
+    static DWORD getDataSize(const D3DQUERYTYPE type) {
+      switch (type) {
+      case D3DQUERYTYPE_VCACHE: return sizeof(D3DDEVINFO_VCACHE);
+      case D3DQUERYTYPE_EVENT: return sizeof(BOOL);
+      case D3DQUERYTYPE_OCCLUSION: return sizeof(DWORD);
+      case D3DQUERYTYPE_TIMESTAMP: return sizeof(UINT64);
+      case D3DQUERYTYPE_TIMESTAMPDISJOINT: return sizeof(BOOL);
+      case D3DQUERYTYPE_TIMESTAMPFREQ: return sizeof(UINT64);
+      default: return 0;
+      }
+    }
+
+  private:
+    const D3DQUERYTYPE m_type;
+  };
+
+  class NullSwapChain : public NullDeviceChild<IDirect3DSwapChain9> {
+  public:
+    NullSwapChain(IDirect3DDevice9Ex* pDevice, const D3DPRESENT_PARAMETERS& presParams, const bool bImplicit)
+      : NullDeviceChild<IDirect3DSwapChain9>(pDevice, bImplicit)
+      , m_presParams(presParams) {
+      // Zero sized windowed backbuffers take the size of the window in D3D9, which
+      // may not exist anymore when replaying, so take the adapter mode instead.
+      if (m_presParams.BackBufferWidth == 0) {
+        m_presParams.BackBufferWidth = kAdapterWidth;
+      }
+      if (m_presParams.BackBufferHeight == 0) {
+        m_presParams.BackBufferHeight = kAdapterHeight;
+      }
+      if (m_presParams.BackBufferFormat == D3DFMT_UNKNOWN) {
+        m_presParams.BackBufferFormat = kAdapterFormat;
+      }
+      m_presParams.BackBufferCount = std::max(1u, m_presParams.BackBufferCount);
+
+      const auto desc = makeSurfaceDesc(m_presParams.BackBufferWidth, m_presParams.BackBufferHeight,
+                                        m_presParams.BackBufferFormat, D3DUSAGE_RENDERTARGET, D3DPOOL_DEFAULT,
+                                        m_presParams.MultiSampleType, m_presParams.MultiSampleQuality);
+      for (UINT i = 0; i < m_presParams.BackBufferCount; ++i) {
+        m_backBuffers.emplace_back(std::make_unique<NullSurface>(pDevice, desc, this));
+      }
+    }
+
+    const D3DPRESENT_PARAMETERS& getPresentParameters() const {
+      return m_presParams;
+    }
+
+    NullSurface* getBackBuffer(const UINT iBackBuffer) const {
+      return (iBackBuffer < m_backBuffers.size()) ? m_backBuffers[iBackBuffer].get() : nullptr;
+    }
+
+    STDMETHOD(Present)(THIS_ CONST RECT* pSourceRect, CONST RECT* pDestRect, HWND hDestWindowOverride, CONST RGNDATA* pDirtyRegion, DWORD dwFlags) override {
+      NULL_D3D9_CALL();
+      return D3D_OK;
+    }
+
+    STDMETHOD(GetFrontBufferData)(THIS_ IDirect3DSurface9* pDestSurface) override {
+      NULL_D3D9_CALL();
+      return D3D_OK;
+    }
+
+    STDMETHOD(GetBackBuffer)(THIS_ UINT iBackBuffer, D3DBACKBUFFER_TYPE Type, IDirect3DSurface9** ppBackBuffer) override {
+      NULL_D3D9_CALL();
+      NullSurface* const pBackBuffer = getBackBuffer(iBackBuffer);
+      if (pBackBuffer == nullptr || ppBackBuffer == nullptr) {
+        return D3DERR_INVALIDCALL;
+      }
+      pBackBuffer->AddRef();
+      *ppBackBuffer = pBackBuffer;
+      return D3D_OK;
+    }
+
+    STDMETHOD(GetRasterStatus)(THIS_ D3DRASTER_STATUS* pRasterStatus) override {
+      NULL_D3D9_CALL();
+      if (pRasterStatus == nullptr) {
+        return D3DERR_INVALIDCALL;
+      }
+      memset(pRasterStatus, 0, sizeof(D3DRASTER_STATUS));
+      return D3D_OK;
+    }
+
+    STDMETHOD(GetDisplayMode)(THIS_ D3DDISPLAYMODE* pMode) override {
+      NULL_D3D9_CALL();
+      if (pMode == nullptr) {
+        return D3DERR_INVALIDCALL;
+      }
+      fillDisplayMode(pMode);
+      return D3D_OK;
+    }
+
+    STDMETHOD(GetPresentParameters)(THIS_ D3DPRESENT_PARAMETERS* pPresentationParameters) override {
+      NULL_D3D9_CALL();
+      if (pPresentationParameters == nullptr) {
+        return D3DERR_INVALIDCALL;
+      }
+      *pPresentationParameters = m_presParams;
+      return D3D_OK;
+    }
+
+  private:
+    D3DPRESENT_PARAMETERS m_presParams;
+    std::vector<std::unique_ptr<NullSurface>> m_backBuffers;
+  };
+
+  class NullDevice : public NullUnknown<IDirect3DDevice9Ex> {
+  public:
+    NullDevice(IDirect3D9Ex* pD3D, const D3DDEVICE_CREATION_PARAMETERS& creationParams,
+               const D3DPRESENT_PARAMETERS& presParams)
+      : NullUnknown<IDirect3DDevice9Ex>(false)
+      , m_pD3D(pD3D)
+      , m_creationParams(creationParams) {
+      m_pD3D->AddRef();
+      createImplicitObjects(presParams);
+    }
+
+    void unbindSurface(const NullSurface* pSurface) {
+      std::lock_guard<std::mutex> lock(m_bindingMutex);
+      for (auto& pRenderTarget : m_pRenderTargets) {
+        if (pRenderTarget == pSurface) {
+          pRenderTarget = nullptr;
+        }
+      }
+      if (m_pDepthStencil == pSurface) {
+        m_pDepthStencil = nullptr;
+      }
+    }
+
+    /*** IDirect3DDevice9 methods ***/
+    STDMETHOD(TestCooperativeLevel)(THIS) override {
+      NULL_D3D9_CALL();
+      return D3D_OK;
+    }
+
+    STDMETHOD_(UINT, GetAvailableTextureMem)(THIS) override {
+      NULL_D3D9_CALL();
+      return 2048u << 20;
+    }
+
+    STDMETHOD(EvictManagedResources)(THIS) override {
+      NULL_D3D9_CALL();
+      return D3D_OK;
+    }
+
+    STDMETHOD(GetDirect3D)(THIS_ IDirect3D9** ppD3D9) override {
+      NULL_D3D9_CALL();
+      if (ppD3D9 == nullptr) {
+        return D3DERR_INVALIDCALL;
+      }
+      m_pD3D->AddRef();
+      *ppD3D9 = m_pD3D;
+      return D3D_OK;
+    }
+
+    STDMETHOD(GetDeviceCaps)(THIS_ D3DCAPS9* pCaps) override {
+      NULL_D3D9_CALL();
+      if (pCaps == nullptr) {
+        return D3DERR_INVALIDCALL;
+      }
+      fillDeviceCaps(m_creationParams.AdapterOrdinal, m_creationParams.DeviceType, pCaps);
+      return D3D_OK;
+    }
+
+    STDMETHOD(GetDisplayMode)(THIS_ UINT iSwapChain, D3DDISPLAYMODE* pMode) override {
+      NULL_D3D9_CALL();
+      if (pMode == nullptr) {
+        return D3DERR_INVALIDCALL;
+      }
+      fillDisplayMode(pMode);
+      return D3D_OK;
+    }
+
+    STDMETHOD(GetCreationParameters)(THIS_ D3DDEVICE_CREATION_PARAMETERS* pParameters) override {
+      NULL_D3D9_CALL();
+      if (pParameters == nullptr) {
+        return D3DERR_INVALIDCALL;
+      }
+      *pParameters = m_creationParams;
+      return D3D_OK;
+    }
+
+    STDMETHOD(SetCursorProperties)(THIS_ UINT XHotSpot, UINT YHotSpot, IDirect3DSurface9* pCursorBitmap) override {
+      NULL_D3D9_CALL();
+      return D3D_OK;
+    }
+
+    STDMETHOD_(void, SetCursorPosition)(THIS_ int X, int Y, DWORD Flags) override {
+      NULL_D3D9_CALL();
+    }
+
+    STDMETHOD_(BOOL, ShowCursor)(THIS_ BOOL bShow) override {
+      NULL_D3D9_CALL();
+      return m_bShowCursor.exchange(bShow);
+    }
+
+    STDMETHOD(CreateAdditionalSwapChain)(THIS_ D3DPRESENT_PARAMETERS* pPresentationParameters, IDirect3DSwapChain9** pSwapChain) override {
+      NULL_D3D9_CALL();
+      if (pPresentationParameters == nullptr || pSwapChain == nullptr) {
+        return D3DERR_INVALIDCALL;
+      }
+      *pSwapChain = new NullSwapChain(this, *pPresentationParameters, false);
+      return D3D_OK;
+    }
+
+    STDMETHOD(GetSwapChain)(THIS_ UINT iSwapChain, IDirect3DSwapChain9** pSwapChain) override {
+      NULL_D3D9_CALL();
+      if (iSwapChain != 0 || pSwapChain == nullptr) {
+        return D3DERR_INVALIDCALL;
+      }
+      m_pSwapChain->AddRef();
+      *pSwapChain = m_pSwapChain.get();
+      return D3D_OK;
+    }
+
+    STDMETHOD_(UINT, GetNumberOfSwapChains)(THIS) override {
+      NULL_D3D9_CALL();
+      return 1;
+    }
+
+    STDMETHOD(Reset)(THIS_ D3DPRESENT_PARAMETERS* pPresentationParameters) override {
+      NULL_D3D9_CALL();
+      if (pPresentationParameters == nullptr) {
+        return D3DERR_INVALIDCALL;
+      }
+      // Handles to the previous implicit objects may still be held by the server,
+      // so keep them alive until the device goes away instead of freeing them here.
+      m_retiredSwapChains.emplace_back(std::move(m_pSwapChain));
+      if (m_pAutoDepthStencil) {
+        m_retiredSurfaces.emplace_back(std::move(m_pAutoDepthStencil));
+      }
+      createImplicitObjects(*pPresentationParameters);
+      return D3D_OK;
+    }
+
+    STDMETHOD(Present)(THIS_ CONST RECT* pSourceRect, CONST RECT* pDestRect, HWND hDestWindowOverride, CONST RGNDATA* pDirtyRegion) override {
+      NULL_D3D9_CALL();
+      return D3D_OK;
+    }
+
+    STDMETHOD(GetBackBuffer)(THIS_ UINT iSwapChain, UINT iBackBuffer, D3DBACKBUFFER_TYPE Type, IDirect3DSurface9** ppBackBuffer) override {
+      NULL_D3D9_CALL();
+      if (iSwapChain != 0) {
+        return D3DERR_INVALIDCALL;
+      }
+      return m_pSwapChain->GetBackBuffer(iBackBuffer, Type, ppBackBuffer);
+    }
+
+    STDMETHOD(GetRasterStatus)(THIS_ UINT iSwapChain, D3DRASTER_STATUS* pRasterStatus) override {
+      NULL_D3D9_CALL();
+      if (iSwapChain != 0) {
+        return D3DERR_INVALIDCALL;
+      }
+      return m_pSwapChain->GetRasterStatus(pRasterStatus);
+    }
+
+    STDMETHOD(SetDialogBoxMode)(THIS_ BOOL bEnableDialogs) override {
+      NULL_D3D9_CALL();
+      return D3D_OK;
+    }
+
+    STDMETHOD_(void, SetGammaRamp)(THIS_ UINT iSwapChain, DWORD Flags, CONST D3DGAMMARAMP* pRamp) override {
+      NULL_D3D9_CALL();
+    }
+
+    STDMETHOD_(void, GetGammaRamp)(THIS_ UINT iSwapChain, D3DGAMMARAMP* pRamp) override {
+      NULL_D3D9_CALL();
+      if (pRamp != nullptr) {
+        memset(pRamp, 0, sizeof(D3DGAMMARAMP));
+      }
+    }
+
+    STDMETHOD(CreateTexture)(THIS_ UINT Width, UINT Height, UINT Levels, DWORD Usage, D3DFORMAT Format, D3DPOOL Pool, IDirect3DTexture9** ppTexture, HANDLE* pSharedHandle) override {
+      NULL_D3D9_CALL();
+      if (ppTexture == nullptr || Width == 0 || Height == 0) {
+        return D3DERR_INVALIDCALL;
+      }
+      *ppTexture = new NullTexture(this, Width, Height, Levels, Usage, Format, Pool);
+      return D3D_OK;
+    }
+
+    STDMETHOD(CreateVolumeTexture)(THIS_ UINT Width, UINT Height, UINT Depth, UINT Levels, DWORD Usage, D3DFORMAT Format, D3DPOOL Pool, IDirect3DVolumeTexture9** ppVolumeTexture, HANDLE* pSharedHandle) override {
+      NULL_D3D9_CALL();
+      if (ppVolumeTexture == nullptr || Width == 0 || Height == 0 || Depth == 0) {
+        return D3DERR_INVALIDCALL;
+      }
+      *ppVolumeTexture = new NullVolumeTexture(this, Width, Height, Depth, Levels, Usage, Format, Pool);
+      return D3D_OK;
+    }
+
+    STDMETHOD(CreateCubeTexture)(THIS_ UINT EdgeLength, UINT Levels, DWORD Usage, D3DFORMAT Format, D3DPOOL Pool, IDirect3DCubeTexture9** ppCubeTexture, HANDLE* pSharedHandle) override {
+      NULL_D3D9_CALL();
+      if (ppCubeTexture == nullptr || EdgeLength == 0) {
+        return D3DERR_INVALIDCALL;
+      }
+      *ppCubeTexture = new NullCubeTexture(this, EdgeLength, Levels, Usage, Format, Pool);
+      return D3D_OK;
+    }
+
+    STDMETHOD(CreateVertexBuffer)(THIS_ UINT Length, DWORD Usage, DWORD FVF, D3DPOOL Pool, IDirect3DVertexBuffer9** ppVertexBuffer, HANDLE* pSharedHandle) override {
+      NULL_D3D9_CALL();
+      if (ppVertexBuffer == nullptr || Length == 0) {
+        return D3DERR_INVALIDCALL;
+      }
+      D3DVERTEXBUFFER_DESC desc;
+      desc.Format = D3DFMT_VERTEXDATA;
+      desc.Type = D3DRTYPE_VERTEXBUFFER;
+      desc.Usage = Usage;
+      desc.Pool = Pool;
+      desc.Size = Length;
+      desc.FVF = FVF;
+      *ppVertexBuffer = new NullVertexBuffer(this, desc);
+      return D3D_OK;
+    }
+
+    STDMETHOD(CreateIndexBuffer)(THIS_ UINT Length, DWORD Usage, D3DFORMAT Format, D3DPOOL Pool, IDirect3DIndexBuffer9** ppIndexBuffer, HANDLE* pSharedHandle) override {
+      NULL_D3D9_CALL();
+      if (ppIndexBuffer == nullptr || Length == 0) {
+        return D3DERR_INVALIDCALL;
+      }
+      D3DINDEXBUFFER_DESC desc;
+      desc.Format = Format;
+      desc.Type = D3DRTYPE_INDEXBUFFER;
+      desc.Usage = Usage;
+      desc.Pool = Pool;
+      desc.Size = Length;
+      *ppIndexBuffer = new NullIndexBuffer(this, desc);
+      return D3D_OK;
+    }
+
+    STDMETHOD(CreateRenderTarget)(THIS_ UINT Width, UINT Height, D3DFORMAT Format, D3DMULTISAMPLE_TYPE MultiSample, DWORD MultisampleQuality, BOOL Lockable, IDirect3DSurface9** ppSurface, HANDLE* pSharedHandle) override {
+      NULL_D3D9_CALL();
+      return createSurface(Width, Height, Format, D3DUSAGE_RENDERTARGET, D3DPOOL_DEFAULT, MultiSample, MultisampleQuality, ppSurface);
+    }
+
+    STDMETHOD(CreateDepthStencilSurface)(THIS_ UINT Width, UINT Height, D3DFORMAT Format, D3DMULTISAMPLE_TYPE MultiSample, DWORD MultisampleQuality, BOOL Discard, IDirect3DSurface9** ppSurface, HANDLE* pSharedHandle) override {
+      NULL_D3D9_CALL();
+      return createSurface(Width, Height, Format, D3DUSAGE_DEPTHSTENCIL, D3DPOOL_DEFAULT, MultiSample, MultisampleQuality, ppSurface);
+    }
+
+    STDMETHOD(UpdateSurface)(THIS_ IDirect3DSurface9* pSourceSurface, CONST RECT* pSourceRect, IDirect3DSurface9* pDestinationSurface, CONST POINT* pDestPoint) override {
+      NULL_D3D9_CALL();
+      return D3D_OK;
+    }
+
+    STDMETHOD(UpdateTexture)(THIS_ IDirect3DBaseTexture9* pSourceTexture, IDirect3DBaseTexture9* pDestinationTexture) override {
+      NULL_D3D9_CALL();
+      return D3D_OK;
+    }
+
+    STDMETHOD(GetRenderTargetData)(THIS_ IDirect3DSurface9* pRenderTarget, IDirect3DSurface9* pDestSurface) override {
+      NULL_D3D9_CALL();
+      return D3D_OK;
+    }
+
+    STDMETHOD(GetFrontBufferData)(THIS_ UINT iSwapChain, IDirect3DSurface9* pDestSurface) override {
+      NULL_D3D9_CALL();
+      return D3D_OK;
+    }
+
+    STDMETHOD(StretchRect)(THIS_ IDirect3DSurface9* pSourceSurface, CONST RECT* pSourceRect, IDirect3DSurface9* pDestSurface, CONST RECT* pDestRect, D3DTEXTUREFILTERTYPE Filter) override {
+      NULL_D3D9_CALL();
+      return D3D_OK;
+    }
+
+    STDMETHOD(ColorFill)(THIS_ IDirect3DSurface9* pSurface, CONST RECT* pRect, D3DCOLOR color) override {
+      NULL_D3D9_CALL();
+      return D3D_OK;
+    }
+
+    STDMETHOD(CreateOffscreenPlainSurface)(THIS_ UINT Width, UINT Height, D3DFORMAT Format, D3DPOOL Pool, IDirect3DSurface9** ppSurface, HANDLE* pSharedHandle) override {
+      NULL_D3D9_CALL();
+      return createSurface(Width, Height, Format, 0, Pool, D3DMULTISAMPLE_NONE, 0, ppSurface);
+    }
+
+    STDMETHOD(SetRenderTarget)(THIS_ DWORD RenderTargetIndex, IDirect3DSurface9* pRenderTarget) override {
+      NULL_D3D9_CALL();
+      if (RenderTargetIndex >= kMaxRenderTargets || (RenderTargetIndex == 0 && pRenderTarget == nullptr)) {
+        return D3DERR_INVALIDCALL;
+      }
+      std::lock_guard<std::mutex> lock(m_bindingMutex);
+      m_pRenderTargets[RenderTargetIndex] = static_cast<NullSurface*>(pRenderTarget);
+      return D3D_OK;
+    }
+
+    STDMETHOD(GetRenderTarget)(THIS_ DWORD RenderTargetIndex, IDirect3DSurface9** ppRenderTarget) override {
+      NULL_D3D9_CALL();
+      if (RenderTargetIndex >= kMaxRenderTargets || ppRenderTarget == nullptr) {
+        return D3DERR_INVALIDCALL;
+      }
+      std::lock_guard<std::mutex> lock(m_bindingMutex);
+      NullSurface* const pRenderTarget = m_pRenderTargets[RenderTargetIndex];
+      if (pRenderTarget == nullptr) {
+        *ppRenderTarget = nullptr;
+        return D3DERR_NOTFOUND;
+      }
+      pRenderTarget->AddRef();
+      *ppRenderTarget = pRenderTarget;
+      return D3D_OK;
+    }
+
+    STDMETHOD(SetDepthStencilSurface)(THIS_ IDirect3DSurface9* pNewZStencil) override {
+      NULL_D3D9_CALL();
+      std::lock_guard<std::mutex> lock(m_bindingMutex);
+      m_pDepthStencil = static_cast<NullSurface*>(pNewZStencil);
+      return D3D_OK;
+    }
+
+    STDMETHOD(GetDepthStencilSurface)(THIS_ IDirect3DSurface9** ppZStencilSurface) override {
+      NULL_D3D9_CALL();
+      if (ppZStencilSurface == nullptr) {
+        return D3DERR_INVALIDCALL;
+      }
+      std::lock_guard<std::mutex> lock(m_bindingMutex);
+      if (m_pDepthStencil == nullptr) {
+        *ppZStencilSurface = nullptr;
+        return D3DERR_NOTFOUND;
+      }
+      m_pDepthStencil->AddRef();
+      *ppZStencilSurface = m_pDepthStencil;
+      return D3D_OK;
+    }
+
+    STDMETHOD(BeginScene)(THIS) override {
+      NULL_D3D9_CALL();
+      return D3D_OK;
+    }
+
+    STDMETHOD(EndScene)(THIS) override {
+      NULL_D3D9_CALL();
+      return D3D_OK;
+    }
+
+    STDMETHOD(Clear)(THIS_ DWORD Count, CONST D3DRECT* pRects, DWORD Flags, D3DCOLOR Color, float Z, DWORD Stencil) override {
+      NULL_D3D9_CALL();
+      return D3D_OK;
+    }
+
+    STDMETHOD(SetTransform)(THIS_ D3DTRANSFORMSTATETYPE State, CONST D3DMATRIX* pMatrix) override {
+      NULL_D3D9_CALL();
+      return D3D_OK;
+    }
+
+    STDMETHOD(GetTransform)(THIS_ D3DTRANSFORMSTATETYPE State, D3DMATRIX* pMatrix) override {
+      NULL_D3D9_CALL();
+      return zeroFill(pMatrix);
+    }
+
+    STDMETHOD(MultiplyTransform)(THIS_ D3DTRANSFORMSTATETYPE State, CONST D3DMATRIX* pMatrix) override {
+      NULL_D3D9_CALL();
+      return D3D_OK;
+    }
+
+    STDMETHOD(SetViewport)(THIS_ CONST D3DVIEWPORT9* pViewport) override {
+      NULL_D3D9_CALL();
+      return D3D_OK;
+    }
+
+    STDMETHOD(GetViewport)(THIS_ D3DVIEWPORT9* pViewport) override {
+      NULL_D3D9_CALL();
+      return zeroFill(pViewport);
+    }
+
+    STDMETHOD(SetMaterial)(THIS_ CONST D3DMATERIAL9* pMaterial) override {
+      NULL_D3D9_CALL();
+      return D3D_OK;
+    }
+
+    STDMETHOD(GetMaterial)(THIS_ D3DMATERIAL9* pMaterial) override {
+      NULL_D3D9_CALL();
+      return zeroFill(pMaterial);
+    }
+
+    STDMETHOD(SetLight)(THIS_ DWORD Index, CONST D3DLIGHT9* pLight) override {
+      NULL_D3D9_CALL();
+      return D3D_OK;
+    }
+
+    STDMETHOD(GetLight)(THIS_ DWORD Index, D3DLIGHT9* pLight) override {
+      NULL_D3D9_CALL();
+      return zeroFill(pLight);
+    }
+
+    STDMETHOD(LightEnable)(THIS_ DWORD Index, BOOL Enable) override {
+      NULL_D3D9_CALL();
+      return D3D_OK;
+    }
+
+    STDMETHOD(GetLightEnable)(THIS_ DWORD Index, BOOL* pEnable) override {
+      NULL_D3D9_CALL();
+      return zeroFill(pEnable);
+    }
+
+    STDMETHOD(SetClipPlane)(THIS_ DWORD Index, CONST float* pPlane) override {
+      NULL_D3D9_CALL();
+      return D3D_OK;
+    }
+
+    STDMETHOD(GetClipPlane)(THIS_ DWORD Index, float* pPlane) override {
+      NULL_D3D9_CALL();
+      return zeroFill(pPlane, 4);
+    }
+
+    STDMETHOD(SetRenderState)(THIS_ D3DRENDERSTATETYPE State, DWORD Value) override {
+      NULL_D3D9_CALL();
+      return D3D_OK;
+    }
+
+    STDMETHOD(GetRenderState)(THIS_ D3DRENDERSTATETYPE State, DWORD* pValue) override {
+      NULL_D3D9_CALL();
+      return zeroFill(pValue);
+    }
+
+    STDMETHOD(CreateStateBlock)(THIS_ D3DSTATEBLOCKTYPE Type, IDirect3DStateBlock9** ppSB) override {
+      NULL_D3D9_CALL();
+      if (ppSB == nullptr) {
+        return D3DERR_INVALIDCALL;
+      }
+      *ppSB = new NullStateBlock(this);
+      return D3D_OK;
+    }
+
+    STDMETHOD(BeginStateBlock)(THIS) override {
+      NULL_D3D9_CALL();
+      return D3D_OK;
+    }
+
+    STDMETHOD(EndStateBlock)(THIS_ IDirect3DStateBlock9** ppSB) override {
+      NULL_D3D9_CALL();
+      if (ppSB == nullptr) {
+        return D3DERR_INVALIDCALL;
+      }
+      *ppSB = new NullStateBlock(this);
+      return D3D_OK;
+    }
+
+    STDMETHOD(SetClipStatus)(THIS_ CONST D3DCLIPSTATUS9* pClipStatus) override {
+      NULL_D3D9_CALL();
+      return D3D_OK;
+    }
+
+    STDMETHOD(GetClipStatus)(THIS_ D3DCLIPSTATUS9* pClipStatus) override {
+      NULL_D3D9_CALL();
+      return zeroFill(pClipStatus);
+    }
+
+    STDMETHOD(GetTexture)(THIS_ DWORD Stage, IDirect3DBaseTexture9** ppTexture) override {
+      NULL_D3D9_CALL();
+      return zeroFill(ppTexture);
+    }
+
+    STDMETHOD(SetTexture)(THIS_ DWORD Stage, IDirect3DBaseTexture9* pTexture) override {
+      NULL_D3D9_CALL();
+      return D3D_OK;
+    }
+
+    STDMETHOD(GetTextureStageState)(THIS_ DWORD Stage, D3DTEXTURESTAGESTATETYPE Type, DWORD* pValue) override {
+      NULL_D3D9_CALL();
+      return zeroFill(pValue);
+    }
+
+    STDMETHOD(SetTextureStageState)(THIS_ DWORD Stage, D3DTEXTURESTAGESTATETYPE Type, DWORD Value) override {
+      NULL_D3D9_CALL();
+      return D3D_OK;
+    }
+
+    STDMETHOD(GetSamplerState)(THIS_ DWORD Sampler, D3DSAMPLERSTATETYPE Type, DWORD* pValue) override {
+      NULL_D3D9_CALL();
+      return zeroFill(pValue);
+    }
+
+    STDMETHOD(SetSamplerState)(THIS_ DWORD Sampler, D3DSAMPLERSTATETYPE Type, DWORD Value) override {
+      NULL_D3D9_CALL();
+      return D3D_OK;
+    }
+
+    STDMETHOD(ValidateDevice)(THIS_ DWORD* pNumPasses) override {
+      NULL_D3D9_CALL();
+      if (pNumPasses != nullptr) {
+        *pNumPasses = 1;
+      }
+      return D3D_OK;
+    }
+
+    STDMETHOD(SetPaletteEntries)(THIS_ UINT PaletteNumber, CONST PALETTEENTRY* pEntries) override {
+      NULL_D3D9_CALL();
+      return D3D_OK;
+    }
+
+    STDMETHOD(GetPaletteEntries)(THIS_ UINT PaletteNumber, PALETTEENTRY* pEntries) override {
+      NULL_D3D9_CALL();
+      return zeroFill(pEntries, 256);
+    }
+
+    STDMETHOD(SetCurrentTexturePalette)(THIS_ UINT PaletteNumber) override {
+      NULL_D3D9_CALL();
+      return D3D_OK;
+    }
+
+    STDMETHOD(GetCurrentTexturePalette)(THIS_ UINT* PaletteNumber) override {
+      NULL_D3D9_CALL();
+      return zeroFill(PaletteNumber);
+    }
+
+    STDMETHOD(SetScissorRect)(THIS_ CONST RECT* pRect) override {
+      NULL_D3D9_CALL();
+      return D3D_OK;
+    }
+
+    STDMETHOD(GetScissorRect)(THIS_ RECT* pRect) override {
+      NULL_D3D9_CALL();
+      return zeroFill(pRect);
+    }
+
+    STDMETHOD(SetSoftwareVertexProcessing)(THIS_ BOOL bSoftware) override {
+      NULL_D3D9_CALL();
+      return D3D_OK;
+    }
+
+    STDMETHOD_(BOOL, GetSoftwareVertexProcessing)(THIS) override {
+      NULL_D3D9_CALL();
+      return FALSE;
+    }
+
+    STDMETHOD(SetNPatchMode)(THIS_ float nSegments) override {
+      NULL_D3D9_CALL();
+      return D3D_OK;
+    }
+
+    STDMETHOD_(float, GetNPatchMode)(THIS) override {
+      NULL_D3D9_CALL();
+      return 0.f;
+    }
+
+    STDMETHOD(DrawPrimitive)(THIS_ D3DPRIMITIVETYPE PrimitiveType, UINT StartVertex, UINT PrimitiveCount) override {
+      NULL_D3D9_CALL();
+      return D3D_OK;
+    }
+
+    STDMETHOD(DrawIndexedPrimitive)(THIS_ D3DPRIMITIVETYPE PrimitiveType, INT BaseVertexIndex, UINT MinVertexIndex, UINT NumVertices, UINT startIndex, UINT primCount) override {
+      NULL_D3D9_CALL();
+      return D3D_OK;
+    }
+
+    STDMETHOD(DrawPrimitiveUP)(THIS_ D3DPRIMITIVETYPE PrimitiveType, UINT PrimitiveCount, CONST void* pVertexStreamZeroData, UINT VertexStreamZeroStride) override {
+      NULL_D3D9_CALL();
+      return D3D_OK;
+    }
+
+    STDMETHOD(DrawIndexedPrimitiveUP)(THIS_ D3DPRIMITIVETYPE PrimitiveType, UINT MinVertexIndex, UINT NumVertices, UINT PrimitiveCount, CONST void* pIndexData, D3DFORMAT IndexDataFormat, CONST void* pVertexStreamZeroData, UINT VertexStreamZeroStride) override {
+      NULL_D3D9_CALL();
+      return D3D_OK;
+    }
+
+    STDMETHOD(ProcessVertices)(THIS_ UINT SrcStartIndex, UINT DestIndex, UINT VertexCount, IDirect3DVertexBuffer9* pDestBuffer, IDirect3DVertexDeclaration9* pVertexDecl, DWORD Flags) override {
+      NULL_D3D9_CALL();
+      return D3D_OK;
+    }
+
+    STDMETHOD(CreateVertexDeclaration)(THIS_ CONST D3DVERTEXELEMENT9* pVertexElements, IDirect3DVertexDeclaration9** ppDecl) override {
+      NULL_D3D9_CALL();
+      if (pVertexElements == nullptr || ppDecl == nullptr) {
+        return D3DERR_INVALIDCALL;
+      }
+      *ppDecl = new NullVertexDeclaration(this, pVertexElements);
+      return D3D_OK;
+    }
+
+    STDMETHOD(SetVertexDeclaration)(THIS_ IDirect3DVertexDeclaration9* pDecl) override {
+      NULL_D3D9_CALL();
+      return D3D_OK;
+    }
+
+    STDMETHOD(GetVertexDeclaration)(THIS_ IDirect3DVertexDeclaration9** ppDecl) override {
+      NULL_D3D9_CALL();
+      return zeroFill(ppDecl);
+    }
+
+    STDMETHOD(SetFVF)(THIS_ DWORD FVF) override {
+      NULL_D3D9_CALL();
+      return D3D_OK;
+    }
+
+    STDMETHOD(GetFVF)(THIS_ DWORD* pFVF) override {
+      NULL_D3D9_CALL();
+      return zeroFill(pFVF);
+    }
+
+    STDMETHOD(CreateVertexShader)(THIS_ CONST DWORD* pFunction, IDirect3DVertexShader9** ppShader) override {
+      NULL_D3D9_CALL();
+      if (pFunction == nullptr || ppShader == nullptr) {
+        return D3DERR_INVALIDCALL;
+      }
+      *ppShader = new NullVertexShader(this, pFunction);
+      return D3D_OK;
+    }
+
+    STDMETHOD(SetVertexShader)(THIS_ IDirect3DVertexShader9* pShader) override {
+      NULL_D3D9_CALL();
+      return D3D_OK;
+    }
+
+    STDMETHOD(GetVertexShader)(THIS_ IDirect3DVertexShader9** ppShader) override {
+      NULL_D3D9_CALL();
+      return zeroFill(ppShader);
+    }
+
+    STDMETHOD(SetVertexShaderConstantF)(THIS_ UINT StartRegister, CONST float* pConstantData, UINT Vector4fCount) override {
+      NULL_D3D9_CALL();
+      return D3D_OK;
+    }
+
+    STDMETHOD(GetVertexShaderConstantF)(THIS_ UINT StartRegister, float* pConstantData, UINT Vector4fCount) override {
+      NULL_D3D9_CALL();
+      return zeroFill(pConstantData, 4 * Vector4fCount);
+    }
+
+    STDMETHOD(SetVertexShaderConstantI)(THIS_ UINT StartRegister, CONST int* pConstantData, UINT Vector4iCount) override {
+      NULL_D3D9_CALL();
+      return D3D_OK;
+    }
+
+    STDMETHOD(GetVertexShaderConstantI)(THIS_ UINT StartRegister, int* pConstantData, UINT Vector4iCount) override {
+      NULL_D3D9_CALL();
+      return zeroFill(pConstantData, 4 * Vector4iCount);
+    }
+
+    STDMETHOD(SetVertexShaderConstantB)(THIS_ UINT StartRegister, CONST BOOL* pConstantData, UINT BoolCount) override {
+      NULL_D3D9_CALL();
+      return D3D_OK;
+    }
+
+    STDMETHOD(GetVertexShaderConstantB)(THIS_ UINT StartRegister, BOOL* pConstantData, UINT BoolCount) override {
+      NULL_D3D9_CALL();
+      return zeroFill(pConstantData, BoolCount);
+    }
+
+    STDMETHOD(SetStreamSource)(THIS_ UINT StreamNumber, IDirect3DVertexBuffer9* pStreamData, UINT OffsetInBytes, UINT Stride) override {
+      NULL_D3D9_CALL();
+      return D3D_OK;
+    }
+
+    STDMETHOD(GetStreamSource)(THIS_ UINT StreamNumber, IDirect3DVertexBuffer9** ppStreamData, UINT* pOffsetInBytes, UINT* pStride) override {
+      NULL_D3D9_CALL();
+      zeroFill(pOffsetInBytes);
+      zeroFill(pStride);
+      return zeroFill(ppStreamData);
+    }
+
+    STDMETHOD(SetStreamSourceFreq)(THIS_ UINT StreamNumber, UINT Setting) override {
+      NULL_D3D9_CALL();
+      return D3D_OK;
+    }
+
+    STDMETHOD(GetStreamSourceFreq)(THIS_ UINT StreamNumber, UINT* pSetting) override {
+      NULL_D3D9_CALL();
+      return zeroFill(pSetting);
+    }
+
+    STDMETHOD(SetIndices)(THIS_ IDirect3DIndexBuffer9* pIndexData) override {
+      NULL_D3D9_CALL();
+      return D3D_OK;
+    }
+
+    STDMETHOD(GetIndices)(THIS_ IDirect3DIndexBuffer9** ppIndexData) override {
+      NULL_D3D9_CALL();
+      return zeroFill(ppIndexData);
+    }
+
+    STDMETHOD(CreatePixelShader)(THIS_ CONST DWORD* pFunction, IDirect3DPixelShader9** ppShader) override {
+      NULL_D3D9_CALL();
+      if (pFunction == nullptr || ppShader == nullptr) {
+        return D3DERR_INVALIDCALL;
+      }
+      *ppShader = new NullPixelShader(this, pFunction);
+      return D3D_OK;
+    }
+
+    STDMETHOD(SetPixelShader)(THIS_ IDirect3DPixelShader9* pShader) override {
+      NULL_D3D9_CALL();
+      return D3D_OK;
+    }
+
+    STDMETHOD(GetPixelShader)(THIS_ IDirect3DPixelShader9** ppShader) override {
+      NULL_D3D9_CALL();
+      return zeroFill(ppShader);
+    }
+
+    STDMETHOD(SetPixelShaderConstantF)(THIS_ UINT StartRegister, CONST float* pConstantData, UINT Vector4fCount) override {
+      NULL_D3D9_CALL();
+      return D3D_OK;
+    }
+
+    STDMETHOD(GetPixelShaderConstantF)(THIS_ UINT StartRegister, float* pConstantData, UINT Vector4fCount) override {
+      NULL_D3D9_CALL();
+      return zeroFill(pConstantData, 4 * Vector4fCount);
+    }
+
+    STDMETHOD(SetPixelShaderConstantI)(THIS_ UINT StartRegister, CONST int* pConstantData, UINT Vector4iCount) override {
+      NULL_D3D9_CALL();
+      return D3D_OK;
+    }
+
+    STDMETHOD(GetPixelShaderConstantI)(THIS_ UINT StartRegister, int* pConstantData, UINT Vector4iCount) override {
+      NULL_D3D9_CALL();
+      return zeroFill(pConstantData, 4 * Vector4iCount);
+    }
+
+    STDMETHOD(SetPixelShaderConstantB)(THIS_ UINT StartRegister, CONST BOOL* pConstantData, UINT BoolCount) override {
+      NULL_D3D9_CALL();
+      return D3D_OK;
+    }
+
+    STDMETHOD(GetPixelShaderConstantB)(THIS_ UINT StartRegister, BOOL* pConstantData, UINT BoolCount) override {
+      NULL_D3D9_CALL();
+      return zeroFill(pConstantData, BoolCount);
+    }
+
+    STDMETHOD(DrawRectPatch)(THIS_ UINT Handle, CONST float* pNumSegs, CONST D3DRECTPATCH_INFO* pRectPatchInfo) override {
+      NULL_D3D9_CALL();
+      return D3D_OK;
+    }
+
+    STDMETHOD(DrawTriPatch)(THIS_ UINT Handle, CONST float* pNumSegs, CONST D3DTRIPATCH_INFO* pTriPatchInfo) override {
+      NULL_D3D9_CALL();
+      return D3D_OK;
+    }
+
+    STDMETHOD(DeletePatch)(THIS_ UINT Handle) override {
+      NULL_D3D9_CALL();
+      return D3D_OK;
+    }
+
+    STDMETHOD(CreateQuery)(THIS_ D3DQUERYTYPE Type, IDirect3DQuery9** ppQuery) override {
+      NULL_D3D9_CALL();
+      if (ppQuery == nullptr) {
+        // A null query pointer is how applications check for query support
+        return D3D_OK;
+      }
+      *ppQuery = new NullQuery(this, Type);
+      return D3D_OK;
+    }
+
+    /*** IDirect3DDevice9Ex methods ***/
+    STDMETHOD(SetConvolutionMonoKernel)(THIS_ UINT width, UINT height, float* rows, float* columns) override {
+      NULL_D3D9_CALL();
+      return D3D_OK;
+    }
+
+    STDMETHOD(ComposeRects)(THIS_ IDirect3DSurface9* pSrc, IDirect3DSurface9* pDst, IDirect3DVertexBuffer9* pSrcRectDescs, UINT NumRects, IDirect3DVertexBuffer9* pDstRectDescs, D3DCOMPOSERECTSOP Operation, int Xoffset, int Yoffset) override {
+      NULL_D3D9_CALL();
+      return D3D_OK;
+    }
+
+    STDMETHOD(PresentEx)(THIS_ CONST RECT* pSourceRect, CONST RECT* pDestRect, HWND hDestWindowOverride, CONST RGNDATA* pDirtyRegion, DWORD dwFlags) override {
+      NULL_D3D9_CALL();
+      return D3D_OK;
+    }
+
+    STDMETHOD(GetGPUThreadPriority)(THIS_ INT* pPriority) override {
+      NULL_D3D9_CALL();
+      return zeroFill(pPriority);
+    }
+
+    STDMETHOD(SetGPUThreadPriority)(THIS_ INT Priority) override {
+      NULL_D3D9_CALL();
+      return D3D_OK;
+    }
+
+    STDMETHOD(WaitForVBlank)(THIS_ UINT iSwapChain) override {
+      NULL_D3D9_CALL();
+      return D3D_OK;
+    }
+
+    STDMETHOD(CheckResourceResidency)(THIS_ IDirect3DResource9** pResourceArray, UINT32 NumResources) override {
+      NULL_D3D9_CALL();
+      return D3D_OK;
+    }
+
+    STDMETHOD(SetMaximumFrameLatency)(THIS_ UINT MaxLatency) override {
+      NULL_D3D9_CALL();
+      return D3D_OK;
+    }
+
+    STDMETHOD(GetMaximumFrameLatency)(THIS_ UINT* pMaxLatency) override {
+      NULL_D3D9_CALL();
+      return zeroFill(pMaxLatency);
+    }
+
+    STDMETHOD(CheckDeviceState)(THIS_ HWND hDestinationWindow) override {
+      NULL_D3D9_CALL();
+      return D3D_OK;
+    }
+
+    STDMETHOD(CreateRenderTargetEx)(THIS_ UINT Width, UINT Height, D3DFORMAT Format, D3DMULTISAMPLE_TYPE MultiSample, DWORD MultisampleQuality, BOOL Lockable, IDirect3DSurface9** ppSurface, HANDLE* pSharedHandle, DWORD Usage) override {
+      NULL_D3D9_CALL();
+      return createSurface(Width, Height, Format, Usage | D3DUSAGE_RENDERTARGET, D3DPOOL_DEFAULT, MultiSample, MultisampleQuality, ppSurface);
+    }
+
+    STDMETHOD(CreateOffscreenPlainSurfaceEx)(THIS_ UINT Width, UINT Height, D3DFORMAT Format, D3DPOOL Pool, IDirect3DSurface9** ppSurface, HANDLE* pSharedHandle, DWORD Usage) override {
+      NULL_D3D9_CALL();
+      return createSurface(Width, Height, Format, Usage, Pool, D3DMULTISAMPLE_NONE, 0, ppSurface);
+    }
+
+    STDMETHOD(CreateDepthStencilSurfaceEx)(THIS_ UINT Width, UINT Height, D3DFORMAT Format, D3DMULTISAMPLE_TYPE MultiSample, DWORD MultisampleQuality, BOOL Discard, IDirect3DSurface9** ppSurface, HANDLE* pSharedHandle, DWORD Usage) override {
+      NULL_D3D9_CALL();
+      return createSurface(Width, Height, Format, Usage | D3DUSAGE_DEPTHSTENCIL, D3DPOOL_DEFAULT, MultiSample, MultisampleQuality, ppSurface);
+    }
+
+    STDMETHOD(ResetEx)(THIS_ D3DPRESENT_PARAMETERS* pPresentationParameters, D3DDISPLAYMODEEX* pFullscreenDisplayMode) override {
+      NULL_D3D9_CALL();
+      return Reset(pPresentationParameters);
+    }
+
+    STDMETHOD(GetDisplayModeEx)(THIS_ UINT iSwapChain, D3DDISPLAYMODEEX* pMode, D3DDISPLAYROTATION* pRotation) override {
+      NULL_D3D9_CALL();
+      if (pMode == nullptr) {
+        return D3DERR_INVALIDCALL;
+      }
+      fillDisplayModeEx(pMode);
+      if (pRotation != nullptr) {
+        *pRotation = D3DDISPLAYROTATION_IDENTITY;
+      }
+      return D3D_OK;
+    }
+
+  protected:
+    bool isSupportedInterface(REFIID riid) const override {
+      return riid == __uuidof(IDirect3DDevice9) || NullUnknown<IDirect3DDevice9Ex>::isSupportedInterface(riid);
+    }
+
+    // Standalone resources may outlive the device they were created on and still
+    // unbind themselves when destroyed, so devices are never freed. A replay only
+    // creates a handful of them.
+    void onFinalRelease() override {
+      m_pD3D->Release();
+    }
+
+  private:
+    template<typename T>
+    static HRESULT zeroFill(T* pValue, const size_t count = 1) {
+      if (pValue == nullptr) {
+        return D3DERR_INVALIDCALL;
+      }
+      memset(pValue, 0, sizeof(T) * count);
+      return D3D_OK;
+    }
+
+    HRESULT createSurface(const UINT width, const UINT height, const D3DFORMAT format, const DWORD usage,
+                          const D3DPOOL pool, const D3DMULTISAMPLE_TYPE multiSample, const DWORD multiSampleQuality,
+                          IDirect3DSurface9** ppSurface) {
+      if (ppSurface == nullptr || width == 0 || height == 0) {
+        return D3DERR_INVALIDCALL;
+      }
+      const auto desc = makeSurfaceDesc(width, height, format, usage, pool, multiSample, multiSampleQuality);
+      *ppSurface = new NullSurface(this, desc, nullptr);
+      return D3D_OK;
+    }
+
+    void createImplicitObjects(const D3DPRESENT_PARAMETERS& presParams) {
+      m_pSwapChain = std::make_unique<NullSwapChain>(this, presParams, true);
+      const auto& actualParams = m_pSwapChain->getPresentParameters();
+      if (actualParams.EnableAutoDepthStencil) {
+        const auto desc = makeSurfaceDesc(actualParams.BackBufferWidth, actualParams.BackBufferHeight,
+                                          actualParams.AutoDepthStencilFormat, D3DUSAGE_DEPTHSTENCIL,
+                                          D3DPOOL_DEFAULT, actualParams.MultiSampleType,
+                                          actualParams.MultiSampleQuality);
+        m_pAutoDepthStencil = std::make_unique<NullSurface>(this, desc, this);
+      }
+
+      std::lock_guard<std::mutex> lock(m_bindingMutex);
+      std::fill(std::begin(m_pRenderTargets), std::end(m_pRenderTargets), nullptr);
+      m_pRenderTargets[0] = m_pSwapChain->getBackBuffer(0);
+      m_pDepthStencil = m_pAutoDepthStencil.get();
+    }
+
+    IDirect3D9Ex* const m_pD3D;
+    const D3DDEVICE_CREATION_PARAMETERS m_creationParams;
+    std::atomic<BOOL> m_bShowCursor { FALSE };
+
+    // Bindings are weak, surfaces remove themselves on destruction
+    std::mutex m_bindingMutex;
+    NullSurface* m_pRenderTargets[kMaxRenderTargets] = {};
+    NullSurface* m_pDepthStencil = nullptr;
+
+    std::unique_ptr<NullSwapChain> m_pSwapChain;
+    std::unique_ptr<NullSurface> m_pAutoDepthStencil;
+    std::vector<std::unique_ptr<NullSwapChain>> m_retiredSwapChains;
+    std::vector<std::unique_ptr<NullSurface>> m_retiredSurfaces;
+  };
+
+  NullSurface::~NullSurface() {
+    static_cast<NullDevice*>(m_pDevice)->unbindSurface(this);
+  }
+
+  class NullD3D9Ex : public NullUnknown<IDirect3D9Ex> {
+  public:
+    NullD3D9Ex(): NullUnknown<IDirect3D9Ex>(false) { }
+
+    /*** IDirect3D9 methods ***/
+    STDMETHOD(RegisterSoftwareDevice)(THIS_ void* pInitializeFunction) override {
+      NULL_D3D9_CALL();
+      return D3D_OK;
+    }
+
+    STDMETHOD_(UINT, GetAdapterCount)(THIS) override {
+      NULL_D3D9_CALL();
+      return 1;
+    }
+
+    STDMETHOD(GetAdapterIdentifier)(THIS_ UINT Adapter, DWORD Flags, D3DADAPTER_IDENTIFIER9* pIdentifier) override {
+      NULL_D3D9_CALL();
+      if (Adapter != 0 || pIdentifier == nullptr) {
+        return D3DERR_INVALIDCALL;
+      }
+      memset(pIdentifier, 0, sizeof(D3DADAPTER_IDENTIFIER9));
+      strncpy_s(pIdentifier->Driver, "null", _TRUNCATE);
+      strncpy_s(pIdentifier->Description, "Remix Bridge Null D3D9 Adapter", _TRUNCATE);
+      strncpy_s(pIdentifier->DeviceName, "\\\\.\\DISPLAY1", _TRUNCATE);
+      return D3D_OK;
+    }
+
+    STDMETHOD_(UINT, GetAdapterModeCount)(THIS_ UINT Adapter, D3DFORMAT Format) override {
+      NULL_D3D9_CALL();
+      return (Adapter == 0 && Format == kAdapterFormat) ? 1 : 0;
+    }
+
+    STDMETHOD(EnumAdapterModes)(THIS_ UINT Adapter, D3DFORMAT Format, UINT Mode, D3DDISPLAYMODE* pMode) override {
+      NULL_D3D9_CALL();
+      if (Adapter != 0 || Format != kAdapterFormat || Mode != 0 || pMode == nullptr) {
+        return D3DERR_INVALIDCALL;
+      }
+      fillDisplayMode(pMode);
+      return D3D_OK;
+    }
+
+    STDMETHOD(GetAdapterDisplayMode)(THIS_ UINT Adapter, D3DDISPLAYMODE* pMode) override {
+      NULL_D3D9_CALL();
+      if (Adapter != 0 || pMode == nullptr) {
+        return D3DERR_INVALIDCALL;
+      }
+      fillDisplayMode(pMode);
+      return D3D_OK;
+    }
+
+    STDMETHOD(CheckDeviceType)(THIS_ UINT Adapter, D3DDEVTYPE DevType, D3DFORMAT AdapterFormat, D3DFORMAT BackBufferFormat, BOOL bWindowed) override {
+      NULL_D3D9_CALL();
+      return (Adapter == 0) ? D3D_OK : D3DERR_INVALIDCALL;
+    }
+
+    STDMETHOD(CheckDeviceFormat)(THIS_ UINT Adapter, D3DDEVTYPE DeviceType, D3DFORMAT AdapterFormat, DWORD Usage, D3DRESOURCETYPE RType, D3DFORMAT CheckFormat) override {
+      NULL_D3D9_CALL();
+      return (Adapter == 0) ? D3D_OK : D3DERR_INVALIDCALL;
+    }
+
+    STDMETHOD(CheckDeviceMultiSampleType)(THIS_ UINT Adapter, D3DDEVTYPE DeviceType, D3DFORMAT SurfaceFormat, BOOL Windowed, D3DMULTISAMPLE_TYPE MultiSampleType, DWORD* pQualityLevels) override {
+      NULL_D3D9_CALL();
+      if (Adapter != 0) {
+        return D3DERR_INVALIDCALL;
+      }
+      if (pQualityLevels != nullptr) {
+        *pQualityLevels = 1;
+      }
+      return D3D_OK;
+    }
+
+    STDMETHOD(CheckDepthStencilMatch)(THIS_ UINT Adapter, D3DDEVTYPE DeviceType, D3DFORMAT AdapterFormat, D3DFORMAT RenderTargetFormat, D3DFORMAT DepthStencilFormat) override {
+      NULL_D3D9_CALL();
+      return (Adapter == 0) ? D3D_OK : D3DERR_INVALIDCALL;
+    }
+
+    STDMETHOD(CheckDeviceFormatConversion)(THIS_ UINT Adapter, D3DDEVTYPE DeviceType, D3DFORMAT SourceFormat, D3DFORMAT TargetFormat) override {
+      NULL_D3D9_CALL();
+      return (Adapter == 0) ? D3D_OK : D3DERR_INVALIDCALL;
+    }
+
+    STDMETHOD(GetDeviceCaps)(THIS_ UINT Adapter, D3DDEVTYPE DeviceType, D3DCAPS9* pCaps) override {
+      NULL_D3D9_CALL();
+      if (Adapter != 0 || pCaps == nullptr) {
+        return D3DERR_INVALIDCALL;
+      }
+      fillDeviceCaps(Adapter, DeviceType, pCaps);
+      return D3D_OK;
+    }
+
+    STDMETHOD_(HMONITOR, GetAdapterMonitor)(THIS_ UINT Adapter) override {
+      NULL_D3D9_CALL();
+      return nullptr;
+    }
+
+    STDMETHOD(CreateDevice)(THIS_ UINT Adapter, D3DDEVTYPE DeviceType, HWND hFocusWindow, DWORD BehaviorFlags, D3DPRESENT_PARAMETERS* pPresentationParameters, IDirect3DDevice9** ppReturnedDeviceInterface) override {
+      NULL_D3D9_CALL();
+      IDirect3DDevice9Ex* pDevice = nullptr;
+      const HRESULT hresult = createDevice(Adapter, DeviceType, hFocusWindow, BehaviorFlags, pPresentationParameters, &pDevice);
+      if (ppReturnedDeviceInterface != nullptr) {
+        *ppReturnedDeviceInterface = pDevice;
+      }
+      return hresult;
+    }
+
+    /*** IDirect3D9Ex methods ***/
+    STDMETHOD_(UINT, GetAdapterModeCountEx)(THIS_ UINT Adapter, CONST D3DDISPLAYMODEFILTER* pFilter) override {
+      NULL_D3D9_CALL();
+      return (Adapter == 0) ? 1 : 0;
+    }
+
+    STDMETHOD(EnumAdapterModesEx)(THIS_ UINT Adapter, CONST D3DDISPLAYMODEFILTER* pFilter, UINT Mode, D3DDISPLAYMODEEX* pMode) override {
+      NULL_D3D9_CALL();
+      if (Adapter != 0 || Mode != 0 || pMode == nullptr) {
+        return D3DERR_INVALIDCALL;
+      }
+      fillDisplayModeEx(pMode);
+      return D3D_OK;
+    }
+
+    STDMETHOD(GetAdapterDisplayModeEx)(THIS_ UINT Adapter, D3DDISPLAYMODEEX* pMode, D3DDISPLAYROTATION* pRotation) override {
+      NULL_D3D9_CALL();
+      if (Adapter != 0 || pMode == nullptr) {
+        return D3DERR_INVALIDCALL;
+      }
+      fillDisplayModeEx(pMode);
+      if (pRotation != nullptr) {
+        *pRotation = D3DDISPLAYROTATION_IDENTITY;
+      }
+      return D3D_OK;
+    }
+
+    STDMETHOD(CreateDeviceEx)(THIS_ UINT Adapter, D3DDEVTYPE DeviceType, HWND hFocusWindow, DWORD BehaviorFlags, D3DPRESENT_PARAMETERS* pPresentationParameters, D3DDISPLAYMODEEX* pFullscreenDisplayMode, IDirect3DDevice9Ex** ppReturnedDeviceInterface) override {
+      NULL_D3D9_CALL();
+      IDirect3DDevice9Ex* pDevice = nullptr;
+      const HRESULT hresult = createDevice(Adapter, DeviceType, hFocusWindow, BehaviorFlags, pPresentationParameters, &pDevice);
+      if (ppReturnedDeviceInterface != nullptr) {
+        *ppReturnedDeviceInterface = pDevice;
+      }
+      return hresult;
+    }
+
+    STDMETHOD(GetAdapterLUID)(THIS_ UINT Adapter, LUID* pLUID) override {
+      NULL_D3D9_CALL();
+      if (Adapter != 0 || pLUID == nullptr) {
+        return D3DERR_INVALIDCALL;
+      }
+      memset(pLUID, 0, sizeof(LUID));
+      return D3D_OK;
+    }
+
+  protected:
+    bool isSupportedInterface(REFIID riid) const override {
+      return riid == __uuidof(IDirect3D9) || NullUnknown<IDirect3D9Ex>::isSupportedInterface(riid);
+    }
+
+  private:
+    HRESULT createDevice(const UINT adapter, const D3DDEVTYPE deviceType, const HWND hFocusWindow,
+                         const DWORD behaviorFlags, const D3DPRESENT_PARAMETERS* pPresentationParameters,
+                         IDirect3DDevice9Ex** ppDevice) {
+      if (adapter != 0 || pPresentationParameters == nullptr || ppDevice == nullptr) {
+        return D3DERR_INVALIDCALL;
+      }
+      const D3DDEVICE_CREATION_PARAMETERS creationParams { adapter, deviceType, hFocusWindow, behaviorFlags };
+      *ppDevice = new NullDevice(this, creationParams, *pPresentationParameters);
+      return D3D_OK;
+    }
+  };
+}
+
+IDirect3D9Ex* create() {
+  return new NullD3D9Ex();
+}
+
+void logCallCounts() {
+  std::vector<std::pair<std::string, uint64_t>> counts;
+  {
+    std::lock_guard<std::mutex> lock(gCounterMutex);
+    for (const auto& pCounter : gCounters) {
+      counts.emplace_back(pCounter->name, pCounter->count.load());
+    }
+  }
+  std::sort(counts.begin(), counts.end(), [](const auto& a, const auto& b) {
+    return a.second > b.second;
+  });
+
+  Logger::info("Null D3D9 interface method calls:");
+  for (const auto& [name, count] : counts) {
+    Logger::info(format_string("  %-72s %12llu", name.c_str(), count));
+  }
+}
+}
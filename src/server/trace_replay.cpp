@@ -0,0 +1,257 @@
+/*
+ * Copyright (c) 2022-2023, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#include "trace_replay.h"
+
+#include "config/global_options.h"
+#include "log/log.h"
+
+#include <algorithm>
+#include <vector>
+
+using namespace Commands;
+using namespace bridge_util;
+
+extern bool gbBridgeRunning;
+
+namespace {
+  using Channel = CommandTrace::Channel;
+  using Record = CommandTrace::Reader::Record;
+  using Item = CommandTrace::Reader::Item;
+  using DataT = CommandTrace::DataT;
+
+  int64_t queryTimestamp() {
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+    return counter.QuadPart;
+  }
+
+  double ticksToMs(const int64_t ticks) {
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+    return 1000.0 * (double) ticks / (double) frequency.QuadPart;
+  }
+
+  bool isPresentCommand(const D3D9Command command) {
+    return command == IDirect3DDevice9Ex_Present || command == IDirect3DSwapChain9_Present;
+  }
+}
+
+TraceReplay::TraceReplay(const std::string& tracePath)
+  : m_reader(tracePath) {
+  if (!isValid()) {
+    return;
+  }
+  const uint32_t traceFlags = m_reader.getFileHeader().flags;
+  if (traceFlags != CommandTrace::getCurrentFileFlags()) {
+    // The server decides on its own whether to send responses, so a mismatch
+    // leaves the replay waiting on responses that never come or vice versa.
+    Logger::warn(format_string("Command trace was captured with server response flags 0x%x, but 0x%x are configured. "
+                               "Use the same bridge.conf for capture and replay.",
+                               traceFlags, CommandTrace::getCurrentFileFlags()));
+  }
+  Logger::info(format_string("Loaded command trace %s (%zu bytes).", tracePath.c_str(), m_reader.getFileSize()));
+}
+
+TraceReplay::~TraceReplay() {
+  if (m_feederThread.joinable()) {
+    m_feederThread.join();
+  }
+}
+
+void TraceReplay::start(NamedSemaphore* pPresentSemaphore) {
+  m_pPresentSemaphore = pPresentSemaphore;
+
+  // Same channel names and sizes that the client would use, see initDeviceBridge()
+  // and initModuleBridge(). The writer side resets the shared queue state, which
+  // is fine as nothing has been sent yet.
+  ClientChannel& device = m_channels[(size_t) Channel::Device];
+  device.pWriter = std::make_unique<WriterChannel>("DeviceClient2Server",
+                                                   GlobalOptions::getClientChannelMemSize(),
+                                                   GlobalOptions::getClientCmdQueueSize(),
+                                                   GlobalOptions::getClientDataQueueSize());
+  device.pReader = std::make_unique<ReaderChannel>("DeviceServer2Client",
+                                                   GlobalOptions::getServerChannelMemSize(),
+                                                   GlobalOptions::getServerCmdQueueSize(),
+                                                   GlobalOptions::getServerDataQueueSize());
+  device.bFlowControl = true;
+
+  ClientChannel& module = m_channels[(size_t) Channel::Module];
+  module.pWriter = std::make_unique<WriterChannel>("ModuleClient2Server",
+                                                   GlobalOptions::getModuleClientChannelMemSize(),
+                                                   GlobalOptions::getModuleClientCmdQueueSize(),
+                                                   GlobalOptions::getModuleClientDataQueueSize());
+  module.pReader = std::make_unique<ReaderChannel>("ModuleServer2Client",
+                                                   GlobalOptions::getModuleServerChannelMemSize(),
+                                                   GlobalOptions::getModuleServerCmdQueueSize(),
+                                                   GlobalOptions::getModuleServerDataQueueSize());
+
+  m_feederThread = std::thread([this]() {
+    feed();
+  });
+}
+
+void TraceReplay::finish() {
+  if (m_feederThread.joinable()) {
+    m_feederThread.join();
+  }
+  m_endTicks = queryTimestamp();
+  logReport();
+}
+
+void TraceReplay::feed() {
+  Logger::info("Starting command trace replay...");
+  m_startTicks = queryTimestamp();
+
+  bool bTerminateSent = false;
+  Record record;
+  while (gbBridgeRunning && m_reader.next(record)) {
+    if (record.header.channel >= Channel::Count) {
+      Logger::err("Command trace contains a record for an unknown channel, stopping replay.");
+      break;
+    }
+    // Bulk lane uploads are replayed in order on the device lane, which needs no dependencies
+    const Channel channelId = (record.header.channel == Channel::Bulk) ? Channel::Device : record.header.channel;
+    ClientChannel& channel = m_channels[(size_t) channelId];
+
+    if (record.header.type == CommandTrace::RecordType::Response) {
+      waitForResponse(channel);
+      continue;
+    }
+
+    const auto command = (D3D9Command) record.header.command;
+    if (command == Bridge_LaneDependency) {
+      continue;
+    }
+    if (isPresentCommand(command) && GlobalOptions::getPresentSemaphoreEnabled()) {
+      // Acquire the frame just like the client does in syncOnPresent()
+      while (gbBridgeRunning && RESULT_FAILURE(m_pPresentSemaphore->wait())) {
+      }
+    }
+    pushCommand(channel, record);
+
+    if (command == Bridge_Terminate) {
+      bTerminateSent = true;
+      break;
+    }
+  }
+
+  if (!bTerminateSent && gbBridgeRunning) {
+    // Traces of applications that did not exit cleanly have no Terminate at the end
+    Record terminate {};
+    terminate.header.channel = Channel::Device;
+    terminate.header.command = Bridge_Terminate;
+    pushCommand(m_channels[(size_t) Channel::Device], terminate);
+  }
+  Logger::info(format_string("Command trace fully submitted, %llu commands sent.", m_numCommandsSent));
+}
+
+void TraceReplay::pushCommand(ClientChannel& channel, const Record& record) {
+  WriterChannel& writer = *channel.pWriter;
+  // UID plus the payload, and leave room for blobs skipping to the start of the buffer
+  const size_t numWords = 1 + record.header.payloadSize / sizeof(DataT);
+  if (channel.bFlowControl) {
+    waitForDataSpace(writer, 2 * numWords);
+  }
+
+  writer.data->begin_batch();
+  writer.data->push((DataT) m_nextUID++);
+  record.forEachItem([&](const Item& item) {
+    if (item.isScalar) {
+      writer.data->push(item.value);
+    } else {
+      writer.data->push(item.value, item.pData);
+    }
+  });
+  writer.data->end_batch();
+
+  Header header { (D3D9Command) record.header.command, record.header.flags,
+                  (uint32_t) writer.get_data_pos(), record.header.handle };
+#ifdef TRACY_ENABLE
+  LARGE_INTEGER counter;
+  QueryPerformanceCounter(&counter);
+  header.enqueueTime = (uint32_t) counter.QuadPart;
+#endif
+  while (RESULT_FAILURE(writer.commands->push(header)) && gbBridgeRunning) {
+  }
+
+  ++m_numCommandsSent;
+  m_numBytesSent += numWords * sizeof(DataT);
+}
+
+void TraceReplay::waitForDataSpace(const WriterChannel& writer, const size_t numWords) {
+  const size_t totalSize = writer.data->get_total_size();
+  if (numWords >= totalSize) {
+    Logger::err("Command trace contains a command that is larger than the data queue, stopping replay.");
+    gbBridgeRunning = false;
+    return;
+  }
+
+  // The server hands back the data queue space of every command it completes. Nothing
+  // was handed back yet before the first command is done, so count from the start.
+  const uint64_t requiredCursor = writer.data->get_cursor() + numWords;
+  const auto getConsumed = [&writer]() {
+    const uint64_t consumed = writer.dataConsumed->load();
+    return (consumed == WriterChannel::kCreditsUntracked) ? 0 : consumed;
+  };
+  while (gbBridgeRunning && requiredCursor - getConsumed() > totalSize) {
+    std::this_thread::yield();
+  }
+}
+
+void TraceReplay::waitForResponse(const ClientChannel& channel) {
+  // The response content does not matter for replay, only that the client
+  // had to wait for it before it could continue.
+  Result result;
+  do {
+    result = Result::Timeout;
+    channel.pReader->commands->pull(result, GlobalOptions::getCommandTimeout());
+  } while (RESULT_FAILURE(result) && gbBridgeRunning);
+}
+
+void TraceReplay::logReport() const {
+  const double totalMs = ticksToMs(m_endTicks - m_startTicks);
+  const double totalSec = std::max(totalMs / 1000.0, 1e-9);
+  Logger::info("==================\nCommand trace replay report\n==================");
+  Logger::info(format_string("Replayed %llu commands and %.2f MB of data in %.2f ms.",
+                             m_numCommandsSent, m_numBytesSent / (1024.0 * 1024.0), totalMs));
+  Logger::info(format_string("Throughput: %.0f commands/s, %.2f MB/s.",
+                             m_numCommandsSent / totalSec, m_numBytesSent / (1024.0 * 1024.0) / totalSec));
+
+  std::vector<size_t> commands;
+  for (size_t i = 0; i < m_stats.size(); ++i) {
+    if (m_stats[i].count > 0) {
+      commands.push_back(i);
+    }
+  }
+  std::sort(commands.begin(), commands.end(), [this](const size_t a, const size_t b) {
+    return m_stats[a].ticks > m_stats[b].ticks;
+  });
+
+  Logger::info(format_string("%-56s %10s %12s %10s %12s", "Command", "Count", "Total ms", "Avg us", "Data KB"));
+  for (const size_t command : commands) {
+    const CommandStats& stats = m_stats[command];
+    const double ms = ticksToMs(stats.ticks);
+    Logger::info(format_string("%-56s %10llu %12.3f %10.3f %12.1f",
+                               toString((D3D9Command) command).c_str(), stats.count, ms,
+                               1000.0 * ms / stats.count, stats.dataSize / 1024.0));
+  }
+}
@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2022-2023, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#pragma once
+
+#include "util_commands.h"
+#include "util_commandtrace.h"
+#include "util_ipcchannel.h"
+#include "util_semaphore.h"
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+
+// Feeds a command trace captured by the client into the server's own command
+// queues, impersonating the client side of both bridge channels, and collects
+// per-command timings while the regular command processing loop consumes it.
+class TraceReplay {
+public:
+  explicit TraceReplay(const std::string& tracePath);
+  ~TraceReplay();
+
+  bool isValid() const {
+    return m_reader.isValid();
+  }
+
+  // Opens the client ends of the bridge channels and starts feeding commands.
+  // The server bridges must already be initialized at this point.
+  void start(bridge_util::NamedSemaphore* pPresentSemaphore);
+  // Waits for the feeder to finish and writes the replay report to the log
+  void finish();
+
+  // Called by the device command processing loop for every processed command
+  inline void recordCommand(const Commands::D3D9Command command, const int64_t ticks, const size_t dataSize) {
+    CommandStats& stats = m_stats[command < m_stats.size() ? command : 0];
+    ++stats.count;
+    stats.ticks += ticks;
+    stats.dataSize += dataSize;
+  }
+
+private:
+  struct ClientChannel {
+    std::unique_ptr<WriterChannel> pWriter;
+    std::unique_ptr<ReaderChannel> pReader;
+    // The server reports its read position only for the device channel
+    bool bFlowControl = false;
+  };
+
+  struct CommandStats {
+    uint64_t count = 0;
+    int64_t ticks = 0;
+    uint64_t dataSize = 0;
+  };
+
+  void feed();
+  void pushCommand(ClientChannel& channel, const bridge_util::CommandTrace::Reader::Record& record);
+  void waitForDataSpace(const WriterChannel& writer, const size_t numWords);
+  void waitForResponse(const ClientChannel& channel);
+  void logReport() const;
+
+  bridge_util::CommandTrace::Reader m_reader;
+  ClientChannel m_channels[(size_t) bridge_util::CommandTrace::Channel::Count];
+  bridge_util::NamedSemaphore* m_pPresentSemaphore = nullptr;
+  std::thread m_feederThread;
+  UID m_nextUID = 0;
+
+  uint64_t m_numCommandsSent = 0;
+  uint64_t m_numBytesSent = 0;
+  int64_t m_startTicks = 0;
+  int64_t m_endTicks = 0;
+  std::array<CommandStats, Commands::Bridge_NumCommands> m_stats;
+};
@@ -106,6 +106,10 @@ public:
     return get().sendCreateFunctionServerResponses;
   }
 
+  static bool getAsyncCreateFunctions() {
+    return get().asyncCreateFunctions;
+  }
+
   static bool getLogAllCalls() {
     return get().logAllCalls;
   }
@@ -122,6 +126,10 @@ public:
     return get().logServerCommands || get().logAllCommands;
   }
 
+  static uint32_t getCommandLogSize() {
+    return get().commandLogSize;
+  }
+
   static uint32_t getCommandTimeout() {
 #ifdef _DEBUG
     return (get().disableTimeouts || (IsDebuggerPresent() && get().disableTimeoutsWhenDebugging)) ? 0 : get().commandTimeout;
@@ -172,6 +180,10 @@ public:
     return get().logLevel;
   }
 
+  static size_t getLogMaxFileSize() {
+    return (size_t) get().logMaxFileSizeMB << 20;
+  }
+
   static uint16_t getKeyStateCircBufMaxSize() {
     return get().keyStateCircBufMaxSize;
   }
@@ -192,6 +204,30 @@ public:
     return get().useSharedHeap;
   }
 
+  static bool getEmulateQueries() {
+    return get().emulateQueries;
+  }
+
+  static uint32_t getGeometryRingSize() {
+    return get().geometryRingSize;
+  }
+
+  static bool getUseBulkLane() {
+    return get().useBulkLane;
+  }
+
+  static uint32_t getBulkChannelMemSize() {
+    return get().bulkChannelMemSize;
+  }
+
+  static uint32_t getBulkCmdQueueSize() {
+    return get().bulkCmdQueueSize;
+  }
+
+  static uint32_t getBulkDataQueueSize() {
+    return get().bulkDataQueueSize;
+  }
+
   static bool getUseSharedHeapForTextures() {
     return (get().sharedHeapPolicy & SharedHeapPolicy::Textures) != 0;
   }
@@ -216,6 +252,10 @@ public:
     return get().sharedHeapFreeChunkWaitTimeout;
   }
 
+  static const uint32_t getSharedHeapPayloadThreshold() {
+    return get().sharedHeapPayloadThreshold;
+  }
+
   static const uint32_t getSemaphoreTimeout() {
     return get().commandTimeout;
   }
@@ -309,6 +349,11 @@ private:
     // sendAllServerResponses are set to False.
     sendCreateFunctionServerResponses = bridge_util::Config::getOption<bool>("sendCreateFunctionServerResponses", true);
 
+    // Create API calls return immediately and the server reports failures through a shared
+    // error ring instead, which the client surfaces on the next Present. Takes precedence over
+    // sendCreateFunctionServerResponses, but not over sendAllServerResponses.
+    asyncCreateFunctions = bridge_util::Config::getOption<bool>("asyncCreateFunctions", false) && !sendAllServerResponses;
+
     // In a Debug or DebugOptimized build of the bridge, setting LogApiCalls
     // to True will write each call to a D3D9 API function through the bridge
     // client to to the the client log file("d3d9.log").
@@ -323,20 +368,25 @@ private:
     // public D3D9 API function will be offset by an additional tab.
     logAllCalls = bridge_util::Config::getOption<bool>("logAllCalls", false);
 
-    // In a Debug or DebugOptimized build of the bridge, setting LogAllCommands
-    // will log Command object creation, commands being pushed to the command buffer,
-    // and waitForCommand calls to the respective Bridge server or client log files.
-    // Additionally, it will enable logging of Bridge Server Module and Device
-    // processing, the same as setting logServerCommands to True
+    // Setting LogAllCommands will record every command pushed to or pulled from
+    // the command queues into a binary command log next to the respective Bridge
+    // server or client log file ("d3d9.cmdlog", "NvRemixBridge.cmdlog"). Additionally,
+    // it will record Bridge Server Module and Device processing, the same as setting
+    // logServerCommands to True. Use "NvRemixBridge.exe --decode-command-log" to merge
+    // the logs into a readable timeline.
 
     logAllCommands = bridge_util::Config::getOption<bool>("logAllCommands", false);
 
-    // In a Debug or DebugOptimized build of the bridge, setting LogServerCommands
-    // or LogAllCommands to True will write each command sent to the server to the server 
-    // log file ("NvRemixBridge.log")
+    // Setting LogServerCommands or LogAllCommands to True will record each command
+    // processed by the server in the server command log ("NvRemixBridge.cmdlog")
 
     logServerCommands = bridge_util::Config::getOption<bool>("logServerCommands", false);
 
+    // Number of most recent commands kept by the command log, rounded down to a
+    // power of two. Each record takes 32 bytes.
+
+    commandLogSize = bridge_util::Config::getOption<uint32_t>("commandLogSize", 262144);
+
     // These values strike a good balance between not waiting too long during the
     // handshake on startup, which we expect to be relatively quick, while still being
     // resilient enough against blips that can cause intermittent timeouts during
@@ -362,6 +412,9 @@ private:
 #endif
     logLevel = bridge_util::str_to_loglevel(strLevel);
 
+    // Size in MB at which the log file is rolled over to a backup, 0 for no limit
+    logMaxFileSizeMB = bridge_util::Config::getOption<uint32_t>("logMaxFileSize", 0);
+
     // We use a simple circular buffer to track user input state in order to send
     // it over the bridge for dxvk developer/user overlay manipulation. This sets
     // the max size of the circ buffer, which stores 2B elements. 100 is probably
@@ -396,6 +449,11 @@ private:
 
     initSharedHeapPolicy();
 
+    // Event and occlusion query results are published by the server into shared memory
+    // once per frame, so that the client can answer GetData() polling locally instead
+    // of waiting on a server response each time. Must match between client and server.
+    emulateQueries = bridge_util::Config::getOption<bool>("emulateQueries", false);
+
     // The SharedHeap is actually divvied up into multiple "segments":shared memory file mappings
     // This is that unit size
     static constexpr uint32_t kDefaultSharedHeapSegmentSize = 256 << 20; // 256MB
@@ -408,12 +466,37 @@ private:
     // The number of seconds to wait for a avaliable chunk to free up in the shared heap
     sharedHeapFreeChunkWaitTimeout = bridge_util::Config::getOption<uint32_t>("sharedHeapFreeChunkWaitTimeout", 10);
 
+    // Command payloads larger than this are placed in the shared heap instead of the data queue,
+    // regardless of the shared heap policy. Only applies if the shared heap is used, 0 disables it.
+    static constexpr uint32_t kDefaultSharedHeapPayloadThreshold = 8 << 20; // 8MB
+    sharedHeapPayloadThreshold = useSharedHeap ?
+      bridge_util::Config::getOption<uint32_t>("sharedHeapPayloadThreshold", kDefaultSharedHeapPayloadThreshold) : 0;
+
     // Thread-safety policy: 0 - use client's choice, 1 - force thread-safe, 2 - force non-thread-safe
     threadSafetyPolicy = bridge_util::Config::getOption<uint32_t>("threadSafetyPolicy", 0);
 
     // If set and a buffer is not dynamic, vertex and index buffer lock/unlocks will ignore the bounds set during the lock call
     // and the brifge will copy the entire buffer. This means
     alwaysCopyEntireStaticBuffer = bridge_util::Config::getOption<bool>("alwaysCopyEntireStaticBuffer", false);
+
+    // Size of the shared memory ring that DrawPrimitiveUP()/DrawIndexedPrimitiveUP() geometry is
+    // passed through instead of the data queue, 0 disables it. Must match between client and server.
+    geometryRingSize = bridge_util::Config::getOption<uint32_t>("geometryRingSize", 0);
+
+    // Texture uploads are sent through a separate bulk channel processed by its own server thread
+    // so they do not hold up the device command stream. Must match between client and server.
+    useBulkLane = bridge_util::Config::getOption<bool>("useBulkLane", false);
+    // Bulk Channel Defaults, only the client to server direction of the bulk channel is used
+    static constexpr size_t kDefaultBulkChannelMemSize = 64 << 20; // 64MB
+    static constexpr size_t kDefaultBulkCmdQueueSize = 1 << 10; // 1k
+    static constexpr size_t kDefaultBulkDataQueueSize = 1 << 10; // 1k
+    // Bulk Channel Options
+    bulkChannelMemSize = bridge_util::Config::getOption<uint32_t>(
+      "bulkChannelMemSize", kDefaultBulkChannelMemSize);
+    bulkCmdQueueSize = bridge_util::Config::getOption<uint32_t>(
+      "bulkCmdQueueSize", kDefaultBulkCmdQueueSize);
+    bulkDataQueueSize = bridge_util::Config::getOption<uint32_t>(
+      "bulkDataQueueSize", kDefaultBulkDataQueueSize);
   }
 
   void initSharedHeapPolicy();
@@ -440,16 +523,19 @@ private:
   bool sendReadOnlyCalls;
   bool sendAllServerResponses;
   bool sendCreateFunctionServerResponses;
+  bool asyncCreateFunctions;
   bool logAllCalls;
   bool logApiCalls;
   bool logAllCommands;
   bool logServerCommands;
+  uint32_t commandLogSize;
   uint32_t commandTimeout;
   uint32_t startupTimeout;
   uint32_t ackTimeout;
   uint32_t commandRetries;
   bool infiniteRetries;
   bridge_util::LogLevel logLevel;
+  uint32_t logMaxFileSizeMB;
   uint16_t keyStateCircBufMaxSize;
   uint8_t presentSemaphoreMaxFrames;
   bool presentSemaphoreEnabled;
@@ -457,11 +543,18 @@ private:
   bool disableTimeoutsWhenDebugging;
   bool disableTimeouts;
   bool useSharedHeap;
+  bool emulateQueries;
+  uint32_t geometryRingSize;
+  bool useBulkLane;
+  uint32_t bulkChannelMemSize;
+  uint32_t bulkCmdQueueSize;
+  uint32_t bulkDataQueueSize;
   uint32_t sharedHeapPolicy;
   uint32_t sharedHeapSize;
   uint32_t sharedHeapDefaultSegmentSize;
   uint32_t sharedHeapChunkSize;
   uint32_t sharedHeapFreeChunkWaitTimeout;
+  uint32_t sharedHeapPayloadThreshold;
   uint32_t threadSafetyPolicy;
   bool alwaysCopyEntireStaticBuffer;
 };
@@ -23,10 +23,14 @@
 
 #include "util_filesys.h"
 
+#include <algorithm>
 #include <array>
+#include <chrono>
+#include <cstdlib>
 #include <iostream>
 #include <iomanip>
 #include <sstream>
+#include <thread>
 
 #ifndef _WIN32
 #include <sys/time.h>
@@ -55,6 +59,73 @@ namespace bridge_util {
 #endif
   }
 
+  namespace {
+    // Must be a power of two
+    constexpr uint32_t kRingSize = 2048;
+    constexpr size_t kRecordTextSize = 240;
+    constexpr size_t kBatchSize = 64 * 1024;
+    constexpr auto kWriterInterval = std::chrono::milliseconds(5);
+
+    constexpr uint8_t kLineStart = 1;
+    constexpr uint8_t kLineEnd = 2;
+
+    const std::array<const char*, 5> kPrefixes
+      = { { "trace: ", "debug: ", "info:  ", "warn:  ", "err:   " } };
+
+    // Local time of day in milliseconds
+    uint32_t getLocalTimeMs() {
+#ifdef _WIN32
+      SYSTEMTIME lt;
+      GetLocalTime(&lt);
+      return ((lt.wHour * 60 + lt.wMinute) * 60 + lt.wSecond) * 1000 + lt.wMilliseconds;
+#else
+      struct timeval tv;
+      gettimeofday(&tv, NULL);
+      struct tm* lt = localtime(&tv.tv_sec);
+      return ((lt->tm_hour * 60 + lt->tm_min) * 60 + lt->tm_sec) * 1000 + (tv.tv_usec / 1000) % 1000;
+#endif
+    }
+
+    // Calls fn(pLine, length) for every line of the message, like std::getline would split it
+    template<typename Fn>
+    void forEachLine(const std::string& message, const Fn& fn) {
+      size_t start = 0;
+      while (start < message.size()) {
+        size_t end = message.find('\n', start);
+        if (end == std::string::npos) {
+          end = message.size();
+        }
+        fn(message.data() + start, end - start);
+        start = end + 1;
+      }
+    }
+  }
+
+  // Multi-producer single-consumer ring of fixed size records. A record at ring
+  // position pos is free when its sequence equals pos, and filled when it equals
+  // pos + 1. Producers claim a contiguous range of positions with one CAS, so the
+  // records of a multi-line message stay together.
+  struct Logger::Ring {
+    struct Record {
+      std::atomic<uint32_t> sequence;
+      uint32_t timeMs;
+      uint16_t length;
+      uint8_t level;
+      uint8_t flags;
+      char text[kRecordTextSize];
+    };
+
+    std::atomic<uint32_t> writePos = 0;
+    std::atomic<uint32_t> readPos = 0;
+    Record records[kRingSize];
+
+    Ring() {
+      for (uint32_t i = 0; i < kRingSize; ++i) {
+        records[i].sequence.store(i, std::memory_order_relaxed);
+      }
+    }
+  };
+
   inline static Logger* logger = nullptr;
 
   void Logger::init(const LogLevel logLevel, void* hModuleLogOwner) {
@@ -83,8 +154,7 @@ namespace bridge_util {
       uint32_t attempt = 0;
       while (attempt < 4) {
         m_hFile = CreateFileA(logPath, GENERIC_WRITE, FILE_SHARE_READ, NULL,
-                            CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL |
-                            FILE_FLAG_WRITE_THROUGH, NULL);
+                            CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
         if (m_hFile != INVALID_HANDLE_VALUE) {
           break;
         }
@@ -95,6 +165,15 @@ namespace bridge_util {
         attempt++;
         sprintf_s(logPath, "%s_%02d.log", logNameStr.c_str(), attempt);
       }
+
+      if (m_hFile != INVALID_HANDLE_VALUE) {
+        m_logPath = logPath;
+        m_pRing = new Ring();
+        // Messages are written synchronously until the writer thread is up, which
+        // is not before the loader lock was released when created from DllMain
+        m_writerThread = std::thread(&Logger::writerThread, this);
+        std::atexit([]() { Logger::get().stopWriterThread(); });
+      }
 #else
       m_fileStream = std::ofstream(logPathStr.c_str());
 #endif
@@ -139,24 +218,224 @@ namespace bridge_util {
     get().emitLine(level, line);
   }
 
+  void Logger::flush() {
+    if (logger != nullptr && logger->m_pRing != nullptr) {
+      logger->drain();
+    }
+  }
+
   void Logger::emitMsg(const LogLevel level, const std::string& message) {
     if (level >= m_level) {
-      std::lock_guard<std::mutex> lock(m_mutex);
+      std::unique_lock<std::mutex> drainLock(m_drainMutex, std::defer_lock);
+      if (m_bWriterRunning.load(std::memory_order_acquire)) {
+        if (pushMsg(level, message)) {
+          return;
+        }
+        // The ring is full, make room on this thread rather than reorder the log
+        drain();
+        if (pushMsg(level, message)) {
+          return;
+        }
+      }
+      if (m_pRing != nullptr) {
+        // Write out what is still queued first, and keep the writer from interleaving
+        if (!tryLock(drainLock)) {
+          return;
+        }
+        drainLocked();
+      }
 
-      std::stringstream stream(message);
-      std::string       line;
+      std::unique_lock<std::mutex> lock(m_mutex, std::defer_lock);
+      if (!tryLock(lock)) {
+        return;
+      }
+      forEachLine(message, [this, level](const char* pLine, const size_t length) {
+        emitLine(level, std::string(pLine, length).c_str());
+      });
+    }
+  }
 
-      while (std::getline(stream, line, '\n')) {
-        emitLine(level, line.c_str());
+  bool Logger::pushMsg(const LogLevel level, const std::string& message) {
+    uint32_t numRecords = 0;
+    forEachLine(message, [&numRecords](const char*, const size_t length) {
+      numRecords += std::max<uint32_t>(1, (uint32_t) ((length + kRecordTextSize - 1) / kRecordTextSize));
+    });
+    if (numRecords == 0) {
+      return true;
+    }
+    if (numRecords > kRingSize) {
+      return false;
+    }
+
+    Ring& ring = *m_pRing;
+    uint32_t first = ring.writePos.load(std::memory_order_relaxed);
+    do {
+      if (first + numRecords - ring.readPos.load(std::memory_order_acquire) > kRingSize) {
+        return false;
+      }
+    } while (!ring.writePos.compare_exchange_weak(first, first + numRecords,
+                                                  std::memory_order_acq_rel,
+                                                  std::memory_order_relaxed));
+
+    const uint32_t timeMs = getLocalTimeMs();
+    uint32_t pos = first;
+    forEachLine(message, [&](const char* pLine, const size_t length) {
+      size_t offset = 0;
+      do {
+        auto& record = ring.records[pos & (kRingSize - 1)];
+        const size_t chunk = std::min(length - offset, kRecordTextSize);
+        memcpy(record.text, pLine + offset, chunk);
+        record.timeMs = timeMs;
+        record.length = (uint16_t) chunk;
+        record.level = (uint8_t) level;
+        record.flags = (offset == 0 ? kLineStart : 0) | (offset + chunk == length ? kLineEnd : 0);
+        record.sequence.store(pos + 1, std::memory_order_release);
+        offset += chunk;
+        ++pos;
+      } while (offset < length);
+    });
+    return true;
+  }
+
+  bool Logger::tryLock(std::unique_lock<std::mutex>& lock) {
+    if (m_bLockAbandoned.load(std::memory_order_relaxed)) {
+      return false;
+    }
+    for (uint32_t attempt = 0; !lock.try_lock(); ++attempt) {
+      if (attempt == 100) {
+        if (!m_bWriterRunning.load(std::memory_order_acquire)) {
+          // The owner is most likely gone, e.g. the writer thread killed at process exit
+          m_bLockAbandoned.store(true, std::memory_order_relaxed);
+        }
+        return false;
       }
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
     }
+    return true;
   }
 
-  void Logger::emitLine(const LogLevel level, const char* line) {
-    static std::array<const char*, 5> s_prefixes
-      = { { "trace: ", "debug: ", "info:  ", "warn:  ", "err:   " } };
+  void Logger::drain() {
+    // Give up rather than deadlock when flushing from a crash handler on a thread
+    // that crashed while draining
+    std::unique_lock<std::mutex> drainLock(m_drainMutex, std::defer_lock);
+    if (tryLock(drainLock)) {
+      drainLocked();
+    }
+  }
 
-    const char* prefix = s_prefixes.at(static_cast<uint32_t>(level));
+  void Logger::drainLocked() {
+    // Timestamp, prefix, text and line end of one record, plus the terminator
+    constexpr size_t kMaxFormattedRecord = 32 + kRecordTextSize;
+    static char batch[kBatchSize + 1];
+    size_t batchSize = 0;
+
+    const auto writeBatch = [&]() {
+      if (batchSize > 0) {
+#ifdef _DEBUG
+        batch[batchSize] = '\0';
+        OutputDebugStringA(batch);
+#endif
+        writeToFile(batch, batchSize);
+        batchSize = 0;
+      }
+    };
+
+    Ring& ring = *m_pRing;
+    uint32_t pos = ring.readPos.load(std::memory_order_relaxed);
+    while (true) {
+      auto& record = ring.records[pos & (kRingSize - 1)];
+      if (record.sequence.load(std::memory_order_acquire) != pos + 1) {
+        break;
+      }
+      if (batchSize + kMaxFormattedRecord > kBatchSize) {
+        writeBatch();
+      }
+      if (record.flags & kLineStart) {
+        const uint32_t ms = record.timeMs;
+        const int len = snprintf(batch + batchSize, kBatchSize - batchSize, "[%02u:%02u:%02u.%03u] %s",
+                                 ms / 3600000, (ms / 60000) % 60, (ms / 1000) % 60, ms % 1000,
+                                 kPrefixes.at(record.level));
+        batchSize += len > 0 ? len : 0;
+      }
+      memcpy(batch + batchSize, record.text, record.length);
+      batchSize += record.length;
+      if (record.flags & kLineEnd) {
+        batch[batchSize++] = '\n';
+      }
+      record.sequence.store(pos + kRingSize, std::memory_order_release);
+      ring.readPos.store(++pos, std::memory_order_release);
+    }
+    writeBatch();
+  }
+
+  void Logger::writerThread() {
+    std::unique_lock<std::mutex> lock(m_writerMutex);
+    // Stay synchronous if the process started exiting before the thread got to run
+    if (!m_bStopWriter) {
+      m_bWriterRunning.store(true, std::memory_order_release);
+    }
+    while (!m_bStopWriter) {
+      lock.unlock();
+      drain();
+      lock.lock();
+      m_writerCv.wait_for(lock, kWriterInterval, [this]() { return m_bStopWriter; });
+    }
+  }
+
+  void Logger::stopWriterThread() {
+    {
+      std::lock_guard<std::mutex> lock(m_writerMutex);
+      m_bStopWriter = true;
+    }
+    m_writerCv.notify_one();
+    // Never join here: within a DLL this runs on detach under the loader lock, which
+    // the exiting thread needs, and at process exit the thread was already killed
+    if (m_writerThread.joinable()) {
+      m_writerThread.detach();
+    }
+    // Anything logged from here on is written synchronously, after what is queued
+    m_bWriterRunning.store(false, std::memory_order_release);
+    drain();
+  }
+
+  void Logger::writeToFile(const char* data, const size_t size) {
+    std::unique_lock<std::mutex> lock(m_mutex, std::defer_lock);
+    if (!tryLock(lock)) {
+      return;
+    }
+#ifdef _WIN32
+    if (m_hFile != INVALID_HANDLE_VALUE) {
+      WriteFile(m_hFile, data, (DWORD) size, NULL, NULL);
+    }
+#else
+    if (m_fileStream.is_open()) {
+      m_fileStream.write(data, size);
+    }
+#endif
+    m_fileSize += size;
+    if (m_maxFileSize > 0 && m_fileSize >= m_maxFileSize) {
+      rollOver();
+    }
+  }
+
+  void Logger::rollOver() {
+#ifdef _WIN32
+    if (m_logPath.empty()) {
+      return;
+    }
+    // Keep a single backup next to the log, e.g. d3d9.1.log
+    const size_t dotPos = m_logPath.find_last_of('.');
+    const std::string backupPath = m_logPath.substr(0, dotPos) + ".1" + m_logPath.substr(dotPos);
+    CloseHandle(m_hFile);
+    MoveFileExA(m_logPath.c_str(), backupPath.c_str(), MOVEFILE_REPLACE_EXISTING);
+    m_hFile = CreateFileA(m_logPath.c_str(), GENERIC_WRITE, FILE_SHARE_READ, NULL,
+                          CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+#endif
+    m_fileSize = 0;
+  }
+
+  void Logger::emitLine(const LogLevel level, const char* line) {
+    const char* prefix = kPrefixes.at(static_cast<uint32_t>(level));
 
     char timeString[64];
     getLocalTimeString(timeString);
@@ -176,6 +455,7 @@ namespace bridge_util {
 
     if (m_hFile != INVALID_HANDLE_VALUE) {
       WriteFile(m_hFile, tmpSpace, len, NULL, NULL);
+      m_fileSize += len;
     }
 
 #else
@@ -191,4 +471,8 @@ namespace bridge_util {
     get().m_level = level;
   }
 
+  void Logger::set_max_file_size(const size_t maxFileSize) {
+    get().m_maxFileSize = maxFileSize;
+  }
+
 }
@@ -21,9 +21,12 @@
  */
 #pragma once
 
+#include <atomic>
+#include <condition_variable>
 #include <fstream>
 #include <mutex>
 #include <string>
+#include <thread>
 #include <unordered_map>
 
 namespace bridge_util {
@@ -42,6 +45,12 @@ namespace bridge_util {
    *
    * Logger for one DLL. Creates a text file and
    * writes all log messages to that file.
+   *
+   * Callers only append their messages to a lock-free
+   * ring, a background thread formats them and writes
+   * them to the file in batches. Once the file grows
+   * past the maximum size it is rolled over to a
+   * single backup file.
    */
   class Logger {
   public:
@@ -57,17 +66,37 @@ namespace bridge_util {
     static void logLine(const LogLevel level, const char* line);
 
     static void set_loglevel(const LogLevel level);
+    // Rolls the log file over once it grows past the given size, 0 for no limit
+    static void set_max_file_size(const size_t maxFileSize);
+    // Writes out everything logged so far on the calling thread, e.g. from a crash handler
+    static void flush();
 
   private:
     inline static Logger* logger = nullptr;
 
+    struct Ring;
+
     Logger(const LogLevel logLevel, void* hModuleLogOwner);
     ~Logger();
 
     static Logger& get(const LogLevel logLevel = LogLevel::None, void* hModuleLogOwner = NULL);
     LogLevel m_level;
 
+    // Guards the file
     std::mutex m_mutex;
+    // Held while draining the ring
+    std::mutex m_drainMutex;
+    Ring* m_pRing = nullptr;
+    std::atomic<bool> m_bWriterRunning = false;
+    std::thread m_writerThread;
+    // Wakes the writer thread early when it is asked to stop
+    std::mutex m_writerMutex;
+    std::condition_variable m_writerCv;
+    bool m_bStopWriter = false;
+    std::atomic<bool> m_bLockAbandoned = false;
+    size_t m_maxFileSize = 0;
+    size_t m_fileSize = 0;
+    std::string m_logPath;
 
 #ifdef _WIN32
     void* m_hFile;
@@ -77,6 +106,16 @@ namespace bridge_util {
 
     void emitMsg(const LogLevel level, const std::string& message);
     void emitLine(const LogLevel level, const char* line);
+    bool pushMsg(const LogLevel level, const std::string& message);
+    void drain();
+    void drainLocked();
+    // Locks with a timeout. Once the writer thread stopped, a timeout gives up on all
+    // further locking, since the lock is then likely held by a thread that was killed.
+    bool tryLock(std::unique_lock<std::mutex>& lock);
+    void writerThread();
+    void stopWriterThread();
+    void writeToFile(const char* data, const size_t size);
+    void rollOver();
   };
 
   static LogLevel str_to_loglevel(const std::string& strLogLevel) {
@@ -0,0 +1,118 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#pragma once
+
+#include <array>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace bridge_util {
+
+  static inline uint32_t countTrailingZeros(const uint32_t value) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, value);
+    return index;
+#else
+    return __builtin_ctz(value);
+#endif
+  }
+
+  // Fixed size set of flags packed into 32-bit words, visiting the set flags
+  // takes time proportional to their number rather than to the size of the set
+  template<size_t N>
+  class Bitset {
+    static constexpr size_t kNumWords = (N + 31) / 32;
+
+  public:
+    class Reference {
+      uint32_t& m_word;
+      const uint32_t m_mask;
+    public:
+      Reference(uint32_t& word, const uint32_t mask)
+        : m_word(word)
+        , m_mask(mask) {
+      }
+
+      Reference& operator=(const bool value) {
+        m_word = value ? (m_word | m_mask) : (m_word & ~m_mask);
+        return *this;
+      }
+
+      operator bool() const {
+        return (m_word & m_mask) != 0;
+      }
+    };
+
+    constexpr size_t size() const {
+      return N;
+    }
+
+    bool operator[](const size_t index) const {
+      return (m_words[index / 32] & (1u << (index % 32))) != 0;
+    }
+
+    Reference operator[](const size_t index) {
+      return Reference(m_words[index / 32], 1u << (index % 32));
+    }
+
+    void setAll() {
+      m_words.fill(~0u);
+      if constexpr ((N % 32) != 0) {
+        m_words[kNumWords - 1] = (1u << (N % 32)) - 1;
+      }
+    }
+
+    void clearAll() {
+      m_words.fill(0);
+    }
+
+    bool any() const {
+      for (const uint32_t word : m_words) {
+        if (word != 0) {
+          return true;
+        }
+      }
+      return false;
+    }
+
+    // Calls fn(index) for every set flag in ascending order
+    template<typename Fn>
+    void forEachSet(const Fn& fn) const {
+      for (size_t w = 0; w < kNumWords; ++w) {
+        uint32_t bits = m_words[w];
+        while (bits != 0) {
+          fn(w * 32 + countTrailingZeros(bits));
+          bits &= bits - 1;
+        }
+      }
+    }
+
+  private:
+    std::array<uint32_t, kNumWords> m_words = {};
+  };
+
+}
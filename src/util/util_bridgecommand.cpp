@@ -54,65 +54,65 @@ DECL_BRIDGE_FUNC(void, init,
   bIsInit = true;
 }
 
-DECL_BRIDGE_FUNC(void, syncDataQueue, size_t expectedMemUsage, bool posResetOnLastIndex) {
-  int serverCount = *s_pWriterChannel->serverDataPos;
-  size_t currClientDataPos = s_pWriterChannel->get_data_pos();
-  size_t expectedClientDataPos = currClientDataPos + ((expectedMemUsage != 0) ? expectedMemUsage : 1) - 1;
-  size_t totalSize = s_pWriterChannel->data->get_total_size();
-
-  auto handleOverwriteCondition = [&]() {
-    // Below variable is set to let the server know that a particular position
-    // in the queue not yet accessed by it is going to be used
-    *s_pWriterChannel->clientDataExpectedPos = s_curBatchStartPos - 1;
-    Logger::warn("Data Queue overwrite condition triggered");
-    // Check to see if there is even enough space to ever succeed in pushing all the data
-    if ((expectedMemUsage + (currClientDataPos >= s_curBatchStartPos ? currClientDataPos - s_curBatchStartPos : currClientDataPos + totalSize - s_curBatchStartPos)) > totalSize) {
-      Logger::err("Command's data batch size is too large and overwrite could not be prevented!");
-      throw std::exception("Command's data batch size is too large and overwrite could not be prevented!");
-    }
-    // Wait for the server to access the data at the above postion
-    const auto maxRetries = GlobalOptions::getCommandRetries();
-    size_t numRetries = 0;
-    Logger::warn("Waiting on server to process enough data from data queue to prevent overwrite...");
-    while (RESULT_FAILURE(s_pWriterChannel->dataSemaphore->wait()) && numRetries++ < maxRetries) {
-    }
-    if (numRetries >= maxRetries) {
-      Logger::err("Max retries reached waiting on the server to process enough data to prevent a overwrite!");
-    }
-    *s_pWriterChannel->clientDataExpectedPos = -1;
-    *s_pWriterChannel->serverResetPosRequired = false;
-    Logger::info("DataQueue overwrite condition resolved");
-  };
-
-  if (expectedClientDataPos >= totalSize) {
-    if (*s_pWriterChannel->serverResetPosRequired == true) {
-      // Double Overflow Condition Detected, mitigate by stalling and waiting for a response
-      handleOverwriteCondition();
-    }
-    if (posResetOnLastIndex) {
-      // Reset index pos to 0 if the size is larger than the remaining buffer
-      expectedClientDataPos = expectedMemUsage - 1;
-    } else {
-      // Evaluate the respective pos when the end of the queue is reached
-      expectedClientDataPos = expectedClientDataPos - totalSize;
-    }
-    // Below variable is set when the server needs to complete a loop to get to
-    // the client's expected position. When this is set on pull we check if
-    // m_pos is reset and toggle this variable if it is
-    *s_pWriterChannel->serverResetPosRequired = true;
+DECL_BRIDGE_FUNC(uint64_t, getRequiredCursor, size_t expectedMemUsage) {
+  const auto& data = s_pWriterChannel->data;
+  const size_t totalSize = data->get_total_size();
+  size_t required = (expectedMemUsage != 0) ? expectedMemUsage : 1;
+  // Objects that do not fit in the remaining space are placed at the start of the
+  // queue, so the skipped tail must be handed back by the reader as well
+  if (data->get_pos() + required >= totalSize) {
+    required += totalSize - data->get_pos();
+  }
+  return data->get_cursor() + required;
+}
+
+DECL_BRIDGE_FUNC(bool, fitsDataBatch, size_t expectedMemUsage) {
+  return getRequiredCursor(expectedMemUsage) - s_curBatchStart <= s_pWriterChannel->data->get_total_size();
+}
+
+DECL_BRIDGE_FUNC(void, syncDataQueue, size_t expectedMemUsage) {
+  const uint64_t requiredCursor = getRequiredCursor(expectedMemUsage);
+  const uint64_t consumed = s_pWriterChannel->dataConsumed->load();
+  if (consumed == WriterChannel::kCreditsUntracked ||
+      requiredCursor - consumed <= s_pWriterChannel->data->get_total_size()) {
+    return;
   }
+  waitForDataCredits(requiredCursor);
+}
 
-  /*
-    * overwrite conditions
-    * 1. client < server, expectedClient >= server
-    * 2. client > server, expectedClient >= server, expectedClient < client
-    */
-  if (expectedClientDataPos >= serverCount &&
-      ((s_curBatchStartPos < serverCount)
-       || (s_curBatchStartPos > serverCount && expectedClientDataPos < s_curBatchStartPos)
-       || ((s_curBatchStartPos <= serverCount) && *s_pWriterChannel->serverResetPosRequired))) {
-    handleOverwriteCondition();
+DECL_BRIDGE_FUNC(void, waitForDataCredits, uint64_t requiredCursor) {
+  ZoneScopedN("Data Queue Stall");
+  if (ZoneIsActive) {
+    const char* const commandName = toName(s_curCommand);
+    ZoneText(commandName, strlen(commandName));
+  }
+  const size_t totalSize = s_pWriterChannel->data->get_total_size();
+  // The reader hands back credits only once a command is fully processed, so check
+  // to see if there is even enough space to ever succeed in pushing all the data
+  if (requiredCursor - s_curBatchStart > totalSize) {
+    Logger::err("Command's data batch size is too large and overwrite could not be prevented!");
+    throw std::exception("Command's data batch size is too large and overwrite could not be prevented!");
+  }
+  // Let the reader know which consumed position to signal the data semaphore at,
+  // then recheck in case the credits were handed back before it could see that
+  const uint64_t targetConsumed = requiredCursor - totalSize;
+  auto& dataConsumed = *s_pWriterChannel->dataConsumed;
+  s_pWriterChannel->dataCreditWait->store(targetConsumed);
+  const auto maxRetries = GlobalOptions::getCommandRetries();
+  size_t numRetries = 0;
+  LARGE_INTEGER stallStart, stallEnd;
+  QueryPerformanceCounter(&stallStart);
+  while (dataConsumed.load() < targetConsumed) {
+    if (!gbBridgeRunning || numRetries++ >= maxRetries) {
+      Logger::err("Max retries reached waiting on the reader to process enough data to prevent a overwrite!");
+      break;
+    }
+    s_pWriterChannel->dataSemaphore->wait();
   }
+  QueryPerformanceCounter(&stallEnd);
+  s_pWriterChannel->dataCreditWait->store(0);
+  ++s_transportStats.dataQueueStalls;
+  s_transportStats.dataQueueStallTicks += stallEnd.QuadPart - stallStart.QuadPart;
 }
 
 DECL_BRIDGE_FUNC(Header, pop_front) {
@@ -123,10 +123,46 @@ DECL_BRIDGE_FUNC(Header, pop_front) {
   if (RESULT_FAILURE(result)) {
     // For now just log when things go wrong, but could use some robustness improvements
     Logger::err("CommandQueue get_response: Failed to retrieve the command response!");
+  } else {
+    CommandLog::record(CommandLog::Event::Pop, (uint8_t) kTraceChannel, (uint16_t) response.command, CommandLog::kNoUid, response.dataOffset, 0);
+#ifdef REMIX_BRIDGE_SERVER
+    if (response.command != Commands::Bridge_DataChunk) {
+      s_bChunkedCommand = Commands::IsDataChunked(response.flags);
+      s_numDataChunks = 0;
+    }
+#endif
+    if (response.command == Commands::Bridge_Response && s_numResponseWaiters.load() > 0) {
+      handOffResponseQueueHead();
+    }
   }
   return response;
 }
 
+DECL_BRIDGE_FUNC(void, signalResponseMailbox, ResponseMailbox& mailbox) {
+  {
+    std::scoped_lock lock(mailbox.mutex);
+    ++mailbox.completion;
+  }
+  mailbox.cv.notify_all();
+}
+
+DECL_BRIDGE_FUNC(void, handOffResponseQueueHead) {
+  ZoneScoped;
+  const auto& commands = getReaderChannel().commands;
+  if (!commands->isEmpty()) {
+    Result result;
+    const Header next = commands->peek(result, 1);
+    if (RESULT_SUCCESS(result) && next.command == Commands::Bridge_Response) {
+      signalResponseMailbox(getResponseMailbox(next.pHandle));
+      return;
+    }
+  }
+  // Nothing to hand over to, so wake everyone up to go back to waiting on the queue itself
+  for (auto& mailbox : s_responseMailboxes) {
+    signalResponseMailbox(mailbox);
+  }
+}
+
 DECL_BRIDGE_FUNC(bridge_util::Result, ensureQueueEmpty) {
   if (getReaderChannel().commands->isEmpty()) {
     return bridge_util::Result::Success;
@@ -156,20 +192,38 @@ DECL_BRIDGE_FUNC(bridge_util::Result, waitForCommand, const Commands::D3D9Comman
   ZoneScoped;
   DWORD peekTimeoutMS = overrideTimeoutMS > 0 ? overrideTimeoutMS : GlobalOptions::getCommandTimeout();
   uint32_t maxAttempts = GlobalOptions::getCommandRetries();
+  if (verifyUID) {
+    ZoneCommandUID(uidToVerify);
+  }
 #ifdef ENABLE_WAIT_FOR_COMMAND_TRACE
   if (command != Commands::Any) {
     Logger::trace(format_string("Waiting for command %s for %d ms up to %d times...", Commands::toString(command).c_str(), peekTimeoutMS, maxAttempts));
   }
-#endif
-#if defined(_DEBUG) || defined(DEBUGOPT)
-  if (GlobalOptions::getLogAllCommands()) {
-    Logger::info("waitForCommand Command:" + toString(command) + (verifyUID ? " UID: " + std::to_string(uidToVerify) : ""));
-  }
 #endif
   bool infiniteRetries = false;
   bool bEarlyOut = false;
   uint32_t attemptNum = 0;
+
+  // Registers this thread as a response waiter for the duration of the call
+  struct ResponseWaiterScope {
+    const bool bActive;
+    ResponseWaiterScope(const bool active) : bActive(active) {
+      if (bActive) {
+        ++s_numResponseWaiters;
+      }
+    }
+    ~ResponseWaiterScope() {
+      if (bActive) {
+        --s_numResponseWaiters;
+      }
+    }
+  } waiterScope(verifyUID);
+
   do {
+    // Sampled before peeking so that a handoff racing with the peek is not lost
+    ResponseMailbox& mailbox = getResponseMailbox(uidToVerify);
+    const uint32_t mailboxCompletion = mailbox.completion.load();
+
     Result result;
     Header header = getReaderChannel().commands->peek(result, peekTimeoutMS);
 
@@ -188,6 +242,11 @@ DECL_BRIDGE_FUNC(bridge_util::Result, waitForCommand, const Commands::D3D9Comman
         if (command != Commands::Bridge_Any) {
           Logger::trace(format_string("...success, command %s received!", Commands::toString(command).c_str()));
         }
+#endif
+#ifdef REMIX_BRIDGE_CLIENT
+        if (command != Commands::Bridge_Any && CommandTrace::isCapturing()) {
+          CommandTrace::recordResponse(kTraceChannel, command);
+        }
 #endif
         return Result::Success;
       } else {
@@ -197,9 +256,17 @@ DECL_BRIDGE_FUNC(bridge_util::Result, waitForCommand, const Commands::D3D9Comman
                                      Commands::toString(command).c_str(), std::to_string(uidToVerify).c_str()));
         }
 #endif
-        // If we see the incorrect command, we want to give the other side of
-        // the bridge ample time to make an attempt to process it first
-        Sleep(peekTimeoutMS);
+        if (verifyUID && header.command == Commands::Bridge_Response) {
+          // A response for another thread is at the head, park until it has been popped
+          std::unique_lock lock(mailbox.mutex);
+          mailbox.cv.wait_for(lock, std::chrono::milliseconds(peekTimeoutMS), [&] {
+            return mailbox.completion.load() != mailboxCompletion;
+          });
+        } else {
+          // If we see the incorrect command, we want to give the other side of
+          // the bridge ample time to make an attempt to process it first
+          Sleep(peekTimeoutMS);
+        }
       }
       break;
     }
@@ -265,16 +332,6 @@ DECL_COMMAND_FUNC(,Command,const Commands::D3D9Command command,
   // this issue I recommend enclosing the Command object in its own scope block, and make
   // sure there is no command nesting happening either.
 
-#if defined(_DEBUG) || defined(DEBUGOPT)
-  if (GlobalOptions::getLogAllCommands()) {
-#ifdef REMIX_BRIDGE_CLIENT
-    Logger::info("Requesting: " +toString(command) + " UID: " + std::to_string(s_cmdUID));
-#else
-    Logger::info("Responding: " + toString(command) + " UID: " + std::to_string(pHandle));
-#endif
-  }
-#endif
-
 #ifdef REMIX_BRIDGE_CLIENT
   s_pWriterChannel->m_mutex.lock();
 #endif
@@ -289,18 +346,18 @@ DECL_COMMAND_FUNC(,Command,const Commands::D3D9Command command,
     s_pWriterChannel->data->begin_batch();
   }
   s_pWriterChannel->pbCmdInProgress->store(true);
-  s_curBatchStartPos = (int32_t) s_pWriterChannel->data->get_pos();
+  s_curBatchStart = s_pWriterChannel->data->get_cursor();
+  s_curCommand = m_command;
   s_cmdCounter++;
   if (gbBridgeRunning) {
+    // The UID pushed below is not part of the trace, replay assigns its own
+    if (CommandTrace::isCapturing()) {
+      CommandTrace::beginCommand(kTraceChannel);
+    }
     // Send command id as part of data queue for everycommand from client to server
 #ifdef REMIX_BRIDGE_CLIENT
-      syncDataQueue(1, false);
+      syncDataQueue(1);
       const auto result = s_pWriterChannel->data->push((UINT)s_cmdUID);
-#if defined(_DEBUG) || defined(DEBUGOPT)
-      if (GlobalOptions::getLogAllCommands()) {
-        Logger::info("Pushed UID: " + std::to_string(s_cmdUID));
-      }
-#endif
       if (RESULT_FAILURE(result)) {
         // For now just log when things go wrong, but could use some robustness improvements
         Logger::err("DataQueue send_data: Failed to send data!");
@@ -312,27 +369,33 @@ DECL_COMMAND_FUNC(,Command,const Commands::D3D9Command command,
 DECL_COMMAND_FUNC(,~Command) {
   // Only actually send the command if the bridge is enabled, otherwise this becomes a no-op
   if (gbBridgeRunning) {
+    ZoneScopedN("Push Command");
+#ifdef REMIX_BRIDGE_CLIENT
+    ZoneCommandUID(s_cmdUID);
+#else
+    ZoneCommandUID(m_handle);
+#endif
+    ZoneCommandName(m_command);
     s_pWriterChannel->data->end_batch();
-    s_curBatchStartPos = -1;
+    const size_t dataPos = s_pWriterChannel->data->get_pos();
+    const uint32_t payloadSize = (uint32_t) (s_pWriterChannel->data->get_cursor() - s_curBatchStart);
     uint32_t numRetries = 0;
-    Result result;
-    // We check if the bridge is enabled for each loop iteration in case it
-    // was disabled externally by the server process exit callback.
-    do {
-      result = s_pWriterChannel->commands->push({ m_command, m_commandFlags, (uint32_t) s_pWriterChannel->data->get_pos(), m_handle });
-#if defined(_DEBUG) || defined(DEBUGOPT)
-      if (GlobalOptions::getLogAllCommands()) {
-        Logger::info("Pushed: " + toString(m_command));
-      }
-#endif
-    } while (
-          RESULT_FAILURE(result)
-      && numRetries++ < GlobalOptions::getCommandRetries()
-      && gbBridgeRunning
+    // A command with a chunked payload had its header sent already, the reader
+    // only needs to know that the data after the last chunk is complete now
+    const Result result = m_bHeaderSent ?
+      push_header(Commands::Bridge_DataChunk, 0, 0, numRetries) :
+      push_header(m_command, m_commandFlags, m_handle, numRetries);
+    if (RESULT_SUCCESS(result) && CommandTrace::isCapturing()) {
+      CommandTrace::endCommand(kTraceChannel, m_command, m_commandFlags, m_handle);
+    }
+    if (RESULT_SUCCESS(result)) {
 #ifdef REMIX_BRIDGE_CLIENT
-      && BridgeState::getServerState_NoLock() == BridgeState::ProcessState::Running
+      const uint32_t uid = s_cmdUID;
+#else
+      const uint32_t uid = m_handle;
 #endif
-    );
+      CommandLog::record(CommandLog::Event::Push, (uint8_t) kTraceChannel, (uint16_t) m_command, uid, (uint32_t) dataPos, payloadSize);
+    }
 #ifdef REMIX_BRIDGE_CLIENT
     if (BridgeState::getServerState_NoLock() >= BridgeState::ProcessState::DoneProcessing) {
       Logger::warn(format_string("The command %s will not be sent; Server is in the process of or has already shut down. Turning bridge off.", Commands::toString(m_command).c_str()));
@@ -354,5 +417,119 @@ DECL_COMMAND_FUNC(,~Command) {
 #endif
 }
 
+DECL_COMMAND_FUNC(bridge_util::Result, push_header, const Commands::D3D9Command command,
+                                         const Commands::Flags commandFlags,
+                                         const uint32_t handle,
+                                         uint32_t& numRetries) {
+  Result result;
+  // We check if the bridge is enabled for each loop iteration in case it
+  // was disabled externally by the server process exit callback.
+  Header header { command, commandFlags, (uint32_t) s_pWriterChannel->data->get_pos(), handle };
+  do {
+#ifdef TRACY_ENABLE
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+    header.enqueueTime = (uint32_t) counter.QuadPart;
+#endif
+    result = s_pWriterChannel->commands->push(header);
+  } while (
+        RESULT_FAILURE(result)
+    && numRetries++ < GlobalOptions::getCommandRetries()
+    && gbBridgeRunning
+#ifdef REMIX_BRIDGE_CLIENT
+    && BridgeState::getServerState_NoLock() == BridgeState::ProcessState::Running
+#endif
+  );
+  if (numRetries > 0) {
+    s_transportStats.commandPushRetries += numRetries;
+    // The command queue was full, the other side is not keeping up with this command
+    TracyPlot("Command Push Retries", (int64_t) numRetries);
+  }
+  return result;
+}
+
+#ifdef REMIX_BRIDGE_CLIENT
+DECL_COMMAND_FUNC(void, send_chunked_payload, const DataT size, const void* obj) {
+  ZoneScopedN("Send Chunked Payload");
+  const auto& data = s_pWriterChannel->data;
+  syncDataQueue(1);
+  data->push(size | kChunkedPayloadFlag);
+  if (!m_bHeaderSent) {
+    // The reader only hands back the queue space of commands it is processing,
+    // so it has to start on this one before the payload can be streamed through
+    uint32_t numRetries = 0;
+    const Result result = push_header(m_command, (Commands::Flags) (m_commandFlags | Commands::FlagBits::DataChunked), m_handle, numRetries);
+    if (RESULT_FAILURE(result)) {
+      Logger::err(format_string("The command %s could not be successfully sent, turning bridge off and falling back to client rendering!", Commands::toString(m_command).c_str()));
+      gbBridgeRunning = false;
+      return;
+    }
+    m_bHeaderSent = true;
+  }
+  // Everything up to the payload is handed back once the reader got to it, and
+  // every chunk once the reader copied it out, so each chunk is reserved separately
+  s_curBatchStart = data->get_cursor();
+  const size_t chunkSize = (data->get_total_size() / kNumPayloadChunks) * sizeof(DataT);
+  const uint8_t* const pBytes = static_cast<const uint8_t*>(obj);
+  for (size_t offset = 0; offset < size && gbBridgeRunning; offset += chunkSize) {
+    const size_t bytes = std::min<size_t>(chunkSize, size - offset);
+    syncDataQueue(align<size_t>(bytes, sizeof(DataT)) / sizeof(DataT) + 1);
+    data->push(bytes, pBytes + offset);
+    uint32_t numRetries = 0;
+    if (RESULT_FAILURE(push_header(Commands::Bridge_DataChunk, 0, 0, numRetries))) {
+      Logger::err("DataQueue send_data: Failed to announce a payload chunk!");
+      gbBridgeRunning = false;
+      return;
+    }
+    s_curBatchStart = data->get_cursor();
+  }
+  if (CommandTrace::isCapturing()) {
+    CommandTrace::appendBlob(kTraceChannel, size, obj);
+  }
+}
+#endif
+
+#ifdef REMIX_BRIDGE_SERVER
+DECL_BRIDGE_FUNC(bool, await_data_chunk) {
+  if (s_numDataChunks == 0) {
+    if (RESULT_FAILURE(waitForCommandAndDiscard(Commands::Bridge_DataChunk))) {
+      Logger::err("DataQueue get_data: Timed out waiting for the next chunk of a payload!");
+      return false;
+    }
+    ++s_numDataChunks;
+  }
+  return true;
+}
+
+DECL_BRIDGE_FUNC(typename Bridge<BridgeId>::DataT, get_chunked_payload, void** obj) {
+  ZoneScoped;
+  const auto& data = getReaderChannel().data;
+  const DataT size = data->pull() & ~kChunkedPayloadFlag;
+  auto& payload = s_stagedPayloads.emplace_back(size);
+  // Earlier payloads of the command were staged, so all of its queue space
+  // can be handed back while the chunks are streamed in
+  release_consumed_data();
+  size_t offset = 0;
+  while (offset < size && await_data_chunk()) {
+    --s_numDataChunks;
+    void* pChunk = nullptr;
+    const DataT chunkSize = data->pull(&pChunk);
+    if (pChunk == nullptr || offset + chunkSize > size) {
+      Logger::err("DataQueue get_data: Payload chunk does not match the payload size!");
+      break;
+    }
+    memcpy(payload.data() + offset, pChunk, chunkSize);
+    offset += chunkSize;
+    release_consumed_data();
+  }
+  // The data after the payload is only complete once the client announced
+  // either the end of the command or the next chunk after it
+  await_data_chunk();
+  *obj = payload.data();
+  return size;
+}
+#endif
+
 template class Bridge<BridgeId::Module>;
-template class Bridge<BridgeId::Device>;
\ No newline at end of file
+template class Bridge<BridgeId::Device>;
+template class Bridge<BridgeId::Bulk>;
\ No newline at end of file
@@ -26,13 +26,60 @@
 #include "util_common.h"
 #include "util_commands.h"
 #include "util_circularbuffer.h"
+#include "util_commandlog.h"
+#include "util_commandtrace.h"
 #include "util_bridge_state.h"
 #include "util_ipcchannel.h"
+#include "util_sharedheap.h"
 #include "util_singleton.h"
 #include "../tracy/tracy.hpp"
 
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
 extern bool gbBridgeRunning;
 
+#ifdef TRACY_ENABLE
+// Tags the active zone with the UID of a command. The client zone that pushed a
+// command and the server zone that executed it carry the same tag, which is how
+// the two processes are correlated in the profiler.
+#define ZoneCommandUID(uid) \
+  do { \
+    if (ZoneIsActive) { \
+      char uidText[24]; \
+      const int uidTextSize = sprintf_s(uidText, "UID %u", (uint32_t) (uid)); \
+      ZoneText(uidText, uidTextSize); \
+      ZoneValue(uid); \
+    } \
+  } while (0)
+
+// Names the active zone after a command, without building the name at runtime
+#define ZoneCommandName(command) \
+  do { \
+    if (ZoneIsActive) { \
+      const char* const commandName = Commands::toName(command); \
+      ZoneName(commandName, strlen(commandName)); \
+    } \
+  } while (0)
+
+// Microseconds since the other side of the bridge pushed the command
+inline double getQueueResidencyUs(const Header& header) {
+  static const double ticksPerUs = [] {
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+    return (double) frequency.QuadPart / 1000000.0;
+  }();
+  LARGE_INTEGER counter;
+  QueryPerformanceCounter(&counter);
+  return (double) ((uint32_t) counter.QuadPart - header.enqueueTime) / ticksPerUs;
+}
+#else
+#define ZoneCommandUID(uid)
+#define ZoneCommandName(command)
+#endif
+
 #define WAIT_FOR_SERVER_RESPONSE(func, value, uidVal) \
   { \
     const uint32_t timeoutMs = GlobalOptions::getAckTimeout(); \
@@ -61,7 +108,9 @@ extern bool gbBridgeRunning;
 
 #define WAIT_FOR_OPTIONAL_CREATE_FUNCTION_SERVER_RESPONSE(func, value, uidVal) \
   { \
-    if (GlobalOptions::getSendCreateFunctionServerResponses() || GlobalOptions::getSendAllServerResponses()) { \
+    if (GlobalOptions::getAsyncCreateFunctions()) { \
+      return D3D_OK; \
+    } else if (GlobalOptions::getSendCreateFunctionServerResponses() || GlobalOptions::getSendAllServerResponses()) { \
       WAIT_FOR_SERVER_RESPONSE(func, value, uidVal) \
       HRESULT res = (HRESULT) DeviceBridge::get_data(); \
       DeviceBridge::pop_front(); \
@@ -80,6 +129,7 @@ namespace BridgeId {
   };
   struct Module : _Bridge {};
   struct Device : _Bridge {};
+  struct Bulk : _Bridge {};
 };
 #define ASSERT_VALID_BRIDGE_ID(BRIDGE_ID) \
   static_assert(std::is_base_of<BridgeId::_Bridge, BRIDGE_ID>::value, "Must use valid BridgeId.");
@@ -100,6 +150,17 @@ public:
   static inline const ReaderChannel& getReaderChannel() {
     return *s_pReaderChannel;
   }
+
+  // How often and for how long the writer side had to wait on the transport
+  // itself, i.e. on the other process draining the queues
+  struct TransportStats {
+    std::atomic<uint64_t> dataQueueStalls = 0;
+    std::atomic<int64_t>  dataQueueStallTicks = 0;
+    std::atomic<uint64_t> commandPushRetries = 0;
+  };
+  static inline const TransportStats& getTransportStats() {
+    return s_transportStats;
+  }
   
   //=========================//
   // Channel writing methods //
@@ -128,31 +189,29 @@ public:
   //=========================//
   static inline const DataT& get_data() {
     ZoneScoped;
-    size_t prevPos = get_data_pos();
-    const Bridge::DataT& retval = getReaderChannel().data->pull();
-    // Check if the server completed a loop
-    if (*getReaderChannel().serverResetPosRequired && get_data_pos() < prevPos) {
-      *getReaderChannel().serverResetPosRequired = false;
-    }
-    return retval;
+    return getReaderChannel().data->pull();
   }
 
-  static inline const DataT& get_data(void** obj) {
+  static inline DataT get_data(void** obj) {
     ZoneScoped;
-    size_t prevPos = get_data_pos();
-    const Bridge::DataT& retval = getReaderChannel().data->pull(obj);
-    // Check if the server completed a loop
-    if ((*getReaderChannel().serverResetPosRequired) &&
-        (get_data_pos() < prevPos)) {
-      *getReaderChannel().serverResetPosRequired = false;
+#ifdef REMIX_BRIDGE_SERVER
+    const DataT size = getReaderChannel().data->peek();
+    if (size & kHeapPayloadFlag) {
+      return get_heap_payload(obj);
     }
-    return retval;
+    if (size & kChunkedPayloadFlag) {
+      return get_chunked_payload(obj);
+    }
+    if (s_bChunkedCommand) {
+      return get_staged_payload(obj);
+    }
+#endif
+    return getReaderChannel().data->pull(obj);
   }
 
   template<typename T>
   static inline const size_t& copy_data(T& obj, bool checkSize = true) {
     ZoneScoped;
-    size_t prevPos = get_data_pos();
     const DataT& retval = getReaderChannel().data->pull_and_copy(obj);
 
     if (checkSize) {
@@ -161,11 +220,6 @@ public:
         Logger::err("DataQueue copy data: Size of source and target object does not match!");
       }
     }
-
-    // Check if the server completed a loop
-    if (*getReaderChannel().serverResetPosRequired && get_data_pos() < prevPos) {
-      *getReaderChannel().serverResetPosRequired = false;
-    }
     return retval;
   }
 
@@ -174,6 +228,20 @@ public:
     return getReaderChannel().data->get_pos();
   }
 
+  // Hands the data queue space of all fully processed commands back to the writer,
+  // waking it up if it is stalled waiting for that space.
+  static inline void release_data_credits() {
+    ZoneScoped;
+#ifdef REMIX_BRIDGE_SERVER
+    for (const auto chunkId : s_heapPayloads) {
+      SharedHeap::releasePayload(chunkId);
+    }
+    s_heapPayloads.clear();
+    s_stagedPayloads.clear();
+#endif
+    release_consumed_data();
+  }
+
   static inline bridge_util::Result begin_read_data() {
     ZoneScoped;
     if (gbBridgeRunning) {
@@ -191,7 +259,7 @@ public:
   }
 
   static Header pop_front();
-  static void syncDataQueue(size_t expectedMemUsage, bool posResetOnLastIndex = false);
+  static void syncDataQueue(size_t expectedMemUsage);
   static bridge_util::Result ensureQueueEmpty();
 
   //=========================//
@@ -231,25 +299,46 @@ public:
     inline void send_data(const DataT obj) {
       ZoneScoped;
       if (gbBridgeRunning) {
-        syncDataQueue(1, false);
+        syncDataQueue(1);
         const auto result = s_pWriterChannel->data->push(obj);
         if (RESULT_FAILURE(result)) {
           // For now just log when things go wrong, but could use some robustness improvements
           Logger::err("DataQueue send_data: Failed to send data!");
         }
+        if (CommandTrace::isCapturing()) {
+          CommandTrace::appendScalar(kTraceChannel, obj);
+        }
       }
     }
 
     inline void send_data(const DataT size, const void* obj) {
       ZoneScoped;
       if (gbBridgeRunning) {
+        if (obj != nullptr) {
+          if (uint8_t* const pPayload = push_heap_payload(size)) {
+            memcpy(pPayload, obj, size);
+            if (CommandTrace::isCapturing()) {
+              CommandTrace::appendBlob(kTraceChannel, size, obj);
+            }
+            return;
+          }
+        }
         size_t memUsed = (obj == nullptr) ? 1 : (align<size_t>(size, sizeof(DataT)) / sizeof(DataT)) + 1;
-        syncDataQueue(memUsed, true);
+#ifdef REMIX_BRIDGE_CLIENT
+        if (!fitsDataBatch(memUsed)) {
+          send_chunked_payload(size, obj);
+          return;
+        }
+#endif
+        syncDataQueue(memUsed);
         const auto result = s_pWriterChannel->data->push(size, obj);
         if (RESULT_FAILURE(result)) {
           // For now just log when things go wrong, but could use some robustness improvements
           Logger::err("DataQueue send_data: Failed to send data object!");
         }
+        if (CommandTrace::isCapturing()) {
+          CommandTrace::appendBlob(kTraceChannel, size, obj);
+        }
       }
     }
 
@@ -258,12 +347,15 @@ public:
       ZoneScoped;
       if (gbBridgeRunning) {
         size_t count = sizeof...(Ts);
-        syncDataQueue(count, false);
+        syncDataQueue(count);
         const auto result = s_pWriterChannel->data->push_many(objs...);
         if (RESULT_FAILURE(result)) {
           // For now just log when things go wrong, but could use some robustness improvements
           Logger::err("DataQueue send_many: Failed to send multiple m_writerChanneldata items!");
         }
+        if (CommandTrace::isCapturing()) {
+          (CommandTrace::appendScalar(kTraceChannel, static_cast<DataT>(objs)), ...);
+        }
       }
     }
 
@@ -271,21 +363,47 @@ public:
       ZoneScoped;
       uint8_t* blobPacketPtr = nullptr;
       if (gbBridgeRunning) {
-        size_t memUsed = align<size_t>(size, sizeof(DataT)) / sizeof(DataT) + 1;
-        syncDataQueue(memUsed, true);
-        const auto result = s_pWriterChannel->data->begin_blob_push(size, blobPacketPtr);
-        if (RESULT_FAILURE(result)) {
-          // For now just log when things go wrong, but could use some robustness improvements
-          Logger::err("DataQueue begin_data_blob: Failed to begin sending a data blob!");
+        blobPacketPtr = push_heap_payload(size);
+        if (blobPacketPtr == nullptr) {
+          size_t memUsed = align<size_t>(size, sizeof(DataT)) / sizeof(DataT) + 1;
+#ifdef REMIX_BRIDGE_CLIENT
+          if (!fitsDataBatch(memUsed)) {
+            // Filled in locally and streamed through the queue once complete
+            m_chunkedBlob.resize(size);
+            m_pTraceBlob = m_chunkedBlob.data();
+            m_traceBlobSize = size;
+            return m_chunkedBlob.data();
+          }
+#endif
+          syncDataQueue(memUsed);
+          const auto result = s_pWriterChannel->data->begin_blob_push(size, blobPacketPtr);
+          if (RESULT_FAILURE(result)) {
+            // For now just log when things go wrong, but could use some robustness improvements
+            Logger::err("DataQueue begin_data_blob: Failed to begin sending a data blob!");
+          }
         }
+        m_pTraceBlob = blobPacketPtr;
+        m_traceBlobSize = size;
       }
       return blobPacketPtr;
     }
 
-    inline void end_data_blob() const {
+    inline void end_data_blob() {
       ZoneScoped;
       if (gbBridgeRunning) {
+#ifdef REMIX_BRIDGE_CLIENT
+        if (!m_chunkedBlob.empty()) {
+          // Also records the blob in the trace
+          send_chunked_payload((DataT) m_chunkedBlob.size(), m_chunkedBlob.data());
+          m_chunkedBlob.clear();
+          return;
+        }
+#endif
         s_pWriterChannel->data->end_blob_push();
+        // The blob is only complete once the caller is done filling it
+        if (CommandTrace::isCapturing()) {
+          CommandTrace::appendBlob(kTraceChannel, m_traceBlobSize, m_pTraceBlob);
+        }
       }
     }
     
@@ -328,21 +446,135 @@ public:
     }
 
   private:
+    // Places payloads above the shared heap payload threshold in a SharedHeap allocation
+    // and only sends its first chunk inline, returning where to write the payload to.
+    // Returns nullptr if the payload is to be sent through the DataQueue instead.
+    inline uint8_t* push_heap_payload(const size_t size) {
+#ifdef REMIX_BRIDGE_CLIENT
+      // SharedHeap allocations are serialized with the rest of the device calls
+      if constexpr (std::is_same_v<BridgeId, BridgeId::Device>) {
+        const uint32_t threshold = GlobalOptions::getSharedHeapPayloadThreshold();
+        if (threshold != 0 && size > threshold) {
+          const SharedHeap::ChunkId chunkId = SharedHeap::allocatePayload(size);
+          if (chunkId != SharedHeap::kInvalidId) {
+            syncDataQueue(2);
+            s_pWriterChannel->data->push_many((DataT) size | kHeapPayloadFlag, (DataT) chunkId);
+            return SharedHeap::getChunkBuf(chunkId);
+          }
+        }
+      }
+#endif
+      return nullptr;
+    }
+
+    bridge_util::Result push_header(const Commands::D3D9Command command,
+                                    const Commands::Flags commandFlags,
+                                    const uint32_t handle,
+                                    uint32_t& numRetries);
+#ifdef REMIX_BRIDGE_CLIENT
+    // Streams a payload that does not fit in the data queue together with the rest of
+    // the command in several chunks, each waiting only on the space of the one before.
+    // The header is sent ahead of the data so the reader can copy out the chunks.
+    void send_chunked_payload(const DataT size, const void* obj);
+#endif
+
     const Commands::D3D9Command m_command;
     const uint32_t m_handle;
     const Commands::Flags m_commandFlags;
+    const uint8_t* m_pTraceBlob = nullptr;
+    size_t m_traceBlobSize = 0;
+    bool m_bHeaderSent = false;
+    std::vector<uint8_t> m_chunkedBlob;
   };
 
 private:
+  // A client thread waiting on a response that is queued behind the response for
+  // another thread parks on the mailbox of its own UID. Popping a response hands the
+  // queue head over to the mailbox of the next response's UID, so the waiting thread
+  // resumes as soon as its answer is at the head instead of sleeping a full timeout.
+  struct ResponseMailbox {
+    std::atomic<uint32_t> completion = 0;
+    std::mutex mutex;
+    std::condition_variable cv;
+  };
+  static constexpr size_t kNumResponseMailboxes = 64;
+  static inline ResponseMailbox& getResponseMailbox(const UID uid) {
+    return s_responseMailboxes[uid % kNumResponseMailboxes];
+  }
+  static void signalResponseMailbox(ResponseMailbox& mailbox);
+  static void handOffResponseQueueHead();
+  static uint64_t getRequiredCursor(size_t expectedMemUsage);
+  // Whether the data would fit in the queue together with the rest of the command
+  static bool fitsDataBatch(size_t expectedMemUsage);
+  static void waitForDataCredits(uint64_t requiredCursor);
+
+  // Hands back the data queue space up to the current read position, waking up
+  // the writer if it is stalled waiting for that space.
+  static inline void release_consumed_data() {
+    auto& channel = getReaderChannel();
+    const uint64_t consumed = channel.data->get_cursor();
+    channel.dataConsumed->store(consumed);
+    uint64_t waitingFor = channel.dataCreditWait->load();
+    if (waitingFor != 0 && consumed >= waitingFor &&
+        channel.dataCreditWait->compare_exchange_strong(waitingFor, 0)) {
+      channel.dataSemaphore->release(1);
+    }
+  }
+
+  // Marks a payload size in the DataQueue as referring to a SharedHeap payload,
+  // which is followed by the first chunk of the allocation instead of the data
+  static constexpr DataT kHeapPayloadFlag = 1u << 31;
+  // Marks a payload size in the DataQueue as referring to a payload that follows in
+  // chunks, each of them announced with a Bridge_DataChunk command
+  static constexpr DataT kChunkedPayloadFlag = 1u << 30;
+  static constexpr size_t kNumPayloadChunks = 4;
+#ifdef REMIX_BRIDGE_SERVER
+  static inline DataT get_heap_payload(void** obj) {
+    const DataT size = getReaderChannel().data->pull() & ~kHeapPayloadFlag;
+    const auto chunkId = (SharedHeap::ChunkId) getReaderChannel().data->pull();
+    *obj = SharedHeap::getChunkBuf(chunkId);
+    // Handed back to the client together with the DataQueue space of the command
+    s_heapPayloads.push_back(chunkId);
+    return size;
+  }
+  static inline std::vector<SharedHeap::ChunkId> s_heapPayloads;
+
+  // The queue space of a command with a chunked payload is handed back before the
+  // command is done, so its other payloads are copied out instead of used in place
+  static inline DataT get_staged_payload(void** obj) {
+    const DataT size = getReaderChannel().data->pull(obj);
+    if (*obj != nullptr && size != 0) {
+      const uint8_t* const pData = static_cast<const uint8_t*>(*obj);
+      *obj = s_stagedPayloads.emplace_back(pData, pData + size).data();
+    }
+    return size;
+  }
+  static DataT get_chunked_payload(void** obj);
+  // Waits until the client announced another chunk, unless one is still pending
+  static bool await_data_chunk();
+  static inline std::vector<std::vector<uint8_t>> s_stagedPayloads;
+  static inline bool s_bChunkedCommand = false;
+  static inline size_t s_numDataChunks = 0;
+#endif
+
   Bridge() = delete;
   Bridge(const Bridge&) = delete;
   Bridge(const Bridge&&) = delete;
   static inline WriterChannel* s_pWriterChannel = nullptr;
   static inline ReaderChannel* s_pReaderChannel = nullptr;
-  static inline int32_t        s_curBatchStartPos = -1;
+  // Data queue cursor at which the command currently being built started
+  static inline uint64_t       s_curBatchStart = 0;
   static inline size_t         s_cmdCounter = 0;
   // UIDs are assigned to commands to tag the responses from server to allow misorder responses to be handled correctly 
   static inline UID s_cmdUID = 0;
+  // Command currently being built by the writer, to attribute transport stalls
+  static inline Commands::D3D9Command s_curCommand = Commands::Bridge_Invalid;
+  static inline TransportStats s_transportStats;
+  static inline ResponseMailbox s_responseMailboxes[kNumResponseMailboxes];
+  static inline std::atomic<uint32_t> s_numResponseWaiters = 0;
+  static constexpr CommandTrace::Channel kTraceChannel =
+    std::is_same_v<BridgeId, BridgeId::Module> ? CommandTrace::Channel::Module :
+    std::is_same_v<BridgeId, BridgeId::Bulk> ? CommandTrace::Channel::Bulk : CommandTrace::Channel::Device;
 #if defined(REMIX_BRIDGE_CLIENT)
   static constexpr char kWriterChannelName[] = "Client2Server";
   static constexpr char kReaderChannelName[] = "Server2Client";
@@ -0,0 +1,54 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#pragma once
+
+#include "config/global_options.h"
+
+#include "util_bridgecommand.h"
+
+// The bulk lane carries texture uploads from the client to a dedicated server thread,
+// so only its client to server direction is sized from the options. Ordering between
+// the device and the bulk lane is restored with Bridge_LaneDependency tokens.
+using BulkBridge = Bridge<BridgeId::Bulk>;
+using BulkClientCommand = BulkBridge::Command;
+static void initBulkBridge() {
+  // The server never writes to the bulk lane
+  static constexpr uint32_t kServerChannelMemSize = 1 << 20; // 1MB
+  static constexpr uint32_t kServerCmdQueueSize = 5;
+  static constexpr uint32_t kServerDataQueueSize = 5;
+  BulkBridge::init("Bulk",
+#if defined(REMIX_BRIDGE_CLIENT)
+                   GlobalOptions::getBulkChannelMemSize(),
+                   GlobalOptions::getBulkCmdQueueSize(),
+                   GlobalOptions::getBulkDataQueueSize(),
+                   kServerChannelMemSize,
+                   kServerCmdQueueSize,
+                   kServerDataQueueSize);
+#elif defined(REMIX_BRIDGE_SERVER)
+                   kServerChannelMemSize,
+                   kServerCmdQueueSize,
+                   kServerDataQueueSize,
+                   GlobalOptions::getBulkChannelMemSize(),
+                   GlobalOptions::getBulkCmdQueueSize(),
+                   GlobalOptions::getBulkDataQueueSize());
+#endif
+}
@@ -132,7 +132,8 @@ namespace bridge_util {
         if (space_needed > m_size) {
           throw std::exception("The data is larger than shared memory size!");
         }
-        // Roll over immediately if not enough space left
+        // Roll over immediately if not enough space left, skipping the tail
+        m_cursor += m_size - m_pos;
         m_pos = 0;
       }
       return space_needed;
@@ -141,6 +142,7 @@ namespace bridge_util {
     template<bool space_ensured>
     inline void advance(size_t step) {
       m_pos += step;
+      m_cursor += step;
 
       if (!space_ensured) {
         m_pos %= m_size;
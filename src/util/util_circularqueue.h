@@ -47,6 +47,9 @@ namespace bridge_util {
     const Accessor m_access;
 
     size_t m_pos = 0;
+    // Total number of items advanced over, including skipped space at the end of the
+    // queue. Reader and writer advance identically, so their cursors can be compared.
+    uint64_t m_cursor = 0;
     size_t m_batchSize = 0;
 
     bool m_batchInProgress = false;
@@ -91,6 +94,7 @@ namespace bridge_util {
         // This is a likely condition: construct param array right in the m_data at m_pos
         new (m_data + m_pos) std::array{ static_cast<T>(objs)... };
         m_pos += count;
+        m_cursor += count;
       } else {
         // Worst case at a boundary: do fold
         (pushImpl<false>(static_cast<T>(objs)), ...);
@@ -110,6 +114,7 @@ namespace bridge_util {
     // Removes an object from the queue
     Result pop() {
       m_pos = m_pos + 1 < m_size ? m_pos + 1 : 0;
+      ++m_cursor;
       return Result::Success;
     }
 
@@ -148,6 +153,10 @@ namespace bridge_util {
       return m_data;
     }
 
+    uint64_t get_cursor() const {
+      return m_cursor;
+    }
+
   private:
     template<bool BatchInProgress>
     Result pushImpl(const T obj) {
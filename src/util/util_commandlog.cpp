@@ -0,0 +1,165 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#include "util_commandlog.h"
+
+#include "util_filesys.h"
+#include "config/global_options.h"
+#include "log/log.h"
+
+#include <algorithm>
+#include <fstream>
+#include <new>
+
+using namespace bridge_util;
+
+namespace {
+  const char* toString(const CommandLog::Event event) {
+    switch (event) {
+    case CommandLog::Event::Push: return "push";
+    case CommandLog::Event::Pop: return "pop";
+    case CommandLog::Event::Process: return "process";
+    default: return "unknown";
+    }
+  }
+
+  const char* toString(const CommandLog::Side side) {
+    return side == CommandLog::Side::Client ? "client" : "server";
+  }
+
+  const char* channelToString(const uint8_t channel) {
+    switch (channel) {
+    case 0: return "module";
+    case 1: return "device";
+    case 2: return "bulk";
+    default: return "unknown";
+    }
+  }
+}
+
+void CommandLog::init(const Side side, const HMODULE hModule) {
+  const bool bEnabled = (side == Side::Client) ? GlobalOptions::getLogAllCommands() : GlobalOptions::getLogServerCommands();
+  if (!bEnabled || s_pHeader != nullptr) {
+    return;
+  }
+
+  // Round down to a power of two so that the write index can wrap freely
+  uint32_t capacity = 1024;
+  while (capacity * 2 <= GlobalOptions::getCommandLogSize() && capacity < (1u << 30) / sizeof(Record)) {
+    capacity *= 2;
+  }
+  const size_t fileSize = sizeof(FileHeader) + capacity * sizeof(Record);
+
+  const std::string modulePath = getModuleFileName(hModule);
+  const size_t dotPos = modulePath.find_last_of('.');
+  const std::string logPath = ((dotPos != std::string::npos) ? modulePath.substr(0, dotPos) : "out") + ".cmdlog";
+
+  const HANDLE hFile = CreateFileA(logPath.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL,
+                                   CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (hFile == INVALID_HANDLE_VALUE) {
+    Logger::err(format_string("Unable to create command log file %s, error: %d", logPath.c_str(), GetLastError()));
+    return;
+  }
+  const HANDLE hMapping = CreateFileMappingA(hFile, NULL, PAGE_READWRITE,
+                                             (DWORD) ((uint64_t) fileSize >> 32), (DWORD) fileSize, NULL);
+  void* const pView = (hMapping != NULL) ? MapViewOfFile(hMapping, FILE_MAP_WRITE, 0, 0, fileSize) : nullptr;
+  // The view keeps the mapping and the file alive for the rest of the process
+  if (hMapping != NULL) {
+    CloseHandle(hMapping);
+  }
+  CloseHandle(hFile);
+  if (pView == nullptr) {
+    Logger::err(format_string("Unable to map command log file %s, error: %d", logPath.c_str(), GetLastError()));
+    return;
+  }
+
+  // A new mapping is zero filled, so unused records can be told apart by their timestamp
+  FileHeader* const pHeader = new(pView) FileHeader();
+  LARGE_INTEGER frequency;
+  QueryPerformanceFrequency(&frequency);
+  pHeader->recordSize = sizeof(Record);
+  pHeader->capacity = capacity;
+  pHeader->side = side;
+  pHeader->timerFrequency = frequency.QuadPart;
+  pHeader->pid = GetCurrentProcessId();
+
+  s_pRecords = reinterpret_cast<Record*>(pHeader + 1);
+  s_indexMask = capacity - 1;
+  s_pHeader = pHeader;
+  Logger::info(format_string("Command log enabled, recording the last %d commands to %s.", capacity, logPath.c_str()));
+}
+
+bool CommandLog::decode(const std::vector<std::string>& inputPaths, const std::string& outputPath) {
+  struct Entry {
+    Record record;
+    Side side;
+    uint32_t pid;
+  };
+  std::vector<Entry> entries;
+  int64_t timerFrequency = 0;
+
+  for (const auto& path : inputPaths) {
+    std::ifstream file(path, std::ios::binary);
+    FileHeader header;
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+        header.magic != kMagic || header.version != kVersion || header.recordSize != sizeof(Record)) {
+      Logger::err(format_string("%s is not a valid command log, skipping it.", path.c_str()));
+      continue;
+    }
+    std::vector<Record> records(header.capacity);
+    file.read(reinterpret_cast<char*>(records.data()), records.size() * sizeof(Record));
+    records.resize((size_t) file.gcount() / sizeof(Record));
+    for (const auto& record : records) {
+      if (record.timestamp != 0) {
+        entries.push_back({ record, header.side, header.pid });
+      }
+    }
+    timerFrequency = header.timerFrequency;
+    Logger::info(format_string("Read %s log of process %d from %s.", toString(header.side), header.pid, path.c_str()));
+  }
+  if (entries.empty() || timerFrequency == 0) {
+    Logger::err("No command log records to decode.");
+    return false;
+  }
+
+  std::stable_sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+    return a.record.timestamp < b.record.timestamp;
+  });
+
+  std::ofstream output(outputPath);
+  if (!output) {
+    Logger::err(format_string("Unable to open %s for writing.", outputPath.c_str()));
+    return false;
+  }
+  const int64_t start = entries.front().record.timestamp;
+  for (const auto& entry : entries) {
+    const Record& record = entry.record;
+    const double ms = (double) (record.timestamp - start) * 1000.0 / (double) timerFrequency;
+    const std::string uid = record.uid == kNoUid ? "n/a" : std::to_string(record.uid);
+    output << format_string("%14.4f ms  %-6s %6d/%-6d %-6s %-7s %-64s uid %-10s data %8u +%-6u\n",
+                            ms, toString(entry.side), entry.pid, record.threadId,
+                            channelToString(record.channel), toString(record.event),
+                            Commands::toString((Commands::D3D9Command) record.command).c_str(),
+                            uid.c_str(), record.dataOffset, record.payloadSize);
+  }
+  Logger::info(format_string("Decoded %zu command log records into %s.", entries.size(), outputPath.c_str()));
+  return true;
+}
@@ -0,0 +1,126 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#pragma once
+
+#include "util_common.h"
+#include "util_commands.h"
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include <windows.h>
+
+namespace bridge_util {
+  // The command log is a cheap always-on record of the command stream, meant to
+  // replace the per-command text logging of logAllCommands and logServerCommands.
+  //
+  // Each side maps a ring of fixed size records into a file next to its log file,
+  // so recording an event costs an atomic increment and a 32 byte store, and the
+  // newest records survive a crash of the process. Timestamps are QPC ticks, which
+  // are shared by all processes on a machine, so decode() is able to merge the
+  // client and the server logs into one timeline.
+  class CommandLog {
+  public:
+    static constexpr uint32_t kMagic = 0x474c4352; // 'RCLG'
+    static constexpr uint16_t kVersion = 1;
+    // Recorded for events that do not know the UID of their command, e.g. a pop
+    // that happens before the UID is pulled from the data queue
+    static constexpr uint32_t kNoUid = UINT32_MAX;
+
+    enum class Side : uint8_t {
+      Client = 0,
+      Server = 1
+    };
+
+    enum class Event : uint8_t {
+      // A command header was pushed to the command queue
+      Push = 0,
+      // A command header was pulled from the command queue
+      Pop = 1,
+      // The server started executing a command
+      Process = 2
+    };
+
+    struct FileHeader {
+      uint32_t magic = kMagic;
+      uint16_t version = kVersion;
+      uint16_t recordSize = 0;
+      uint32_t capacity = 0;
+      Side side = Side::Client;
+      uint8_t reserved[3] = {};
+      int64_t timerFrequency = 0;
+      std::atomic<uint32_t> writeIndex = 0;
+      uint32_t pid = 0;
+    };
+    static_assert(sizeof(FileHeader) == 32);
+
+    struct Record {
+      int64_t timestamp;
+      uint32_t uid;
+      uint32_t dataOffset;
+      uint32_t payloadSize; // In data queue items
+      uint32_t threadId;
+      uint16_t command;
+      Event event;
+      uint8_t channel;
+      uint32_t reserved;
+    };
+    static_assert(sizeof(Record) == 32);
+
+    // Maps the log file of the given side if command logging is enabled for it
+    static void init(const Side side, const HMODULE hModule = NULL);
+
+    static inline bool isEnabled() {
+      return s_pHeader != nullptr;
+    }
+
+    static inline void record(const Event event, const uint8_t channel, const uint16_t command,
+                              const uint32_t uid, const uint32_t dataOffset, const uint32_t payloadSize) {
+      if (s_pHeader == nullptr) {
+        return;
+      }
+      LARGE_INTEGER counter;
+      QueryPerformanceCounter(&counter);
+      const uint32_t index = s_pHeader->writeIndex.fetch_add(1, std::memory_order_relaxed) & s_indexMask;
+      Record& record = s_pRecords[index];
+      record.timestamp = counter.QuadPart;
+      record.uid = uid;
+      record.dataOffset = dataOffset;
+      record.payloadSize = payloadSize;
+      record.threadId = GetCurrentThreadId();
+      record.command = command;
+      record.event = event;
+      record.channel = channel;
+    }
+
+    // Merges the given command log files into one timeline and writes it as text
+    // to outputPath. Returns false if no input could be read.
+    static bool decode(const std::vector<std::string>& inputPaths, const std::string& outputPath);
+
+  private:
+    CommandLog() = delete;
+
+    static inline FileHeader* s_pHeader = nullptr;
+    static inline Record* s_pRecords = nullptr;
+    static inline uint32_t s_indexMask = 0;
+  };
+}
@@ -48,6 +48,17 @@ namespace Commands {
     // prevent leaks.
     Bridge_UnlinkResource,
 
+    // Releases server side buffers that repeated UP draw payloads were promoted to
+    Bridge_ReleaseCachedGeometry,
+
+    // Commands after this one depend on the commands that the other lane of the
+    // device and bulk lane pair sent before the token in the header
+    Bridge_LaneDependency,
+
+    // Announces that a chunk of a payload too large for the data queue was written,
+    // the command it belongs to had its header sent ahead of its data
+    Bridge_DataChunk,
+
     // These are not actually official D3D9 API calls.
     IDirect3DDevice9Ex_LinkSwapchain,
     IDirect3DDevice9Ex_LinkBackBuffer,
@@ -431,6 +442,9 @@ namespace Commands {
     IDirect3DQuery9_GetDataSize,
     IDirect3DQuery9_Issue,
     IDirect3DQuery9_GetData,
+
+    // Not a command, the number of commands above for tables indexed by command
+    Bridge_NumCommands
   };
 
   // Maybe this will be useful...  
@@ -453,7 +467,8 @@ namespace Commands {
     kIDirect3DQuery9 = IDirect3DQuery9_QueryInterface
   };
 
-  inline static std::string toString(const D3D9Command& command) {
+  // Names are string literals, so that profiling and logging do not have to build them per command
+  inline static constexpr const char* toName(const D3D9Command& command) {
     switch (command) {
     case Bridge_Terminate: return "Terminate";
     case Bridge_Invalid: return "Invalid";
@@ -469,6 +484,9 @@ namespace Commands {
     case Bridge_SharedHeap_Dealloc: return "SharedHeap_Dealloc";
     
     case Bridge_UnlinkResource: return "Bridge_UnlinkResource";
+    case Bridge_ReleaseCachedGeometry: return "Bridge_ReleaseCachedGeometry";
+    case Bridge_LaneDependency: return "Bridge_LaneDependency";
+    case Bridge_DataChunk: return "Bridge_DataChunk";
 
     case IDirect3DDevice9Ex_LinkSwapchain: return "IDirect3DDevice9Ex_LinkSwapchain";
     case IDirect3DDevice9Ex_LinkBackBuffer: return "IDirect3DDevice9Ex_LinkBackBuffer";
@@ -840,6 +858,10 @@ namespace Commands {
     }
   }
 
+  inline static std::string toString(const D3D9Command& command) {
+    return toName(command);
+  }
+
   typedef uint16_t Flags;
 
   enum FlagBits: Flags {
@@ -847,6 +869,20 @@ namespace Commands {
                                     // and only allocation id(s) is transferred on the queue
     DataIsReserved   = 0b00000010,  // Data was already reserved in data queue and only its
                                     // offset is transferred
+    DataInStreamMirror = 0b00000100, // Data is in a persistent shared heap mirror of the buffer,
+                                     // its allocation id and a consumption serial are transferred
+    DataInGeometryRing = 0b00001000, // Draw geometry is in the transient geometry ring and only
+                                     // its offset(s) are transferred
+    GeometryPromote  = 0b00010000,   // UP draw geometry is sent along with its hash, for the
+                                     // server to keep in resident buffers
+    GeometryCached   = 0b00100000,   // UP draw geometry was promoted before and only its hash
+                                     // is transferred
+    InternObject     = 0b01000000,   // Created object is sent along with its content hash, for
+                                     // the server to share with later identical creates
+    ObjectInterned   = 0b10000000,   // Created object has the contents of an interned object and
+                                     // only the content hash is transferred
+    DataChunked      = 0b100000000,  // Header was sent ahead of the data, which contains a payload
+                                     // streamed through the data queue in several chunks
   };
 
   inline bool IsDataInSharedHeap(Flags flags) {
@@ -856,6 +892,34 @@ namespace Commands {
   inline bool IsDataReserved(Flags flags) {
     return (flags & FlagBits::DataIsReserved) != 0;
   }
+
+  inline bool IsDataInStreamMirror(Flags flags) {
+    return (flags & FlagBits::DataInStreamMirror) != 0;
+  }
+
+  inline bool IsDataInGeometryRing(Flags flags) {
+    return (flags & FlagBits::DataInGeometryRing) != 0;
+  }
+
+  inline bool IsGeometryPromote(Flags flags) {
+    return (flags & FlagBits::GeometryPromote) != 0;
+  }
+
+  inline bool IsGeometryCached(Flags flags) {
+    return (flags & FlagBits::GeometryCached) != 0;
+  }
+
+  inline bool IsInternObject(Flags flags) {
+    return (flags & FlagBits::InternObject) != 0;
+  }
+
+  inline bool IsObjectInterned(Flags flags) {
+    return (flags & FlagBits::ObjectInterned) != 0;
+  }
+
+  inline bool IsDataChunked(Flags flags) {
+    return (flags & FlagBits::DataChunked) != 0;
+  }
 }
 
 struct Header {
@@ -863,6 +927,9 @@ struct Header {
   Commands::Flags flags = 0; // Command flags
   uint32_t dataOffset = 0;   // Current data queue position value to ensure client and server are in sync
   uint32_t pHandle = 0;      // Handle for client side resource invoking the command, which we map to matching resource on server side
+#ifdef TRACY_ENABLE
+  uint32_t enqueueTime = 0;  // Low part of the QPC value when the command was pushed, to measure how long it was queued
+#endif
 };
 
 #endif // UTIL_COMMANDS_H_
@@ -0,0 +1,211 @@
+/*
+ * Copyright (c) 2022-2023, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#include "util_commandtrace.h"
+
+#include "config/global_options.h"
+#include "log/log.h"
+
+using namespace bridge_util;
+
+namespace {
+  int64_t queryTimestamp() {
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+    return counter.QuadPart;
+  }
+}
+
+uint32_t CommandTrace::getCurrentFileFlags() {
+  uint32_t flags = 0;
+  if (GlobalOptions::getSendAllServerResponses()) {
+    flags |= SendAllServerResponses;
+  }
+  if (GlobalOptions::getSendCreateFunctionServerResponses() && !GlobalOptions::getAsyncCreateFunctions()) {
+    flags |= SendCreateFunctionServerResponses;
+  }
+  if (GlobalOptions::getSendReadOnlyCalls()) {
+    flags |= SendReadOnlyCalls;
+  }
+  return flags;
+}
+
+bool CommandTrace::beginCapture(const std::string& path) {
+  std::lock_guard<std::mutex> lock(s_fileMutex);
+  if (s_pFile != nullptr) {
+    Logger::warn("Command trace capture is already in progress.");
+    return false;
+  }
+  if (fopen_s(&s_pFile, path.c_str(), "wb") != 0 || s_pFile == nullptr) {
+    Logger::err(format_string("Unable to open command trace file %s for writing.", path.c_str()));
+    s_pFile = nullptr;
+    return false;
+  }
+
+  LARGE_INTEGER frequency;
+  QueryPerformanceFrequency(&frequency);
+  FileHeader fileHeader;
+  fileHeader.flags = getCurrentFileFlags();
+  fileHeader.timerFrequency = frequency.QuadPart;
+  fwrite(&fileHeader, sizeof(fileHeader), 1, s_pFile);
+
+  s_bCapturing.store(true);
+  Logger::info(format_string("Command trace capture started, writing to %s.", path.c_str()));
+  return true;
+}
+
+void CommandTrace::endCapture() {
+  std::lock_guard<std::mutex> lock(s_fileMutex);
+  if (s_pFile == nullptr) {
+    return;
+  }
+  s_bCapturing.store(false);
+  fclose(s_pFile);
+  s_pFile = nullptr;
+  Logger::info("Command trace capture finished.");
+}
+
+void CommandTrace::beginCommand(const Channel channel) {
+  Staging& staging = s_staging[(size_t) channel];
+  staging.payload.clear();
+  staging.timestamp = queryTimestamp();
+}
+
+void CommandTrace::appendScalar(const Channel channel, const DataT value) {
+  auto& payload = s_staging[(size_t) channel].payload;
+  payload.push_back(kScalarTag);
+  payload.push_back(value);
+}
+
+void CommandTrace::appendBlob(const Channel channel, const size_t size, const void* pData) {
+  // A null blob goes over the wire as a single zero size, same as a zero scalar
+  if (pData == nullptr) {
+    appendScalar(channel, 0);
+    return;
+  }
+  auto& payload = s_staging[(size_t) channel].payload;
+  const size_t numWords = align<size_t>(size, sizeof(DataT)) / sizeof(DataT);
+  const size_t offset = payload.size() + 1;
+  payload.push_back((DataT) size);
+  payload.resize(offset + numWords, 0);
+  memcpy(payload.data() + offset, pData, size);
+}
+
+void CommandTrace::endCommand(const Channel channel, const Commands::D3D9Command command,
+                              const Commands::Flags flags, const uint32_t handle) {
+  const Staging& staging = s_staging[(size_t) channel];
+  RecordHeader header;
+  header.type = RecordType::Command;
+  header.channel = channel;
+  header.command = (uint16_t) command;
+  header.flags = flags;
+  header.handle = handle;
+  header.payloadSize = (uint32_t) (staging.payload.size() * sizeof(DataT));
+  header.timestamp = staging.timestamp;
+  writeRecord(header, staging.payload.data());
+}
+
+void CommandTrace::recordResponse(const Channel channel, const Commands::D3D9Command command) {
+  RecordHeader header;
+  header.type = RecordType::Response;
+  header.channel = channel;
+  header.command = (uint16_t) command;
+  header.timestamp = queryTimestamp();
+  writeRecord(header, nullptr);
+}
+
+void CommandTrace::writeRecord(const RecordHeader& header, const void* pPayload) {
+  std::lock_guard<std::mutex> lock(s_fileMutex);
+  if (s_pFile == nullptr) {
+    return;
+  }
+  fwrite(&header, sizeof(header), 1, s_pFile);
+  if (header.payloadSize > 0) {
+    fwrite(pPayload, header.payloadSize, 1, s_pFile);
+  }
+}
+
+CommandTrace::Reader::Reader(const std::string& path) {
+  m_hFile = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                        OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+  if (m_hFile == INVALID_HANDLE_VALUE) {
+    Logger::err(format_string("Unable to open command trace file %s.", path.c_str()));
+    return;
+  }
+  LARGE_INTEGER fileSize;
+  if (!GetFileSizeEx(m_hFile, &fileSize) || fileSize.QuadPart < (LONGLONG) sizeof(FileHeader)) {
+    Logger::err(format_string("Command trace file %s is empty or truncated.", path.c_str()));
+    return;
+  }
+  m_hMapping = CreateFileMappingA(m_hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (m_hMapping == nullptr) {
+    Logger::err(format_string("Unable to map command trace file %s: %d", path.c_str(), GetLastError()));
+    return;
+  }
+  const auto pView = static_cast<const uint8_t*>(MapViewOfFile(m_hMapping, FILE_MAP_READ, 0, 0, 0));
+  if (pView == nullptr) {
+    Logger::err(format_string("Unable to map command trace file %s: %d", path.c_str(), GetLastError()));
+    return;
+  }
+
+  const FileHeader& fileHeader = *reinterpret_cast<const FileHeader*>(pView);
+  if (fileHeader.magic != kMagic || fileHeader.version != kVersion) {
+    Logger::err(format_string("%s is not a command trace file of a supported version.", path.c_str()));
+    UnmapViewOfFile(pView);
+    return;
+  }
+  m_pBegin = pView;
+  m_size = (size_t) fileSize.QuadPart;
+  rewind();
+}
+
+CommandTrace::Reader::~Reader() {
+  if (m_pBegin != nullptr) {
+    UnmapViewOfFile(m_pBegin);
+  }
+  if (m_hMapping != nullptr) {
+    CloseHandle(m_hMapping);
+  }
+  if (m_hFile != INVALID_HANDLE_VALUE) {
+    CloseHandle(m_hFile);
+  }
+}
+
+bool CommandTrace::Reader::next(Record& record) {
+  if (m_offset + sizeof(RecordHeader) > m_size) {
+    return false;
+  }
+  memcpy(&record.header, m_pBegin + m_offset, sizeof(RecordHeader));
+  const size_t payloadOffset = m_offset + sizeof(RecordHeader);
+  if (payloadOffset + record.header.payloadSize > m_size) {
+    // The capturing process most likely went away in the middle of a write
+    Logger::warn("Command trace ends with a truncated record, ignoring it.");
+    m_offset = m_size;
+    return false;
+  }
+  record.pPayload = m_pBegin + payloadOffset;
+  m_offset = payloadOffset + record.header.payloadSize;
+  return true;
+}
+
+void CommandTrace::Reader::rewind() {
+  m_offset = getFileHeader().headerSize;
+}
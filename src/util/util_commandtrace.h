@@ -0,0 +1,187 @@
+/*
+ * Copyright (c) 2022-2023, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#pragma once
+
+#include "util_common.h"
+#include "util_commands.h"
+
+#include <atomic>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <windows.h>
+
+namespace bridge_util {
+  // Command traces are a binary recording of everything the client pushes into the
+  // bridge command and data queues, so that the exact same stream can later be fed
+  // into a server without the application that produced it.
+  //
+  // A trace file starts with a FileHeader followed by a sequence of records. Each
+  // record is a RecordHeader followed by payloadSize bytes of data items, which are
+  // either a tagged scalar (kScalarTag followed by the value) or a blob (its byte
+  // size followed by the data, padded to a full DataT). The UID that the client
+  // prepends to every command is not recorded, it is regenerated on replay.
+  class CommandTrace {
+  public:
+    using DataT = uint32_t;
+
+    static constexpr uint32_t kMagic = 0x52544252; // 'RBTR'
+    static constexpr uint16_t kVersion = 3;
+    static constexpr DataT kScalarTag = (DataT) -1;
+
+    enum class Channel : uint8_t {
+      Module = 0,
+      Device = 1,
+      Bulk = 2,
+      Count
+    };
+
+    enum class RecordType : uint8_t {
+      // A command sent by the client
+      Command = 0,
+      // The client consumed a response from the server before continuing
+      Response = 1
+    };
+
+    enum FileFlagBits : uint32_t {
+      SendAllServerResponses = 0b00000001,
+      SendCreateFunctionServerResponses = 0b00000010,
+      SendReadOnlyCalls = 0b00000100,
+    };
+
+#pragma pack(push, 1)
+    struct FileHeader {
+      uint32_t magic = kMagic;
+      uint16_t version = kVersion;
+      uint16_t headerSize = sizeof(FileHeader);
+      uint32_t flags = 0;
+      uint32_t reserved = 0;
+      int64_t timerFrequency = 0;
+    };
+
+    struct RecordHeader {
+      RecordType type = RecordType::Command;
+      Channel channel = Channel::Device;
+      uint16_t command = Commands::Bridge_Invalid;
+      Commands::Flags flags = 0;
+      uint16_t reserved = 0;
+      uint32_t handle = 0;
+      uint32_t payloadSize = 0;
+      int64_t timestamp = 0;
+    };
+#pragma pack(pop)
+
+    // Flags describing the global options that change the shape of the command
+    // stream. A trace should be replayed with the same options it was captured with.
+    static uint32_t getCurrentFileFlags();
+
+    //===========//
+    // Capturing //
+    //===========//
+    static bool beginCapture(const std::string& path);
+    static void endCapture();
+    static inline bool isCapturing() {
+      return s_bCapturing.load(std::memory_order_relaxed);
+    }
+
+    // Record building is not synchronized, the caller must hold the writer channel
+    // lock of the respective bridge for the whole lifetime of a command.
+    static void beginCommand(const Channel channel);
+    static void appendScalar(const Channel channel, const DataT value);
+    static void appendBlob(const Channel channel, const size_t size, const void* pData);
+    static void endCommand(const Channel channel, const Commands::D3D9Command command,
+                           const Commands::Flags flags, const uint32_t handle);
+    static void recordResponse(const Channel channel, const Commands::D3D9Command command);
+
+    //=========//
+    // Reading //
+    //=========//
+    class Reader {
+    public:
+      struct Item {
+        bool isScalar;
+        DataT value; // Scalar value or blob byte size
+        const void* pData;
+      };
+
+      struct Record {
+        RecordHeader header;
+        const uint8_t* pPayload;
+
+        template<typename Func>
+        void forEachItem(Func&& func) const {
+          const DataT* pCur = reinterpret_cast<const DataT*>(pPayload);
+          const DataT* const pEnd = reinterpret_cast<const DataT*>(pPayload + header.payloadSize);
+          while (pCur < pEnd) {
+            const DataT tag = *pCur++;
+            if (tag == kScalarTag) {
+              func(Item { true, *pCur, nullptr });
+              ++pCur;
+            } else {
+              func(Item { false, tag, pCur });
+              pCur += align<size_t>(tag, sizeof(DataT)) / sizeof(DataT);
+            }
+          }
+        }
+      };
+
+      explicit Reader(const std::string& path);
+      ~Reader();
+
+      bool isValid() const {
+        return m_pBegin != nullptr;
+      }
+      const FileHeader& getFileHeader() const {
+        return *reinterpret_cast<const FileHeader*>(m_pBegin);
+      }
+      size_t getFileSize() const {
+        return m_size;
+      }
+      // Returns false once the end of the trace is reached
+      bool next(Record& record);
+      void rewind();
+
+    private:
+      HANDLE m_hFile = INVALID_HANDLE_VALUE;
+      HANDLE m_hMapping = nullptr;
+      const uint8_t* m_pBegin = nullptr;
+      size_t m_size = 0;
+      size_t m_offset = 0;
+    };
+
+  private:
+    CommandTrace() = delete;
+
+    struct Staging {
+      std::vector<DataT> payload;
+      int64_t timestamp = 0;
+    };
+
+    static void writeRecord(const RecordHeader& header, const void* pPayload);
+
+    static inline std::atomic<bool> s_bCapturing = false;
+    static inline std::mutex s_fileMutex;
+    static inline FILE* s_pFile = nullptr;
+    static inline Staging s_staging[(size_t) Channel::Count];
+  };
+}
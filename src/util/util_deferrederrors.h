@@ -0,0 +1,99 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#pragma once
+
+#include "util_commands.h"
+#include "util_sharedmemory.h"
+
+#include <atomic>
+#include <memory>
+#include <stdint.h>
+
+namespace bridge_util {
+  // Shared memory ring through which the server reports failed create calls when
+  // the client does not wait for their responses (see asyncCreateFunctions). The
+  // server is the only producer and the client the only consumer.
+  class DeferredErrors {
+  public:
+    static constexpr uint32_t kNumEntries = 256;
+
+    struct Entry {
+      Commands::D3D9Command command;
+      uint32_t uid;
+      HRESULT hresult;
+    };
+
+    struct Ring {
+      std::atomic<uint32_t> writePos;
+      std::atomic<uint32_t> readPos;
+      // Errors dropped because the client did not drain the ring in time
+      std::atomic<uint32_t> numDropped;
+      uint32_t reserved;
+      Entry entries[kNumEntries];
+    };
+
+    // Both sides must call this once the bridge GUID is known
+    static void init() {
+      if (!s_pMemory) {
+        s_pMemory = std::make_unique<SharedMemory>("DeferredErrors", sizeof(Ring));
+      }
+    }
+
+    static void post(const Commands::D3D9Command command, const uint32_t uid, const HRESULT hresult) {
+      Ring& ring = get();
+      const uint32_t writePos = ring.writePos.load(std::memory_order_relaxed);
+      if (writePos - ring.readPos.load(std::memory_order_acquire) >= kNumEntries) {
+        ring.numDropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+      }
+      ring.entries[writePos % kNumEntries] = { command, uid, hresult };
+      ring.writePos.store(writePos + 1, std::memory_order_release);
+    }
+
+    // Invokes fn for each reported error in order, returns the number of errors drained
+    template<typename Fn>
+    static uint32_t drain(const Fn& fn) {
+      Ring& ring = get();
+      const uint32_t writePos = ring.writePos.load(std::memory_order_acquire);
+      uint32_t readPos = ring.readPos.load(std::memory_order_relaxed);
+      const uint32_t count = writePos - readPos;
+      for (; readPos != writePos; ++readPos) {
+        fn(ring.entries[readPos % kNumEntries]);
+      }
+      ring.readPos.store(readPos, std::memory_order_release);
+      return count;
+    }
+
+    static uint32_t getNumDropped() {
+      return get().numDropped.load(std::memory_order_relaxed);
+    }
+
+  private:
+    DeferredErrors() = delete;
+
+    static Ring& get() {
+      return *static_cast<Ring*>(s_pMemory->data());
+    }
+
+    static inline std::unique_ptr<SharedMemory> s_pMemory;
+  };
+}
@@ -0,0 +1,130 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#pragma once
+
+#include "util_sharedmemory.h"
+#include "log/log.h"
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <stdint.h>
+
+namespace bridge_util {
+  // Frame fenced transient ring in shared memory that DrawPrimitiveUP() and
+  // DrawIndexedPrimitiveUP() geometry is written into, instead of competing with
+  // resource uploads for space in the data queue. The client only writes into the
+  // ring, and the server draws straight from it. The space a frame used is
+  // reclaimed once the server has processed the Present that ended that frame.
+  class GeometryRing {
+  public:
+    static constexpr uint32_t kInvalidOffset = (uint32_t) -1;
+    static constexpr uint32_t kAlignment = 16;
+
+    // Both sides must call this once the bridge GUID is known. Sizes smaller
+    // than the alignment leave the ring disabled.
+    static void init(const uint32_t size) {
+      if (size < kAlignment) {
+        Logger::warn("Geometry ring size of " + std::to_string(size) + " bytes is too small, the geometry ring is disabled.");
+        return;
+      }
+      if (!s_pMemory) {
+        s_size = size & ~(kAlignment - 1);
+        s_pMemory = std::make_unique<SharedMemory>("GeometryRing", kDataOffset + s_size);
+      }
+    }
+
+    static bool isEnabled() {
+      return s_pMemory != nullptr;
+    }
+
+    static uint8_t* getData(const uint32_t offset) {
+      return static_cast<uint8_t*>(s_pMemory->data()) + kDataOffset + offset;
+    }
+
+    // Client: reserves size bytes for the current frame, returns kInvalidOffset
+    // when the ring is full, in which case the caller uses the data queue instead
+    static uint32_t allocate(const uint32_t size) {
+      std::scoped_lock lock(s_mutex);
+      const uint64_t alignedSize = (size + kAlignment - 1) & ~(uint64_t) (kAlignment - 1);
+      if (alignedSize > s_size) {
+        return kInvalidOffset;
+      }
+      // Reclaim the space of every frame the server is done with
+      const uint32_t completedFrames = getHeader().completedFrames.load(std::memory_order_acquire);
+      while (!s_frames.empty() && (int32_t) (completedFrames - s_frames.front().frame) >= 0) {
+        s_tail = s_frames.front().end;
+        s_frames.pop_front();
+      }
+      uint64_t pos = s_head;
+      if ((pos % s_size) + alignedSize > s_size) {
+        // Allocations never wrap, skip to the start of the ring instead
+        pos += s_size - (pos % s_size);
+      }
+      if (pos + alignedSize - s_tail > s_size) {
+        return kInvalidOffset;
+      }
+      s_head = pos + alignedSize;
+      return (uint32_t) (pos % s_size);
+    }
+
+    // Client: ends the current frame, must be called for every Present sent
+    static void onPresentSubmitted() {
+      std::scoped_lock lock(s_mutex);
+      s_frames.push_back({ ++s_submittedFrames, s_head });
+    }
+
+    // Server: must be called for every Present processed
+    static void onPresentCompleted() {
+      getHeader().completedFrames.fetch_add(1, std::memory_order_release);
+    }
+
+  private:
+    GeometryRing() = delete;
+
+    struct Header {
+      std::atomic<uint32_t> completedFrames;
+    };
+    static constexpr uint32_t kDataOffset = 64;
+    static_assert(sizeof(Header) <= kDataOffset, "Geometry ring header does not fit");
+
+    static Header& getHeader() {
+      return *static_cast<Header*>(s_pMemory->data());
+    }
+
+    struct Frame {
+      uint32_t frame;
+      uint64_t end;
+    };
+
+    static inline std::unique_ptr<SharedMemory> s_pMemory;
+    static inline uint32_t s_size = 0;
+    // Client side allocation state, positions grow monotonically
+    static inline std::mutex s_mutex;
+    static inline uint64_t s_head = 0;
+    static inline uint64_t s_tail = 0;
+    static inline uint32_t s_submittedFrames = 0;
+    static inline std::deque<Frame> s_frames;
+  };
+}
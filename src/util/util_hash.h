@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+namespace bridge_util {
+  // MurmurHash64A, a fast non-cryptographic 64-bit hash. Good enough to identify
+  // byte-identical payloads, and cheap compared to copying them across the bridge.
+  static inline uint64_t hash64(const void* const pData, const size_t size, const uint64_t seed = 0) {
+    constexpr uint64_t m = 0xc6a4a7935bd1e995ull;
+    constexpr int r = 47;
+
+    uint64_t h = seed ^ (size * m);
+
+    const uint8_t* pBytes = static_cast<const uint8_t*>(pData);
+    const uint8_t* const pEnd = pBytes + (size & ~(size_t) 7);
+    for (; pBytes != pEnd; pBytes += 8) {
+      uint64_t k;
+      memcpy(&k, pBytes, sizeof(k));
+      k *= m;
+      k ^= k >> r;
+      k *= m;
+      h ^= k;
+      h *= m;
+    }
+
+    switch (size & 7) {
+    case 7: h ^= uint64_t(pBytes[6]) << 48; [[fallthrough]];
+    case 6: h ^= uint64_t(pBytes[5]) << 40; [[fallthrough]];
+    case 5: h ^= uint64_t(pBytes[4]) << 32; [[fallthrough]];
+    case 4: h ^= uint64_t(pBytes[3]) << 24; [[fallthrough]];
+    case 3: h ^= uint64_t(pBytes[2]) << 16; [[fallthrough]];
+    case 2: h ^= uint64_t(pBytes[1]) << 8; [[fallthrough]];
+    case 1: h ^= uint64_t(pBytes[0]);
+      h *= m;
+    }
+
+    h ^= h >> r;
+    h *= m;
+    h ^= h >> r;
+    return h;
+  }
+}
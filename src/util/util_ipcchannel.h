@@ -44,10 +44,9 @@ public:
     : sharedMem(new bridge_util::SharedMemory(name + "Channel", memSize + kReservedSpace))
     , m_cmdMemSize(sizeof(Header)* cmdQueueSize + CommandQueue::getExtraMemoryRequirements())
     , m_dataMemSize(memSize - m_cmdMemSize)
-    , serverDataPos(static_cast<int64_t*>(sharedMem->data()))
-    , clientDataExpectedPos(serverDataPos + 1)
-    , serverResetPosRequired(reinterpret_cast<bool*>(clientDataExpectedPos + 1))
-    // Offsetting shared memory to account for 3 pointers used above
+    , dataConsumed(static_cast<std::atomic<uint64_t>*>(sharedMem->data()))
+    , dataCreditWait(dataConsumed + 1)
+    // Offsetting shared memory to account for the data queue credit state above
     , commands(new CommandQueue(name + "Command",
                                 reinterpret_cast<void*>(
                                   reinterpret_cast<uintptr_t>(sharedMem->data()) +
@@ -65,11 +64,10 @@ public:
     , pbCmdInProgress(new std::atomic<bool>(false)) {
     // Check that we're leaving enough space.
     assert(m_cmdMemSize + m_dataMemSize <= sharedMem->getSize());
-    // Initialize buffer override protection
+    // Data queue credits are only tracked once the reader starts handing them back
     if constexpr (IS_WRITER(Accessor)) {
-      *serverDataPos = -1;
-      *clientDataExpectedPos = -1;
-      *serverResetPosRequired = false;
+      dataConsumed->store(kCreditsUntracked);
+      dataCreditWait->store(0);
     }
   }
 
@@ -91,18 +89,21 @@ public:
   bridge_util::SharedMemory* const   sharedMem;
   const size_t                       m_cmdMemSize;
   const size_t                       m_dataMemSize;
-  int64_t*                           serverDataPos;
-  int64_t*                           clientDataExpectedPos;
-  bool*                              serverResetPosRequired;
+  // Data queue cursor up to which the reader consumed everything, published after
+  // each command. The writer only reuses queue space handed back this way.
+  std::atomic<uint64_t>*             dataConsumed;
+  // Consumed cursor the writer is blocked on, 0 while it is not waiting for credits
+  std::atomic<uint64_t>*             dataCreditWait;
   CommandQueue* const                commands;
   bridge_util::DataQueue* const      data;
   bridge_util::NamedSemaphore* const dataSemaphore;
   std::atomic<bool>* const           pbCmdInProgress;
   mutable std::mutex                 m_mutex;
 
+  static constexpr uint64_t kCreditsUntracked = ~0ull;
+
   // Extra storage needed for data queue synchronization params
-  static constexpr size_t kReservedSpace = align<size_t>(sizeof(*serverDataPos) +
-    sizeof(*clientDataExpectedPos) + sizeof(*serverResetPosRequired), 64);
+  static constexpr size_t kReservedSpace = align<size_t>(sizeof(*dataConsumed) + sizeof(*dataCreditWait), 64);
 };
 using WriterChannel = IpcChannel<bridge_util::Accessor::Writer>;
 using ReaderChannel = IpcChannel<bridge_util::Accessor::Reader>;
@@ -46,6 +46,10 @@ static std::string format_string(const std::string& format, Args... args) {
 
 #endif
 
+std::string MessageRing::getName(uint32_t serverThreadId) {
+  return format_string("RemixMessageRing_%u", serverThreadId);
+}
+
 MessageChannelBase::MessageChannelBase(const char* handshakeMsgName)
   : m_handshakeMsgName(handshakeMsgName) {
   m_handshakeMsgId = getMessageId(handshakeMsgName);
@@ -113,6 +117,17 @@ uint32_t MessageChannelBase::getMessageId(const char* msgName) {
   return msg;
 }
 
+void MessageChannelBase::releaseRing() {
+  if (m_pRing) {
+    ::UnmapViewOfFile(m_pRing);
+    m_pRing = nullptr;
+  }
+  if (m_hRingMapping) {
+    ::CloseHandle(m_hRingMapping);
+    m_hRingMapping = nullptr;
+  }
+}
+
 bool MessageChannelBase::onMessage(uint32_t msgId, uint32_t wParam,
                                    uint32_t lParam) {
   std::lock_guard<std::recursive_mutex> _(m_accessMutex);
@@ -129,13 +144,72 @@ MessageChannelClient::MessageChannelClient(const char* handshakeMsgName)
   : MessageChannelBase(handshakeMsgName) {
   registerHandler(handshakeMsgName, [this](uint32_t wParam, uint32_t lParam) {
     m_serverThreadId = wParam;
+    attachRing();
     Logger::info(format_string("Message channel %s handshake complete.",
                                m_handshakeMsgName));
     return true;
   });
 }
 
+void MessageChannelClient::attachRing() {
+  std::lock_guard<std::mutex> lock(m_ringMutex);
+  releaseRing();
+  if (m_serverThreadId == 0) {
+    return;
+  }
+
+  const std::string name = MessageRing::getName(m_serverThreadId);
+  m_hRingMapping = ::OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, name.c_str());
+  if (m_hRingMapping == nullptr) {
+    // The server predates message rings, keep posting messages
+    return;
+  }
+  m_pRing = static_cast<MessageRing*>(
+    ::MapViewOfFile(m_hRingMapping, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(MessageRing)));
+  m_ringWakeMsgId = getMessageId(MessageRing::kWakeMsgName);
+  if (m_pRing == nullptr || m_ringWakeMsgId == 0) {
+    releaseRing();
+    return;
+  }
+  Logger::info(format_string("Message channel using message ring %s.", name.c_str()));
+}
+
+bool MessageChannelClient::pushToRing(uint32_t msg, uint32_t wParam, uint32_t lParam) {
+  static constexpr uint32_t kRingFullTimeoutMs = 100;
+
+  MessageRing& ring = *m_pRing;
+  const uint32_t writePos = ring.writePos.load(std::memory_order_relaxed);
+  uint32_t waitedMs = 0;
+  while (writePos - ring.readPos.load(std::memory_order_acquire) >= MessageRing::kCapacity) {
+    // A dropped mouse move is superseded by the next one anyway
+    if (msg == WM_MOUSEMOVE) {
+      return true;
+    }
+    if (waitedMs++ == kRingFullTimeoutMs) {
+      Logger::err(format_string("Message ring is full, message %d was not sent!", msg));
+      return false;
+    }
+    ::Sleep(1);
+  }
+
+  ring.messages[writePos % MessageRing::kCapacity] = { msg, wParam, lParam };
+  ring.writePos.store(writePos + 1);
+
+  // Only the first message of a batch wakes the server up
+  if (ring.bWakePending.exchange(1) == 0) {
+    if (::PostThreadMessage(m_serverThreadId, m_ringWakeMsgId, 0, 0) == FALSE) {
+      ring.bWakePending.store(0);
+      return false;
+    }
+  }
+  return true;
+}
+
 bool MessageChannelClient::send(uint32_t msg, uint32_t wParam, uint32_t lParam) {
+  std::lock_guard<std::mutex> lock(m_ringMutex);
+  if (m_pRing) {
+    return pushToRing(msg, wParam, lParam);
+  }
   return ::PostThreadMessage(m_serverThreadId, msg, wParam, lParam) != FALSE;
 }
 
@@ -154,6 +228,7 @@ MessageChannelServer::~MessageChannelServer() {
     ::PostThreadMessage(m_workerThreadId, WM_QUIT, 0, 0);
     m_worker.join();
   }
+  releaseRing();
 }
 
 bool MessageChannelServer::init(HWND clientWindow,
@@ -170,8 +245,18 @@ bool MessageChannelServer::init(HWND clientWindow,
 
   m_clientWindow = clientWindow;
   m_windowHandler = std::move(windowHandler);
-  m_worker = ThreadType([this] { workerJob(); });
+  // The ring name is derived from the worker thread id, so the worker is
+  // held at a gate until the ring exists. This also publishes m_pRing and
+  // m_ringWakeMsgId to the worker before it reads them.
+  std::promise<void> ringCreated;
+  std::shared_future<void> ringReady = ringCreated.get_future().share();
+  m_worker = ThreadType([this, ringReady] {
+    ringReady.wait();
+    workerJob();
+  });
   m_workerThreadId = ::GetThreadId((HANDLE) m_worker.native_handle());
+  createRing();
+  ringCreated.set_value();
 
   // It would be better to do handshake here, however because init is
   // usually called from SwapChain which is created at CreateDevice,
@@ -212,14 +297,83 @@ void MessageChannelServer::workerJob() {
 
   MSG msg;
   while (GetMessage(&msg, kCurrentThreadId, 0, 0)) {
-    TranslateMessage(&msg);
-
-    if (onMessage(msg.message, msg.wParam, msg.lParam)) {
+    if (m_ringWakeMsgId != 0 && msg.message == m_ringWakeMsgId) {
+      drainRing();
       continue;
     }
+    dispatch(msg);
+  }
+}
+
+void MessageChannelServer::dispatch(MSG& msg) {
+  TranslateMessage(&msg);
+
+  if (onMessage(msg.message, msg.wParam, msg.lParam)) {
+    return;
+  }
+
+  if (m_windowHandler) {
+    m_windowHandler(m_clientWindow, msg.message, msg.wParam, msg.lParam);
+  }
+}
+
+void MessageChannelServer::createRing() {
+  m_ringWakeMsgId = getMessageId(MessageRing::kWakeMsgName);
+  if (m_ringWakeMsgId == 0) {
+    return;
+  }
+
+  const std::string name = MessageRing::getName(m_workerThreadId);
+  m_hRingMapping = ::CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+                                        0, sizeof(MessageRing), name.c_str());
+  if (m_hRingMapping == nullptr) {
+    Logger::err(format_string("Message ring %s could not be created (%d), "
+                              "falling back to thread messages.",
+                              name.c_str(), GetLastError()));
+    return;
+  }
+  // A new mapping is zero filled, which is an empty ring
+  m_pRing = static_cast<MessageRing*>(
+    ::MapViewOfFile(m_hRingMapping, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(MessageRing)));
+  if (m_pRing == nullptr) {
+    releaseRing();
+  }
+}
+
+void MessageChannelServer::drainRing() {
+  if (m_pRing == nullptr) {
+    return;
+  }
+  MessageRing& ring = *m_pRing;
+
+  // Cleared before draining, so a message pushed after the last check
+  // below is guaranteed to post another wake-up
+  ring.bWakePending.store(0);
+
+  uint32_t readPos = ring.readPos.load(std::memory_order_relaxed);
+  uint32_t writePos = ring.writePos.load();
+  while (readPos != writePos) {
+    const MessageRing::Message message = ring.messages[readPos % MessageRing::kCapacity];
+    ++readPos;
+
+    // Only the last of consecutive mouse moves with the same button state matters
+    bool bSuperseded = false;
+    if (message.msg == WM_MOUSEMOVE && readPos != writePos) {
+      const MessageRing::Message& next = ring.messages[readPos % MessageRing::kCapacity];
+      bSuperseded = next.msg == WM_MOUSEMOVE && next.wParam == message.wParam;
+    }
+    ring.readPos.store(readPos, std::memory_order_release);
+
+    if (!bSuperseded) {
+      MSG msg {};
+      msg.message = message.msg;
+      msg.wParam = message.wParam;
+      msg.lParam = message.lParam;
+      dispatch(msg);
+    }
 
-    if (m_windowHandler) {
-      m_windowHandler(m_clientWindow, msg.message, msg.wParam, msg.lParam);
+    if (readPos == writePos) {
+      writePos = ring.writePos.load();
     }
   }
 }
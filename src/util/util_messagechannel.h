@@ -21,9 +21,11 @@
  */
 #pragma once
 #include <stdint.h>
+#include <atomic>
 #include <string>
 #include <unordered_map>
 #include <functional>
+#include <future>
 #include <mutex>
 
 // The code is shared between Remix Bridge and Remix Renderer
@@ -56,6 +58,34 @@ namespace UTIL_NS {
   // - No handshake message is necessary. Client may be only given the server thread id.
   // - Server will not be able to send messages to the client.
   //
+  // Client -> server message ring:
+  // - The server creates a MessageRing in shared memory named after its worker thread.
+  //   A client that finds the ring pushes its messages there instead of posting each
+  //   one, and only posts a single wake-up message per batch. High rate input thus no
+  //   longer floods the thread message queue.
+  // - Client side senders are serialized, so the ring has a single producer.
+  // - Consecutive mouse moves are coalesced by the server when draining a batch.
+  // - Without a ring, e.g. with an older server, messages are posted as before.
+  //
+  struct MessageRing {
+    static constexpr uint32_t kCapacity = 4096;
+    static constexpr char kWakeMsgName[] = "UWM_REMIX_MESSAGE_RING_WAKE";
+
+    struct Message {
+      uint32_t msg;
+      uint32_t wParam;
+      uint32_t lParam;
+    };
+
+    alignas(64) std::atomic<uint32_t> writePos;
+    alignas(64) std::atomic<uint32_t> readPos;
+    // Set by the client when it posted a wake-up, cleared by the server before draining
+    alignas(64) std::atomic<uint32_t> bWakePending;
+    Message messages[kCapacity];
+
+    static std::string getName(uint32_t serverThreadId);
+  };
+
   class MessageChannelBase {
   public:
     using HandlerType = std::function<bool(uint32_t, uint32_t)>;
@@ -76,10 +106,16 @@ namespace UTIL_NS {
     const char* m_handshakeMsgName = nullptr;
     uint32_t m_handshakeMsgId = 0;
 
+    void releaseRing();
+
     mutable std::recursive_mutex m_accessMutex;
 
     std::unordered_map<std::string, uint32_t> m_msgs;
     std::unordered_map<uint32_t, HandlerType> m_handlers;
+
+    MessageRing* m_pRing = nullptr;
+    HANDLE m_hRingMapping = nullptr;
+    uint32_t m_ringWakeMsgId = 0;
   };
 
   class MessageChannelServer: public MessageChannelBase {
@@ -110,6 +146,9 @@ namespace UTIL_NS {
   private:
     bool handshake();
     void workerJob();
+    void createRing();
+    void drainRing();
+    void dispatch(MSG& msg);
 
     HWND m_clientWindow = nullptr;
     WindowMessageHandlerType m_windowHandler;
@@ -124,6 +163,10 @@ namespace UTIL_NS {
     explicit MessageChannelClient(const char* handshakeMsgName);
     explicit MessageChannelClient(uint32_t serverThreadId)
       : m_serverThreadId(serverThreadId) {
+      attachRing();
+    }
+    ~MessageChannelClient() {
+      releaseRing();
     }
 
     bool send(uint32_t msg, uint32_t wParam, uint32_t lParam);
@@ -134,6 +177,10 @@ namespace UTIL_NS {
     }
 
   private:
+    void attachRing();
+    bool pushToRing(uint32_t msg, uint32_t wParam, uint32_t lParam);
+
     uint32_t m_serverThreadId = 0;
+    std::mutex m_ringMutex;
   };
 }
@@ -138,4 +138,16 @@ namespace bridge_util {
 
     return ::PostThreadMessage(processMainThreadId, msg, wParam, lParam);
   }
+
+  void logStartupPhase(const char* const phase) {
+    FILETIME creationTime, exitTime, kernelTime, userTime, now;
+    GetProcessTimes(GetCurrentProcess(), &creationTime, &exitTime, &kernelTime, &userTime);
+    GetSystemTimePreciseAsFileTime(&now);
+    const auto toTicks = [](const FILETIME& time) {
+      return ((uint64_t) time.dwHighDateTime << 32) | time.dwLowDateTime;
+    };
+    // File times are in 100ns units
+    const uint64_t elapsedMs = (toTicks(now) - toTicks(creationTime)) / 10000;
+    Logger::info(format_string("[Startup] %s after %llu ms", phase, elapsedMs));
+  }
 }
@@ -75,6 +75,10 @@ namespace bridge_util {
     void releaseChildProcess();
   };
 
+  // Logs how long after the creation of the current process a startup phase was
+  // reached, to track the time until the bridge is ready
+  void logStartupPhase(const char* const phase);
+
 }
 
 #endif // UTIL_PROCESS_H_
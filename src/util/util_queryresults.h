@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#pragma once
+
+#include "util_sharedmemory.h"
+
+#include <atomic>
+#include <memory>
+#include <stdint.h>
+
+namespace bridge_util {
+  // Shared memory table through which the server hands query state back to the
+  // client, so that IDirect3DQuery9::GetData() polling becomes a local read
+  // instead of a round trip per call. The server publishes finished occlusion
+  // query results into per-query slots and counts the Presents it completed,
+  // which the client uses as a fence for event queries.
+  class QueryResults {
+  public:
+    static constexpr uint32_t kMaxSlots = 4096;
+    static constexpr uint32_t kInvalidSlot = (uint32_t) -1;
+
+    struct Slot {
+      // Issue sequence number of the query the result belongs to, written last
+      std::atomic<uint32_t> sequence;
+      uint32_t result;
+    };
+
+    struct Table {
+      std::atomic<uint32_t> completedFrames;
+      uint32_t reserved;
+      Slot slots[kMaxSlots];
+    };
+
+    // Both sides must call this once the bridge GUID is known
+    static void init() {
+      if (!s_pMemory) {
+        s_pMemory = std::make_unique<SharedMemory>("QueryResults", sizeof(Table));
+      }
+    }
+
+    static Table& get() {
+      return *static_cast<Table*>(s_pMemory->data());
+    }
+
+  private:
+    QueryResults() = delete;
+
+    static inline std::unique_ptr<SharedMemory> s_pMemory;
+  };
+}
@@ -0,0 +1,40 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+
+namespace bridge_util {
+  // Layout of a SharedHeap allocation that receives an asynchronous surface
+  // readback. The server writes the surface rows, tightly packed, starting at
+  // kReadbackDataOffset, then the result of the D3D9 call, and finally publishes
+  // both by storing the fence value that came with the readback command. The
+  // client only has to wait for the fence once it actually touches the data.
+  struct ReadbackHeader {
+    std::atomic<uint32_t> fence;
+    int32_t result;
+  };
+  static constexpr size_t kReadbackDataOffset = 16;
+  static_assert(sizeof(ReadbackHeader) <= kReadbackDataOffset, "Readback header does not fit");
+  static_assert(std::atomic<uint32_t>::is_always_lock_free, "Readback fence must be usable across processes");
+}
@@ -47,6 +47,9 @@ static void SafeLog(LogLevel level, const char* format, ...) {
 }
 
 static LONG WINAPI BridgeExceptionHandler(PEXCEPTION_POINTERS pExceptionPointers) {
+  // Get everything logged up to the crash into the file before anything else
+  Logger::flush();
+
   SYSTEMTIME lt;
   GetLocalTime(&lt);
 
@@ -90,6 +93,8 @@ static LONG WINAPI BridgeExceptionHandler(PEXCEPTION_POINTERS pExceptionPointers
     SafeLog(LogLevel::Error, "CreateFile() failed with %d", GetLastError());
   }
 
+  Logger::flush();
+
   // Trap it in debug
   assert(0 && "Unhandled exception thrown!");
 
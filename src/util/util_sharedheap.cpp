@@ -49,8 +49,11 @@ SharedHeap::Instance::Instance()
 #ifdef REMIX_BRIDGE_CLIENT
   assert(GlobalOptions::getUseSharedHeap());
   assert(m_defaultSegmentSize % m_chunkSize == 0);
-  for (ChunkId chunkId = 0; chunkId < (kMax32BitHeapSize / m_chunkSize); ++chunkId) {
-    setChunkState(chunkId, ChunkState::Unallocated);
+  // Chunk states are only touched once the chunk is handed out, a new metadata
+  // mapping is zero filled and thereby already all Unallocated
+  static_assert((uint8_t) ChunkState::Unallocated == 0);
+  if (!m_metaShMem.isNew()) {
+    memset(m_metaShMem.data(), 0, m_metaShMem.getSize());
   }
   addNewHeapSegment();
   assert(m_segments.size() == 1);
@@ -59,7 +62,10 @@ SharedHeap::Instance::Instance()
 
 BYTE* SharedHeap::Instance::getBuf(const AllocId id) {
   assert(m_cache.count(id) != 0);
-  const auto firstChunk = m_cache[id];
+  return getChunkBuf(m_cache[id]);
+}
+
+BYTE* SharedHeap::Instance::getChunkBuf(const ChunkId firstChunk) const {
   const auto segId = chunkIdToSegId(firstChunk);
   BYTE* const pBuf = m_segments[segId].getBuf(firstChunk);
   return pBuf;
@@ -196,6 +202,27 @@ SharedHeap::AllocId SharedHeap::Instance::allocate(const size_t size) {
 #endif
   return id;
 }
+SharedHeap::ChunkId SharedHeap::Instance::allocatePayload(const size_t size) {
+  const uint32_t numChunks =
+    ((size % m_chunkSize) == 0) ? (size / m_chunkSize) : (size / m_chunkSize + 1);
+
+  // Growing the heap has to be announced to the server with a command of its own
+  const auto alloc = findAllocation(numChunks, false);
+  if (!isValidAllocation(alloc)) {
+    return kInvalidId;
+  }
+
+  // Tracked like any other allocation, so that it is reclaimed by freeDeallocations()
+  // once the server marks it as deallocated
+  const auto id = m_nextUid++;
+  m_cache[id] = alloc.firstChunk;
+  m_allocations[alloc.firstChunk] = alloc.finalChunk;
+
+  assert(getChunkState(alloc.firstChunk) == ChunkState::Unallocated);
+  setChunkState(alloc.firstChunk, ChunkState::Allocated);
+  m_sizeAllocated += numChunks * m_chunkSize;
+  return alloc.firstChunk;
+}
 void SharedHeap::Instance::deallocate(const AllocId id) {
   ClientMessage c(Commands::Bridge_SharedHeap_Dealloc, id);
 }
@@ -212,11 +239,15 @@ void SharedHeap::Instance::deallocate(const AllocId id) {
   setChunkState(firstChunk, ChunkState::Deallocated);
   m_cache.erase(id);
 }
+void SharedHeap::Instance::releasePayload(const ChunkId firstChunk) {
+  assert(getChunkState(firstChunk) == ChunkState::Allocated);
+  setChunkState(firstChunk, ChunkState::Deallocated);
+}
 #endif
 
 #ifdef REMIX_BRIDGE_CLIENT
 SharedHeap::Instance::Allocation
-SharedHeap::Instance::findAllocation(const size_t numChunks) {
+SharedHeap::Instance::findAllocation(const size_t numChunks, const bool bCanGrow) {
   Allocation alloc;
   const bool bFirstAllocation = m_allocations.size() == 0; // Trivial case
   if (bFirstAllocation) {
@@ -230,6 +261,10 @@ SharedHeap::Instance::findAllocation(const size_t numChunks) {
           isValidAllocation(alloc = findFreeOnEnd(numChunks))) {
         break;
       }
+      // Without growing, only a retry after reclaiming deallocated chunks can succeed
+      if (!bCanGrow && nFailedIterations == 1) {
+        return { kInvalidId, kInvalidId };
+      }
       if (nFailedIterations == 1) {
         std::stringstream ss;
         ss << "[SharedHeap][findAllocation] Unable to allocate ";
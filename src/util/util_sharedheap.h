@@ -39,6 +39,9 @@ namespace bridge_util {
     static BYTE* getBuf(const AllocId id) {
       return get().getBuf(id);
     }
+    static BYTE* getChunkBuf(const ChunkId firstChunk) {
+      return get().getChunkBuf(firstChunk);
+    }
 #ifdef REMIX_BRIDGE_CLIENT
     static AllocId allocate(const size_t size) {
       return get().allocate(size);
@@ -46,6 +49,13 @@ namespace bridge_util {
     static void deallocate(const AllocId id) {
       get().deallocate(id);
     }
+    // Allocates space for a command payload without announcing it to the server,
+    // so that it is safe to call while a command is being built. The server finds
+    // the payload by the returned first chunk and frees it with releasePayload().
+    // Never grows the heap, returns kInvalidId if there is no room.
+    static ChunkId allocatePayload(const size_t size) {
+      return get().allocatePayload(size);
+    }
 #endif
 #ifdef REMIX_BRIDGE_SERVER
     static void allocate(const AllocId id, const ChunkId firstChunk) {
@@ -57,6 +67,9 @@ namespace bridge_util {
     static void addNewHeapSegment(const uint32_t segmentSize) {
       get().addNewHeapSegment(segmentSize);
     }
+    static void releasePayload(const ChunkId firstChunk) {
+      get().releasePayload(firstChunk);
+    }
 #endif
 
   private:
@@ -68,14 +81,17 @@ namespace bridge_util {
     public:
       Instance();
       BYTE* getBuf(const AllocId id);
+      BYTE* getChunkBuf(const ChunkId firstChunk) const;
 #ifdef REMIX_BRIDGE_CLIENT
       AllocId allocate(const size_t size);
+      ChunkId allocatePayload(const size_t size);
       void deallocate(const AllocId id);
 #endif
 #ifdef REMIX_BRIDGE_SERVER
       void allocate(const AllocId id, const ChunkId firstChunk);
       void deallocate(const AllocId id);
       void addNewHeapSegment(const uint32_t segmentSize);
+      void releasePayload(const ChunkId firstChunk);
 #endif
 
     private:
@@ -110,7 +126,7 @@ namespace bridge_util {
                                                 const size_t numChunks) {
         return { firstChunk, firstChunk + numChunks - 1 };
       }
-      Allocation findAllocation(const size_t numChunks);
+      Allocation findAllocation(const size_t numChunks, const bool bCanGrow = true);
       Allocation findFreeInMiddle(const size_t numChunks);
       Allocation findFreeOnEnd(const size_t numChunks);
       void freeDeallocations();
@@ -47,8 +47,8 @@ namespace bridge_util {
       return false;
     }
 
-    // The first process to attach initializes memory
-    const bool bIsInit = (GetLastError() != ERROR_ALREADY_EXISTS);
+    // The first process to attach creates the memory
+    m_bIsNew = (GetLastError() != ERROR_ALREADY_EXISTS);
 
     // Get a pointer to the file-mapped shared memory
     m_lpvMem = MapViewOfFile(
@@ -63,10 +63,10 @@ namespace bridge_util {
       return false;
     }
 
-    // Initialize memory if this is the first process
-    if (bIsInit) {
-      Logger::info("Initializing new shared memory object.");
-      memset(m_lpvMem, '\0', m_size);
+    // A new pagefile backed mapping is already zero filled, and its pages only get
+    // backed by physical memory once touched, so it is deliberately not cleared here
+    if (m_bIsNew) {
+      Logger::info("Created new shared memory object.");
     }
 
     return true;
@@ -65,11 +65,17 @@ namespace bridge_util {
       return m_size;
     }
 
+    // True if this process created the mapping, in which case it is zero filled
+    bool isNew() const {
+      return m_bIsNew;
+    }
+
     void swap(SharedMemory& rhs) {
       std::swap(m_name, rhs.m_name);
       std::swap(m_size, rhs.m_size);
       std::swap(m_lpvMem, rhs.m_lpvMem);
       std::swap(m_hMapObject, rhs.m_hMapObject);
+      std::swap(m_bIsNew, rhs.m_bIsNew);
     }
 
     // TODO: Implement malloc/free
@@ -79,6 +85,7 @@ namespace bridge_util {
     size_t m_size = 0;
     LPVOID m_lpvMem = NULL;      // pointer to shared memory
     HANDLE m_hMapObject = NULL;  // handle to file mapping
+    bool m_bIsNew = false;
 
     bool createSharedMemory(const std::string& name, const size_t size);
     void releaseSharedMemory();
@@ -0,0 +1,40 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+
+namespace bridge_util {
+  // Layout of a SharedHeap allocation that persistently mirrors a dynamic buffer
+  // used for append-style streaming. The client writes vertex/index data straight
+  // into the mirror starting at kStreamMirrorDataOffset and only sends the locked
+  // range on unlock. After copying that range into the real buffer the server
+  // stores the serial that came with the unlock, which tells the client when the
+  // mirror may be written from the start again.
+  struct StreamMirrorHeader {
+    std::atomic<uint32_t> consumedSerial;
+  };
+  static constexpr size_t kStreamMirrorDataOffset = 16;
+  static_assert(sizeof(StreamMirrorHeader) <= kStreamMirrorDataOffset, "Stream mirror header does not fit");
+  static_assert(std::atomic<uint32_t>::is_always_lock_free, "Stream mirror serial must be usable across processes");
+}